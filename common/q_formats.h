@@ -466,6 +466,7 @@ inline constexpr int IDBSPHEADER = MakeFourCC( 'I', 'B', 'S', 'P' ); // MakeFour
 #define	MAX_MAP_SURFEDGES	256000
 #define	MAX_MAP_LIGHTING	0x200000
 #define	MAX_MAP_VISIBILITY	0x100000
+#define	MAX_MAP_LIGHTGRID	0x800000
 
 // key / value pair sizes in the entities lump
 
@@ -511,7 +512,7 @@ struct lump_t
 #define	LUMP_MODELS			13
 #define	LUMP_BRUSHES		14
 #define	LUMP_BRUSHSIDES		15
-#define	LUMP_POP			16		// POP lump
+#define	LUMP_LIGHTGRID		16		// Was the POP lump, see dlightgrid_t
 #define	LUMP_AREAS			17		// TODO: why doesn't Quake 3 have these?
 #define	LUMP_AREAPORTALS	18		// TODO: why doesn't Quake 3 have these?
 #define	HEADER_LUMPS		19
@@ -663,6 +664,35 @@ struct darea_t
 	int32		firstareaportal;
 };
 
+// the light grid is a lattice of lighting samples for lighting models, written by qrad.
+// samples are grouped into bricks of LIGHTGRID_BRICK^3 and only bricks with at least one
+// sample outside the solid are stored. the lump is a dlightgrid_t, then an int32 per brick
+// giving the index of its samples or -1 if it has none, then numbricks bricks of samples,
+// x fastest. bricks that came out the same share their samples
+inline constexpr int32 LIGHTGRID_IDENT = MakeFourCC( 'L', 'G', 'R', 'D' );
+inline constexpr int32 LIGHTGRID_VERSION = 1;
+
+inline constexpr int LIGHTGRID_BRICK = 4;
+inline constexpr int LIGHTGRID_BRICK_SAMPLES = LIGHTGRID_BRICK * LIGHTGRID_BRICK * LIGHTGRID_BRICK;
+
+struct dlightgrid_t
+{
+	int32		ident;
+	int32		version;
+	float		origin[3];				// position of the first sample
+	float		cellsize[3];			// distance between samples
+	int32		bricks[3];				// size of the grid in bricks
+	int32		numbricks;				// stored bricks
+};
+
+// the same units as the lightmaps, a surface facing dir gets ambient + directed
+struct dlightgridsample_t
+{
+	byte		ambient[3];				// all zero if the sample is in the solid
+	byte		directed[3];
+	byte		latlong[2];				// direction the directed light comes from
+};
+
 //=============================================================================
 
 #if 0 // Remains of the old plans to revise the BSP format...
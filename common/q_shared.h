@@ -104,6 +104,16 @@ struct trace_t
 	bool		startsolid;	// if true, the initial point was in a solid area
 };
 
+// one entry of a batched trace, the arguments of a regular trace call
+struct traceRequest_t
+{
+	vec3_t		start;
+	vec3_t		mins, maxs;		// zero for line traces
+	vec3_t		end;
+	edict_t		*passent;
+	int			contentmask;
+};
+
 //-------------------------------------------------------------------------------------------------
 // Player movement
 //-------------------------------------------------------------------------------------------------
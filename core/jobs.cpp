@@ -0,0 +1,182 @@
+/*
+===================================================================================================
+
+	Parallel for
+
+===================================================================================================
+*/
+
+#include "core.h"
+
+#include "jobs.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#define MAX_JOB_THREADS		64
+
+struct jobPool_t
+{
+	std::vector<std::thread>	workers;
+	std::mutex					mutex;
+	std::condition_variable		wake;			// workers wait for a new generation
+	std::condition_variable		done;			// the caller waits for busy to hit zero
+
+	uint64						generation = 0;
+	int							busy = 0;
+	bool						quit = false;
+
+	// the current job
+	jobFunc_t					func = nullptr;
+	void *						data = nullptr;
+	int							count = 0;
+	std::atomic<int>			next;
+
+	~jobPool_t()
+	{
+		Jobs_Shutdown();
+	}
+};
+
+static std::mutex			s_submitMutex;		// one Jobs_ParallelFor at a time owns the workers
+static jobPool_t			s_pool;				// declared after s_submitMutex so it's destroyed first
+static int					s_numThreads;		// 0 until decided
+static thread_local bool	s_insideJob;
+
+static void Jobs_RunItems()
+{
+	int index;
+
+	while ( ( index = s_pool.next.fetch_add( 1, std::memory_order_relaxed ) ) < s_pool.count )
+	{
+		s_pool.func( index, s_pool.data );
+	}
+}
+
+static void Jobs_WorkerLoop()
+{
+	uint64 seen = 0;
+
+	s_insideJob = true;
+
+	while ( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( s_pool.mutex );
+			s_pool.wake.wait( lock, [seen]() { return s_pool.quit || s_pool.generation != seen; } );
+			if ( s_pool.quit ) {
+				return;
+			}
+			seen = s_pool.generation;
+		}
+
+		Jobs_RunItems();
+
+		{
+			std::lock_guard<std::mutex> lock( s_pool.mutex );
+			if ( --s_pool.busy == 0 ) {
+				s_pool.done.notify_one();
+			}
+		}
+	}
+}
+
+static void Jobs_StartWorkers()
+{
+	if ( s_numThreads == 0 )
+	{
+		s_numThreads = Clamp( (int)std::thread::hardware_concurrency(), 1, MAX_JOB_THREADS );
+	}
+
+	s_pool.quit = false;
+
+	// the caller is a worker too
+	for ( int i = 1; i < s_numThreads; ++i )
+	{
+		s_pool.workers.emplace_back( Jobs_WorkerLoop );
+	}
+}
+
+void Jobs_ParallelFor( int count, jobFunc_t func, void *data )
+{
+	if ( count <= 0 ) {
+		return;
+	}
+
+	if ( count == 1 || s_insideJob || s_numThreads == 1 || !s_submitMutex.try_lock() )
+	{
+		for ( int i = 0; i < count; ++i )
+		{
+			func( i, data );
+		}
+		return;
+	}
+
+	if ( s_pool.workers.empty() )
+	{
+		Jobs_StartWorkers();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( s_pool.mutex );
+		s_pool.func = func;
+		s_pool.data = data;
+		s_pool.count = count;
+		s_pool.next.store( 0, std::memory_order_relaxed );
+		s_pool.busy = (int)s_pool.workers.size();
+		++s_pool.generation;
+	}
+	s_pool.wake.notify_all();
+
+	s_insideJob = true;
+	Jobs_RunItems();
+	s_insideJob = false;
+
+	{
+		std::unique_lock<std::mutex> lock( s_pool.mutex );
+		s_pool.done.wait( lock, []() { return s_pool.busy == 0; } );
+	}
+
+	s_submitMutex.unlock();
+}
+
+void Jobs_SetNumThreads( int numThreads )
+{
+	Jobs_Shutdown();
+
+	s_numThreads = ( numThreads <= 0 ) ? 0 : Min( numThreads, MAX_JOB_THREADS );
+}
+
+int Jobs_NumThreads()
+{
+	if ( s_numThreads == 0 )
+	{
+		return Clamp( (int)std::thread::hardware_concurrency(), 1, MAX_JOB_THREADS );
+	}
+
+	return s_numThreads;
+}
+
+void Jobs_Shutdown()
+{
+	std::lock_guard<std::mutex> submitLock( s_submitMutex );
+
+	if ( s_pool.workers.empty() ) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( s_pool.mutex );
+		s_pool.quit = true;
+	}
+	s_pool.wake.notify_all();
+
+	for ( std::thread &worker : s_pool.workers )
+	{
+		worker.join();
+	}
+	s_pool.workers.clear();
+}
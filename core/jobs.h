@@ -0,0 +1,37 @@
+/*
+===================================================================================================
+
+	Parallel for
+
+	A small pool of persistent worker threads built on the standard library, so it works on
+	every platform unlike threading.h. Work is handed out one index at a time, so it suits
+	a few dozen to a few thousand coarse items, not millions of tiny ones.
+
+	The calling thread helps out and Jobs_ParallelFor doesn't return until every index is
+	done. Calls made from inside a job, or while another thread owns the pool, just run
+	serially on the caller.
+
+===================================================================================================
+*/
+
+#pragma once
+
+#include <type_traits>
+
+using jobFunc_t = void ( * )( int index, void *data );
+
+void	Jobs_ParallelFor( int count, jobFunc_t func, void *data );
+
+// 0 picks one thread per hardware thread, 1 disables the workers
+void	Jobs_SetNumThreads( int numThreads );
+int		Jobs_NumThreads();
+
+// Joins the workers, the next Jobs_ParallelFor starts them up again.
+// DLLs must call this before being unloaded
+void	Jobs_Shutdown();
+
+template< typename func_t >
+void Jobs_ParallelFor( int count, func_t &&func )
+{
+	Jobs_ParallelFor( count, []( int index, void *data ) { ( *(std::remove_reference_t<func_t> *)data )( index ); }, (void *)&func );
+}
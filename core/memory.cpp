@@ -3,7 +3,8 @@
 
 	Memory management
 
-	Tagged allocation is used by the game code
+	Tagged allocation is used by the tools and anything that frees in bits and pieces, arenas are
+	for data that all dies at the same time, levels, frames and job scratch space
 
 ===================================================================================================
 */
@@ -20,6 +21,8 @@
 
 #include "memory.h"
 
+#include <mutex>
+
 #if defined Q_MEM_USE_MIMALLOC
 
 #define malloc_internal				mi_malloc
@@ -114,8 +117,9 @@ struct zhead_t
 	uint32		size;			// Size of this allocation in bytes, could use _msize
 };
 
-static zhead_t	z_tagchain;
-static size_t	z_tagcount, z_tagbytes;
+static zhead_t		z_tagchain;
+static size_t		z_tagcount, z_tagbytes;
+static std::mutex	z_tagmutex;
 
 // Allocate some memory with a tag at the front
 void *Mem_TagAlloc( size_t size, uint16 tag )
@@ -126,13 +130,15 @@ void *Mem_TagAlloc( size_t size, uint16 tag )
 	z = (zhead_t *)Mem_Alloc( size );
 	Assert( z );
 
-	++z_tagcount;
-	z_tagbytes += size;
-
 	z->magic = Z_MAGIC;
 	z->tag = tag;
 	z->size = static_cast<uint32>( size );
 
+	std::lock_guard<std::mutex> lock( z_tagmutex );
+
+	++z_tagcount;
+	z_tagbytes += size;
+
 	z->next = z_tagchain.next;
 	z->prev = &z_tagchain;
 	z_tagchain.next->prev = z;
@@ -141,6 +147,16 @@ void *Mem_TagAlloc( size_t size, uint16 tag )
 	return (void *)( z + 1 );
 }
 
+// Unlinks a block, z_tagmutex must be held
+static void Mem_TagUnlink( zhead_t *z )
+{
+	z->prev->next = z->next;
+	z->next->prev = z->prev;
+
+	--z_tagcount;
+	z_tagbytes -= z->size;
+}
+
 // Free a single tag allocation
 void Mem_TagFree( void *block )
 {
@@ -154,11 +170,11 @@ void Mem_TagFree( void *block )
 		return;
 	}
 
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
+	{
+		std::lock_guard<std::mutex> lock( z_tagmutex );
+		Mem_TagUnlink( z );
+	}
 
-	--z_tagcount;
-	z_tagbytes -= z->size;
 	Mem_Free( z );
 }
 
@@ -167,13 +183,229 @@ void Mem_TagFreeGroup( uint16 tag )
 {
 	zhead_t *z, *next;
 
+	std::lock_guard<std::mutex> lock( z_tagmutex );
+
 	for ( z = z_tagchain.next; z != &z_tagchain; z = next )
 	{
 		next = z->next;
-		if ( z->tag == tag ) {
-			Mem_TagFree( (void *)( z + 1 ) );
+		if ( z->tag == tag )
+		{
+			Mem_TagUnlink( z );
+			Mem_Free( z );
+		}
+	}
+}
+
+/*
+=================================================
+	Arena allocation
+=================================================
+*/
+
+// Blocks are reused in chain order after a reset, data follows the header
+struct alignas( 16 ) memArenaBlock_t
+{
+	memArenaBlock_t *	next;
+	size_t				size;			// Bytes of data
+	size_t				used;
+};
+
+static byte *Mem_ArenaBlockData( memArenaBlock_t *block )
+{
+	return reinterpret_cast<byte *>( block + 1 );
+}
+
+static byte *Mem_ArenaBlockAlloc( memArenaBlock_t *block, size_t size, size_t alignment )
+{
+	uintptr_t start = reinterpret_cast<uintptr_t>( Mem_ArenaBlockData( block ) );
+	uintptr_t aligned = ( start + block->used + alignment - 1 ) & ~( (uintptr_t)alignment - 1 );
+
+	if ( aligned + size > start + block->size ) {
+		return nullptr;
+	}
+
+	block->used = ( aligned + size ) - start;
+	return reinterpret_cast<byte *>( aligned );
+}
+
+void Mem_ArenaInit( memArena_t &arena, size_t blockSize /*= MEM_ARENA_BLOCK_SIZE*/ )
+{
+	arena.first = nullptr;
+	arena.current = nullptr;
+	arena.blockSize = blockSize;
+}
+
+RESTRICTFN void *Mem_ArenaAlloc( memArena_t &arena, size_t size, size_t alignment /*= 16*/ )
+{
+	Assert( alignment && ( alignment & ( alignment - 1 ) ) == 0 );
+
+	if ( arena.current )
+	{
+		byte *mem = Mem_ArenaBlockAlloc( arena.current, size, alignment );
+		if ( mem ) {
+			return mem;
 		}
 	}
+
+	// move on to the next block left over from before a reset, if it's big enough
+	memArenaBlock_t *next = arena.current ? arena.current->next : arena.first;
+	if ( next )
+	{
+		next->used = 0;
+		byte *mem = Mem_ArenaBlockAlloc( next, size, alignment );
+		if ( mem )
+		{
+			arena.current = next;
+			return mem;
+		}
+	}
+
+	// need a new block, it goes in front of the leftovers
+	size_t blockSize = arena.blockSize ? arena.blockSize : MEM_ARENA_BLOCK_SIZE;
+	blockSize = Max( blockSize, size + alignment );
+
+	memArenaBlock_t *block = (memArenaBlock_t *)Mem_Alloc( sizeof( memArenaBlock_t ) + blockSize );
+	Assert( block );
+	block->next = next;
+	block->size = blockSize;
+	block->used = 0;
+
+	if ( arena.current ) {
+		arena.current->next = block;
+	} else {
+		arena.first = block;
+	}
+	arena.current = block;
+
+	return Mem_ArenaBlockAlloc( block, size, alignment );
+}
+
+RESTRICTFN void *Mem_ArenaClearedAlloc( memArena_t &arena, size_t size, size_t alignment /*= 16*/ )
+{
+	void *mem = Mem_ArenaAlloc( arena, size, alignment );
+	memset( mem, 0, size );
+	return mem;
+}
+
+RESTRICTFN char *Mem_ArenaCopyString( memArena_t &arena, const char *in )
+{
+	size_t size = strlen( in ) + 1;
+	char *out = (char *)Mem_ArenaAlloc( arena, size, 1 );
+	memcpy( out, in, size );
+	return out;
+}
+
+void Mem_ArenaReset( memArena_t &arena )
+{
+	// the blocks after the first are cleared as they're moved into
+	arena.current = arena.first;
+	if ( arena.current ) {
+		arena.current->used = 0;
+	}
+}
+
+void Mem_ArenaFree( memArena_t &arena )
+{
+	memArenaBlock_t *next;
+	for ( memArenaBlock_t *block = arena.first; block; block = next )
+	{
+		next = block->next;
+		Mem_Free( block );
+	}
+
+	arena.first = nullptr;
+	arena.current = nullptr;
+}
+
+memArenaMark_t Mem_ArenaGetMark( const memArena_t &arena )
+{
+	memArenaMark_t mark;
+	mark.block = arena.current;
+	mark.used = arena.current ? arena.current->used : 0;
+	return mark;
+}
+
+void Mem_ArenaRewind( memArena_t &arena, memArenaMark_t mark )
+{
+	if ( !mark.block )
+	{
+		// marked before the first allocation
+		Mem_ArenaReset( arena );
+		return;
+	}
+
+	Assert( mark.used <= mark.block->size );
+
+	arena.current = mark.block;
+	arena.current->used = mark.used;
+}
+
+size_t Mem_ArenaBytesUsed( const memArena_t &arena )
+{
+	size_t used = 0;
+
+	if ( arena.current )
+	{
+		for ( const memArenaBlock_t *block = arena.first; block != arena.current; block = block->next ) {
+			used += block->used;
+		}
+		used += arena.current->used;
+	}
+
+	return used;
+}
+
+size_t Mem_ArenaBytesReserved( const memArena_t &arena )
+{
+	size_t reserved = 0;
+
+	for ( const memArenaBlock_t *block = arena.first; block; block = block->next ) {
+		reserved += sizeof( memArenaBlock_t ) + block->size;
+	}
+
+	return reserved;
+}
+
+/*
+=================================================
+	Frame allocation
+=================================================
+*/
+
+void Mem_FrameArenaSwap( memFrameArena_t &frameArena )
+{
+	frameArena.current ^= 1;
+	Mem_ArenaReset( frameArena.arenas[frameArena.current] );
+}
+
+void Mem_FrameArenaFree( memFrameArena_t &frameArena )
+{
+	Mem_ArenaFree( frameArena.arenas[0] );
+	Mem_ArenaFree( frameArena.arenas[1] );
+	frameArena.current = 0;
+}
+
+/*
+=================================================
+	Thread scratch
+=================================================
+*/
+
+struct threadScratch_t
+{
+	memArena_t arena;
+
+	~threadScratch_t()
+	{
+		Mem_ArenaFree( arena );
+	}
+};
+
+static thread_local threadScratch_t t_threadScratch;
+
+memArena_t &Mem_ThreadScratch()
+{
+	return t_threadScratch.arena;
 }
 
 /*
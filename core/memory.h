@@ -49,6 +49,68 @@ void							Mem_Free( void *block );
 void							Mem_TagFree( void *block );
 void							Mem_TagFreeGroup( uint16 tag );
 
+// Arena allocation
+// Bump allocation out of big blocks, nothing is freed on its own, a reset frees everything at once.
+// Blocks are kept around after a reset so an arena that has warmed up never touches the heap.
+// A zeroed arena is ready to use. Arenas aren't thread safe, use one per thread.
+
+#define MEM_ARENA_BLOCK_SIZE	( 64 * 1024 )
+
+struct memArenaBlock_t;
+
+struct memArena_t
+{
+	memArenaBlock_t *	first;
+	memArenaBlock_t *	current;
+	size_t				blockSize;		// Minimum size of new blocks, 0 means MEM_ARENA_BLOCK_SIZE
+};
+
+// Where an arena was at, rewinding to it gives back everything allocated since
+struct memArenaMark_t
+{
+	memArenaBlock_t *	block;
+	size_t				used;
+};
+
+void							Mem_ArenaInit( memArena_t &arena, size_t blockSize = MEM_ARENA_BLOCK_SIZE );
+[[nodiscard]] RESTRICTFN void *	Mem_ArenaAlloc( memArena_t &arena, size_t size, size_t alignment = 16 );
+[[nodiscard]] RESTRICTFN void *	Mem_ArenaClearedAlloc( memArena_t &arena, size_t size, size_t alignment = 16 );
+[[nodiscard]] RESTRICTFN char *	Mem_ArenaCopyString( memArena_t &arena, const char *in );
+void							Mem_ArenaReset( memArena_t &arena );		// O(1), keeps the blocks
+void							Mem_ArenaFree( memArena_t &arena );			// Gives the blocks back to the heap
+[[nodiscard]] memArenaMark_t	Mem_ArenaGetMark( const memArena_t &arena );
+void							Mem_ArenaRewind( memArena_t &arena, memArenaMark_t mark );
+[[nodiscard]] size_t			Mem_ArenaBytesUsed( const memArena_t &arena );
+[[nodiscard]] size_t			Mem_ArenaBytesReserved( const memArena_t &arena );
+
+template< typename T >
+[[nodiscard]] T *Mem_ArenaAllocArray( memArena_t &arena, size_t count )
+{
+	return static_cast<T *>( Mem_ArenaAlloc( arena, count * sizeof( T ), alignof( T ) ) );
+}
+
+// Frame allocation
+// Two arenas that take turns, Mem_FrameArenaSwap resets the older one, so
+// anything allocated last frame is still good for the whole of this frame.
+
+struct memFrameArena_t
+{
+	memArena_t	arenas[2];
+	int			current;
+};
+
+void							Mem_FrameArenaSwap( memFrameArena_t &frameArena );
+void							Mem_FrameArenaFree( memFrameArena_t &frameArena );
+
+inline memArena_t &Mem_FrameArena( memFrameArena_t &frameArena )
+{
+	return frameArena.arenas[frameArena.current];
+}
+
+// Per thread scratch arena for jobs, take a mark and rewind to it when done.
+// Freed when the thread exits
+[[nodiscard]] memArena_t &		Mem_ThreadScratch();
+
 // Status
 void		Mem_Init();
 void		Mem_Shutdown();
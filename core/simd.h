@@ -0,0 +1,99 @@
+/*
+===================================================================================================
+
+	SIMD helpers
+
+	Thin wrappers over the widest float vectors we're compiled for, 8 lanes with AVX and 4 with
+	SSE, so structure of arrays loops can be written once for both. Loads are unaligned.
+	The integer loads read exactly SIMD_WIDTH values and only need SSE2 and AVX, not AVX2.
+
+===================================================================================================
+*/
+
+#pragma once
+
+#include <immintrin.h>
+
+#include <cstring>
+
+#include "sys_types.h"
+
+#ifdef __AVX__
+
+#define SIMD_WIDTH	8
+
+using simdFloat_t = __m256;
+
+inline simdFloat_t Simd_Load( const float *p )		{ return _mm256_loadu_ps( p ); }
+inline simdFloat_t Simd_Set1( float f )				{ return _mm256_set1_ps( f ); }
+inline simdFloat_t Simd_Add( simdFloat_t a, simdFloat_t b )	{ return _mm256_add_ps( a, b ); }
+inline simdFloat_t Simd_Sub( simdFloat_t a, simdFloat_t b )	{ return _mm256_sub_ps( a, b ); }
+inline simdFloat_t Simd_Mul( simdFloat_t a, simdFloat_t b )	{ return _mm256_mul_ps( a, b ); }
+inline simdFloat_t Simd_And( simdFloat_t a, simdFloat_t b )	{ return _mm256_and_ps( a, b ); }
+inline simdFloat_t Simd_Or( simdFloat_t a, simdFloat_t b )	{ return _mm256_or_ps( a, b ); }
+inline simdFloat_t Simd_AndNot( simdFloat_t a, simdFloat_t b )	{ return _mm256_andnot_ps( a, b ); }
+inline simdFloat_t Simd_CmpGt( simdFloat_t a, simdFloat_t b )	{ return _mm256_cmp_ps( a, b, _CMP_GT_OQ ); }
+inline simdFloat_t Simd_CmpLt( simdFloat_t a, simdFloat_t b )	{ return _mm256_cmp_ps( a, b, _CMP_LT_OQ ); }
+inline int Simd_MoveMask( simdFloat_t a )				{ return _mm256_movemask_ps( a ); }
+inline void Simd_Store( float *p, simdFloat_t a )		{ _mm256_storeu_ps( p, a ); }
+inline simdFloat_t Simd_Min( simdFloat_t a, simdFloat_t b )	{ return _mm256_min_ps( a, b ); }
+inline simdFloat_t Simd_Max( simdFloat_t a, simdFloat_t b )	{ return _mm256_max_ps( a, b ); }
+
+// Sign extends 8 int16s to floats
+inline simdFloat_t Simd_LoadInt16( const int16 *p )
+{
+	const __m128i x = _mm_loadu_si128( (const __m128i *)p );
+	const __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 );
+	const __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 );
+	return _mm256_cvtepi32_ps( _mm256_insertf128_si256( _mm256_castsi128_si256( lo ), hi, 1 ) );
+}
+
+// Sign extends 8 int8s to floats
+inline simdFloat_t Simd_LoadInt8( const int8 *p )
+{
+	const __m128i x = _mm_loadl_epi64( (const __m128i *)p );
+	const __m128i w = _mm_unpacklo_epi8( x, x );
+	const __m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( w, w ), 24 );
+	const __m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( w, w ), 24 );
+	return _mm256_cvtepi32_ps( _mm256_insertf128_si256( _mm256_castsi128_si256( lo ), hi, 1 ) );
+}
+
+#else
+
+#define SIMD_WIDTH	4
+
+using simdFloat_t = __m128;
+
+inline simdFloat_t Simd_Load( const float *p )		{ return _mm_loadu_ps( p ); }
+inline simdFloat_t Simd_Set1( float f )				{ return _mm_set1_ps( f ); }
+inline simdFloat_t Simd_Add( simdFloat_t a, simdFloat_t b )	{ return _mm_add_ps( a, b ); }
+inline simdFloat_t Simd_Sub( simdFloat_t a, simdFloat_t b )	{ return _mm_sub_ps( a, b ); }
+inline simdFloat_t Simd_Mul( simdFloat_t a, simdFloat_t b )	{ return _mm_mul_ps( a, b ); }
+inline simdFloat_t Simd_And( simdFloat_t a, simdFloat_t b )	{ return _mm_and_ps( a, b ); }
+inline simdFloat_t Simd_Or( simdFloat_t a, simdFloat_t b )	{ return _mm_or_ps( a, b ); }
+inline simdFloat_t Simd_AndNot( simdFloat_t a, simdFloat_t b )	{ return _mm_andnot_ps( a, b ); }
+inline simdFloat_t Simd_CmpGt( simdFloat_t a, simdFloat_t b )	{ return _mm_cmpgt_ps( a, b ); }
+inline simdFloat_t Simd_CmpLt( simdFloat_t a, simdFloat_t b )	{ return _mm_cmplt_ps( a, b ); }
+inline int Simd_MoveMask( simdFloat_t a )				{ return _mm_movemask_ps( a ); }
+inline void Simd_Store( float *p, simdFloat_t a )		{ _mm_storeu_ps( p, a ); }
+inline simdFloat_t Simd_Min( simdFloat_t a, simdFloat_t b )	{ return _mm_min_ps( a, b ); }
+inline simdFloat_t Simd_Max( simdFloat_t a, simdFloat_t b )	{ return _mm_max_ps( a, b ); }
+
+// Sign extends 4 int16s to floats
+inline simdFloat_t Simd_LoadInt16( const int16 *p )
+{
+	const __m128i x = _mm_loadl_epi64( (const __m128i *)p );
+	return _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 ) );
+}
+
+// Sign extends 4 int8s to floats
+inline simdFloat_t Simd_LoadInt8( const int8 *p )
+{
+	int32 bytes;
+	memcpy( &bytes, p, sizeof( bytes ) );
+	const __m128i x = _mm_cvtsi32_si128( bytes );
+	const __m128i w = _mm_unpacklo_epi8( x, x );
+	return _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( w, w ), 24 ) );
+}
+
+#endif
@@ -2,14 +2,7 @@
 // A wrapper for the old CDAudio API that hooks into the soundsystem (which now supports OGG Vorbis!)
 //=================================================================================================
 
-#include "client.h"
-
-#define STB_VORBIS_NO_STDIO
-#define STB_VORBIS_NO_PUSHDATA_API
-#define STB_VORBIS_HEADER_ONLY
-#include "stb_vorbis.c"
-
-#include "cdaudio.h"
+#include "cl_local.h"
 
 bool CDAudio_Init()
 {
@@ -18,37 +11,28 @@ bool CDAudio_Init()
 
 void CDAudio_Shutdown( void )
 {
+	S_StopMusic();
 }
 
 void CDAudio_Play( int track, bool looping )
 {
 	char path[MAX_QPATH];
 
-	Q_sprintf_s( path, "sound/music/Track%02d.ogg", track );
-
-	byte *data;
-	int size = FS_LoadFile( path, (void **)&data );
-	if ( !data )
+	if ( track == 0 )
 	{
-		Com_Printf( "Couldn't load music track %s\n", path );
+		S_StopMusic();
 		return;
 	}
 
-	int channels, samplerate, samples;
-	short *output;
-	samples = stb_vorbis_decode_memory( data, size, &channels, &samplerate, &output );
-	FS_FreeFile( data );
-	if ( samples == -1 )
-	{
-		Com_Printf( "Failed to decode music track %s\n", path );
-		return;
-	}
+	Q_sprintf_s( path, "sound/music/Track%02d.ogg", track );
 
-	S_RawSamples( 32768*4, samplerate, sizeof( short ), channels, (byte *)output );
+	// streamed by the sound system's loader thread
+	S_StartMusic( path, looping );
 }
 
 void CDAudio_Stop()
 {
+	S_StopMusic();
 }
 
 void CDAudio_Update()
@@ -48,145 +48,35 @@ static void InterpolateAngles( const vec3_t start, const vec3_t end, vec3_t outp
 
 /*
 ========================
-CL_ParseEntityBits
+CL_ParseEntityNumber
 
-Returns the entity number and the header bits
+Returns the entity number and whether it's being removed
 ========================
 */
-int CL_ParseEntityBits( uint *bits )
+int CL_ParseEntityNumber( bitReader_t &reader, bool *remove )
 {
-	uint	b, total;
-	int		number;
-
-	total = MSG_ReadByte( &net_message );
-	if ( total & U_MOREBITS1 )
-	{
-		b = MSG_ReadByte( &net_message );
-		total |= b << 8;
-	}
-	if ( total & U_MOREBITS2 )
-	{
-		b = MSG_ReadByte( &net_message );
-		total |= b << 16;
-	}
-	if ( total & U_MOREBITS3 )
-	{
-		b = MSG_ReadByte( &net_message );
-		total |= b << 24;
-	}
-
-	if ( total & U_NUMBER16 ) {
-		number = MSG_ReadShort( &net_message );
-	} else {
-		number = MSG_ReadByte( &net_message );
-	}
-
-	*bits = total;
-
-	return number;
+	return MSG_ReadEntityNumber( reader, &net_message, remove );
 }
 
 /*
 ========================
 CL_ParseDelta
 
-Can go from either a baseline or a previous packet_entity
+Can go from either a baseline or a previous packet_entity,
+unchanged entities have no reader
 ========================
 */
-void CL_ParseDelta( entity_state_t *from, entity_state_t *to, int number, uint bits )
+void CL_ParseDelta( entity_state_t *from, entity_state_t *to, int number, bitReader_t *reader )
 {
 	// set everything to the state we are delta'ing from
 	*to = *from;
 
 	VectorCopy( from->origin, to->old_origin );
 	to->number = number;
+	to->event = 0;
 
-	if ( bits & U_MODEL ) {
-		to->modelindex = MSG_ReadByte( &net_message );
-	}
-	if ( bits & U_MODEL2 ) {
-		to->modelindex2 = MSG_ReadByte( &net_message );
-	}
-	if ( bits & U_MODEL3 ) {
-		to->modelindex3 = MSG_ReadByte( &net_message );
-	}
-	if ( bits & U_MODEL4 ) {
-		to->modelindex4 = MSG_ReadByte( &net_message );
-	}
-
-	if ( bits & U_FRAME8 ) {
-		to->frame = MSG_ReadByte( &net_message );
-	}
-	if ( bits & U_FRAME16 ) {
-		to->frame = MSG_ReadShort( &net_message );
-	}
-
-	if ( ( bits & U_SKIN8 ) && ( bits & U_SKIN16 ) ) {		//used for laser colors
-		to->skinnum = MSG_ReadLong( &net_message );
-	}
-	else if ( bits & U_SKIN8 ) {
-		to->skinnum = MSG_ReadByte( &net_message );
-	}
-	else if ( bits & U_SKIN16 ) {
-		to->skinnum = MSG_ReadShort( &net_message );
-	}
-
-	if ( ( bits & ( U_EFFECTS8 | U_EFFECTS16 ) ) == ( U_EFFECTS8 | U_EFFECTS16 ) ) {
-		to->effects = MSG_ReadLong( &net_message );
-	}
-	else if ( bits & U_EFFECTS8 ) {
-		to->effects = MSG_ReadByte( &net_message );
-	}
-	else if ( bits & U_EFFECTS16 ) {
-		to->effects = MSG_ReadShort( &net_message );
-	}
-
-	if ( ( bits & ( U_RENDERFX8 | U_RENDERFX16 ) ) == ( U_RENDERFX8 | U_RENDERFX16 ) ) {
-		to->renderfx = MSG_ReadLong( &net_message );
-	}
-	else if ( bits & U_RENDERFX8 ) {
-		to->renderfx = MSG_ReadByte( &net_message );
-	}
-	else if ( bits & U_RENDERFX16 ) {
-		to->renderfx = MSG_ReadShort( &net_message );
-	}
-
-	if ( bits & U_ORIGIN1 ) {
-		to->origin[0] = MSG_ReadCoord( &net_message );
-	}
-	if ( bits & U_ORIGIN2 ) {
-		to->origin[1] = MSG_ReadCoord( &net_message );
-	}
-	if ( bits & U_ORIGIN3 ) {
-		to->origin[2] = MSG_ReadCoord( &net_message );
-	}
-
-	if ( bits & U_ANGLE1 ) {
-		to->angles[0] = MSG_ReadAngle( &net_message );
-	}
-	if ( bits & U_ANGLE2 ) {
-		to->angles[1] = MSG_ReadAngle( &net_message );
-	}
-	if ( bits & U_ANGLE3 ) {
-		to->angles[2] = MSG_ReadAngle( &net_message );
-	}
-
-	if ( bits & U_OLDORIGIN ) {
-		MSG_ReadPos( &net_message, to->old_origin );
-	}
-
-	if ( bits & U_SOUND ) {
-		to->sound = MSG_ReadByte( &net_message );
-	}
-
-	if ( bits & U_EVENT ) {
-		to->event = MSG_ReadByte( &net_message );
-	} else {
-		to->event = 0;
-	}
-
-	if ( bits & U_SOLID ) {
-		to->solid = MSG_ReadShort( &net_message );
+	if ( reader ) {
+		MSG_ReadDeltaEntity( *reader, to );
 	}
 }
 
@@ -198,7 +88,7 @@ Parses deltas from the given base and adds the resulting entity
 to the current frame
 ========================
 */
-static void CL_DeltaEntity( clSnapshot_t *frame, int newnum, entity_state_t *old, uint bits )
+static void CL_DeltaEntity( clSnapshot_t *frame, int newnum, entity_state_t *old, bitReader_t *reader )
 {
 	centity_t *ent;
 	entity_state_t *state;
@@ -209,7 +99,7 @@ static void CL_DeltaEntity( clSnapshot_t *frame, int newnum, entity_state_t *old
 	cl.parse_entities++;
 	frame->num_entities++;
 
-	CL_ParseDelta( old, state, newnum, bits );
+	CL_ParseDelta( old, state, newnum, reader );
 
 	// some data changes will force no lerping
 	if ( state->modelindex != ent->current.modelindex   ||
@@ -263,7 +153,8 @@ rest of the data stream.
 static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newframe )
 {
 	int			newnum;
-	uint		bits;
+	bitReader_t	reader;
+	bool		remove;
 	entity_state_t *oldstate;
 	int			oldindex, oldnum;
 
@@ -291,7 +182,7 @@ static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newfra
 
 	while ( 1 )
 	{
-		newnum = CL_ParseEntityBits( &bits );
+		newnum = CL_ParseEntityNumber( reader, &remove );
 		if ( newnum >= MAX_EDICTS ) {
 			Com_Errorf( "CL_ParsePacketEntities: bad number:%i", newnum );
 		}
@@ -310,7 +201,7 @@ static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newfra
 			if ( cl_shownet.GetInt() == 3 ) {
 				Com_Printf( "   unchanged: %i\n", oldnum );
 			}
-			CL_DeltaEntity( newframe, oldnum, oldstate, 0 );
+			CL_DeltaEntity( newframe, oldnum, oldstate, nullptr );
 
 			oldindex++;
 
@@ -325,14 +216,14 @@ static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newfra
 			}
 		}
 
-		if ( bits & U_REMOVE )
+		if ( remove )
 		{
 			// the entity present in oldframe is not in the current frame
 			if ( cl_shownet.GetInt() == 3 ) {
 				Com_Printf( "   remove: %i\n", newnum );
 			}
 			if ( oldnum != newnum ) {
-				Com_Printf( "U_REMOVE: oldnum != newnum\n" );
+				Com_Printf( "remove: oldnum != newnum\n" );
 			}
 
 			oldindex++;
@@ -354,7 +245,7 @@ static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newfra
 			if ( cl_shownet.GetInt() == 3 ) {
 				Com_Printf( "   delta: %i\n", newnum );
 			}
-			CL_DeltaEntity( newframe, newnum, oldstate, bits );
+			CL_DeltaEntity( newframe, newnum, oldstate, &reader );
 
 			oldindex++;
 
@@ -376,7 +267,7 @@ static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newfra
 			if ( cl_shownet.GetInt() == 3 ) {
 				Com_Printf( "   baseline: %i\n", newnum );
 			}
-			CL_DeltaEntity( newframe, newnum, &cl_entities[newnum].baseline, bits );
+			CL_DeltaEntity( newframe, newnum, &cl_entities[newnum].baseline, &reader );
 			continue;
 		}
 
@@ -389,7 +280,7 @@ static void CL_ParsePacketEntities( clSnapshot_t *oldframe, clSnapshot_t *newfra
 		if ( cl_shownet.GetInt() == 3 ) {
 			Com_Printf( "   unchanged: %i\n", oldnum );
 		}
-		CL_DeltaEntity( newframe, oldnum, oldstate, 0 );
+		CL_DeltaEntity( newframe, oldnum, oldstate, nullptr );
 
 		oldindex++;
 
@@ -412,10 +303,7 @@ CL_ParsePlayerstate
 */
 void CL_ParsePlayerstate( clSnapshot_t *oldframe, clSnapshot_t *newframe )
 {
-	int			flags;
 	player_state_t *state;
-	int			i;
-	int			statbits;
 
 	state = &newframe->playerstate;
 
@@ -426,111 +314,12 @@ void CL_ParsePlayerstate( clSnapshot_t *oldframe, clSnapshot_t *newframe )
 		memset( state, 0, sizeof( *state ) );
 	}
 
-	flags = MSG_ReadShort( &net_message );
-
-	//
-	// parse the pmove_state_t
-	//
-	if ( flags & PS_M_TYPE ) {
-		state->pmove.pm_type = (pmType_t)MSG_ReadByte( &net_message );
-	}
-
-	if ( flags & PS_M_ORIGIN )
-	{
-		state->pmove.origin[0] = MSG_ReadFloat( &net_message );
-		state->pmove.origin[1] = MSG_ReadFloat( &net_message );
-		state->pmove.origin[2] = MSG_ReadFloat( &net_message );
-	}
-
-	if ( flags & PS_M_VELOCITY )
-	{
-		state->pmove.velocity[0] = MSG_ReadFloat( &net_message );
-		state->pmove.velocity[1] = MSG_ReadFloat( &net_message );
-		state->pmove.velocity[2] = MSG_ReadFloat( &net_message );
-	}
-
-	if ( flags & PS_M_TIME ) {
-		state->pmove.pm_time = MSG_ReadByte( &net_message );
-	}
-
-	if ( flags & PS_M_FLAGS ) {
-		state->pmove.pm_flags = MSG_ReadByte( &net_message );
-	}
-
-	if ( flags & PS_M_GRAVITY ) {
-		state->pmove.gravity = MSG_ReadShort( &net_message );
-	}
-
-	if ( flags & PS_M_DELTA_ANGLES )
-	{
-		state->pmove.delta_angles[0] = MSG_ReadFloat( &net_message );
-		state->pmove.delta_angles[1] = MSG_ReadFloat( &net_message );
-		state->pmove.delta_angles[2] = MSG_ReadFloat( &net_message );
-	}
+	MSG_ReadDeltaPlayerstate( &net_message, state );
 
 	if ( cl.attractloop ) {
 		// demo playback
 		state->pmove.pm_type = PM_FREEZE;
 	}
-
-	//
-	// parse the rest of the player_state_t
-	//
-	if ( flags & PS_VIEWOFFSET )
-	{
-		state->viewoffset[0] = MSG_ReadFloat( &net_message );
-		state->viewoffset[1] = MSG_ReadFloat( &net_message );
-		state->viewoffset[2] = MSG_ReadFloat( &net_message );
-	}
-
-	if ( flags & PS_VIEWANGLES )
-	{
-		state->viewangles[0] = MSG_ReadFloat( &net_message );
-		state->viewangles[1] = MSG_ReadFloat( &net_message );
-		state->viewangles[2] = MSG_ReadFloat( &net_message );
-	}
-
-	if ( flags & PS_KICKANGLES )
-	{
-		state->kick_angles[0] = MSG_ReadFloat( &net_message );
-		state->kick_angles[1] = MSG_ReadFloat( &net_message );
-		state->kick_angles[2] = MSG_ReadFloat( &net_message );
-	}
-
-	if ( flags & PS_WEAPONINDEX )
-	{
-		state->gunindex = MSG_ReadByte( &net_message );
-	}
-
-	if ( flags & PS_WEAPONFRAME )
-	{
-		state->gunframe = MSG_ReadByte( &net_message );
-	}
-
-	if ( flags & PS_BLEND )
-	{
-		state->blend[0] = MSG_ReadByte( &net_message ) / 255.0f;
-		state->blend[1] = MSG_ReadByte( &net_message ) / 255.0f;
-		state->blend[2] = MSG_ReadByte( &net_message ) / 255.0f;
-		state->blend[3] = MSG_ReadByte( &net_message ) / 255.0f;
-	}
-
-	if ( flags & PS_FOV ) {
-		state->fov = (float)MSG_ReadByte( &net_message );
-	}
-
-	if ( flags & PS_RDFLAGS ) {
-		state->rdflags = MSG_ReadByte( &net_message );
-	}
-
-	// parse stats
-	statbits = MSG_ReadLong( &net_message );
-	for ( i = 0; i < MAX_STATS; i++ )
-	{
-		if ( statbits & ( 1 << i ) ) {
-			state->stats[i] = MSG_ReadShort( &net_message );
-		}
-	}
 }
 
 /*
@@ -708,6 +497,8 @@ static void CL_AddPacketEntities( clSnapshot_t *frame )
 
 		cent = &cl_entities[s1->number];
 
+		ent.entnum = s1->number;
+
 		effects = s1->effects;
 		renderfx = s1->renderfx;
 
@@ -1246,6 +1037,7 @@ static void CL_AddViewModel( player_state_t *ps, player_state_t *ops, float bob
 	}
 
 	view.flags = RF_MINLIGHT | RF_DEPTHHACK | RF_WEAPONMODEL;
+	view.entnum = cl.playernum + 1;
 	view.backlerp = 1.0f - cl.lerpfrac;
 	VectorCopy( view.origin, view.oldorigin );	// don't lerp at all
 
@@ -53,6 +53,16 @@ struct clientinfo_t
 extern char cl_weaponmodels[MAX_CLIENTWEAPONMODELS][MAX_QPATH];
 extern int num_cl_weaponmodels;
 
+// what running one command predicted, kept so the next frame can carry on from it
+struct predictedMove_t
+{
+	pmove_state_t	s;
+	vec3_t			viewangles;
+	int				sequence;		// of the command, slots get reused
+	bool			onground;
+	bool			valid;
+};
+
 struct clientActive_t
 {
 	int			timeoutcount;
@@ -75,6 +85,8 @@ struct clientActive_t
 	unsigned	predicted_step_time;
 
 	pmove_state_t	predMove;		// generated by CL_PredictMovement
+	predictedMove_t	predictedMoves[CMD_BACKUP];
+	int				predictedSequence;	// last command in predictedMoves that follows on from the acked state
 	vec3_t			predAngles;
 	vec3_t			predError;
 
@@ -340,8 +352,8 @@ const char *Key_KeynumToString( int keynum );
 void CL_ParseFrame();
 void CL_AddEntities();
 
-int CL_ParseEntityBits( uint *bits );
-void CL_ParseDelta( entity_state_t *from, entity_state_t *to, int number, uint bits );
+int CL_ParseEntityNumber( bitReader_t &reader, bool *remove );
+void CL_ParseDelta( entity_state_t *from, entity_state_t *to, int number, bitReader_t *reader );
 void CL_ParseFrame();
 
 //
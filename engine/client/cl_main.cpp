@@ -358,8 +358,8 @@ static void CL_SendConnectPacket()
 	int port = net_qport->GetInt();
 	userinfo_modified = false;
 
-	Netchan_OutOfBandPrint( NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo() );
+	Netchan_OutOfBandPrint( NS_CLIENT, adr, "connect %i %i %i \"%s\" %i\n",
+		PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo(), net_compress->GetBool() ? 1 : 0 );
 }
 
 /*
@@ -581,6 +581,7 @@ static void CL_Disconnect()
 	Netchan_Transmit( &cls.netchan, length, (byte *)final );
 	Netchan_Transmit( &cls.netchan, length, (byte *)final );
 	Netchan_Transmit( &cls.netchan, length, (byte *)final );
+	Netchan_Shutdown( &cls.netchan );
 
 	CL_ClearState();
 
@@ -840,7 +841,8 @@ static void CL_ConnectionlessPacket()
 			Com_Printf( "Dup connect received.  Ignored.\n" );
 			return;
 		}
-		Netchan_Setup( NS_CLIENT, &cls.netchan, net_from, cls.quakePort );
+		// the server says whether it took us up on compression
+		Netchan_Setup( NS_CLIENT, &cls.netchan, net_from, cls.quakePort, Q_atoi( Cmd_Argv( 1 ) ) != 0 );
 		MSG_WriteChar( &cls.netchan.message, clc_stringcmd );
 		MSG_WriteString( &cls.netchan.message, "new" );
 		cls.state = ca_connected;
@@ -325,15 +325,19 @@ CL_ParseBaseline
 void CL_ParseBaseline (void)
 {
 	entity_state_t	*es;
-	uint			bits;
+	bitReader_t		reader;
+	bool			remove;
 	int				newnum;
 	entity_state_t	nullstate;
 
 	memset (&nullstate, 0, sizeof(nullstate));
 
-	newnum = CL_ParseEntityBits (&bits);
+	newnum = CL_ParseEntityNumber (reader, &remove);
+	if (newnum <= 0 || newnum >= MAX_EDICTS || remove)
+		Com_Errorf ("CL_ParseBaseline: bad number:%i", newnum);
+
 	es = &cl_entities[newnum].baseline;
-	CL_ParseDelta (&nullstate, es, newnum, bits);
+	CL_ParseDelta (&nullstate, es, newnum, &reader);
 }
 
 
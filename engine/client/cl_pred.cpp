@@ -59,61 +59,136 @@ enum solid_t
 	SOLID_PHYSICS		// rigid body
 };
 
+#define PREDICT_EPSILON		0.01f		// how far the server can be from a prediction and have it still count
+
+static StaticCvar cl_predictCache( "cl_predictCache", "1", 0, "Carry on from last frame's prediction while the server agrees with it, instead of replaying every command." );
+
+// a solid entity the player can bump into, gathered once per CL_PredictMovement
+struct predEntity_t
+{
+	entityState_t *			state;
+	cmodel_t *				cmodel;			// null for boxes
+	vec3_t					mins, maxs;		// decoded box size
+	vec3_t					absmin, absmax;
+};
+
+static std::vector<predEntity_t> s_predEntities;
+
 /*
 ========================
-CL_ClipMoveToEntities
+CL_BuildPredictionEntities
+
+Decodes the solid entities in the current frame once,
+rather than for every trace pmove makes
 ========================
 */
-static void CL_ClipMoveToEntities ( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, trace_t *tr )
+static void CL_BuildPredictionEntities()
 {
-	int				i, x, zd, zu;
-	trace_t			trace;
-	int				headnode;
-	float *			angles;
-	entityState_t *	ent;
-	int				num;
-	cmodel_t *		cmodel;
-	vec3_t			bmins, bmaxs;
-
-	for (i=0 ; i<cl.frame.num_entities ; i++)
+	s_predEntities.clear();
+
+	for ( int i = 0; i < cl.frame.num_entities; ++i )
 	{
-		num = (cl.frame.parse_entities + i)&(MAX_PARSE_ENTITIES-1);
-		ent = &cl_parse_entities[num];
+		const int num = ( cl.frame.parse_entities + i ) & ( MAX_PARSE_ENTITIES - 1 );
+		entityState_t *ent = &cl_parse_entities[num];
 
-		if (!ent->solid)
+		if ( !ent->solid || ent->number == cl.playernum + 1 )
+		{
 			continue;
+		}
 
-		if (ent->number == cl.playernum+1)
-			continue;
+		predEntity_t &pent = s_predEntities.emplace_back();
+		pent.state = ent;
+		pent.cmodel = nullptr;
 
-		if (ent->solid == 31)
+		if ( ent->solid == 31 )
 		{
 			// special value for bmodel
-			cmodel = cl.model_clip[ent->modelindex];
-			if (!cmodel)
+			pent.cmodel = cl.model_clip[ent->modelindex];
+			if ( !pent.cmodel )
+			{
+				s_predEntities.pop_back();
 				continue;
-			headnode = cmodel->headnode;
-			angles = ent->angles;
+			}
+
+			VectorCopy( pent.cmodel->mins, pent.mins );
+			VectorCopy( pent.cmodel->maxs, pent.maxs );
+
+			if ( ent->angles[0] || ent->angles[1] || ent->angles[2] )
+			{
+				// rotated, so anything within reach of the origin
+				const float radius = Max( VectorLength( pent.mins ), VectorLength( pent.maxs ) );
+				VectorSet( pent.mins, -radius, -radius, -radius );
+				VectorSet( pent.maxs, radius, radius, radius );
+			}
 		}
 		else
 		{
 			// encoded bbox
-			x = 8*(ent->solid & 31);
-			zd = 8*((ent->solid>>5) & 31);
-			zu = 8*((ent->solid>>10) & 63) - 32;
+			const int x = 8 * ( ent->solid & 31 );
+			const int zd = 8 * ( ( ent->solid >> 5 ) & 31 );
+			const int zu = 8 * ( ( ent->solid >> 10 ) & 63 ) - 32;
+
+			VectorSet( pent.mins, -x, -x, -zd );
+			VectorSet( pent.maxs, x, x, zu );
+		}
 
-			bmins[0] = bmins[1] = -x;
-			bmaxs[0] = bmaxs[1] = x;
-			bmins[2] = -zd;
-			bmaxs[2] = zu;
+		for ( int j = 0; j < 3; ++j )
+		{
+			pent.absmin[j] = ent->origin[j] + pent.mins[j] - 1.0f;
+			pent.absmax[j] = ent->origin[j] + pent.maxs[j] + 1.0f;
+		}
 
-			headnode = CM_HeadnodeForBox (bmins, bmaxs);
-			angles = vec3_origin;	// boxes don't rotate
+		// the bmodel's real bounds go to the trace, not the rotated ones
+		if ( pent.cmodel )
+		{
+			VectorCopy( pent.cmodel->mins, pent.mins );
+			VectorCopy( pent.cmodel->maxs, pent.maxs );
 		}
+	}
+}
 
-		if (tr->allsolid)
+/*
+========================
+CL_ClipMoveToEntities
+========================
+*/
+static void CL_ClipMoveToEntities ( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, trace_t *tr )
+{
+	trace_t	trace;
+	vec3_t	boxmins, boxmaxs;
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		boxmins[i] = Min( start[i], end[i] ) + mins[i];
+		boxmaxs[i] = Max( start[i], end[i] ) + maxs[i];
+	}
+
+	for ( predEntity_t &pent : s_predEntities )
+	{
+		if ( tr->allsolid )
 			return;
 
+		if ( boxmins[0] > pent.absmax[0] || boxmins[1] > pent.absmax[1] || boxmins[2] > pent.absmax[2]
+			|| boxmaxs[0] < pent.absmin[0] || boxmaxs[1] < pent.absmin[1] || boxmaxs[2] < pent.absmin[2] )
+		{
+			continue;
+		}
+
+		entityState_t *ent = pent.state;
+		int headnode;
+		float *angles;
+
+		if ( pent.cmodel )
+		{
+			headnode = pent.cmodel->headnode;
+			angles = ent->angles;
+		}
+		else
+		{
+			headnode = CM_HeadnodeForBox( pent.mins, pent.maxs );
+			angles = vec3_origin;	// boxes don't rotate
+		}
+
 #if 0
 		if ( ent->solid == SOLID_PHYSICS )
 		{
@@ -167,30 +242,24 @@ static trace_t CL_PMTrace( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end )
 
 static int CL_PMPointContents( vec3_t point )
 {
-	int num;
-	entity_state_t *ent;
-	cmodel_t *cmodel;
-
 	int contents = CM_PointContents( point, 0 );
 
-	for ( int i = 0; i < cl.frame.num_entities; i++ )
+	for ( const predEntity_t &pent : s_predEntities )
 	{
-		num = ( cl.frame.parse_entities + i ) & ( MAX_PARSE_ENTITIES - 1 );
-		ent = &cl_parse_entities[num];
-
-		if ( ent->solid != 31 )
+		if ( !pent.cmodel )
 		{
-			// special value for bmodel
 			continue;
 		}
 
-		cmodel = cl.model_clip[ent->modelindex];
-		if ( !cmodel )
+		if ( point[0] < pent.absmin[0] || point[1] < pent.absmin[1] || point[2] < pent.absmin[2]
+			|| point[0] > pent.absmax[0] || point[1] > pent.absmax[1] || point[2] > pent.absmax[2] )
 		{
 			continue;
 		}
 
-		contents |= CM_TransformedPointContents( point, cmodel->headnode, ent->origin, ent->angles );
+		entityState_t *ent = pent.state;
+
+		contents |= CM_TransformedPointContents( point, pent.cmodel->headnode, ent->origin, ent->angles );
 	}
 
 	return contents;
@@ -200,11 +269,39 @@ static void CL_PMPlaySound( const char *sample, float volume )
 {
 }
 
+static bool CL_PredictionMatches( const pmove_state_t &predicted, const pmove_state_t &server )
+{
+	if ( predicted.pm_type != server.pm_type
+		|| predicted.pm_flags != server.pm_flags
+		|| predicted.pm_time != server.pm_time
+		|| predicted.gravity != server.gravity
+		|| !VectorCompare( predicted.delta_angles, server.delta_angles ) )
+	{
+		return false;
+	}
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( fabs( predicted.origin[i] - server.origin[i] ) > PREDICT_EPSILON
+			|| fabs( predicted.velocity[i] - server.velocity[i] ) > PREDICT_EPSILON )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /*
 ========================
 CL_PredictMovement
 
 Sets cl.predicted_origin and cl.predicted_angles
+
+Each command's result is kept, and while the server's state for the last
+command it acknowledged matches what we predicted for it, everything we
+predicted after it still stands. Only commands sent since last frame need
+running then, instead of every unacknowledged one
 ========================
 */
 void CL_PredictMovement()
@@ -227,6 +324,7 @@ void CL_PredictMovement()
 		{
 			cl.predAngles[i] = cl.viewangles[i] + cl.frame.playerstate.pmove.delta_angles[i];
 		}
+		cl.predictedSequence = -1;
 		return;
 	}
 
@@ -240,6 +338,7 @@ void CL_PredictMovement()
 		{
 			Com_Print( "exceeded CMD_BACKUP\n" );
 		}
+		cl.predictedSequence = -1;
 		return;
 	}
 
@@ -253,12 +352,38 @@ void CL_PredictMovement()
 	// copy current state to pmove
 	pm.s = cl.frame.playerstate.pmove;
 
+	bool onground = false;
+	int first = ack + 1;
+
+	const predictedMove_t &acked = cl.predictedMoves[ack & ( CMD_BACKUP - 1 )];
+
+	if ( cl_predictCache.GetBool() && acked.valid && acked.sequence == ack
+		&& cl.predictedSequence >= ack && cl.predictedSequence < current
+		&& CL_PredictionMatches( acked.s, pm.s ) )
+	{
+		first = cl.predictedSequence + 1;
+
+		if ( first > ack + 1 )
+		{
+			const predictedMove_t &last = cl.predictedMoves[( first - 1 ) & ( CMD_BACKUP - 1 )];
+
+			pm.s = last.s;
+			VectorCopy( last.viewangles, pm.viewangles );
+			onground = last.onground;
+		}
+	}
+
 //	SCR_DebugGraph (current - ack - 1, colorBlack);
 
+	if ( first < current )
+	{
+		CL_BuildPredictionEntities();
+	}
+
 	// run frames
-	while ( ++ack < current )
+	for ( int sequence = first; sequence < current; ++sequence )
 	{
-		int frame = ack & ( CMD_BACKUP - 1 );
+		int frame = sequence & ( CMD_BACKUP - 1 );
 
 		// copy over the cmd
 		pm.cmd = cl.cmds[frame];
@@ -266,16 +391,27 @@ void CL_PredictMovement()
 		// perform the move!
 		cge->Pmove( &pm );
 
+		onground = pm.groundentity != nullptr;
+
+		predictedMove_t &move = cl.predictedMoves[frame];
+		move.s = pm.s;
+		VectorCopy( pm.viewangles, move.viewangles );
+		move.sequence = sequence;
+		move.onground = onground;
+		move.valid = true;
+
 		// save for debug checking
 		VectorCopy( pm.s.origin, cl.predicted_origins[frame] );
 	}
 
+	cl.predictedSequence = current - 1;
+
 	// calc data for smoothing stair ups
-	int oldframe = ( ack - 2 ) & ( CMD_BACKUP - 1 );
+	int oldframe = ( current - 2 ) & ( CMD_BACKUP - 1 );
 	float oldz = cl.predicted_origins[oldframe][2];
 	float step = pm.s.origin[2] - oldz;
 	float stepFabs = fabs( step );
-	if ( pm.groundentity && stepFabs > 1.0f && stepFabs < 18.0f ) // STEPSIZE
+	if ( onground && stepFabs > 1.0f && stepFabs < 18.0f ) // STEPSIZE
 	{
 		cl.predicted_step = step;
 		cl.predicted_step_time = cls.realtime - ( cls.frametime * 100.0f );
@@ -119,6 +119,7 @@ void S_Init (void)
 			return;
 
 		S_InitScaletable ();
+		S_InitLoader ();
 
 		sound_started = 1;
 		num_sfx = 0;
@@ -147,6 +148,7 @@ void S_Shutdown(void)
 	if (!sound_started)
 		return;
 
+	S_ShutdownLoader();
 	SNDDMA_Shutdown();
 
 	sound_started = 0;
@@ -161,8 +163,7 @@ void S_Shutdown(void)
 	{
 		if (!sfx->name[0])
 			continue;
-		if (sfx->cache)
-			Mem_Free (sfx->cache);
+		S_FreeSound (sfx);
 		if (sfx->truename)
 			Mem_Free(sfx->truename);
 		memset (sfx, 0, sizeof(*sfx));
@@ -323,8 +324,7 @@ void S_EndRegistration (void)
 			continue;
 		if (sfx->registration_sequence != s_registration_sequence)
 		{	// don't need this sound
-			if (sfx->cache)	// it is possible to have a leftover
-				Mem_Free (sfx->cache);	// from a server that didn't finish loading
+			S_FreeSound (sfx);	// it is possible to have a leftover from a server that didn't finish loading
 			memset (sfx, 0, sizeof(*sfx));
 		}
 #if 0
@@ -340,11 +340,13 @@ void S_EndRegistration (void)
 
 	}
 
-	// load everything in
+	// queue everything up for the loader thread, sounds missing last time get another go
 	for (i=0, sfx=known_sfx ; i < num_sfx ; i++,sfx++)
 	{
 		if (!sfx->name[0])
 			continue;
+		if (sfx->loadState == SFX_MISSING)
+			sfx->loadState = SFX_NOT_LOADED;
 		S_LoadSound (sfx);
 	}
 
@@ -565,7 +567,13 @@ void S_IssuePlaysound (playsound_t *ps)
 
 	ch->pos = 0;
 	sc = S_LoadSound (ch->sfx);
-	ch->end = paintedtime + sc->length;
+	if (sc)
+		ch->end = paintedtime + sc->length;
+	else
+	{	// still loading, the mixer starts it once it's in
+		ch->waiting = true;
+		ch->end = paintedtime;
+	}
 
 	// free the playsound
 	S_FreePlaysound (ps);
@@ -652,9 +660,9 @@ void S_StartSound(vec3_t origin, int entnum, int entchannel, sfx_t *sfx, float f
 	if (sfx->name[0] == '*')
 		sfx = S_RegisterSexedSound(&cl_entities[entnum].current, sfx->name);
 
-	// make sure the sound is loaded
+	// make sure the sound is loaded, or on its way
 	sc = S_LoadSound (sfx);
-	if (!sc)
+	if (!sc && sfx->loadState != SFX_LOADING)
 		return;		// couldn't load the sound's data
 
 	vol = fvol*255;
@@ -1000,6 +1008,9 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	if (!sound_started)
 		return;
 
+	// pick up sounds the loader has finished, even while loading
+	S_UpdateLoads ();
+
 	// if the loading plaque is up, clear everything
 	// out to make sure we aren't looping a dirty
 	// dma buffer while loading
@@ -1177,18 +1188,23 @@ void S_SoundList(void)
 		sc = sfx->cache;
 		if (sc)
 		{
-			size = sc->length*sc->width*(sc->stereo+1);
+			if (sc->stream)
+				size = SND_STREAM_CHUNK*SND_STREAM_SLOTS*sc->width;
+			else
+				size = sc->length*sc->width*(sc->stereo+1);
 			total += size;
 			if (sc->loopstart >= 0)
 				Com_Printf ("L");
 			else
 				Com_Printf (" ");
-			Com_Printf("(%2db) %6i : %s\n",sc->width*8,  size, sfx->name);
+			Com_Printf("(%2db) %6i : %s%s\n",sc->width*8,  size, sfx->name, sc->stream ? " (streamed)" : "");
 		}
 		else
 		{
 			if (sfx->name[0] == '*')
 				Com_Printf("  placeholder : %s\n", sfx->name);
+			else if (sfx->loadState == SFX_LOADING)
+				Com_Printf("  loading     : %s\n", sfx->name);
 			else
 				Com_Printf("  not loaded  : %s\n", sfx->name);
 		}
@@ -10,6 +10,12 @@ struct portable_samplepair_t
 	int			right;
 };
 
+struct sndStream_t;
+
+// long sounds are decoded a chunk at a time as they play
+#define SND_STREAM_CHUNK	16384	// output samples
+#define SND_STREAM_SLOTS	4		// chunks held per sound
+
 struct sfxcache_t
 {
 	int 		length;
@@ -17,15 +23,26 @@ struct sfxcache_t
 	int 		speed;			// not needed, because converted on load?
 	int 		width;
 	int 		stereo;
+	sndStream_t	*stream;		// if set data is unused, see S_StreamSamples
 	byte		data[1];		// variable sized
 };
 
+enum sfxLoadState_t
+{
+	SFX_NOT_LOADED,
+	SFX_LOADING,				// waiting on the loader thread
+	SFX_LOADED,
+	SFX_MISSING					// not tried again until the next registration
+};
+
 struct sfx_t
 {
 	char 		name[MAX_QPATH];
 	int			registration_sequence;
 	sfxcache_t	*cache;
 	char 		*truename;
+	sfxLoadState_t loadState;
+	int			loadId;			// ties a finished load to the request for it
 };
 
 // a playsound_t will be generated by each call to S_StartSound,
@@ -70,6 +87,7 @@ struct channel_t
 	int			master_vol;		// 0-255 master volume
 	qboolean	fixed_origin;	// use origin instead of fetching entnum's origin
 	qboolean	autosound;		// from an entity->sound, cleared each frame
+	qboolean	waiting;		// started before its sound was loaded, the mixer starts it once it is
 };
 
 struct wavinfo_t
@@ -112,6 +130,8 @@ void	SNDDMA_Activate( bool active );
 
 extern channel_t channels[MAX_CHANNELS];
 
+extern int			sound_started;
+
 extern int			paintedtime;
 extern int			s_rawend;
 extern vec3_t		listener_origin;
@@ -130,7 +150,21 @@ extern cvar_t *s_mixahead;
 extern cvar_t *s_testsound;
 extern cvar_t *s_primary;
 
+// snd_mem
+
+void			S_InitLoader();
+void			S_ShutdownLoader();
+
+// hands finished loads to their sounds and feeds the music, once a frame
+void			S_UpdateLoads();
+
+// returns the decoded sound, or null if it's still on the loader thread or missing
 sfxcache_t *	S_LoadSound (sfx_t *s);
+void			S_FreeSound( sfx_t *s );
+
+// samples of a streamed sound from pos on, count is cut to what's contiguous.
+// returns null if that chunk hasn't been decoded yet
+const byte *	S_StreamSamples( sfxcache_t *sc, int pos, int &count );
 
 void			S_IssuePlaysound (playsound_t *ps);
 
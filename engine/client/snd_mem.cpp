@@ -1,82 +1,36 @@
 // snd_mem.c: sound caching
+//
+// Sounds are decoded and resampled on a loader thread, the main thread only maps the file and
+// picks up the finished sound in S_UpdateLoads. Anything longer than s_streamSeconds keeps its
+// file and decoder and is decoded a chunk at a time as the mixer gets to it, music too.
 
 #include "snd_local.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
 #define STB_VORBIS_NO_STDIO
 #define STB_VORBIS_NO_PUSHDATA_API
 #include "../../thirdparty/stb/stb_vorbis.c"
 
-/*
-========================
-ResampleSfx
-========================
-*/
-static void ResampleSfx( sfx_t *sfx, int inrate, int inwidth, byte *data )
-{
-	int		outcount;
-	int		srcsample;
-	float	stepscale;
-	int		i;
-	int		sample, samplefrac, fracstep; // samplefrac has a tendency to overflow int32 with -huge- audio files
-	sfxcache_t	*sc;
-
-	sc = sfx->cache;
-	if ( !sc ) {
-		return;
-	}
-
-	stepscale = (float)inrate / dma.speed; // this is usually 0.5, 1, or 2
+#define MAX_LOAD_REQUESTS	1024	// power of two
 
-	outcount = sc->length / stepscale;
-	sc->length = outcount;
-	if ( sc->loopstart != -1 )
-		sc->loopstart = sc->loopstart / stepscale;
-
-	sc->speed = dma.speed;
-	sc->width = inwidth;
-	sc->stereo = 0;
+#define MUSIC_CHUNK_FRAMES	16384
+#define MUSIC_BUFFERS		3
 
-	// resample / decimate to the current source rate
+static StaticCvar s_asyncLoad( "s_asyncLoad", "1", 0, "Decode sounds on a loader thread, takes effect when the sound system restarts." );
+static StaticCvar s_streamSeconds( "s_streamSeconds", "10", 0, "Sounds longer than this many seconds are decoded a chunk at a time as they play." );
 
-	if ( stepscale == 1 && inwidth == 1 && sc->width == 1 )
-	{
-		// fast special case
-		for ( i = 0; i < outcount; i++ )
-		{
-			( (signed char *)sc->data )[i] = (int)( (unsigned char)( data[i] ) - 128 );
-		}
-	}
-	else
-	{
-		// general case
-		samplefrac = 0;
-		fracstep = stepscale * 256;
-		for ( i = 0; i < outcount; i++ )
-		{
-			srcsample = samplefrac >> 8;
-			samplefrac += fracstep;
-			if ( inwidth == 2 ) {
-				sample = LittleShort( ( (short *)data )[srcsample] );
-			} else {
-				sample = (int)( (unsigned char)( data[srcsample] ) - 128 ) << 8;
-			}
-			if ( sc->width == 2 ) {
-				( (short *)sc->data )[i] = sample;
-			} else {
-				( (signed char *)sc->data )[i] = sample >> 8;
-			}
-		}
-	}
-}
-
-static bool IsWav( byte *wav )
+static bool IsWav( const byte *wav )
 {
-	return *( (int32 *)wav ) == MakeFourCC( 'R', 'I', 'F', 'F' );
+	return *( (const int32 *)wav ) == MakeFourCC( 'R', 'I', 'F', 'F' );
 }
 
-static bool IsOgg( byte *ogg )
+static bool IsOgg( const byte *ogg )
 {
-	return *( (int32 *)ogg ) == MakeFourCC( 'O', 'g', 'g', 'S' );
+	return *( (const int32 *)ogg ) == MakeFourCC( 'O', 'g', 'g', 'S' );
 }
 
 /*
@@ -87,75 +41,81 @@ WAV loading
 ===============================================================================
 */
 
-byte	*data_p;
-byte 	*iff_end;
-byte 	*last_chunk;
-byte 	*iff_data;
-int 	iff_chunk_len;
+struct iffReader_t
+{
+	const byte *	data_p;
+	const byte *	iff_end;
+	const byte *	last_chunk;
+	const byte *	iff_data;
+	int				iff_chunk_len;
+};
 
-static short GetLittleShort()
+static short GetLittleShort( iffReader_t &iff )
 {
 	short val = 0;
-	val = *data_p;
-	val = val + ( *( data_p + 1 ) << 8 );
-	data_p += 2;
+	val = *iff.data_p;
+	val = val + ( *( iff.data_p + 1 ) << 8 );
+	iff.data_p += 2;
 	return val;
 }
 
-static int GetLittleLong()
+static int GetLittleLong( iffReader_t &iff )
 {
 	int val = 0;
-	val = *data_p;
-	val = val + ( *( data_p + 1 ) << 8 );
-	val = val + ( *( data_p + 2 ) << 16 );
-	val = val + ( *( data_p + 3 ) << 24 );
-	data_p += 4;
+	val = *iff.data_p;
+	val = val + ( *( iff.data_p + 1 ) << 8 );
+	val = val + ( *( iff.data_p + 2 ) << 16 );
+	val = val + ( *( iff.data_p + 3 ) << 24 );
+	iff.data_p += 4;
 	return val;
 }
 
-static void FindNextChunk( const char *name )
+static void FindNextChunk( iffReader_t &iff, const char *name )
 {
 	while ( 1 )
 	{
-		data_p = last_chunk;
+		iff.data_p = iff.last_chunk;
 
-		if ( data_p >= iff_end )
+		if ( iff.data_p >= iff.iff_end )
 		{
 			// didn't find the chunk
-			data_p = nullptr;
+			iff.data_p = nullptr;
 			return;
 		}
 
-		data_p += 4;
-		iff_chunk_len = GetLittleLong();
-		if ( iff_chunk_len < 0 )
+		iff.data_p += 4;
+		iff.iff_chunk_len = GetLittleLong( iff );
+		if ( iff.iff_chunk_len < 0 )
 		{
-			data_p = nullptr;
+			iff.data_p = nullptr;
 			return;
 		}
 
-		data_p -= 8;
-		last_chunk = data_p + 8 + ( ( iff_chunk_len + 1 ) & ~1 );
-		if ( Q_strncmp( (char*)data_p, name, 4 ) == 0 )
+		iff.data_p -= 8;
+		iff.last_chunk = iff.data_p + 8 + ( ( iff.iff_chunk_len + 1 ) & ~1 );
+		if ( Q_strncmp( (const char *)iff.data_p, name, 4 ) == 0 )
 		{
 			return;
 		}
 	}
 }
 
-static void FindChunk( const char *name )
+static void FindChunk( iffReader_t &iff, const char *name )
 {
-	last_chunk = iff_data;
-	FindNextChunk( name );
+	iff.last_chunk = iff.iff_data;
+	FindNextChunk( iff, name );
 }
 
 /*
 ========================
 GetWavinfo
+
+Sets error and returns a zeroed info if the file can't be used
 ========================
 */
-static wavinfo_t GetWavinfo( const char *name, byte *wav, int wavlength )
+static wavinfo_t GetWavinfo( const byte *wav, fsSize_t wavlength, const char *&error )
 {
+	iffReader_t	iff;
 	wavinfo_t	info;
 	int     i;
 	int     format;
@@ -163,61 +123,55 @@ static wavinfo_t GetWavinfo( const char *name, byte *wav, int wavlength )
 
 	memset( &info, 0, sizeof( info ) );
 
-	if ( !wav ) {
-		return info;
-	}
-
-	iff_data = wav;
-	iff_end = wav + wavlength;
+	iff.iff_data = wav;
+	iff.iff_end = wav + wavlength;
 
 	// find "RIFF" chunk
-	FindChunk( "RIFF" );
-	if ( !( data_p && !Q_strncmp( (char*)( data_p + 8 ), "WAVE", 4 ) ) )
+	FindChunk( iff, "RIFF" );
+	if ( !( iff.data_p && !Q_strncmp( (const char *)( iff.data_p + 8 ), "WAVE", 4 ) ) )
 	{
-		Com_Printf( "Missing RIFF/WAVE chunks\n" );
+		error = "is missing its RIFF/WAVE chunks";
 		return info;
 	}
 
 	// get "fmt " chunk
-	iff_data = data_p + 12;
+	iff.iff_data = iff.data_p + 12;
 
-	FindChunk( "fmt " );
-	if ( !data_p )
+	FindChunk( iff, "fmt " );
+	if ( !iff.data_p )
 	{
-		Com_Printf( "Missing fmt chunk\n" );
+		error = "is missing its fmt chunk";
 		return info;
 	}
-	data_p += 8;
-	format = GetLittleShort();
+	iff.data_p += 8;
+	format = GetLittleShort( iff );
 	if ( format != 1 )
 	{
-		Com_Printf( "Microsoft PCM format only\n" );
+		error = "isn't Microsoft PCM";
 		return info;
 	}
 
-	info.channels = GetLittleShort();
-	info.rate = GetLittleLong();
-	data_p += 4 + 2;
-	info.width = GetLittleShort() / 8;
+	const int channels = GetLittleShort( iff );
+	info.rate = GetLittleLong( iff );
+	iff.data_p += 4 + 2;
+	info.width = GetLittleShort( iff ) / 8;
 
 // get cue chunk
-	FindChunk( "cue " );
-	if ( data_p )
+	FindChunk( iff, "cue " );
+	if ( iff.data_p )
 	{
-		data_p += 32;
-		info.loopstart = GetLittleLong();
-//		Com_Printf("loopstart=%d\n", sfx->loopstart);
+		iff.data_p += 32;
+		info.loopstart = GetLittleLong( iff );
 
 		// if the next chunk is a LIST chunk, look for a cue length marker
-		FindNextChunk( "LIST" );
-		if ( data_p )
+		FindNextChunk( iff, "LIST" );
+		if ( iff.data_p )
 		{
-			if ( !Q_strncmp( (char*)data_p + 28, "mark", 4 ) )
+			if ( !Q_strncmp( (const char *)iff.data_p + 28, "mark", 4 ) )
 			{	// this is not a proper parse, but it works with cooledit...
-				data_p += 24;
-				i = GetLittleLong();	// samples in loop
+				iff.data_p += 24;
+				i = GetLittleLong( iff );	// samples in loop
 				info.samples = info.loopstart + i;
-//				Com_Printf("looped length: %i\n", i);
 			}
 		}
 	}
@@ -225,30 +179,684 @@ static wavinfo_t GetWavinfo( const char *name, byte *wav, int wavlength )
 		info.loopstart = -1;
 
 // find data chunk
-	FindChunk( "data" );
-	if ( !data_p )
+	FindChunk( iff, "data" );
+	if ( !iff.data_p || info.width < 1 || info.width > 2 )
 	{
-		Com_Printf( "Missing data chunk\n" );
+		error = "is missing its data chunk";
 		return info;
 	}
 
-	data_p += 4;
-	samples = GetLittleLong() / info.width;
+	iff.data_p += 4;
+	samples = GetLittleLong( iff ) / info.width;
 
 	if ( info.samples )
 	{
 		if ( samples < info.samples )
-			Com_Errorf( "Sound %s has a bad loop length", name );
+		{
+			error = "has a bad loop length";
+			return info;
+		}
 	}
 	else
 		info.samples = samples;
 
-	info.dataofs = data_p - wav;
+	info.dataofs = iff.data_p - wav;
+
+	if ( info.dataofs + (fsSize_t)info.samples * info.width > wavlength )
+	{
+		error = "is cut short";
+		return info;
+	}
+
+	info.channels = channels;
 
 	return info;
 }
 
-//=============================================================================
+/*
+===================================================================================================
+
+	Decoding
+
+	Runs on the loader thread, or on the main thread when the loader isn't there or is backed
+	up, so it only touches what it's given
+
+===================================================================================================
+*/
+
+struct soundSource_t
+{
+	const byte *	pcm;			// wav sample data
+	stb_vorbis *	vorbis;
+	int				vorbisPos;		// the sample the decoder gives out next
+	int				rate;
+	int				width;			// of the decoded samples
+	int				samples;		// at rate
+	int				loopstart;		// at rate, -1 for none
+	int64			step;			// source samples per output sample, 16.16
+};
+
+static int S_OutputSamples( const soundSource_t &src, int samples )
+{
+	return static_cast<int>( (int64)samples * dma.speed / src.rate );
+}
+
+static void S_CloseSource( soundSource_t &src )
+{
+	if ( src.vorbis )
+	{
+		stb_vorbis_close( src.vorbis );
+		src.vorbis = nullptr;
+	}
+}
+
+static bool S_OpenSource( const byte *data, fsSize_t size, soundSource_t &src, const char *&error )
+{
+	memset( &src, 0, sizeof( src ) );
+
+	if ( size >= 4 && IsWav( data ) )
+	{
+		const wavinfo_t info = GetWavinfo( data, size, error );
+		if ( error )
+		{
+			return false;
+		}
+		if ( info.channels != 1 )
+		{
+			error = "is a stereo sample";
+			return false;
+		}
+
+		src.pcm = data + info.dataofs;
+		src.rate = info.rate;
+		src.width = info.width;
+		src.samples = info.samples;
+		src.loopstart = info.loopstart;
+	}
+	else if ( size >= 4 && IsOgg( data ) )
+	{
+		int vorbisError;
+		src.vorbis = stb_vorbis_open_memory( data, (int)size, &vorbisError, nullptr );
+		if ( !src.vorbis )
+		{
+			error = "couldn't be decoded";
+			return false;
+		}
+
+		const stb_vorbis_info info = stb_vorbis_get_info( src.vorbis );
+		if ( info.channels != 1 )
+		{
+			// SlartTodo: Implement channel downmixing
+			S_CloseSource( src );
+			error = "is a stereo sample";
+			return false;
+		}
+
+		src.rate = info.sample_rate;
+		src.width = sizeof( short );
+		src.samples = stb_vorbis_stream_length_in_samples( src.vorbis );
+		src.loopstart = -1;
+	}
+	else
+	{
+		error = "is neither WAV or OGG data";
+		return false;
+	}
+
+	if ( src.rate <= 0 || src.samples <= 0 || S_OutputSamples( src, src.samples ) <= 0 )
+	{
+		S_CloseSource( src );
+		error = "is empty";
+		return false;
+	}
+
+	src.step = ( (int64)src.rate << 16 ) / dma.speed;
+
+	return true;
+}
+
+/*
+========================
+S_DecodeRange
+
+Resamples output samples [first, first + count) into out at the
+source's width, replaces ResampleSfx
+========================
+*/
+static void S_DecodeRange( soundSource_t &src, int first, int count, byte *out )
+{
+	int64 frac = first * src.step;
+
+	const int srcFirst = static_cast<int>( frac >> 16 );
+	const int srcLast = Min( static_cast<int>( ( ( first + count - 1 ) * src.step ) >> 16 ), src.samples - 1 );
+	const int srcCount = srcLast - srcFirst + 1;
+
+	frac -= (int64)srcFirst << 16;
+
+	short *decoded = nullptr;
+
+	if ( src.vorbis )
+	{
+		decoded = (short *)Mem_Alloc( srcCount * sizeof( short ) );
+
+		if ( srcFirst != src.vorbisPos )
+		{
+			stb_vorbis_seek( src.vorbis, srcFirst );
+			src.vorbisPos = srcFirst;
+		}
+
+		// the stream length is only an estimate for some files
+		const int got = stb_vorbis_get_samples_short( src.vorbis, 1, &decoded, srcCount );
+		memset( decoded + got, 0, ( srcCount - got ) * sizeof( short ) );
+		src.vorbisPos += got;
+	}
+
+	if ( src.width == 2 )
+	{
+		const short *in = decoded ? decoded : (const short *)src.pcm + srcFirst;
+		short *out16 = (short *)out;
+
+		if ( src.step == 1 << 16 )
+		{
+			for ( int i = 0; i < count; ++i )
+				out16[i] = LittleShort( in[i] );
+		}
+		else
+		{
+			for ( int i = 0; i < count; ++i, frac += src.step )
+				out16[i] = LittleShort( in[Min( static_cast<int>( frac >> 16 ), srcCount - 1 )] );
+		}
+	}
+	else
+	{
+		const byte *in = src.pcm + srcFirst;
+		int8 *out8 = (int8 *)out;
+
+		if ( src.step == 1 << 16 )
+		{
+			for ( int i = 0; i < count; ++i )
+				out8[i] = static_cast<int8>( in[i] - 128 );
+		}
+		else
+		{
+			for ( int i = 0; i < count; ++i, frac += src.step )
+				out8[i] = static_cast<int8>( in[Min( static_cast<int>( frac >> 16 ), srcCount - 1 )] - 128 );
+		}
+	}
+
+	if ( decoded )
+	{
+		Mem_Free( decoded );
+	}
+}
+
+/*
+===================================================================================================
+
+	Streamed sounds
+
+	Each keeps SND_STREAM_SLOTS chunks decoded. The main thread asks for a chunk by marking a
+	free slot as loading and queueing it, the loader marks it ready when it's done. Only the
+	main thread picks and frees slots, and never one that's loading
+
+===================================================================================================
+*/
+
+enum streamSlotState_t
+{
+	SLOT_EMPTY,
+	SLOT_LOADING,
+	SLOT_READY
+};
+
+struct streamSlot_t
+{
+	std::atomic<int>	state{ SLOT_EMPTY };
+	int					chunk = -1;
+	int					lastUsed = 0;		// paintedtime
+	byte *				data = nullptr;
+};
+
+struct sndStream_t
+{
+	FileSystem::mappedFile_t file;
+	soundSource_t		source;				// the loader's once the stream is handed out
+	int					length;
+	int					numChunks;
+	streamSlot_t		slots[SND_STREAM_SLOTS];
+	std::atomic<int>	pending{ 0 };		// chunks queued that the loader hasn't finished
+};
+
+static void S_DecodeChunk( sndStream_t *stream, int index )
+{
+	streamSlot_t &slot = stream->slots[index];
+
+	const int first = slot.chunk * SND_STREAM_CHUNK;
+	const int count = Min( SND_STREAM_CHUNK, stream->length - first );
+
+	S_DecodeRange( stream->source, first, count, slot.data );
+
+	slot.state.store( SLOT_READY, std::memory_order_release );
+}
+
+// Takes the file, the first chunk is decoded straight away so the sound can start
+static sfxcache_t *S_CreateStream( soundSource_t &src, int length, int loopstart, FileSystem::mappedFile_t &file )
+{
+	sndStream_t *stream = new sndStream_t;
+	stream->file = file;
+	stream->source = src;
+	stream->length = length;
+	stream->numChunks = ( length + SND_STREAM_CHUNK - 1 ) / SND_STREAM_CHUNK;
+
+	for ( streamSlot_t &slot : stream->slots )
+	{
+		slot.data = (byte *)Mem_Alloc( SND_STREAM_CHUNK * src.width );
+	}
+
+	stream->slots[0].chunk = 0;
+	S_DecodeChunk( stream, 0 );
+
+	sfxcache_t *sc = (sfxcache_t *)Mem_ClearedAlloc( sizeof( sfxcache_t ) );
+	sc->length = length;
+	sc->loopstart = loopstart;
+	sc->speed = dma.speed;
+	sc->width = src.width;
+	sc->stereo = 0;
+	sc->stream = stream;
+
+	file = {};
+	src = {};
+
+	return sc;
+}
+
+static void S_WaitForLoader( const std::atomic<int> &pending )
+{
+	while ( pending.load( std::memory_order_acquire ) != 0 )
+	{
+		std::this_thread::yield();
+	}
+}
+
+static void S_FreeCache( sfxcache_t *sc )
+{
+	sndStream_t *stream = sc->stream;
+
+	if ( stream )
+	{
+		// the loader may still be writing to it
+		S_WaitForLoader( stream->pending );
+
+		for ( streamSlot_t &slot : stream->slots )
+		{
+			Mem_Free( slot.data );
+		}
+
+		S_CloseSource( stream->source );
+		FileSystem::UnmapFile( stream->file );
+
+		delete stream;
+	}
+
+	Mem_Free( sc );
+}
+
+/*
+========================
+S_DecodeSound
+
+Decodes the whole file, or sets up a stream for it if it's longer
+than streamSamples. Sets error and returns null on failure
+========================
+*/
+static sfxcache_t *S_DecodeSound( FileSystem::mappedFile_t &file, int streamSamples, const char *&error )
+{
+	soundSource_t src;
+	if ( !S_OpenSource( file.data, file.size, src, error ) )
+	{
+		return nullptr;
+	}
+
+	const int length = S_OutputSamples( src, src.samples );
+	const int loopstart = ( src.loopstart != -1 ) ? S_OutputSamples( src, src.loopstart ) : -1;
+
+	if ( length > streamSamples )
+	{
+		return S_CreateStream( src, length, loopstart, file );
+	}
+
+	sfxcache_t *sc = (sfxcache_t *)Mem_Alloc( length * src.width + sizeof( sfxcache_t ) );
+	sc->length = length;
+	sc->loopstart = loopstart;
+	sc->speed = dma.speed;
+	sc->width = src.width;
+	sc->stereo = 0;
+	sc->stream = nullptr;
+
+	S_DecodeRange( src, 0, length, sc->data );
+	S_CloseSource( src );
+
+	return sc;
+}
+
+/*
+===================================================================================================
+
+	Music
+
+	Decoded in order into MUSIC_BUFFERS buffers of stereo frames at the track's own rate,
+	which the main thread feeds to S_RawSamples as the raw buffer empties
+
+===================================================================================================
+*/
+
+struct musicBuffer_t
+{
+	std::atomic<int>	state{ SLOT_EMPTY };
+	int					frames = 0;			// 0 once the track has ended
+	short				data[MUSIC_CHUNK_FRAMES * 2];
+};
+
+struct musicStream_t
+{
+	char				name[MAX_QPATH];
+	FileSystem::mappedFile_t file;
+	bool				looping = false;
+
+	stb_vorbis *		vorbis = nullptr;	// the loader's
+	int					rate = 0;			// set with the first buffer
+
+	musicBuffer_t		buffers[MUSIC_BUFFERS];
+	int					readBuffer = 0;		// main thread
+	int					readFrame = 0;
+
+	std::atomic<int>	pending{ 0 };
+};
+
+static musicStream_t *s_music;
+
+static void S_DecodeMusic( musicStream_t *music, int index )
+{
+	musicBuffer_t &buffer = music->buffers[index];
+
+	if ( !music->vorbis && music->rate == 0 )
+	{
+		int error;
+		music->vorbis = stb_vorbis_open_memory( music->file.data, (int)music->file.size, &error, nullptr );
+		if ( music->vorbis )
+		{
+			music->rate = stb_vorbis_get_info( music->vorbis ).sample_rate;
+		}
+	}
+
+	int frames = 0;
+	bool rewound = false;
+
+	while ( music->vorbis && frames < MUSIC_CHUNK_FRAMES )
+	{
+		const int got = stb_vorbis_get_samples_short_interleaved( music->vorbis, 2, buffer.data + frames * 2, ( MUSIC_CHUNK_FRAMES - frames ) * 2 );
+		if ( got > 0 )
+		{
+			frames += got;
+			rewound = false;
+			continue;
+		}
+
+		// nothing straight after going back to the start means there's nothing at all
+		if ( !music->looping || rewound )
+		{
+			break;
+		}
+
+		stb_vorbis_seek_start( music->vorbis );
+		rewound = true;
+	}
+
+	buffer.frames = frames;
+	buffer.state.store( SLOT_READY, std::memory_order_release );
+}
+
+/*
+===================================================================================================
+
+	Loader thread
+
+===================================================================================================
+*/
+
+enum loadRequestType_t
+{
+	LOAD_SOUND,
+	LOAD_CHUNK,
+	LOAD_MUSIC
+};
+
+struct loadRequest_t
+{
+	loadRequestType_t	type;
+	sfx_t *				sfx;				// LOAD_SOUND, only handed back
+	int					loadId;
+	int					streamSamples;
+	FileSystem::mappedFile_t file;
+	sndStream_t *		stream;				// LOAD_CHUNK
+	musicStream_t *		music;				// LOAD_MUSIC
+	int					index;				// of the slot or music buffer
+};
+
+struct loadResult_t
+{
+	sfx_t *				sfx;
+	int					loadId;
+	sfxcache_t *		cache;				// null if it couldn't be decoded
+	const char *		error;
+	FileSystem::mappedFile_t file;			// empty if a stream kept it
+};
+
+struct soundLoader_t
+{
+	std::thread				thread;
+	std::mutex				mutex;
+	std::condition_variable	wake;
+	bool					quit;
+	bool					running;		// main thread only
+
+	loadRequest_t			requests[MAX_LOAD_REQUESTS];
+	uint32					requestHead, requestTail;
+
+	loadResult_t			results[MAX_LOAD_REQUESTS];
+	uint32					resultHead, resultTail;
+
+	int						outstanding;	// LOAD_SOUND requests without a collected result, main thread
+};
+
+static soundLoader_t	s_loader;
+static int				s_loadId;
+
+static void S_LoaderThread()
+{
+	while ( true )
+	{
+		loadRequest_t request;
+
+		{
+			std::unique_lock<std::mutex> lock( s_loader.mutex );
+			s_loader.wake.wait( lock, []() { return s_loader.quit || s_loader.requestHead != s_loader.requestTail; } );
+
+			// S_ShutdownLoader cleans up whatever's left
+			if ( s_loader.quit ) {
+				return;
+			}
+
+			request = s_loader.requests[s_loader.requestTail++ & ( MAX_LOAD_REQUESTS - 1 )];
+		}
+
+		switch ( request.type )
+		{
+		case LOAD_SOUND:
+		{
+			loadResult_t result;
+			result.sfx = request.sfx;
+			result.loadId = request.loadId;
+			result.error = nullptr;
+			result.file = request.file;
+			result.cache = S_DecodeSound( result.file, request.streamSamples, result.error );
+
+			// there's always room, S_LoadSound doesn't queue more than fits
+			std::lock_guard<std::mutex> lock( s_loader.mutex );
+			s_loader.results[s_loader.resultHead++ & ( MAX_LOAD_REQUESTS - 1 )] = result;
+			break;
+		}
+		case LOAD_CHUNK:
+			S_DecodeChunk( request.stream, request.index );
+			request.stream->pending.fetch_sub( 1, std::memory_order_release );
+			break;
+		case LOAD_MUSIC:
+			S_DecodeMusic( request.music, request.index );
+			request.music->pending.fetch_sub( 1, std::memory_order_release );
+			break;
+		}
+	}
+}
+
+static bool S_PushLoadRequest( const loadRequest_t &request )
+{
+	{
+		std::lock_guard<std::mutex> lock( s_loader.mutex );
+
+		if ( s_loader.requestHead - s_loader.requestTail == MAX_LOAD_REQUESTS ) {
+			return false;
+		}
+
+		s_loader.requests[s_loader.requestHead++ & ( MAX_LOAD_REQUESTS - 1 )] = request;
+	}
+
+	s_loader.wake.notify_one();
+
+	return true;
+}
+
+/*
+========================
+S_InitLoader
+========================
+*/
+void S_InitLoader()
+{
+	if ( s_loader.running || !s_asyncLoad.GetBool() ) {
+		return;
+	}
+
+	s_loader.quit = false;
+	s_loader.requestHead = s_loader.requestTail = 0;
+	s_loader.resultHead = s_loader.resultTail = 0;
+	s_loader.outstanding = 0;
+
+	s_loader.thread = std::thread( S_LoaderThread );
+	s_loader.running = true;
+}
+
+/*
+========================
+S_ShutdownLoader
+
+Anything still queued is thrown away, sounds that were loading stay
+that way so this should only be followed by freeing all of them
+========================
+*/
+void S_ShutdownLoader()
+{
+	if ( s_loader.running )
+	{
+		{
+			std::lock_guard<std::mutex> lock( s_loader.mutex );
+			s_loader.quit = true;
+		}
+		s_loader.wake.notify_one();
+		s_loader.thread.join();
+		s_loader.running = false;
+
+		for ( ; s_loader.requestTail != s_loader.requestHead; ++s_loader.requestTail )
+		{
+			loadRequest_t &request = s_loader.requests[s_loader.requestTail & ( MAX_LOAD_REQUESTS - 1 )];
+
+			switch ( request.type )
+			{
+			case LOAD_SOUND:
+				FileSystem::UnmapFile( request.file );
+				break;
+			case LOAD_CHUNK:
+				request.stream->slots[request.index].chunk = -1;
+				request.stream->slots[request.index].state.store( SLOT_EMPTY, std::memory_order_relaxed );
+				request.stream->pending.fetch_sub( 1, std::memory_order_relaxed );
+				break;
+			case LOAD_MUSIC:
+				request.music->pending.fetch_sub( 1, std::memory_order_relaxed );
+				break;
+			}
+		}
+
+		for ( ; s_loader.resultTail != s_loader.resultHead; ++s_loader.resultTail )
+		{
+			loadResult_t &result = s_loader.results[s_loader.resultTail & ( MAX_LOAD_REQUESTS - 1 )];
+
+			if ( result.cache ) {
+				S_FreeCache( result.cache );
+			}
+			FileSystem::UnmapFile( result.file );
+		}
+
+		s_loader.outstanding = 0;
+	}
+
+	S_StopMusic();
+}
+
+/*
+===================================================================================================
+
+	Main thread side
+
+===================================================================================================
+*/
+
+static void S_SoundPath( const sfx_t *s, char( &path )[MAX_QPATH] )
+{
+	const char *name = s->truename ? s->truename : s->name;
+
+	if ( name[0] == '#' ) {
+		Q_strcpy_s( path, name + 1 );
+	} else {
+		Q_sprintf_s( path, "sound/%s", name );
+	}
+}
+
+static void S_FinishLoad( loadResult_t &result )
+{
+	sfx_t *s = result.sfx;
+
+	if ( s->loadState != SFX_LOADING || s->loadId != result.loadId )
+	{
+		// freed while it was being decoded
+		if ( result.cache ) {
+			S_FreeCache( result.cache );
+		}
+	}
+	else if ( result.cache )
+	{
+		s->cache = result.cache;
+		s->loadState = SFX_LOADED;
+	}
+	else
+	{
+		char path[MAX_QPATH];
+		S_SoundPath( s, path );
+		Com_Printf( "%s %s\n", path, result.error );
+
+		s->loadState = SFX_MISSING;
+	}
+
+	FileSystem::UnmapFile( result.file );
+}
 
 /*
 ========================
@@ -258,125 +866,361 @@ S_LoadSound
 sfxcache_t *S_LoadSound( sfx_t *s )
 {
 	char	namebuffer[MAX_QPATH];
-	byte	*data;
-	int		len;
-	float	stepscale;
-	sfxcache_t	*sc;
-	char	*name;
 
 	if ( s->name[0] == '*' ) {
 		return NULL;
 	}
 
 	// see if still in memory
-	sc = s->cache;
-	if ( sc ) {
-		return sc;
+	if ( s->cache ) {
+		return s->cache;
 	}
 
-	// load it in
-	if ( s->truename ) {
-		name = s->truename;
-	} else {
-		name = s->name;
+	// on its way, or not there at all
+	if ( s->loadState != SFX_NOT_LOADED ) {
+		return nullptr;
 	}
 
-	if ( name[0] == '#' ) {
-		Q_strcpy_s( namebuffer, name + 1 );
-	} else {
-		Q_sprintf_s( namebuffer, "sound/%s", name );
-	}
+	S_SoundPath( s, namebuffer );
 
 	//Com_Printf ("loading %s\n",namebuffer);
 
-	fsSize_t size = FileSystem::LoadFile (namebuffer, (void **)&data);
-	if ( !data )
+	// mapping doesn't read anything, that's left to the decoder
+	loadRequest_t request{};
+	if ( !FileSystem::MapFile( namebuffer, request.file ) )
 	{
 		Com_Printf( "Couldn't load %s\n", namebuffer );
+		s->loadState = SFX_MISSING;
 		return nullptr;
 	}
 
-	if ( IsWav( data ) )
+	request.type = LOAD_SOUND;
+	request.sfx = s;
+	request.loadId = s->loadId = ++s_loadId;
+	request.streamSamples = static_cast<int>( Clamp( s_streamSeconds.GetFloat(), 0.0f, 3600.0f ) * dma.speed );
+
+	s->loadState = SFX_LOADING;
+
+	if ( s_loader.running && s_loader.outstanding < MAX_LOAD_REQUESTS && S_PushLoadRequest( request ) )
 	{
-		wavinfo_t info;
+		++s_loader.outstanding;
+		return nullptr;
+	}
 
-		info = GetWavinfo( s->name, data, size );
-		if ( info.channels != 1 )
-		{
-			FileSystem::FreeFile( data );
-			Com_Printf( "%s is a stereo sample\n", s->name );
-			return nullptr;
-		}
+	// no loader or it's swamped, do it here
+	loadResult_t result;
+	result.sfx = s;
+	result.loadId = s->loadId;
+	result.error = nullptr;
+	result.file = request.file;
+	result.cache = S_DecodeSound( result.file, request.streamSamples, result.error );
 
-		stepscale = (float)info.rate / dma.speed;
-		len = info.samples / stepscale;
+	S_FinishLoad( result );
 
-		len = len * info.width * info.channels;
+	return s->cache;
+}
 
-		sc = s->cache = (sfxcache_t *)Mem_Alloc( len + sizeof( sfxcache_t ) );
-		if ( !sc )
-		{
-			FileSystem::FreeFile( data );
-			return nullptr;
-		}
+/*
+========================
+S_FreeSound
+
+A load still in progress is thrown away when it finishes
+========================
+*/
+void S_FreeSound( sfx_t *s )
+{
+	if ( s->cache )
+	{
+		S_FreeCache( s->cache );
+		s->cache = nullptr;
+	}
 
-		sc->length = info.samples;
-		sc->loopstart = info.loopstart;
-		sc->speed = info.rate;
-		sc->width = info.width;
-		sc->stereo = info.channels;
+	s->loadState = SFX_NOT_LOADED;
+	s->loadId = 0;
+}
 
-		ResampleSfx( s, sc->speed, sc->width, data + info.dataofs );
+static void S_RequestChunk( sndStream_t *stream, int index, int chunk )
+{
+	streamSlot_t &slot = stream->slots[index];
+	slot.chunk = chunk;
+	slot.lastUsed = paintedtime;
 
-		FileSystem::FreeFile( data );
+	if ( !s_loader.running )
+	{
+		S_DecodeChunk( stream, index );
+		return;
 	}
-	else if ( IsOgg( data ) )
+
+	slot.state.store( SLOT_LOADING, std::memory_order_relaxed );
+	stream->pending.fetch_add( 1, std::memory_order_relaxed );
+
+	loadRequest_t request{};
+	request.type = LOAD_CHUNK;
+	request.stream = stream;
+	request.index = index;
+
+	if ( !S_PushLoadRequest( request ) )
 	{
-		int channels, samplerate, samples;
-		short *output;
-		samples = stb_vorbis_decode_memory( data, size, &channels, &samplerate, &output );
-		FileSystem::FreeFile( data );
-		if ( samples == -1 )
+		// asked for again on the next block
+		stream->pending.fetch_sub( 1, std::memory_order_relaxed );
+		slot.state.store( SLOT_EMPTY, std::memory_order_relaxed );
+		slot.chunk = -1;
+	}
+}
+
+// Finds the slot holding chunk or asks for it, null if every slot is busy
+static streamSlot_t *S_GetChunk( sndStream_t *stream, int chunk )
+{
+	int victim = -1;
+	int oldest = INT_MAX;
+
+	for ( int i = 0; i < SND_STREAM_SLOTS; ++i )
+	{
+		streamSlot_t &slot = stream->slots[i];
+
+		if ( slot.chunk == chunk )
 		{
-			Com_Printf( "Couldn't load %s\n", namebuffer );
-			return nullptr;
+			slot.lastUsed = paintedtime;
+			return &slot;
 		}
-		if ( channels != 1 )
+
+		const int state = slot.state.load( std::memory_order_relaxed );
+
+		if ( state == SLOT_EMPTY )
 		{
-			// SlartTodo: Implement channel downmixing
-			Com_Printf( "%s is a stereo sample\n", s->name );
-			Mem_Free( output );
-			return nullptr;
+			victim = i;
+			oldest = INT_MIN;
+		}
+		// anything used for this block may be needed again
+		else if ( state == SLOT_READY && slot.lastUsed != paintedtime && slot.lastUsed < oldest )
+		{
+			victim = i;
+			oldest = slot.lastUsed;
 		}
+	}
+
+	if ( victim == -1 ) {
+		return nullptr;
+	}
+
+	S_RequestChunk( stream, victim, chunk );
 
-		stepscale = (float)samplerate / dma.speed;
-		len = samples / stepscale;
+	return &stream->slots[victim];
+}
 
-		len *= sizeof( short ) * channels;
+/*
+========================
+S_StreamSamples
+========================
+*/
+const byte *S_StreamSamples( sfxcache_t *sc, int pos, int &count )
+{
+	sndStream_t *stream = sc->stream;
 
-		sc = s->cache = (sfxcache_t *)Mem_Alloc( len + sizeof( sfxcache_t ) );
-		if ( !sc )
+	const int chunk = pos / SND_STREAM_CHUNK;
+	const int offset = pos - chunk * SND_STREAM_CHUNK;
+
+	count = Min( count, SND_STREAM_CHUNK - offset );
+
+	streamSlot_t *slot = S_GetChunk( stream, chunk );
+
+	// have the next one ready for when this one runs out
+	int next = chunk + 1;
+	if ( next >= stream->numChunks ) {
+		next = Max( sc->loopstart, 0 ) / SND_STREAM_CHUNK;
+	}
+	if ( next != chunk ) {
+		S_GetChunk( stream, next );
+	}
+
+	if ( !slot || slot->state.load( std::memory_order_acquire ) != SLOT_READY ) {
+		return nullptr;
+	}
+
+	return slot->data + offset * sc->width;
+}
+
+static void S_QueueMusicBuffer( musicStream_t *music, int index )
+{
+	musicBuffer_t &buffer = music->buffers[index];
+
+	if ( !s_loader.running )
+	{
+		S_DecodeMusic( music, index );
+		return;
+	}
+
+	buffer.state.store( SLOT_LOADING, std::memory_order_relaxed );
+	music->pending.fetch_add( 1, std::memory_order_relaxed );
+
+	loadRequest_t request{};
+	request.type = LOAD_MUSIC;
+	request.music = music;
+	request.index = index;
+
+	if ( !S_PushLoadRequest( request ) )
+	{
+		// asked for again on the next frame
+		music->pending.fetch_sub( 1, std::memory_order_relaxed );
+		buffer.state.store( SLOT_EMPTY, std::memory_order_relaxed );
+	}
+}
+
+static void S_FreeMusic()
+{
+	musicStream_t *music = s_music;
+	if ( !music ) {
+		return;
+	}
+
+	s_music = nullptr;
+
+	S_WaitForLoader( music->pending );
+
+	if ( music->vorbis ) {
+		stb_vorbis_close( music->vorbis );
+	}
+	FileSystem::UnmapFile( music->file );
+
+	delete music;
+}
+
+/*
+========================
+S_StartMusic
+========================
+*/
+void S_StartMusic( const char *path, bool looping )
+{
+	S_StopMusic();
+
+	if ( !sound_started ) {
+		return;
+	}
+
+	musicStream_t *music = new musicStream_t;
+
+	if ( !FileSystem::MapFile( path, music->file ) )
+	{
+		Com_Printf( "Couldn't load music track %s\n", path );
+		delete music;
+		return;
+	}
+
+	Q_strcpy_s( music->name, path );
+	music->looping = looping;
+
+	for ( int i = 0; i < MUSIC_BUFFERS; ++i )
+	{
+		S_QueueMusicBuffer( music, i );
+	}
+
+	s_music = music;
+}
+
+/*
+========================
+S_StopMusic
+
+Drops whatever was already handed to the mixer too
+========================
+*/
+void S_StopMusic()
+{
+	if ( !s_music ) {
+		return;
+	}
+
+	S_FreeMusic();
+
+	s_rawend = 0;
+}
+
+/*
+========================
+S_UpdateMusic
+
+Keeps the raw sample buffer topped up from the decoded buffers
+========================
+*/
+static void S_UpdateMusic()
+{
+	musicStream_t *music = s_music;
+	if ( !music ) {
+		return;
+	}
+
+	while ( true )
+	{
+		musicBuffer_t &buffer = music->buffers[music->readBuffer];
+
+		const int state = buffer.state.load( std::memory_order_acquire );
+		if ( state == SLOT_EMPTY )
 		{
-			Mem_Free( output );
-			return nullptr;
+			// the queue was full last time
+			S_QueueMusicBuffer( music, music->readBuffer );
+			return;
+		}
+		if ( state != SLOT_READY ) {
+			return;		// the loader is behind
 		}
 
-		sc->length = samples;
-		sc->loopstart = -1;
-		sc->speed = samplerate;
-		sc->width = sizeof( short );
-		sc->stereo = channels;
+		if ( buffer.frames == 0 )
+		{
+			if ( music->rate == 0 ) {
+				Com_Printf( "Couldn't decode music track %s\n", music->name );
+			}
+			// let what's already queued play out
+			S_FreeMusic();
+			return;
+		}
 
-		ResampleSfx( s, sc->speed, sc->width, (byte *)output );
+		// the raw buffer only holds MAX_RAW_SAMPLES past paintedtime
+		const int queued = Max( s_rawend - paintedtime, 0 );
+		const int room = static_cast<int>( (int64)( MAX_RAW_SAMPLES - queued ) * music->rate / dma.speed ) - 1;
+		const int frames = Min( buffer.frames - music->readFrame, room );
+		if ( frames <= 0 ) {
+			return;
+		}
+
+		S_RawSamples( frames, music->rate, sizeof( short ), 2, (byte *)( buffer.data + music->readFrame * 2 ) );
 
-		Mem_Free( output );
+		music->readFrame += frames;
+		if ( music->readFrame < buffer.frames ) {
+			return;
+		}
+
+		// used up, decode the next piece into it
+		music->readFrame = 0;
+		S_QueueMusicBuffer( music, music->readBuffer );
+		music->readBuffer = ( music->readBuffer + 1 ) % MUSIC_BUFFERS;
 	}
-	else
+}
+
+/*
+========================
+S_UpdateLoads
+========================
+*/
+void S_UpdateLoads()
+{
+	while ( true )
 	{
-		FileSystem::FreeFile( data );
-		Com_Printf( "%s is neither WAV or OGG data\n", namebuffer );
-		return nullptr;
+		loadResult_t result;
+
+		{
+			std::lock_guard<std::mutex> lock( s_loader.mutex );
+
+			if ( s_loader.resultTail == s_loader.resultHead ) {
+				break;
+			}
+
+			result = s_loader.results[s_loader.resultTail++ & ( MAX_LOAD_REQUESTS - 1 )];
+		}
+
+		--s_loader.outstanding;
+		S_FinishLoad( result );
 	}
 
-	return sc;
+	S_UpdateMusic();
 }
@@ -2,65 +2,65 @@
 
 #include "snd_local.h"
 
+#include "../../core/simd.h"
+
 #define	PAINTBUFFER_SIZE 2048
-static portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
 
-static int		snd_scaletable[32][256];
-static int *	snd_p;
-static int		snd_linear_count, snd_vol;
-static short *	snd_out;
+// Planar and in output units, so mixing a channel is a multiply add per side
+// and the transfer only has to clamp, round and interleave
+alignas( 32 ) static float s_paintLeft[PAINTBUFFER_SIZE];
+alignas( 32 ) static float s_paintRight[PAINTBUFFER_SIZE];
+
+static int16 S_ClampSample( float sample )
+{
+	return static_cast<int16>( lrintf( Clamp( sample, -32768.0f, 32767.0f ) ) );
+}
 
-static void S_WriteLinearBlastStereo16()
+// Clamps and interleaves count frames into 16 bit stereo
+static void S_WriteStereo16( const float *left, const float *right, int16 *out, int count )
 {
-	int		i;
-	int		val;
+	const __m128 lo = _mm_set1_ps( -32768.0f );
+	const __m128 hi = _mm_set1_ps( 32767.0f );
 
-	for (i=0 ; i<snd_linear_count ; i+=2)
+	int i = 0;
+
+	for ( ; i + 4 <= count; i += 4 )
 	{
-		val = snd_p[i]>>8;
-		if (val > 0x7fff)
-			snd_out[i] = 0x7fff;
-		else if (val < (short)0x8000)
-			snd_out[i] = (short)0x8000;
-		else
-			snd_out[i] = val;
+		const __m128i l = _mm_cvtps_epi32( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( left + i ), lo ), hi ) );
+		const __m128i r = _mm_cvtps_epi32( _mm_min_ps( _mm_max_ps( _mm_loadu_ps( right + i ), lo ), hi ) );
 
-		val = snd_p[i+1]>>8;
-		if (val > 0x7fff)
-			snd_out[i+1] = 0x7fff;
-		else if (val < (short)0x8000)
-			snd_out[i+1] = (short)0x8000;
-		else
-			snd_out[i+1] = val;
+		// l0 r0 l1 r1 l2 r2 l3 r3
+		_mm_storeu_si128( (__m128i *)( out + i * 2 ), _mm_packs_epi32( _mm_unpacklo_epi32( l, r ), _mm_unpackhi_epi32( l, r ) ) );
+	}
+
+	for ( ; i < count; ++i )
+	{
+		out[i * 2 + 0] = S_ClampSample( left[i] );
+		out[i * 2 + 1] = S_ClampSample( right[i] );
 	}
 }
 
-static void S_TransferStereo16 (unsigned long *pbuf, int endtime)
+static void S_TransferStereo16( int16 *pbuf, int endtime )
 {
-	int		lpos;
-	int		lpaintedtime;
-	
-	snd_p = (int *) paintbuffer;
-	lpaintedtime = paintedtime;
+	const float *left = s_paintLeft;
+	const float *right = s_paintRight;
+	int lpaintedtime = paintedtime;
 
-	while (lpaintedtime < endtime)
+	while ( lpaintedtime < endtime )
 	{
-	// handle recirculating buffer issues
-		lpos = lpaintedtime & ((dma.samples>>1)-1);
-
-		snd_out = (short *) pbuf + (lpos<<1);
-
-		snd_linear_count = (dma.samples>>1) - lpos;
-		if (lpaintedtime + snd_linear_count > endtime)
-			snd_linear_count = endtime - lpaintedtime;
+		// handle recirculating buffer issues
+		const int lpos = lpaintedtime & ( ( dma.samples >> 1 ) - 1 );
 
-		snd_linear_count <<= 1;
+		int count = ( dma.samples >> 1 ) - lpos;
+		if ( lpaintedtime + count > endtime )
+			count = endtime - lpaintedtime;
 
-	// write a linear blast of samples
-		S_WriteLinearBlastStereo16 ();
+		// write a linear blast of samples
+		S_WriteStereo16( left, right, pbuf + ( lpos << 1 ), count );
 
-		snd_p += snd_linear_count;
-		lpaintedtime += (snd_linear_count>>1);
+		left += count;
+		right += count;
+		lpaintedtime += count;
 	}
 }
 
@@ -70,70 +70,39 @@ S_TransferPaintBuffer
 
 ===================
 */
-static void S_TransferPaintBuffer(int endtime)
+static void S_TransferPaintBuffer( int endtime )
 {
-	int 	out_idx;
-	int 	count;
-	int 	out_mask;
-	int 	*p;
-	int 	step;
-	int		val;
-	unsigned long *pbuf;
+	const int count = endtime - paintedtime;
 
-	pbuf = (unsigned long *)dma.buffer;
-
-	if (s_testsound->GetBool())
+	if ( s_testsound->GetBool() )
 	{
-		int		i;
-		int		count;
-
 		// write a fixed sine wave
-		count = (endtime - paintedtime);
-		for (i=0 ; i<count ; i++)
-			paintbuffer[i].left = paintbuffer[i].right = sinf((paintedtime+i)*0.1f)*20000*256;
+		for ( int i = 0; i < count; i++ )
+			s_paintLeft[i] = s_paintRight[i] = sinf( ( paintedtime + i ) * 0.1f ) * 20000;
 	}
 
-	if (dma.samplebits == 16 && dma.channels == 2)
+	if ( dma.samplebits == 16 && dma.channels == 2 )
 	{	// optimized case
-		S_TransferStereo16 (pbuf, endtime);
+		S_TransferStereo16( (int16 *)dma.buffer, endtime );
+		return;
 	}
-	else
-	{	// general case
-		p = (int *) paintbuffer;
-		count = (endtime - paintedtime) * dma.channels;
-		out_mask = dma.samples - 1; 
-		out_idx = paintedtime * dma.channels & out_mask;
-		step = 3 - dma.channels;
-
-		if (dma.samplebits == 16)
-		{
-			short *out = (short *) pbuf;
-			while (count--)
-			{
-				val = *p >> 8;
-				p+= step;
-				if (val > 0x7fff)
-					val = 0x7fff;
-				else if (val < (short)0x8000)
-					val = (short)0x8000;
-				out[out_idx] = val;
-				out_idx = (out_idx + 1) & out_mask;
-			}
-		}
-		else if (dma.samplebits == 8)
+
+	// general case
+	const int out_mask = dma.samples - 1;
+	int out_idx = paintedtime * dma.channels & out_mask;
+
+	for ( int i = 0; i < count; ++i )
+	{
+		for ( int c = 0; c < dma.channels; ++c )
 		{
-			unsigned char *out = (unsigned char *) pbuf;
-			while (count--)
-			{
-				val = *p >> 8;
-				p+= step;
-				if (val > 0x7fff)
-					val = 0x7fff;
-				else if (val < (short)0x8000)
-					val = (short)0x8000;
-				out[out_idx] = (val>>8) + 128;
-				out_idx = (out_idx + 1) & out_mask;
-			}
+			const int16 val = S_ClampSample( c == 0 ? s_paintLeft[i] : s_paintRight[i] );
+
+			if ( dma.samplebits == 16 )
+				( (int16 *)dma.buffer )[out_idx] = val;
+			else if ( dma.samplebits == 8 )
+				dma.buffer[out_idx] = ( val >> 8 ) + 128;
+
+			out_idx = ( out_idx + 1 ) & out_mask;
 		}
 	}
 }
@@ -143,63 +112,87 @@ static void S_TransferPaintBuffer(int endtime)
 
 	Channel mixing
 
+	Sounds are mono, so each channel scales the same samples for either side.
+	Channels panned hard to one side only touch that side's buffer
+
 ===================================================================================================
 */
 
-static void S_PaintChannelFrom8( channel_t *ch, sfxcache_t *sc, int count, int offset )
-{
-	int 	data;
-	int		*lscale, *rscale;
-	unsigned char *sfx;
-	int		i;
-	portable_samplepair_t *samp;
+static simdFloat_t S_LoadSamples( const int16 *p ) { return Simd_LoadInt16( p ); }
+static simdFloat_t S_LoadSamples( const int8 *p ) { return Simd_LoadInt8( p ); }
 
-	// TODO: leftvol and rightvol should never be higher than 255 anyway. Right?
-	ch->leftvol = Min( ch->leftvol, 255 );
-	ch->rightvol = Min( ch->rightvol, 255 );
-
-	//ZOID-- >>11 has been changed to >>3, >>11 didn't make much sense
-	//as it would always be zero.
-	lscale = snd_scaletable[ch->leftvol >> 3];
-	rscale = snd_scaletable[ch->rightvol >> 3];
-	sfx = (unsigned char *)sc->data + ch->pos;
+template< typename sample_t >
+static void S_PaintOneSide( const sample_t *sfx, float scale, float *out, int count )
+{
+	const simdFloat_t vscale = Simd_Set1( scale );
 
-	samp = &paintbuffer[offset];
+	int i = 0;
 
-	for ( i = 0; i < count; i++, samp++ )
+	for ( ; i + SIMD_WIDTH <= count; i += SIMD_WIDTH )
 	{
-		data = sfx[i];
-		samp->left += lscale[data];
-		samp->right += rscale[data];
+		const simdFloat_t s = S_LoadSamples( sfx + i );
+		Simd_Store( out + i, Simd_Add( Simd_Load( out + i ), Simd_Mul( s, vscale ) ) );
 	}
 
-	ch->pos += count;
+	for ( ; i < count; ++i )
+	{
+		out[i] += sfx[i] * scale;
+	}
 }
 
-static void S_PaintChannelFrom16( channel_t *ch, sfxcache_t *sc, int count, int offset )
+template< typename sample_t >
+static void S_PaintBothSides( const sample_t *sfx, float leftScale, float rightScale, int count, int offset )
 {
-	int data;
-	int left, right;
-	int leftvol, rightvol;
-	signed short *sfx;
-	int	i;
-	portable_samplepair_t *samp;
-
-	leftvol = ch->leftvol * snd_vol;
-	rightvol = ch->rightvol * snd_vol;
-	sfx = (signed short *)sc->data + ch->pos;
-
-	samp = &paintbuffer[offset];
-	for ( i = 0; i < count; i++, samp++ )
+	float *left = s_paintLeft + offset;
+	float *right = s_paintRight + offset;
+
+	const simdFloat_t vleft = Simd_Set1( leftScale );
+	const simdFloat_t vright = Simd_Set1( rightScale );
+
+	int i = 0;
+
+	if ( leftScale == rightScale )
+	{
+		// centred, one multiply does for both
+		for ( ; i + SIMD_WIDTH <= count; i += SIMD_WIDTH )
+		{
+			const simdFloat_t s = Simd_Mul( S_LoadSamples( sfx + i ), vleft );
+			Simd_Store( left + i, Simd_Add( Simd_Load( left + i ), s ) );
+			Simd_Store( right + i, Simd_Add( Simd_Load( right + i ), s ) );
+		}
+	}
+	else
+	{
+		for ( ; i + SIMD_WIDTH <= count; i += SIMD_WIDTH )
+		{
+			const simdFloat_t s = S_LoadSamples( sfx + i );
+			Simd_Store( left + i, Simd_Add( Simd_Load( left + i ), Simd_Mul( s, vleft ) ) );
+			Simd_Store( right + i, Simd_Add( Simd_Load( right + i ), Simd_Mul( s, vright ) ) );
+		}
+	}
+
+	for ( ; i < count; ++i )
 	{
-		data = sfx[i];
-		left = ( data * leftvol ) >> 8;
-		right = ( data * rightvol ) >> 8;
-		samp->left += left;
-		samp->right += right;
+		left[i] += sfx[i] * leftScale;
+		right[i] += sfx[i] * rightScale;
 	}
+}
+
+template< typename sample_t >
+static void S_PaintChannel( const channel_t *ch, const byte *samples, float sampleScale, int count, int offset )
+{
+	const sample_t *sfx = (const sample_t *)samples;
+
+	// TODO: leftvol and rightvol should never be higher than 255 anyway. Right?
+	const float leftScale = Min( ch->leftvol, 255 ) * sampleScale;
+	const float rightScale = Min( ch->rightvol, 255 ) * sampleScale;
 
-	ch->pos += count;
+	if ( rightScale == 0.0f )
+		S_PaintOneSide( sfx, leftScale, s_paintLeft + offset, count );
+	else if ( leftScale == 0.0f )
+		S_PaintOneSide( sfx, rightScale, s_paintRight + offset, count );
+	else
+		S_PaintBothSides( sfx, leftScale, rightScale, count, offset );
 }
 
 void S_PaintChannels(int endtime)
@@ -211,7 +204,23 @@ void S_PaintChannels(int endtime)
 	int		ltime, count;
 	playsound_t	*ps;
 
-	snd_vol = static_cast<int>( s_volume->GetFloat() * 256.0f );
+	// a full volume 16 bit sample at a channel volume of 256 comes out as is,
+	// 8 bit samples are a 256th of the range
+	const float volume = s_volume->GetFloat();
+	const float scale16 = volume * ( 1.0f / 256.0f );
+	const float scale8 = volume;
+
+	// look every channel's samples up once rather than for every block, sounds
+	// started while painting get theirs as they turn up. none of this waits for
+	// a sound to load, S_UpdateLoads hands them over between frames
+	sfx_t *		channelSfx[MAX_CHANNELS];
+	sfxcache_t *channelCache[MAX_CHANNELS];
+
+	for ( i = 0; i < MAX_CHANNELS; ++i )
+	{
+		channelSfx[i] = channels[i].sfx;
+		channelCache[i] = channelSfx[i] ? S_LoadSound( channelSfx[i] ) : nullptr;
+	}
 
 //Com_Printf ("%i to %i\n", paintedtime, endtime);
 	while (paintedtime < endtime)
@@ -242,7 +251,8 @@ void S_PaintChannels(int endtime)
 		if (s_rawend < paintedtime)
 		{
 //			Com_Printf ("clear\n");
-			memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
+			memset( s_paintLeft, 0, ( end - paintedtime ) * sizeof( float ) );
+			memset( s_paintRight, 0, ( end - paintedtime ) * sizeof( float ) );
 		}
 		else
 		{	// copy from the streaming sound source
@@ -251,10 +261,12 @@ void S_PaintChannels(int endtime)
 
 			stop = (end < s_rawend) ? end : s_rawend;
 
+			// raw samples are still in the old 24.8 fixed point
 			for (i=paintedtime ; i<stop ; i++)
 			{
 				s = i&(MAX_RAW_SAMPLES-1);
-				paintbuffer[i-paintedtime] = s_rawsamples[s];
+				s_paintLeft[i-paintedtime] = s_rawsamples[s].left * ( 1.0f / 256.0f );
+				s_paintRight[i-paintedtime] = s_rawsamples[s].right * ( 1.0f / 256.0f );
 			}
 //		if (i != end)
 //			Com_Printf ("partial stream\n");
@@ -262,8 +274,8 @@ void S_PaintChannels(int endtime)
 //			Com_Printf ("full stream\n");
 			for ( ; i<end ; i++)
 			{
-				paintbuffer[i-paintedtime].left =
-				paintbuffer[i-paintedtime].right = 0;
+				s_paintLeft[i-paintedtime] =
+				s_paintRight[i-paintedtime] = 0.0f;
 			}
 		}
 
@@ -273,30 +285,55 @@ void S_PaintChannels(int endtime)
 		for (i=0; i<MAX_CHANNELS ; i++, ch++)
 		{
 			ltime = paintedtime;
-		
+
 			while (ltime < end)
 			{
 				if (!ch->sfx || (!ch->leftvol && !ch->rightvol) )
 					break;
 
+				if ( ch->sfx != channelSfx[i] )
+				{
+					channelSfx[i] = ch->sfx;
+					channelCache[i] = S_LoadSound( ch->sfx );
+				}
+
+				sc = channelCache[i];
+				if (!sc)
+				{
+					if ( ch->sfx->loadState != SFX_LOADING )
+						ch->sfx = NULL;		// it's never going to be there
+					break;
+				}
+
+				if ( ch->waiting )
+				{	// the sound has come in since it was started
+					ch->waiting = false;
+					ch->pos = 0;
+					ch->end = ltime + sc->length;
+				}
+
 				// max painting is to the end of the buffer
 				count = end - ltime;
 
 				// might be stopped by running out of data
 				if (ch->end - ltime < count)
 					count = ch->end - ltime;
-		
-				sc = S_LoadSound (ch->sfx);
-				if (!sc)
-					break;
 
 				if (count > 0 && ch->sfx)
-				{	
-					if (sc->width == 1)// FIXME; 8 bit asm is wrong now
-						S_PaintChannelFrom8(ch, sc, count,  ltime - paintedtime);
-					else
-						S_PaintChannelFrom16(ch, sc, count, ltime - paintedtime);
-	
+				{
+					// streamed sounds are only contiguous to the end of a chunk, and are
+					// silent where the chunk hasn't been decoded in time
+					const byte *samples = sc->stream ? S_StreamSamples( sc, ch->pos, count ) : sc->data + ch->pos * sc->width;
+
+					if ( samples )
+					{
+						if (sc->width == 1)
+							S_PaintChannel<int8>( ch, samples, scale8, count, ltime - paintedtime );
+						else
+							S_PaintChannel<int16>( ch, samples, scale16, count, ltime - paintedtime );
+					}
+
+					ch->pos += count;
 					ltime += count;
 				}
 
@@ -313,13 +350,13 @@ void S_PaintChannels(int endtime)
 						ch->pos = sc->loopstart;
 						ch->end = ltime + sc->length - ch->pos;
 					}
-					else				
+					else
 					{	// channel just stopped
 						ch->sfx = NULL;
 					}
 				}
 			}
-															  
+
 		}
 
 	// transfer out according to DMA format
@@ -328,18 +365,124 @@ void S_PaintChannels(int endtime)
 	}
 }
 
+// The volume is read as the channels are painted, there's no table to rebuild any more
 void S_InitScaletable()
 {
 	s_volume->ClearModified();
+}
 
-	const float volume = s_volume->GetFloat();
+/*
+===================================================================================================
+
+	Mixer benchmark
+
+===================================================================================================
+*/
 
-	for ( int i = 0; i < 32; ++i )
+static sfxcache_t *S_MakeBenchSound( int length, int width )
+{
+	sfxcache_t *sc = (sfxcache_t *)Mem_ClearedAlloc( sizeof( sfxcache_t ) + length * width );
+	sc->length = length;
+	sc->loopstart = 0;
+	sc->speed = dma.speed;
+	sc->width = width;
+	sc->stereo = 0;
+
+	for ( int i = 0; i < length; ++i )
 	{
-		const int scale = i * 8 * 256 * volume;
-		for ( int j = 0; j < 256; ++j )
-		{
-			snd_scaletable[i][j] = ( (char)j ) * scale;
-		}
+		const float wave = sinf( i * 0.05f ) * 0.8f + ( ( rand() & 255 ) - 128 ) * ( 0.2f / 128.0f );
+
+		if ( width == 2 )
+			( (int16 *)sc->data )[i] = static_cast<int16>( wave * 32767.0f );
+		else
+			( (int8 *)sc->data )[i] = static_cast<int8>( wave * 127.0f );
+	}
+
+	return sc;
+}
+
+/*
+===================
+snd_mixBench
+
+Mixes every channel playing a looping sound into a stand in DMA buffer,
+nothing reaches the sound device and the mixer state is put back after
+===================
+*/
+CON_COMMAND( snd_mixBench, "Times mixing MAX_CHANNELS busy channels without a sound device. Usage: snd_mixBench [seconds]", 0 )
+{
+	if ( !s_volume || !s_testsound )
+	{
+		Com_Print( "The sound system isn't set up, s_initsound is 0\n" );
+		return;
+	}
+
+	const float seconds = Cmd_Argc() > 1 ? Max( (float)Q_atof( Cmd_Argv( 1 ) ), 0.1f ) : 10.0f;
+
+	const dma_t savedDma = dma;
+	channel_t savedChannels[MAX_CHANNELS];
+	memcpy( savedChannels, channels, sizeof( channels ) );
+	const int savedPaintedTime = paintedtime;
+	const int savedRawEnd = s_rawend;
+	const playsound_t savedPending = s_pendingplays;
+
+	// 16 bit stereo at 44 kHz, about a third of a second of buffer like a real device
+	dma.channels = 2;
+	dma.samplebits = 16;
+	dma.speed = 44100;
+	dma.samples = 32768;
+	dma.submission_chunk = 1;
+	dma.samplepos = 0;
+	dma.buffer = (byte *)Mem_ClearedAlloc( dma.samples * ( dma.samplebits / 8 ) );
+
+	paintedtime = 0;
+	s_rawend = -1;
+	s_pendingplays.next = s_pendingplays.prev = &s_pendingplays;
+
+	// half the channels on 16 bit sounds and half on 8 bit, spread around the listener
+	sfx_t sfx16{}, sfx8{};
+	Q_strcpy_s( sfx16.name, "mixbench16" );
+	Q_strcpy_s( sfx8.name, "mixbench8" );
+	sfx16.cache = S_MakeBenchSound( dma.speed, 2 );
+	sfx8.cache = S_MakeBenchSound( dma.speed, 1 );
+
+	for ( int i = 0; i < MAX_CHANNELS; ++i )
+	{
+		channel_t *ch = &channels[i];
+		memset( ch, 0, sizeof( *ch ) );
+
+		ch->sfx = ( i & 1 ) ? &sfx8 : &sfx16;
+		ch->leftvol = ( i * 37 ) % 256;
+		ch->rightvol = 255 - ch->leftvol;
+		ch->master_vol = 255;
+		ch->autosound = true;
+		ch->pos = ( i * 997 ) % ch->sfx->cache->length;
+		ch->end = ch->sfx->cache->length - ch->pos;
+	}
+
+	// mix a typical frame's worth at a time
+	const int totalSamples = static_cast<int>( seconds * dma.speed );
+	const int blockSamples = dma.speed / 60;
+
+	const double start = Time_FloatMilliseconds();
+
+	while ( paintedtime < totalSamples )
+	{
+		S_PaintChannels( Min( paintedtime + blockSamples, totalSamples ) );
 	}
+
+	const double elapsed = Time_FloatMilliseconds() - start;
+
+	Com_Printf( "Mixed %.1f s of %d channels in %.2f ms, %.0fx realtime, %d wide\n",
+		seconds, MAX_CHANNELS, elapsed, seconds * 1000.0 / Max( elapsed, 0.001 ), SIMD_WIDTH );
+
+	Mem_Free( sfx16.cache );
+	Mem_Free( sfx8.cache );
+	Mem_Free( dma.buffer );
+
+	dma = savedDma;
+	memcpy( channels, savedChannels, sizeof( channels ) );
+	paintedtime = savedPaintedTime;
+	s_rawend = savedRawEnd;
+	s_pendingplays = savedPending;
 }
@@ -14,6 +14,10 @@ void		S_StartLocalSound( const char *s, float volume = 1.0f );
 // Play raw sound data (used by cinematics and VOIP)
 void		S_RawSamples( int samples, int rate, int width, int channels, byte *data );
 
+// Music decoded a piece at a time, replaces any that's already playing
+void		S_StartMusic( const char *path, bool looping );
+void		S_StopMusic();
+
 void		S_StopAllSounds();
 void		S_Update( vec3_t origin, vec3_t v_forward, vec3_t v_right, vec3_t v_up );
 
@@ -380,23 +380,25 @@ static bool GL_CategorizeDDS( const char *pName, const byte *pBuffer, int bufLen
 
 //-------------------------------------------------------------------------------------------------
 // Loads any of the supported image types into a cannonical 32 bit format.
+// DDS files are uploaded as they are, pPic points into file which the caller unmaps.
 //-------------------------------------------------------------------------------------------------
-static bool GL_LoadImage( const char *pName, int &width, int &height, byte *&pPic )
+static bool GL_LoadImage( const char *pName, int &width, int &height, byte *&pPic, FileSystem::mappedFile_t &file )
 {
-	byte *pBuffer;
-	fsSize_t nBufLen = FileSystem::LoadFile( pName, (void **)&pBuffer );
-	if ( !pBuffer )
+	if ( !FileSystem::MapFile( pName, file ) )
 	{
 		return false;
 	}
 
+	const byte *pBuffer = file.data;
+	int nBufLen = (int)file.size;
+
 	Assert( nBufLen > 32 ); // Sanity check
 
 	if ( img::TestPNG( pBuffer ) )
 	{
 		pPic = img::LoadPNG( pBuffer, width, height );
 
-		FileSystem::FreeFile( pBuffer );
+		FileSystem::UnmapFile( file );
 		return false;
 	}
 	else if ( img::TestDDS( pBuffer ) )
@@ -404,10 +406,12 @@ static bool GL_LoadImage( const char *pName, int &width, int &height, byte *&pPi
 		// if we're a dds, pPic becomes the file buffer
 
 		if ( !GL_CategorizeDDS( pName, pBuffer, nBufLen ) ) {
+			FileSystem::UnmapFile( file );
 			return false;
 		}
 
-		pPic = pBuffer;
+		// GL_UploadCompressed only reads it
+		pPic = const_cast<byte *>( pBuffer );
 
 		return true;
 	}
@@ -416,7 +420,7 @@ static bool GL_LoadImage( const char *pName, int &width, int &height, byte *&pPi
 		// There is no real test for TGA
 		pPic = img::LoadTGA( pBuffer, nBufLen, width, height );
 
-		FileSystem::FreeFile( pBuffer );
+		FileSystem::UnmapFile( file );
 		return false;
 	}
 
@@ -454,8 +458,9 @@ static image_t *GL_FindImage( const char *name, imageFlags_t flags )
 	// load the pic from disk
 	//
 	byte *pic = nullptr;
+	FileSystem::mappedFile_t file;
 
-	bool compressed = GL_LoadImage( name, width, height, pic );
+	bool compressed = GL_LoadImage( name, width, height, pic, file );
 	if ( !pic ) {
 		defaultMaterial->image->IncrementRefCount();
 		return defaultMaterial->image;
@@ -463,11 +468,11 @@ static image_t *GL_FindImage( const char *name, imageFlags_t flags )
 
 	image = GL_CreateImage( name, pic, width, height, flags, compressed );
 
-	// HACK: this is weird
+	// compressed images point into the file, the rest were decoded into their own buffer
 	if ( compressed ) {
-		Mem_Free( pic );
+		FileSystem::UnmapFile( file );
 	} else {
-		FileSystem::FreeFile( pic );
+		Mem_Free( pic );
 	}
 
 	++image->refcount;
@@ -13,6 +13,8 @@ cvar_t *r_norefresh;
 cvar_t *r_drawentities;
 cvar_t *r_drawworld;
 cvar_t *r_drawlights;
+cvar_t *r_lightCache;
+cvar_t *r_lightGrid;
 cvar_t *r_speeds;
 cvar_t *r_fullbright;
 cvar_t *r_novis;
@@ -193,6 +195,8 @@ static void R_InitCVars()
 	r_drawentities = Cvar_Get( "r_drawentities", "1", 0, "If true, entities are drawn." );
 	r_drawworld = Cvar_Get( "r_drawworld", "1", 0, "If true, the world is drawn." );
 	r_drawlights = Cvar_Get( "r_drawlights", "0", 0, "If true, lights are drawn." );
+	r_lightCache = Cvar_Get( "r_lightCache", "1", 0, "If true, models keep their static lights until they change leaf." );
+	r_lightGrid = Cvar_Get( "r_lightGrid", "1", 0, "If true, models are lit from the map's light grid instead of tracing into the lightmaps." );
 	r_novis = Cvar_Get( "r_novis", "0", 0, "If true, vis is ignored." );
 	r_nocull = Cvar_Get( "r_nocull", "0", 0, "If true, world polygons are not frustrum culled." );
 	r_lerpmodels = Cvar_Get( "r_lerpmodels", "1", 0, "If true, md2 models are vertex lerped." );
@@ -325,6 +329,8 @@ void R_Restart()
 
 	Shaders_Shutdown();
 
+	Mem_FrameArenaFree( tr.frameArena );
+
 	GL_CheckErrors();
 
 	GLimp_Shutdown();
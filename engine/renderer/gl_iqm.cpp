@@ -208,7 +208,7 @@ void R_DrawIQM( entity_t *e )
 
 	vec3_t ambientColor;
 	renderLight_t finalLights[MAX_LIGHTS];
-	R_FourNearestLights( e->origin, finalLights, ambientColor );
+	R_FourNearestLights( e->origin, e->entnum, finalLights, ambientColor );
 
 	glUniform3fv( 7, 1, tr.refdef.vieworg );
 	glUniform3fv( 8, 1, ambientColor );
@@ -1,6 +1,8 @@
 
 #include "gl_local.h"
 
+#include <vector>
+
 static int r_dlightframecount;
 
 #define	DLIGHT_CUTOFF	64
@@ -199,6 +201,210 @@ static int RecursiveLightPoint( mnode_t *node, const vec3_t start, const vec3_t
 	return RecursiveLightPoint (node->children[!side], mid, end);
 }
 
+/*
+===================
+R_LightPointTrace
+
+The lightmap on whatever is under p
+===================
+*/
+static void R_LightPointTrace( const vec3_t p, vec3_t color )
+{
+	vec3_t end;
+
+	end[0] = p[0];
+	end[1] = p[1];
+	end[2] = p[2] - 2048;
+
+	int r = RecursiveLightPoint( r_worldmodel->nodes, p, end );
+
+	if ( r == -1 )
+	{
+		VectorClear( color );
+	}
+	else
+	{
+		VectorCopy( pointcolor, color );
+	}
+}
+
+/*
+===================
+R_LightGridSample
+
+The grid sample at a lattice position, or null if it's outside the grid,
+in a brick that wasn't stored or in the solid
+===================
+*/
+static const dlightgridsample_t *R_LightGridSample( const mlightgrid_t &grid, const int *pos )
+{
+	if ( (unsigned)pos[0] >= (unsigned)grid.samples[0]
+		|| (unsigned)pos[1] >= (unsigned)grid.samples[1]
+		|| (unsigned)pos[2] >= (unsigned)grid.samples[2] )
+	{
+		return nullptr;
+	}
+
+	const int brickX = pos[0] / LIGHTGRID_BRICK;
+	const int brickY = pos[1] / LIGHTGRID_BRICK;
+	const int brickZ = pos[2] / LIGHTGRID_BRICK;
+
+	const int32 brick = grid.brickIndex[( brickZ * grid.bricks[1] + brickY ) * grid.bricks[0] + brickX];
+	if ( brick < 0 ) {
+		return nullptr;
+	}
+
+	const int offset = ( ( pos[2] % LIGHTGRID_BRICK ) * LIGHTGRID_BRICK + ( pos[1] % LIGHTGRID_BRICK ) ) * LIGHTGRID_BRICK + ( pos[0] % LIGHTGRID_BRICK );
+	const dlightgridsample_t *sample = grid.brickSamples + (size_t)brick * LIGHTGRID_BRICK_SAMPLES + offset;
+
+	if ( ( sample->ambient[0] | sample->ambient[1] | sample->ambient[2] ) == 0 ) {
+		return nullptr;
+	}
+
+	return sample;
+}
+
+struct lightGridAngles_t
+{
+	float sinYaw[256], cosYaw[256];
+	float sinPitch[256], cosPitch[256];
+};
+
+static const lightGridAngles_t s_lightGridAngles = []()
+{
+	lightGridAngles_t angles;
+
+	for ( int i = 0; i < 256; ++i )
+	{
+		const float yaw = i * ( 2.0f * M_PI_F / 256.0f );
+		const float pitch = i * ( M_PI_F / 255.0f );
+
+		angles.sinYaw[i] = sinf( yaw );
+		angles.cosYaw[i] = cosf( yaw );
+		angles.sinPitch[i] = sinf( pitch );
+		angles.cosPitch[i] = cosf( pitch );
+	}
+
+	return angles;
+}();
+
+/*
+===================
+R_LightGridPoint
+
+Trilinear blend of the eight grid samples around p, in lightmap units. Samples
+in the solid are left out and the rest weighted back up, so models up against
+a wall don't go dark. Returns false if there's no grid or nothing usable near p
+===================
+*/
+bool R_LightGridPoint( const vec3_t p, vec3_t ambient, vec3_t directed, vec3_t dir )
+{
+	const mlightgrid_t &grid = r_worldmodel->lightgrid;
+
+	if ( !grid.brickIndex ) {
+		return false;
+	}
+
+	int base[3];
+	float frac[3];
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		const float v = ( p[i] - grid.origin[i] ) * grid.inverseCellsize[i];
+		const float f = floorf( v );
+
+		base[i] = (int)f;
+		frac[i] = v - f;
+	}
+
+	VectorClear( ambient );
+	VectorClear( directed );
+	VectorClear( dir );
+
+	float totalWeight = 0.0f;
+
+	for ( int corner = 0; corner < 8; ++corner )
+	{
+		int pos[3];
+		float weight = 1.0f;
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			const int bit = ( corner >> i ) & 1;
+
+			pos[i] = base[i] + bit;
+			weight *= bit ? frac[i] : 1.0f - frac[i];
+		}
+
+		if ( weight <= 0.0f ) {
+			continue;
+		}
+
+		const dlightgridsample_t *sample = R_LightGridSample( grid, pos );
+		if ( !sample ) {
+			continue;
+		}
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			ambient[i] += sample->ambient[i] * weight;
+			directed[i] += sample->directed[i] * weight;
+		}
+
+		// samples with more directed light get more say in where it comes from
+		const float dirWeight = weight * ( sample->directed[0] + sample->directed[1] + sample->directed[2] );
+		const int yaw = sample->latlong[0];
+		const int pitch = sample->latlong[1];
+
+		dir[0] += s_lightGridAngles.sinPitch[pitch] * s_lightGridAngles.cosYaw[yaw] * dirWeight;
+		dir[1] += s_lightGridAngles.sinPitch[pitch] * s_lightGridAngles.sinYaw[yaw] * dirWeight;
+		dir[2] += s_lightGridAngles.cosPitch[pitch] * dirWeight;
+
+		totalWeight += weight;
+	}
+
+	if ( totalWeight <= 0.0f ) {
+		return false;
+	}
+
+	const float scale = 1.0f / totalWeight;
+	VectorScale( ambient, scale, ambient );
+	VectorScale( directed, scale, directed );
+
+	if ( VectorNormalize( dir ) == 0.0f ) {
+		VectorSet( dir, 0.0f, 0.0f, 1.0f );
+	}
+
+	return true;
+}
+
+/*
+===================
+R_LightPointGrid
+
+What a floor under p would have in its lightmap, which is what the trace
+would have found, straight out of the grid
+===================
+*/
+static bool R_LightPointGrid( const vec3_t p, vec3_t color )
+{
+	vec3_t ambient, directed, dir;
+
+	if ( !R_LightGridPoint( p, ambient, directed, dir ) ) {
+		return false;
+	}
+
+	// the grid only has style 0 in it
+	const float facing = Max( dir[2], 0.0f );
+	const float modulate = r_modulate->GetFloat() * ( 1.0f / 255 );
+
+	for ( int i = 0; i < 3; ++i ) {
+		color[i] = ( ambient[i] + directed[i] * facing ) * modulate * tr.refdef.lightstyles[0].rgb[i];
+	}
+
+	return true;
+}
+
 /*
 ===================
 R_LightPoint
@@ -206,11 +412,8 @@ R_LightPoint
 */
 void R_LightPoint( const vec3_t p, vec3_t color )
 {
-	vec3_t		end;
-	float		r;
 	int			lnum;
 	dlight_t	*dl;
-	float		light;
 	vec3_t		dist;
 	float		add;
 	
@@ -219,26 +422,15 @@ void R_LightPoint( const vec3_t p, vec3_t color )
 		color[0] = color[1] = color[2] = 1.0f;
 		return;
 	}
-	
-	end[0] = p[0];
-	end[1] = p[1];
-	end[2] = p[2] - 2048;
-	
-	r = RecursiveLightPoint (r_worldmodel->nodes, p, end);
-	
-	if (r == -1)
-	{
-		VectorClear( color );
-	}
-	else
+
+	if ( !r_lightGrid->GetBool() || !R_LightPointGrid( p, color ) )
 	{
-		VectorCopy( pointcolor, color );
+		R_LightPointTrace( p, color );
 	}
 
 	//
 	// add dynamic lights
 	//
-	light = 0;
 	dl = tr.refdef.dlights;
 	for (lnum=0 ; lnum<tr.refdef.num_dlights ; lnum++, dl++)
 	{
@@ -256,6 +448,118 @@ void R_LightPoint( const vec3_t p, vec3_t color )
 	VectorScale (color, r_modulate->GetFloat(), color);
 }
 
+/*
+===================
+r_lightGridBench
+
+Lights random points in the open with the grid and with the trace down into
+the lightmaps, and compares the two
+===================
+*/
+CON_COMMAND( r_lightGridBench, "Compares the light grid against tracing into the lightmaps at random points. Usage: r_lightGridBench [points]", 0 )
+{
+	if ( !r_worldmodel || !tr.refdef.lightstyles )
+	{
+		Com_Print( S_COLOR_YELLOW "No map loaded, can't benchmark the light grid\n" );
+		return;
+	}
+
+	if ( !r_worldmodel->lightdata || !r_worldmodel->lightgrid.brickIndex )
+	{
+		Com_Print( S_COLOR_YELLOW "The map has no lightmaps or no light grid\n" );
+		return;
+	}
+
+	const int numPoints = Clamp( Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 10000, 1, 1000000 );
+
+	struct benchPoint_t
+	{
+		vec3_t origin;
+		vec3_t traced;
+		vec3_t gridded;
+		bool inGrid;
+	};
+
+	std::vector<benchPoint_t> points( numPoints );
+
+	// the same points every run, so runs can be compared
+	const mmodel_t &world = r_worldmodel->submodels[0];
+	uint32 seed = 0x9E3779B9u;
+	auto random = [&seed]()
+	{
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		return ( seed & 0xFFFFFF ) * ( 1.0f / 0xFFFFFF );
+	};
+
+	int found = 0;
+	for ( int attempt = 0; found < numPoints && attempt < numPoints * 64; ++attempt )
+	{
+		vec3_t &point = points[found].origin;
+		for ( int i = 0; i < 3; ++i ) {
+			point[i] = world.mins[i] + ( world.maxs[i] - world.mins[i] ) * random();
+		}
+
+		const mleaf_t *leaf = Mod_PointInLeaf( point, r_worldmodel );
+		if ( !( leaf->contents & CONTENTS_SOLID ) && leaf->cluster != -1 ) {
+			++found;
+		}
+	}
+
+	if ( found == 0 )
+	{
+		Com_Print( S_COLOR_YELLOW "Couldn't find any points in the open\n" );
+		return;
+	}
+
+	double start = Time_FloatMilliseconds();
+	for ( int i = 0; i < found; ++i ) {
+		R_LightPointTrace( points[i].origin, points[i].traced );
+	}
+	const double traceTime = Time_FloatMilliseconds() - start;
+
+	start = Time_FloatMilliseconds();
+	for ( int i = 0; i < found; ++i ) {
+		points[i].inGrid = R_LightPointGrid( points[i].origin, points[i].gridded );
+	}
+	const double gridTime = Time_FloatMilliseconds() - start;
+
+	int compared = 0;
+	double totalError = 0.0, totalSquaredError = 0.0, totalTraced = 0.0;
+	float maxError = 0.0f;
+
+	for ( int i = 0; i < found; ++i )
+	{
+		const benchPoint_t &point = points[i];
+		if ( !point.inGrid ) {
+			continue;
+		}
+
+		for ( int j = 0; j < 3; ++j )
+		{
+			const float error = fabsf( point.gridded[j] - point.traced[j] );
+
+			totalError += error;
+			totalSquaredError += error * error;
+			totalTraced += point.traced[j];
+			maxError = Max( maxError, error );
+		}
+		++compared;
+	}
+
+	Com_Printf( "%d points, %d outside the grid\n", found, found - compared );
+	Com_Printf( "trace: %.4f us/point\n", traceTime * 1000.0 / found );
+	Com_Printf( "grid:  %.4f us/point\n", gridTime * 1000.0 / found );
+
+	if ( compared )
+	{
+		const double channels = compared * 3.0;
+
+		Com_Printf( "mean trace colour %.4f, mean error %.4f, rms error %.4f, max error %.4f\n",
+			totalTraced / channels, totalError / channels, sqrt( totalSquaredError / channels ), maxError );
+	}
+}
 
 //===================================================================
 
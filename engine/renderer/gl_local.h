@@ -101,12 +101,14 @@ struct perfCounters_t
 {
 	uint32		worldPolys;
 	uint32		worldDrawCalls;
+	uint32		worldIndicesUploaded;
 	uint32		aliasPolys;
 
 	void Reset()
 	{
 		worldPolys = 0;
 		worldDrawCalls = 0;
+		worldIndicesUploaded = 0;
 		aliasPolys = 0;
 	}
 };
@@ -129,6 +131,8 @@ struct renderSystemGlobals_t
 
 	GLuint debugMeshVAO;
 	GLuint debugMeshVBO;
+
+	memFrameArena_t frameArena;				// scratch memory that lives for two frames, swapped in R_BeginFrame
 };
 
 extern glState_t				glState;
@@ -144,6 +148,8 @@ extern cvar_t *r_norefresh;
 extern cvar_t *r_drawentities;
 extern cvar_t *r_drawworld;
 extern cvar_t *r_drawlights;
+extern cvar_t *r_lightCache;
+extern cvar_t *r_lightGrid;
 extern cvar_t *r_speeds;
 extern cvar_t *r_fullbright;
 extern cvar_t *r_novis;
@@ -205,6 +211,9 @@ extern	cplane_t	frustum[4];
 //
 extern	int		r_viewcluster, r_viewcluster2, r_oldviewcluster, r_oldviewcluster2;
 
+void R_SetupFrame();
+void R_SetFrustum();
+
 // needed by gl_init
 void Particles_Init();
 void Particles_Shutdown();
@@ -228,7 +237,7 @@ struct renderLight_t
 	float intensity;
 };
 
-void R_FourNearestLights( vec3_t origin, renderLight_t *finalLights, vec3_t ambientColor );
+void R_FourNearestLights( vec3_t origin, int entnum, renderLight_t *finalLights, vec3_t ambientColor );
 
 /*
 ===============================================================================
@@ -401,6 +410,7 @@ struct material_t
 void	R_MarkLights( dlight_t *light, int bit, mnode_t *node );
 void	R_PushDlights();
 void	R_LightPoint( const vec3_t p, vec3_t color );
+bool	R_LightGridPoint( const vec3_t p, vec3_t ambient, vec3_t directed, vec3_t dir );
 
 /*
 ===============================================================================
@@ -442,6 +452,13 @@ struct worldRenderData_t
 	material_t *lastMaterial;		// This is used when building the vector below
 	std::vector<worldMesh_t>	meshes;
 
+	std::vector<mtexinfo_t *>	materialTexinfos;	// A texinfo for each dense material index
+
+	// Node then leaf bounds as structure of arrays for R_CullWorldNodes, padded to a whole vector
+	std::vector<float>			nodeMins[3];
+	std::vector<float>			nodeMaxs[3];
+	std::vector<uint32>			subtreeSurfaces;	// Surfaces on each node and every node below it
+
 	GLuint vao, vbo, ebo, eboSubmodels;
 	GLuint lightmapTexnum;
 
@@ -452,6 +469,7 @@ extern worldRenderData_t g_worldData;
 
 void	R_DrawBrushModel( entity_t *e );
 void	R_DrawWorld();
+void	R_RecordCameraFrame();		// For r_recordCameraPath
 void	R_DrawAlphaSurfaces();
 void	R_RotateForEntity( entity_t *e );
 
@@ -520,7 +520,7 @@ static StaticCvar r_lockfrustum( "r_lockfrustum", "0", 0 );
 R_SetFrustum
 ========================
 */
-static void R_SetFrustum()
+void R_SetFrustum()
 {
 	if ( r_lockfrustum.GetBool() )
 	{
@@ -568,7 +568,7 @@ static void R_SetFrustum()
 R_SetupFrame
 ========================
 */
-static void R_SetupFrame()
+void R_SetupFrame()
 {
 	ZoneScoped
 
@@ -731,6 +731,8 @@ static void R_RenderView( refdef_t *fd )
 
 	R_SetFrustum();
 
+	R_RecordCameraFrame();
+
 	// reset state
 	R_SetupGL();
 
@@ -854,6 +856,8 @@ void R_BeginFrame( bool imgui, int frameBuffer )
 {
 	GLimp_BeginFrame();
 
+	Mem_FrameArenaSwap( tr.frameArena );
+
 	// check if we need to set modes
 	R_SetMode();
 
@@ -8,8 +8,6 @@
 
 #include "gl_local.h"
 
-#include <vector>
-
 /*
 ===================================================================================================
 
@@ -18,6 +16,19 @@
 ===================================================================================================
 */
 
+#define MAX_CACHED_LIGHTS	32		// nearest visible lights kept for each entity
+
+// the lights an entity could see from where it entered its current leaf
+struct entityLights_t
+{
+	int		sequence;				// mod_lightIndexSequence when it was built
+	int		leaf;
+	int		numLights;
+	int		lights[MAX_CACHED_LIGHTS];
+};
+
+static entityLights_t	s_entityLights[MAX_EDICTS];
+
 static trace_t R_LightTrace( vec3_t start, vec3_t end )
 {
 	vec3_t mins{}, maxs{};
@@ -25,7 +36,89 @@ static trace_t R_LightTrace( vec3_t start, vec3_t end )
 	return CM_BoxTrace( start, end, mins, maxs, 0, MASK_OPAQUE );
 }
 
-void R_FourNearestLights( vec3_t origin, renderLight_t *finalLights, vec3_t ambientColor )
+/*
+========================
+R_NearestLights
+
+Top-k selection of the lights closest to origin, nearest first. Lights the same
+distance away keep their order in the list
+========================
+*/
+static int R_NearestLights( const vec3_t origin, const int *lights, int numLights, int *nearest, int k )
+{
+	float distances[MAX_CACHED_LIGHTS];
+	int count = 0;
+
+	for ( int i = 0; i < numLights; ++i )
+	{
+		vec3_t delta;
+		VectorSubtract( mod_staticLights[lights[i]].origin, origin, delta );
+		const float distance = DotProduct( delta, delta );
+
+		if ( count == k && distance >= distances[k - 1] ) {
+			continue;
+		}
+
+		// the last one falls off the end when full
+		int slot = Min( count, k - 1 );
+		for ( ; slot > 0 && distance < distances[slot - 1]; --slot )
+		{
+			distances[slot] = distances[slot - 1];
+			nearest[slot] = nearest[slot - 1];
+		}
+
+		distances[slot] = distance;
+		nearest[slot] = lights[i];
+
+		if ( count < k ) {
+			++count;
+		}
+	}
+
+	return count;
+}
+
+/*
+========================
+R_VisibleLights
+
+The nearest lights in the PVS of leaf that origin has a clear line to
+========================
+*/
+static int R_VisibleLights( vec3_t origin, const mleaf_t *leaf, int *lights, int maxLights )
+{
+	if ( leaf->cluster == -1 || !mod_lightClusters ) {
+		return 0;
+	}
+
+	const lightCluster_t &cluster = mod_lightClusters[r_worldmodel->vis ? leaf->cluster : 0];
+
+	static int visible[MAX_ENTITIES];
+	int numVisible = 0;
+
+	for ( int i = 0; i < cluster.numLights; ++i )
+	{
+		const int index = mod_lightClusterIndices[cluster.firstLight + i];
+
+		// TODO: is this really necessary?
+		trace_t trace = R_LightTrace( origin, mod_staticLights[index].origin );
+		if ( trace.fraction == 1.0f ) {
+			visible[numVisible++] = index;
+		}
+	}
+
+	return R_NearestLights( origin, visible, numVisible, lights, maxLights );
+}
+
+/*
+========================
+R_FourNearestLights
+
+Entities that say which they are keep their visible lights while they stay in
+the same leaf, so they only pay for the traces when they cross into another one
+========================
+*/
+void R_FourNearestLights( vec3_t origin, int entnum, renderLight_t *finalLights, vec3_t ambientColor )
 {
 	memset( finalLights, 0, sizeof( renderLight_t ) * MAX_LIGHTS );
 
@@ -33,72 +126,54 @@ void R_FourNearestLights( vec3_t origin, renderLight_t *finalLights, vec3_t ambi
 	{
 		R_LightPoint( origin, ambientColor );
 
-		// build a list of all lights in our PVS
-
-		std::vector<staticLight_t> lightsInPVS;
-		lightsInPVS.reserve( 32 );
+		const mleaf_t *leaf = Mod_PointInLeaf( origin, r_worldmodel );
 
-		trace_t trace;
+		int uncached[MAX_CACHED_LIGHTS];
+		const int *lights = uncached;
+		int numLights;
 
-		for ( int i = 0; i < mod_numStaticLights; ++i )
+		if ( entnum > 0 && entnum < MAX_EDICTS && r_lightCache->GetBool() )
 		{
-			// hack into the server code, this doesn't call any server functions so we're safe, it's just a wrapper
-			extern qboolean PF_inPVS( vec3_t p1, vec3_t p2 );
+			entityLights_t &cache = s_entityLights[entnum];
+			const int leafnum = (int)( leaf - r_worldmodel->leafs );
 
-			if ( PF_inPVS( origin, mod_staticLights[i].origin ) )
+			if ( cache.sequence != mod_lightIndexSequence || cache.leaf != leafnum )
 			{
-				// TODO: is this really necessary?
-				trace = R_LightTrace( origin, mod_staticLights[i].origin );
-				if ( trace.fraction == 1.0f )
-				{
-					lightsInPVS.push_back( mod_staticLights[i] );
-				}
+				cache.sequence = mod_lightIndexSequence;
+				cache.leaf = leafnum;
+				cache.numLights = R_VisibleLights( origin, leaf, cache.lights, MAX_CACHED_LIGHTS );
 			}
-		}
 
-		if ( lightsInPVS.size() != 0 )
+			lights = cache.lights;
+			numLights = cache.numLights;
+		}
+		else
 		{
-			int skipIndices[MAX_LIGHTS]{ -1, -1, -1, -1 };
+			numLights = R_VisibleLights( origin, leaf, uncached, MAX_CACHED_LIGHTS );
+		}
 
-			// for all the lights in our PVS, find the four values that have the shortest distance to the origin, do this MAX_LIGHTS times
-			for ( int iter1 = 0; iter1 < MAX_LIGHTS && iter1 < (int)lightsInPVS.size(); ++iter1 )
-			{
-				float smallestDistance = MAX_TRACE_LENGTH;
-				int smallestIndex = 0;
+		// doors can close areas off at any time, so that's checked every frame
+		int connected[MAX_CACHED_LIGHTS];
+		int numConnected = 0;
 
-				// in all our PVS lights, find the smallest distance, then mark it as skippable
-				for ( int iter2 = 0; iter2 < (int)lightsInPVS.size(); ++iter2 )
-				{
-					float distance = VectorDistance( origin, lightsInPVS[iter2].origin );
-					if ( distance < smallestDistance )
-					{
-						bool skip = false;
-						// check our skip indices
-						for ( int iter3 = 0; iter3 < MAX_LIGHTS; ++iter3 )
-						{
-							if ( skipIndices[iter3] == iter2 )
-							{
-								skip = true;
-							}
-						}
-						if ( !skip )
-						{
-							smallestDistance = distance;
-							smallestIndex = iter2;
-						}
-					}
-				}
+		for ( int i = 0; i < numLights; ++i )
+		{
+			if ( CM_AreasConnected( leaf->area, mod_staticLights[lights[i]].area ) ) {
+				connected[numConnected++] = lights[i];
+			}
+		}
 
-				// mark off the smallest index
-				skipIndices[iter1] = smallestIndex;
+		int nearest[MAX_LIGHTS];
+		const int numNearest = R_NearestLights( origin, connected, numConnected, nearest, MAX_LIGHTS );
 
-				renderLight_t &finalLight = finalLights[iter1];
-				const staticLight_t &staticLight = lightsInPVS[smallestIndex];
+		for ( int i = 0; i < numNearest; ++i )
+		{
+			renderLight_t &finalLight = finalLights[i];
+			const staticLight_t &staticLight = mod_staticLights[nearest[i]];
 
-				VectorCopy( staticLight.origin, finalLight.position );
-				VectorCopy( staticLight.color, finalLight.color );
-				finalLight.intensity = static_cast<float>( staticLight.intensity ); // compensate
-			}
+			VectorCopy( staticLight.origin, finalLight.position );
+			VectorCopy( staticLight.color, finalLight.color );
+			finalLight.intensity = static_cast<float>( staticLight.intensity ); // compensate
 		}
 	}
 	else
@@ -737,7 +812,7 @@ void R_DrawStaticMeshFile( entity_t *e )
 
 	vec3_t ambientColor;
 	renderLight_t finalLights[MAX_LIGHTS];
-	R_FourNearestLights( e->origin, finalLights, ambientColor );
+	R_FourNearestLights( e->origin, e->entnum, finalLights, ambientColor );
 
 	GL_UseProgram( glProgs.smfMeshProg );
 
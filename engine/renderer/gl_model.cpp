@@ -10,6 +10,9 @@
 
 #include "iqm.h"
 
+#include <bit>
+#include <vector>
+
 #define	MAX_MOD_KNOWN 1024
 
 // delete me
@@ -38,6 +41,10 @@ static model_t	mod_inline[MAX_MOD_KNOWN];
 staticLight_t	mod_staticLights[MAX_ENTITIES];
 int				mod_numStaticLights;
 
+lightCluster_t *	mod_lightClusters;
+int *				mod_lightClusterIndices;
+int					mod_lightIndexSequence;
+
 /*
 ========================
 Mod_PointInLeaf
@@ -175,7 +182,6 @@ Loads in a model for the given name
 model_t *Mod_ForName( const char *name, bool crash )
 {
 	model_t *	pMod;
-	void *		pBuffer;
 	int			i;
 
 	if ( !name[0] ) {
@@ -230,8 +236,7 @@ model_t *Mod_ForName( const char *name, bool crash )
 	//
 	// load the file
 	//
-	fsSize_t bufferLength = FileSystem::LoadFile( pMod->name, (void **)&pBuffer );
-	if ( !pBuffer )
+	if ( !FileSystem::MapFile( pMod->name, pMod->file ) )
 	{
 		if ( crash ) {
 			Com_Errorf( "Mod_NumForName: %s not found", pMod->name );
@@ -240,6 +245,10 @@ model_t *Mod_ForName( const char *name, bool crash )
 		return NULL;
 	}
 
+	// the loaders only ever read from the file
+	void *pBuffer = const_cast<byte *>( pMod->file.data );
+	fsSize_t bufferLength = pMod->file.size;
+
 	loadmodel = pMod;
 
 	//
@@ -284,7 +293,11 @@ model_t *Mod_ForName( const char *name, bool crash )
 
 	loadmodel->extradatasize = Hunk_End();
 
-	FileSystem::FreeFile( pBuffer );
+	// brush models keep the file around for the lumps they read in place
+	if ( pMod->type != mod_brush || pMod->file.loaded )
+	{
+		FileSystem::UnmapFile( pMod->file );
+	}
 
 	return pMod;
 }
@@ -299,6 +312,13 @@ model_t *Mod_ForName( const char *name, bool crash )
 
 static byte *mod_base;
 
+// Lumps that are already in the runtime layout can be used straight out of
+// the mapped file, but not out of a heap copy we don't want to hold on to
+static bool Mod_InPlace()
+{
+	return std::endian::native == std::endian::little && !loadmodel->file.loaded;
+}
+
 /*
 ========================
 Mod_LoadLighting
@@ -311,10 +331,101 @@ static void Mod_LoadLighting (lump_t *l)
 		loadmodel->lightdata = NULL;
 		return;
 	}
+	if ( Mod_InPlace() )
+	{
+		loadmodel->lightdata = mod_base + l->fileofs;
+		return;
+	}
 	loadmodel->lightdata = (byte*)Hunk_Alloc ( l->filelen);	
 	memcpy (loadmodel->lightdata, mod_base + l->fileofs, l->filelen);
 }
 
+/*
+========================
+Mod_LoadLightGrid
+
+Maps from before the light grid have nothing in this lump, or a POP lump, so
+anything that doesn't check out just leaves the model without one
+========================
+*/
+static void Mod_LoadLightGrid( lump_t *l )
+{
+	mlightgrid_t &grid = loadmodel->lightgrid;
+	memset( &grid, 0, sizeof( grid ) );
+
+	if ( l->filelen < (int)sizeof( dlightgrid_t ) ) {
+		return;
+	}
+
+	const dlightgrid_t *in = (const dlightgrid_t *)( mod_base + l->fileofs );
+
+	if ( LittleLong( in->ident ) != LIGHTGRID_IDENT || LittleLong( in->version ) != LIGHTGRID_VERSION ) {
+		Com_DPrintf( "Mod_LoadLightGrid: %s has no light grid\n", loadmodel->name );
+		return;
+	}
+
+	int64 totalBricks = 1;
+	for ( int i = 0; i < 3; ++i )
+	{
+		const float cellsize = LittleFloat( in->cellsize[i] );
+
+		grid.origin[i] = LittleFloat( in->origin[i] );
+		grid.bricks[i] = LittleLong( in->bricks[i] );
+		grid.samples[i] = grid.bricks[i] * LIGHTGRID_BRICK;
+
+		if ( !( cellsize > 0.0f ) || grid.bricks[i] <= 0 || grid.bricks[i] > 65536 ) {
+			Com_Printf( S_COLOR_YELLOW "Mod_LoadLightGrid: %s has a bad light grid\n", loadmodel->name );
+			return;
+		}
+
+		grid.inverseCellsize[i] = 1.0f / cellsize;
+		totalBricks *= grid.bricks[i];
+	}
+
+	grid.numbricks = LittleLong( in->numbricks );
+
+	const int64 indexSize = totalBricks * (int64)sizeof( int32 );
+	const int64 samplesSize = (int64)grid.numbricks * LIGHTGRID_BRICK_SAMPLES * (int64)sizeof( dlightgridsample_t );
+
+	if ( grid.numbricks < 0 || (int64)sizeof( dlightgrid_t ) + indexSize + samplesSize != l->filelen ) {
+		Com_Printf( S_COLOR_YELLOW "Mod_LoadLightGrid: %s has a bad light grid\n", loadmodel->name );
+		return;
+	}
+
+	const int32 *index = (const int32 *)( in + 1 );
+	const dlightgridsample_t *samples = (const dlightgridsample_t *)( index + totalBricks );
+
+	for ( int64 i = 0; i < totalBricks; ++i )
+	{
+		const int32 brick = LittleLong( index[i] );
+		if ( brick < -1 || brick >= grid.numbricks ) {
+			Com_Printf( S_COLOR_YELLOW "Mod_LoadLightGrid: %s has a bad light grid\n", loadmodel->name );
+			return;
+		}
+	}
+
+	if ( Mod_InPlace() )
+	{
+		grid.brickIndex = index;
+		grid.brickSamples = samples;
+	}
+	else
+	{
+		int32 *outIndex = (int32 *)Hunk_Alloc( indexSize );
+		for ( int64 i = 0; i < totalBricks; ++i ) {
+			outIndex[i] = LittleLong( index[i] );
+		}
+
+		dlightgridsample_t *outSamples = (dlightgridsample_t *)Hunk_Alloc( Max( samplesSize, (int64)1 ) );
+		memcpy( outSamples, samples, samplesSize );
+
+		grid.brickIndex = outIndex;
+		grid.brickSamples = outSamples;
+	}
+
+	Com_DPrintf( "Mod_LoadLightGrid: %d x %d x %d bricks, %d stored\n", grid.bricks[0], grid.bricks[1], grid.bricks[2], grid.numbricks );
+}
+
 /*
 ========================
 Mod_LoadVisibility
@@ -329,6 +440,11 @@ static void Mod_LoadVisibility (lump_t *l)
 		loadmodel->vis = NULL;
 		return;
 	}
+	if ( Mod_InPlace() )
+	{
+		loadmodel->vis = (dvis_t *)( mod_base + l->fileofs );
+		return;
+	}
 	loadmodel->vis = (dvis_t*)Hunk_Alloc ( l->filelen);	
 	memcpy (loadmodel->vis, mod_base + l->fileofs, l->filelen);
 
@@ -808,10 +924,17 @@ static void Mod_LoadSurfedges (lump_t *l)
 		Com_Errorf ("MOD_LoadBmodel: bad surfedges count in %s: %i",
 		loadmodel->name, count);
 
+	loadmodel->numsurfedges = count;
+
+	if ( Mod_InPlace() )
+	{
+		loadmodel->surfedges = in;
+		return;
+	}
+
 	out = (int*)Hunk_Alloc ( count*sizeof(*out));	
 
 	loadmodel->surfedges = out;
-	loadmodel->numsurfedges = count;
 
 	for ( i=0 ; i<count ; i++)
 		out[i] = LittleLong (in[i]);
@@ -1002,6 +1125,59 @@ static void Mod_ParseLights( char *entString )
 	}
 }
 
+/*
+========================
+Mod_BuildLightIndex
+
+Lists the static lights each cluster can see, so lighting a model only has to
+look at the lights in its own cluster's list. Needs the leafs and the lights
+========================
+*/
+static void Mod_BuildLightIndex( model_t *pMod )
+{
+	for ( int i = 0; i < mod_numStaticLights; ++i )
+	{
+		staticLight_t &light = mod_staticLights[i];
+		const mleaf_t *leaf = Mod_PointInLeaf( light.origin, pMod );
+
+		light.cluster = leaf->cluster;
+		light.area = leaf->area;
+	}
+
+	// without vis every cluster sees everything, so they can all share a list
+	const int numClusters = pMod->vis ? pMod->vis->numclusters : 1;
+
+	mod_lightClusters = (lightCluster_t *)Hunk_Alloc( numClusters * sizeof( lightCluster_t ) );
+
+	std::vector<int> indices;
+
+	for ( int cluster = 0; cluster < numClusters; ++cluster )
+	{
+		const byte *pvs = Mod_ClusterPVS( pMod->vis ? cluster : -1, pMod );
+
+		mod_lightClusters[cluster].firstLight = (int)indices.size();
+
+		for ( int i = 0; i < mod_numStaticLights; ++i )
+		{
+			const int lightCluster = mod_staticLights[i].cluster;
+
+			// lights stuck in the void can't be seen from anywhere
+			if ( lightCluster != -1 && ( pvs[lightCluster >> 3] & ( 1 << ( lightCluster & 7 ) ) ) ) {
+				indices.push_back( i );
+			}
+		}
+
+		mod_lightClusters[cluster].numLights = (int)indices.size() - mod_lightClusters[cluster].firstLight;
+	}
+
+	mod_lightClusterIndices = (int *)Hunk_Alloc( Max( indices.size(), (size_t)1 ) * sizeof( int ) );
+	memcpy( mod_lightClusterIndices, indices.data(), indices.size() * sizeof( int ) );
+
+	++mod_lightIndexSequence;
+
+	Com_DPrintf( "Mod_BuildLightIndex: %d lights, %d clusters, %d entries\n", mod_numStaticLights, numClusters, (int)indices.size() );
+}
+
 /*
 ========================
 Mod_LoadBrushModel
@@ -1031,6 +1207,7 @@ void Mod_LoadBrushModel( model_t *pMod, void *pBuffer, int bufferLength )
 	Mod_LoadEdges			( header->lumps + LUMP_EDGES );
 	Mod_LoadSurfedges		( header->lumps + LUMP_SURFEDGES );
 	Mod_LoadLighting		( header->lumps + LUMP_LIGHTING );
+	Mod_LoadLightGrid		( header->lumps + LUMP_LIGHTGRID );
 	Mod_LoadPlanes			( header->lumps + LUMP_PLANES );
 	Mod_LoadTexinfo			( header->lumps + LUMP_TEXINFO );
 	Mod_LoadFaces			( header->lumps + LUMP_FACES );
@@ -1042,6 +1219,7 @@ void Mod_LoadBrushModel( model_t *pMod, void *pBuffer, int bufferLength )
 
 	// Parse lights out of the entity data... This uses the client bsp...
 	Mod_ParseLights( CM_EntityString() );
+	Mod_BuildLightIndex( pMod );
 
 	// Regular and alternate animation
 	pMod->numframes = 2;
@@ -1347,6 +1525,7 @@ Mod_Free
 void Mod_Free( model_t *pModel )
 {
 	Hunk_Free( pModel->extradata );
+	FileSystem::UnmapFile( pModel->file );
 	memset( pModel, 0, sizeof( *pModel ) );
 }
 
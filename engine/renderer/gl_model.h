@@ -47,6 +47,7 @@ struct mtexinfo_t
 	int32		numframes;
 	mtexinfo_t	*next;		// animation chain
 	material_t	*material;
+	uint32		materialIndex;	// dense index of the material in the world, see R_IndexWorldMaterials
 };
 
 #define	VERTEXSIZE	7
@@ -153,6 +154,25 @@ struct mSMF_t
 };
 
 
+//=================================================================================================
+
+//
+// Light grid
+//
+
+// the irradiance lattice qrad writes into LUMP_LIGHTGRID, see dlightgrid_t
+struct mlightgrid_t
+{
+	vec3_t		origin;
+	vec3_t		inverseCellsize;
+	int32		samples[3];		// size of the grid in samples
+	int32		bricks[3];
+	int32		numbricks;
+
+	const int32 *				brickIndex;		// null if the map has no grid
+	const dlightgridsample_t *	brickSamples;
+};
+
 //=================================================================================================
 
 //
@@ -218,11 +238,16 @@ struct model_t
 
 	byte		*lightdata;
 
+	mlightgrid_t	lightgrid;
+
 	// for alias models and skins
 	material_t	*skins[MAX_MD2SKINS];
 
 	size_t		extradatasize;
 	void *		extradata;
+
+	// brush models point some of their lumps straight into the file
+	FileSystem::mappedFile_t	file;
 };
 
 struct staticLight_t
@@ -230,11 +255,24 @@ struct staticLight_t
 	vec3_t origin;
 	vec3_t color;
 	uint32 intensity;	// 0 - 1
+	int cluster;		// where the light is, filled in by Mod_BuildLightIndex
+	int area;
+};
+
+// the static lights in each cluster's PVS, as a run of indices into mod_staticLights
+struct lightCluster_t
+{
+	int firstLight;
+	int numLights;
 };
 
 extern staticLight_t	mod_staticLights[MAX_ENTITIES];
 extern int				mod_numStaticLights;
 
+extern lightCluster_t *	mod_lightClusters;			// one per cluster, or just one without vis
+extern int *			mod_lightClusterIndices;
+extern int				mod_lightIndexSequence;		// bumped every time the index is built
+
 //-------------------------------------------------------------------------------------------------
 
 void		Mod_Init();
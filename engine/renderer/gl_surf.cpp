@@ -14,6 +14,8 @@
 #include "gl_local.h"
 
 #include "../shared/imgtools.h"
+#include "../../core/jobs.h"
+#include "../../core/simd.h"
 #include <algorithm> // std::sort
 #include <vector>
 
@@ -57,16 +59,13 @@
 
 worldRenderData_t g_worldData;
 
+// Lives in the frame arena
 struct worldLists_t
 {
-	std::vector<worldIndex_t>	finalIndices;		// Indices into the render data used to draw the PVS
-	std::vector<worldMesh_t>	opaqueMeshes;		// Each worldMesh_t is a draw call
-
-	void ClearAllLists()
-	{
-		finalIndices.clear();
-		opaqueMeshes.clear();
-	}
+	worldIndex_t *	finalIndices;		// Indices into the render data used to draw the PVS
+	uint32			numFinalIndices;
+	worldMesh_t *	opaqueMeshes;		// Each worldMesh_t is a draw call
+	uint32			numOpaqueMeshes;
 };
 
 static vec3_t modelorg;		// relative to viewpoint
@@ -326,19 +325,47 @@ e->angles[2] = -e->angles[2];	// stupid quake bug
 ===================================================================================================
 */
 
-// When recursing the BSP tree we give each material its own array of indices, then
-// when we finish, we append them all into one large array which we send to the GPU
-struct worldMaterialSet_t
+// When recursing the BSP tree we bucket the visible surfaces by their dense material index (see
+// R_IndexWorldMaterials), then when we finish, we copy their indices into one large array,
+// material by material. Materials always come out in the same order so the lists of nearby
+// views share most of the index buffer. Everything is allocated up front from the frame arena
+struct worldNodeWork_t
 {
-	mtexinfo_t *texinfo;
-	std::vector<worldIndex_t> indices;
+	uint32 *				materialCounts;		// Visible indices per material
+	uint32 *				writeIndices;		// Where the next surface of each material goes in the final indices
+
+	const msurface_t **		surfaces;			// Visible surfaces in the order they were found
+	uint32					numSurfaces;
+
+	const msurface_t **		skySurfaces;		// Replayed into R_AddSkySurface every frame
+	uint32					numSkySurfaces;
+
+	bool					cull;				// Frustum and backface culling, off for cached lists
 };
 
-struct worldNodeWork_t
+// The lists we draw. With r_cacheWorldLists they hold everything in the PVS and connected areas,
+// which only changes with the view cluster or areabits, so most frames reuse them as they are
+// and leave frustum and backface culling to the GPU
+struct worldListCache_t
 {
-	std::vector<worldMaterialSet_t> materialSets;
+	bool							valid;			// False if the lists were culled to one view
+	int								visCount;		// tr.visCount the lists were built for
+	byte							areabits[MAX_MAP_AREAS / 8];
+
+	std::vector<worldMesh_t>		opaqueMeshes;
+	std::vector<const msurface_t *>	skySurfaces;
+
+	// A copy of the index buffer, new lists are diffed against it so only what changed is uploaded
+	std::vector<worldIndex_t>		indices;
+	uint32							capacity;		// Size of the index buffer, in indices
+	uint32							dirtyFirst, dirtyEnd;
+	bool							reallocate;
 };
 
+static worldListCache_t s_worldListCache;
+
+static StaticCvar r_cacheWorldLists( "r_cacheWorldLists", "1", 0, "Reuse the world lists while the view cluster and areabits stay the same." );
+
 // Mark the leaves and nodes that are in the PVS for the current cluster
 static void R_MarkLeaves()
 {
@@ -442,56 +469,23 @@ static void R_MarkLeaves()
 #endif
 }
 
-static void R_AddSurfaceToMaterialSet( const msurface_t *surf, worldMaterialSet_t &materialSet )
+static void R_AddSurface( const msurface_t *surf, worldNodeWork_t &work )
 {
 	if ( surf->texinfoFlags & SURF_SKY )
 	{
-		R_AddSkySurface( surf );
+		work.skySurfaces[work.numSkySurfaces++] = surf;
 		return;
 	}
 
-	const auto begin = g_worldData.indices.begin() + surf->firstIndex;
-	const auto end = begin + surf->numIndices;
-
-	materialSet.indices.insert( materialSet.indices.end(), begin, end );
+	work.surfaces[work.numSurfaces++] = surf;
 
-	//Assert( !( materialSet.indices.size() % 3 ) );
-}
-
-static void R_AddSurface( const msurface_t *surf, worldNodeWork_t &work )
-{
-#if 1
-	bool added = false;
-	for ( worldMaterialSet_t &materialSet : work.materialSets )
-	{
-		if ( materialSet.texinfo->material == surf->texinfo->material )
-		{
-			// Insert into this material set
-			R_AddSurfaceToMaterialSet( surf, materialSet );
-			added = true;
-		}
-	}
-	if ( !added )
-	{
-		// Create a new material set
-		worldMaterialSet_t &materialSet = work.materialSets.emplace_back();
-		materialSet.texinfo = surf->texinfo;
-		R_AddSurfaceToMaterialSet( surf, materialSet );
-	}
-#else
-	glBegin( GL_TRIANGLES );
-	for ( uint32 i = surf->firstIndex; i < surf->firstIndex + surf->numIndices; ++i )
-	{
-		const worldVertex_t &vertex = g_worldData.vertices[g_worldData.indices[i]];
-		glVertex3fv( (float *)&vertex.pos );
-	}
-	glEnd();
-#endif
+	work.materialCounts[surf->texinfo->materialIndex] += surf->numIndices;
 }
 
 //
 // Recurses down the BSP tree inserting surfaces that need to be drawn
-// into the world lists from back to front (TODO: make it front to back)
+// into the world lists from front to back. Replaced by R_TraverseWorld,
+// kept as the reference r_worldTraversalBench checks it against
 //
 static void R_RecursiveWorldNode( worldNodeWork_t &work, const mnode_t *node )
 {
@@ -510,7 +504,7 @@ static void R_RecursiveWorldNode( worldNodeWork_t &work, const mnode_t *node )
 		}
 
 		// Frustum cull
-		if ( R_CullBox( node->mins, node->maxs ) ) {
+		if ( work.cull && R_CullBox( node->mins, node->maxs ) ) {
 			return;
 		}
 
@@ -589,63 +583,646 @@ static void R_RecursiveWorldNode( worldNodeWork_t &work, const mnode_t *node )
 				continue;
 			}
 
-			if ( ( surf->flags & MSURF_PLANEBACK ) != sidebit )
+			if ( work.cull && ( surf->flags & MSURF_PLANEBACK ) != sidebit )
 			{
 				// Surface is facing away from us
 				continue;
 			}
 
-			R_AddSurface( surf, work );
+			R_AddSurface( surf, work );
+		}
+
+		// Recurse down the back side
+		// We can prevent a recursion by just using this while loop
+		//R_RecursiveWorldNode( work, node->children[!side] );
+		node = node->children[!side];
+	}
+}
+
+/*
+===================================================================================================
+
+	Parallel world traversal
+
+	R_TraverseWorld finds the same surfaces as R_RecursiveWorldNode, in the same order, in two
+	passes over the same subtrees. Every node and leaf is frustum culled up front, a vector at a
+	time, from the flattened bounds. The top of the tree is then cut into subtrees, each worker
+	marks the surfaces of the visible leaves in its subtrees into its own bitset, and once the
+	bitsets are merged each subtree writes its visible node surfaces, front to back, into its
+	own slice of the output. Stitching the slices back together in tree order gives the list
+	the recursive walk would have made.
+
+	R_RecursiveWorldNode adds the surfaces of a node before walking its back side, so it could
+	only ever see marks from in front of it. That's harmless when backfaces are culled, as the
+	back side can only mark surfaces facing away, but the cached lists draw those too.
+
+===================================================================================================
+*/
+
+static StaticCvar r_parallelWorld( "r_parallelWorld", "1", 0, "Traverse the world on the job pool." );
+
+// Enough subtrees for the job pool to balance out, without the bitsets getting silly
+#define MAX_TRAVERSAL_SPLIT_DEPTH	8
+
+// Nodes frustum culled per job
+#define CULL_BATCH_SIZE				2048
+
+struct worldTraversalTask_t
+{
+	const mnode_t *	node;
+	int				sidebit;			// Only used by emitOnly
+	bool			emitOnly;			// Just the node's own surfaces, its children are other tasks
+
+	uint32			firstSurface;		// Where this task writes in worldTraversal_t::surfaces
+	uint32			numSurfaces;
+};
+
+struct worldTraversal_t
+{
+	const byte *			culled;				// Per node then leaf, null to skip frustum culling
+	bool					backfaceCull;
+
+	worldTraversalTask_t *	tasks;				// In tree order
+	uint32					numTasks;
+
+	uint64 *				visibleSurfaces;	// One bit per surface
+	const msurface_t **		surfaces;
+};
+
+static uint32 R_WorldNodeIndex( const mnode_t *node )
+{
+	if ( node->contents != -1 )
+	{
+		return static_cast<uint32>( r_worldmodel->numnodes + ( reinterpret_cast<const mleaf_t *>( node ) - r_worldmodel->leafs ) );
+	}
+
+	return static_cast<uint32>( node - r_worldmodel->nodes );
+}
+
+//
+// Flattens the bounds of every node and leaf for R_CullWorldNodes and
+// counts the surfaces under each node, called at load
+//
+static uint32 R_CountSubtreeSurfaces_r( const model_t *worldModel, const mnode_t *node )
+{
+	if ( node->contents != -1 )
+	{
+		return 0;
+	}
+
+	const uint32 numSurfaces = node->numsurfaces
+		+ R_CountSubtreeSurfaces_r( worldModel, node->children[0] )
+		+ R_CountSubtreeSurfaces_r( worldModel, node->children[1] );
+
+	g_worldData.subtreeSurfaces[node - worldModel->nodes] = numSurfaces;
+
+	return numSurfaces;
+}
+
+static void R_FlattenWorldNodes( const model_t *worldModel )
+{
+	const uint32 numNodes = static_cast<uint32>( worldModel->numnodes );
+	const uint32 numBounds = numNodes + static_cast<uint32>( worldModel->numleafs );
+	const uint32 paddedBounds = ( numBounds + SIMD_WIDTH - 1 ) & ~( SIMD_WIDTH - 1 );
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		g_worldData.nodeMins[j].assign( paddedBounds, 0.0f );
+		g_worldData.nodeMaxs[j].assign( paddedBounds, 0.0f );
+
+		for ( uint32 i = 0; i < numNodes; ++i )
+		{
+			g_worldData.nodeMins[j][i] = worldModel->nodes[i].mins[j];
+			g_worldData.nodeMaxs[j][i] = worldModel->nodes[i].maxs[j];
+		}
+		for ( uint32 i = numNodes; i < numBounds; ++i )
+		{
+			g_worldData.nodeMins[j][i] = worldModel->leafs[i - numNodes].mins[j];
+			g_worldData.nodeMaxs[j][i] = worldModel->leafs[i - numNodes].maxs[j];
+		}
+	}
+
+	g_worldData.subtreeSurfaces.assign( numNodes, 0 );
+	R_CountSubtreeSurfaces_r( worldModel, worldModel->nodes );
+}
+
+//
+// Sets culled for every node in [first, first + count) that R_CullBox would reject.
+// The far corner is summed in the same order BoxOnPlaneSide does, so the results match
+//
+static void R_CullWorldNodes( byte *culled, uint32 first, uint32 count )
+{
+	simdFloat_t normals[4][3];
+	simdFloat_t dists[4];
+	const float *corners[4][3];
+
+	for ( int p = 0; p < 4; ++p )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			normals[p][j] = Simd_Set1( frustum[p].normal[j] );
+			corners[p][j] = frustum[p].normal[j] < 0.0f ? g_worldData.nodeMins[j].data() : g_worldData.nodeMaxs[j].data();
+		}
+		dists[p] = Simd_Set1( frustum[p].dist );
+	}
+
+	for ( uint32 i = first; i < first + count; i += SIMD_WIDTH )
+	{
+		simdFloat_t outside = Simd_Set1( 0.0f );
+
+		for ( int p = 0; p < 4; ++p )
+		{
+			const simdFloat_t dist = Simd_Add( Simd_Add(
+				Simd_Mul( normals[p][0], Simd_Load( corners[p][0] + i ) ),
+				Simd_Mul( normals[p][1], Simd_Load( corners[p][1] + i ) ) ),
+				Simd_Mul( normals[p][2], Simd_Load( corners[p][2] + i ) ) );
+
+			outside = Simd_Or( outside, Simd_CmpLt( dist, dists[p] ) );
+		}
+
+		const int mask = Simd_MoveMask( outside );
+		for ( int lane = 0; lane < SIMD_WIDTH; ++lane )
+		{
+			culled[i + lane] = ( mask >> lane ) & 1;
+		}
+	}
+}
+
+static bool R_WorldNodeVisible( const worldTraversal_t &trav, const mnode_t *node )
+{
+	// No polygons in solid nodes
+	if ( node->contents == CONTENTS_SOLID ) {
+		return false;
+	}
+
+	// If the node wasn't marked by R_MarkLeaves, exit
+	if ( node->visframe != tr.visCount ) {
+		return false;
+	}
+
+	// Frustum cull
+	if ( trav.culled && trav.culled[R_WorldNodeIndex( node )] ) {
+		return false;
+	}
+
+	// Check for door connected areas
+	if ( node->contents != -1 )
+	{
+		const mleaf_t *leaf = reinterpret_cast<const mleaf_t *>( node );
+		return tr.refdef.areabits[leaf->area >> 3] & ( 1 << ( leaf->area & 7 ) );
+	}
+
+	return true;
+}
+
+// Returns the side of the node the view is on
+static int R_WorldNodeSide( const mnode_t *node )
+{
+	const cplane_t *plane = node->plane;
+	float dot;
+
+	switch ( plane->type )
+	{
+	case PLANE_X:
+		dot = modelorg[0] - plane->dist;
+		break;
+	case PLANE_Y:
+		dot = modelorg[1] - plane->dist;
+		break;
+	case PLANE_Z:
+		dot = modelorg[2] - plane->dist;
+		break;
+	default:
+		dot = DotProduct( modelorg, plane->normal ) - plane->dist;
+		break;
+	}
+
+	return dot >= 0 ? 0 : 1;
+}
+
+static void R_MarkWorldLeaves_r( const worldTraversal_t &trav, const mnode_t *node, uint64 *visibleSurfaces )
+{
+	while ( R_WorldNodeVisible( trav, node ) )
+	{
+		if ( node->contents != -1 )
+		{
+			const mleaf_t *leaf = reinterpret_cast<const mleaf_t *>( node );
+
+			msurface_t **firstMarkSurface = r_worldmodel->marksurfaces + leaf->firstmarksurface;
+			msurface_t **lastMarkSurface = firstMarkSurface + leaf->nummarksurfaces;
+
+			for ( msurface_t **mark = firstMarkSurface; mark < lastMarkSurface; ++mark )
+			{
+				const uint32 surfNum = static_cast<uint32>( *mark - r_worldmodel->surfaces );
+				visibleSurfaces[surfNum >> 6] |= 1ull << ( surfNum & 63 );
+			}
+
+			return;
+		}
+
+		R_MarkWorldLeaves_r( trav, node->children[0], visibleSurfaces );
+		node = node->children[1];
+	}
+}
+
+static void R_EmitNodeSurfaces( const worldTraversal_t &trav, const mnode_t *node, int sidebit, worldTraversalTask_t &task )
+{
+	const msurface_t *firstSurface = r_worldmodel->surfaces + node->firstsurface;
+	const msurface_t *lastSurface = firstSurface + node->numsurfaces;
+
+	for ( const msurface_t *surf = firstSurface; surf < lastSurface; ++surf )
+	{
+		const uint32 surfNum = static_cast<uint32>( surf - r_worldmodel->surfaces );
+
+		if ( !( trav.visibleSurfaces[surfNum >> 6] & ( 1ull << ( surfNum & 63 ) ) ) )
+		{
+			// Not visited in the leafs
+			continue;
+		}
+
+		if ( trav.backfaceCull && ( surf->flags & MSURF_PLANEBACK ) != sidebit )
+		{
+			// Surface is facing away from us
+			continue;
+		}
+
+		trav.surfaces[task.firstSurface + task.numSurfaces++] = surf;
+	}
+}
+
+static void R_EmitWorldSurfaces_r( const worldTraversal_t &trav, const mnode_t *node, worldTraversalTask_t &task )
+{
+	while ( R_WorldNodeVisible( trav, node ) && node->contents == -1 )
+	{
+		const int side = R_WorldNodeSide( node );
+
+		// Front side first, then this node, then round again for the back side
+		R_EmitWorldSurfaces_r( trav, node->children[side], task );
+		R_EmitNodeSurfaces( trav, node, side ? MSURF_PLANEBACK : 0, task );
+		node = node->children[!side];
+	}
+}
+
+//
+// Cuts the top of the tree into tasks, in the order R_RecursiveWorldNode would reach them
+//
+static void R_SplitWorldTraversal( worldTraversal_t &trav, const mnode_t *node, int depth, uint32 &numSurfaces )
+{
+	if ( !R_WorldNodeVisible( trav, node ) )
+	{
+		return;
+	}
+
+	if ( depth == 0 || node->contents != -1 )
+	{
+		worldTraversalTask_t &task = trav.tasks[trav.numTasks++];
+		task = {};
+		task.node = node;
+		task.firstSurface = numSurfaces;
+		numSurfaces += node->contents == -1 ? g_worldData.subtreeSurfaces[node - r_worldmodel->nodes] : 0;
+		return;
+	}
+
+	const int side = R_WorldNodeSide( node );
+
+	R_SplitWorldTraversal( trav, node->children[side], depth - 1, numSurfaces );
+
+	worldTraversalTask_t &task = trav.tasks[trav.numTasks++];
+	task = {};
+	task.node = node;
+	task.sidebit = side ? MSURF_PLANEBACK : 0;
+	task.emitOnly = true;
+	task.firstSurface = numSurfaces;
+	numSurfaces += node->numsurfaces;
+
+	R_SplitWorldTraversal( trav, node->children[!side], depth - 1, numSurfaces );
+}
+
+//
+// Fills work with the visible surfaces, the same ones R_RecursiveWorldNode would find
+//
+static void R_TraverseWorld( worldNodeWork_t &work, memArena_t &arena, bool parallel )
+{
+	ZoneScoped
+
+	const int numThreads = parallel ? Jobs_NumThreads() : 1;
+
+	worldTraversal_t trav{};
+	trav.backfaceCull = work.cull;
+
+	if ( work.cull && !r_nocull->GetBool() )
+	{
+		const uint32 numBounds = static_cast<uint32>( g_worldData.nodeMins[0].size() );
+		byte *culled = Mem_ArenaAllocArray<byte>( arena, numBounds );
+
+		if ( numThreads > 1 )
+		{
+			Jobs_ParallelFor( ( numBounds + CULL_BATCH_SIZE - 1 ) / CULL_BATCH_SIZE, [culled, numBounds]( int batch )
+			{
+				const uint32 first = batch * CULL_BATCH_SIZE;
+				R_CullWorldNodes( culled, first, Min<uint32>( CULL_BATCH_SIZE, numBounds - first ) );
+			} );
+		}
+		else
+		{
+			R_CullWorldNodes( culled, 0, numBounds );
+		}
+
+		trav.culled = culled;
+	}
+
+	int depth = 0;
+	while ( ( 1 << depth ) < numThreads * 8 && depth < MAX_TRAVERSAL_SPLIT_DEPTH )
+	{
+		++depth;
+	}
+
+	uint32 numSurfaces = 0;
+	trav.tasks = Mem_ArenaAllocArray<worldTraversalTask_t>( arena, 2u << depth );
+	R_SplitWorldTraversal( trav, r_worldmodel->nodes, depth, numSurfaces );
+
+	if ( trav.numTasks == 0 )
+	{
+		return;
+	}
+
+	trav.surfaces = Mem_ArenaAllocArray<const msurface_t *>( arena, numSurfaces );
+
+	// Each worker marks into its own bitset, so they never write to the same words
+	const uint32 numWords = ( static_cast<uint32>( r_worldmodel->numsurfaces ) + 63 ) / 64;
+	const uint32 numWorkers = Min<uint32>( numThreads, trav.numTasks );
+
+	uint64 *bitsets = static_cast<uint64 *>( Mem_ArenaClearedAlloc( arena, numWorkers * numWords * sizeof( uint64 ), alignof( uint64 ) ) );
+
+	auto markWorker = [&trav, bitsets, numWords, numWorkers]( int worker )
+	{
+		for ( uint32 i = worker; i < trav.numTasks; i += numWorkers )
+		{
+			if ( !trav.tasks[i].emitOnly )
+			{
+				R_MarkWorldLeaves_r( trav, trav.tasks[i].node, bitsets + worker * numWords );
+			}
+		}
+	};
+
+	auto emitTask = [&trav]( int i )
+	{
+		worldTraversalTask_t &task = trav.tasks[i];
+
+		if ( task.emitOnly )
+		{
+			R_EmitNodeSurfaces( trav, task.node, task.sidebit, task );
+		}
+		else
+		{
+			R_EmitWorldSurfaces_r( trav, task.node, task );
+		}
+	};
+
+	if ( numWorkers > 1 )
+	{
+		Jobs_ParallelFor( numWorkers, markWorker );
+
+		for ( uint32 worker = 1; worker < numWorkers; ++worker )
+		{
+			const uint64 *bitset = bitsets + worker * numWords;
+			for ( uint32 i = 0; i < numWords; ++i )
+			{
+				bitsets[i] |= bitset[i];
+			}
+		}
+		trav.visibleSurfaces = bitsets;
+
+		Jobs_ParallelFor( trav.numTasks, emitTask );
+	}
+	else
+	{
+		markWorker( 0 );
+		trav.visibleSurfaces = bitsets;
+
+		for ( uint32 i = 0; i < trav.numTasks; ++i )
+		{
+			emitTask( i );
+		}
+	}
+
+	// Stitch the slices back together in tree order
+	for ( uint32 i = 0; i < trav.numTasks; ++i )
+	{
+		const worldTraversalTask_t &task = trav.tasks[i];
+
+		for ( uint32 j = 0; j < task.numSurfaces; ++j )
+		{
+			R_AddSurface( trav.surfaces[task.firstSurface + j], work );
+		}
+	}
+}
+
+//
+// Squashes our index lists into the final index buffer, builds the world lists
+//
+static void R_SquashIndices( worldLists_t &worldLists, worldNodeWork_t &work, memArena_t &arena )
+{
+	ZoneScoped
+
+	const uint32 numMaterials = static_cast<uint32>( g_worldData.materialTexinfos.size() );
+
+	uint32 numMeshes = 0;
+	for ( uint32 i = 0; i < numMaterials; ++i )
+	{
+		numMeshes += work.materialCounts[i] != 0;
+	}
+
+	if ( numMeshes == 0 )
+	{
+		return;
+	}
+
+	worldLists.opaqueMeshes = Mem_ArenaAllocArray<worldMesh_t>( arena, numMeshes );
+
+	// Each visible material gets a range of the final index buffer
+	uint32 numIndices = 0;
+
+	for ( uint32 i = 0; i < numMaterials; ++i )
+	{
+		if ( work.materialCounts[i] == 0 )
+		{
+			continue;
+		}
+
+		// Create a new mesh
+		worldMesh_t &opaqueMesh = worldLists.opaqueMeshes[worldLists.numOpaqueMeshes++];
+		opaqueMesh.texinfo = g_worldData.materialTexinfos[i];
+		opaqueMesh.firstIndex = numIndices;
+		opaqueMesh.numIndices = work.materialCounts[i];
+
+		work.writeIndices[i] = numIndices;
+		numIndices += work.materialCounts[i];
+	}
+
+	worldLists.finalIndices = Mem_ArenaAllocArray<worldIndex_t>( arena, numIndices );
+	worldLists.numFinalIndices = numIndices;
+
+	// Copy each surface into its material's range, in the order they were found
+	const worldIndex_t *indices = g_worldData.indices.data();
+
+	for ( uint32 i = 0; i < work.numSurfaces; ++i )
+	{
+		const msurface_t *surf = work.surfaces[i];
+		uint32 &writeIndex = work.writeIndices[surf->texinfo->materialIndex];
+
+		memcpy( worldLists.finalIndices + writeIndex, indices + surf->firstIndex, surf->numIndices * sizeof( worldIndex_t ) );
+		writeIndex += surf->numIndices;
+	}
+}
+
+//
+// Records the range of the index buffer that differs from the new indices
+//
+static void R_DiffWorldIndices( worldListCache_t &cache, const worldIndex_t *indices, uint32 numIndices )
+{
+	const uint32 oldNumIndices = static_cast<uint32>( cache.indices.size() );
+
+	uint32 first = 0;
+	uint32 end = numIndices;
+
+	if ( numIndices > cache.capacity )
+	{
+		// Leave some room so walking around doesn't keep reallocating the buffer
+		cache.capacity = Max( numIndices, cache.capacity + cache.capacity / 2 );
+		cache.reallocate = true;
+	}
+	else
+	{
+		// Skip what matches at the start, and at the end if nothing moved
+		const uint32 common = Min( oldNumIndices, numIndices );
+		while ( first < common && cache.indices[first] == indices[first] )
+		{
+			++first;
+		}
+		if ( numIndices == oldNumIndices )
+		{
+			while ( end > first && cache.indices[end - 1] == indices[end - 1] )
+			{
+				--end;
+			}
+		}
+	}
+
+	if ( first < end )
+	{
+		// Merge with anything that hasn't been uploaded yet
+		if ( cache.dirtyFirst < cache.dirtyEnd )
+		{
+			first = Min( first, cache.dirtyFirst );
+			end = Max( end, cache.dirtyEnd );
 		}
+		cache.dirtyFirst = first;
+		cache.dirtyEnd = Min( end, numIndices );
+	}
 
-		// Recurse down the back side
-		// We can prevent a recursion by just using this while loop
-		//R_RecursiveWorldNode( work, node->children[!side] );
-		node = node->children[!side];
+	cache.indices.assign( indices, indices + numIndices );
+}
+
+//
+// Sends the changed range of the index buffer to the GPU, expects the ebo to be bound
+//
+static void R_UploadWorldIndices( worldListCache_t &cache )
+{
+	ZoneScoped
+
+	if ( cache.reallocate )
+	{
+		glBufferData( GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>( cache.capacity ) * sizeof( worldIndex_t ), nullptr, GL_DYNAMIC_DRAW );
+		cache.reallocate = false;
+	}
+
+	if ( cache.dirtyFirst < cache.dirtyEnd )
+	{
+		const GLintptr offset = static_cast<GLintptr>( cache.dirtyFirst ) * sizeof( worldIndex_t );
+		const GLsizeiptr size = static_cast<GLsizeiptr>( cache.dirtyEnd - cache.dirtyFirst ) * sizeof( worldIndex_t );
+
+		glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, offset, size, cache.indices.data() + cache.dirtyFirst );
+
+		tr.pc.worldIndicesUploaded += cache.dirtyEnd - cache.dirtyFirst;
+		cache.dirtyFirst = cache.dirtyEnd = 0;
 	}
 }
 
+static void R_AllocWorldNodeWork( worldNodeWork_t &work, memArena_t &arena, bool cull )
+{
+	const uint32 numMaterials = static_cast<uint32>( g_worldData.materialTexinfos.size() );
+
+	work = {};
+	work.materialCounts = static_cast<uint32 *>( Mem_ArenaClearedAlloc( arena, numMaterials * sizeof( uint32 ), alignof( uint32 ) ) );
+	work.writeIndices = Mem_ArenaAllocArray<uint32>( arena, numMaterials );
+	work.surfaces = Mem_ArenaAllocArray<const msurface_t *>( arena, r_worldmodel->numsurfaces );
+	work.skySurfaces = Mem_ArenaAllocArray<const msurface_t *>( arena, r_worldmodel->numsurfaces );
+	work.cull = cull;
+}
+
 //
-// Squashes our index lists into the final index buffer, builds the world lists
+// Brings the world lists up to date for the current view, returns true if they were rebuilt.
+// Doesn't touch GL so the benchmark can run it on its own
 //
-static void R_SquashAndUploadIndices( worldLists_t &worldLists, const worldNodeWork_t &work )
+static bool R_UpdateWorldLists( worldListCache_t &cache, memArena_t &arena, bool useCache )
 {
 	ZoneScoped
 
-	if ( work.materialSets.empty() )
+	// Determine which leaves are in the PVS / areamask
+	R_MarkLeaves();
+
+	if ( useCache && cache.valid && cache.visCount == tr.visCount && memcmp( cache.areabits, tr.refdef.areabits, sizeof( cache.areabits ) ) == 0 )
 	{
-		return;
+		return false;
 	}
 
-	for ( const worldMaterialSet_t &materialSet : work.materialSets )
+	worldNodeWork_t work;
+	R_AllocWorldNodeWork( work, arena, !useCache );
+
+#if 0
+	int64 start, end;
+
+	if ( r_fastProfile.GetBool() )
 	{
-		// Create a new mesh
-		worldMesh_t &opaqueMesh = worldLists.opaqueMeshes.emplace_back();
-		opaqueMesh.texinfo = materialSet.texinfo;
+		start = Time_Microseconds();
+	}
+#endif
 
-		uint32 firstIndex = static_cast<uint32>( worldLists.finalIndices.size() );
+	// This figures out what we need to render and builds the world lists
+	R_TraverseWorld( work, arena, r_parallelWorld.GetBool() );
 
-		// Insert our individual index buffer at the end of the final index buffer
-		worldLists.finalIndices.insert( worldLists.finalIndices.end(), materialSet.indices.begin(), materialSet.indices.end() );
+#if 0
+	if ( r_fastProfile.GetBool() )
+	{
+		end = Time_Microseconds();
 
-		uint32 end = static_cast<uint32>( worldLists.finalIndices.size() );
+		Cvar_SetBool( &r_fastProfile, false );
 
-		Assert( end - firstIndex == materialSet.indices.size() );
+		int64 timeTaken = end - start;
 
-		opaqueMesh.firstIndex = firstIndex;
-		opaqueMesh.numIndices = materialSet.indices.size();
+		Com_Printf( "Spent %llu microseconds inside R_RecursiveWorldNode\n", timeTaken );
 	}
+#endif
+
+	worldLists_t worldLists{};
+	R_SquashIndices( worldLists, work, arena );
 
-	const void *indexData = reinterpret_cast<const void *>( worldLists.finalIndices.data() );
-	const GLsizeiptr indexSize = static_cast<GLsizeiptr>( worldLists.finalIndices.size() ) * sizeof( worldIndex_t );
+	cache.opaqueMeshes.assign( worldLists.opaqueMeshes, worldLists.opaqueMeshes + worldLists.numOpaqueMeshes );
+	cache.skySurfaces.assign( work.skySurfaces, work.skySurfaces + work.numSkySurfaces );
+	R_DiffWorldIndices( cache, worldLists.finalIndices, worldLists.numFinalIndices );
 
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, indexSize, indexData, GL_DYNAMIC_DRAW );
+	cache.valid = useCache;
+	cache.visCount = tr.visCount;
+	memcpy( cache.areabits, tr.refdef.areabits, sizeof( cache.areabits ) );
+
+	return true;
 }
 
 //
 // Draws all opaque surfaces in the world list
 //
-static void R_DrawStaticOpaqueWorld( const worldLists_t &worldLists )
+static void R_DrawStaticOpaqueWorld( const worldListCache_t &worldLists )
 {
 	ZoneScoped
 
@@ -695,42 +1272,14 @@ void R_DrawWorld()
 	glBindBuffer( GL_ARRAY_BUFFER, g_worldData.vbo );
 	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, g_worldData.ebo );
 
-	// Build the world lists
+	// Build the world lists, or reuse last frame's
 
-	worldLists_t worldLists;
+	R_UpdateWorldLists( s_worldListCache, Mem_FrameArena( tr.frameArena ), r_cacheWorldLists.GetBool() );
+	R_UploadWorldIndices( s_worldListCache );
 
+	for ( const msurface_t *surf : s_worldListCache.skySurfaces )
 	{
-		worldNodeWork_t work;
-
-		// Determine which leaves are in the PVS / areamask
-		R_MarkLeaves();
-
-#if 0
-		int64 start, end;
-
-		if ( r_fastProfile.GetBool() )
-		{
-			start = Time_Microseconds();
-		}
-#endif
-
-		// This figures out what we need to render and builds the world lists
-		R_RecursiveWorldNode( work, r_worldmodel->nodes );
-
-#if 0
-		if ( r_fastProfile.GetBool() )
-		{
-			end = Time_Microseconds();
-
-			Cvar_SetBool( &r_fastProfile, false );
-
-			int64 timeTaken = end - start;
-
-			Com_Printf( "Spent %llu microseconds inside R_RecursiveWorldNode\n", timeTaken );
-		}
-#endif
-
-		R_SquashAndUploadIndices( worldLists, work );
+		R_AddSkySurface( surf );
 	}
 
 	// Create the model matrix
@@ -767,7 +1316,7 @@ void R_DrawWorld()
 	glUniform1i( indexAfterLights + 3, 3 ); // spec
 
 	// Render stuff!
-	R_DrawStaticOpaqueWorld( worldLists );
+	R_DrawStaticOpaqueWorld( s_worldListCache );
 
 	GL_UseProgram( 0 );
 
@@ -780,6 +1329,378 @@ void R_DrawWorld()
 	//R_DrawTriangleOutlines();
 }
 
+/*
+===================================================================================================
+
+	Camera paths
+
+	r_recordCameraPath saves the view of every rendered frame, r_worldListBench replays them
+	through the list building code without drawing anything, so changes to it can be timed
+	against the same walk through a map.
+
+===================================================================================================
+*/
+
+#define CAMERAPATH_IDENT	MakeFourCC( 'C', 'A', 'M', 'P' )
+#define CAMERAPATH_VERSION	1
+
+struct cameraPathHeader_t
+{
+	uint32	ident;
+	uint32	version;
+	char	mapName[MAX_QPATH];
+	uint32	numFrames;
+};
+
+struct cameraPathFrame_t
+{
+	vec3_t	vieworg;
+	vec3_t	viewangles;
+	float	fov_x, fov_y;
+	byte	areabits[MAX_MAP_AREAS / 8];
+};
+
+static std::vector<cameraPathFrame_t> s_cameraPath;
+static char s_cameraPathName[MAX_QPATH];
+static bool s_recordingCameraPath;
+
+static void R_CameraPathFileName( const char *name, char *fileName, strlen_t maxLen )
+{
+	Q_sprintf_s( fileName, maxLen, "campaths/%s.campath", name );
+}
+
+void R_RecordCameraFrame()
+{
+	if ( !s_recordingCameraPath || ( tr.refdef.rdflags & RDF_NOWORLDMODEL ) )
+	{
+		return;
+	}
+
+	cameraPathFrame_t &frame = s_cameraPath.emplace_back();
+	VectorCopy( tr.refdef.vieworg, frame.vieworg );
+	VectorCopy( tr.refdef.viewangles, frame.viewangles );
+	frame.fov_x = tr.refdef.fov_x;
+	frame.fov_y = tr.refdef.fov_y;
+	memcpy( frame.areabits, tr.refdef.areabits, sizeof( frame.areabits ) );
+}
+
+static void R_StopCameraPath()
+{
+	s_recordingCameraPath = false;
+
+	char fileName[MAX_OSPATH];
+	R_CameraPathFileName( s_cameraPathName, fileName, sizeof( fileName ) );
+
+	fsHandle_t handle = FileSystem::OpenFileWrite( fileName );
+	if ( !handle )
+	{
+		Com_Printf( S_COLOR_YELLOW "Couldn't open %s for writing\n", fileName );
+		s_cameraPath.clear();
+		return;
+	}
+
+	cameraPathHeader_t header{};
+	header.ident = CAMERAPATH_IDENT;
+	header.version = CAMERAPATH_VERSION;
+	Q_strcpy_s( header.mapName, r_worldmodel ? r_worldmodel->name : "" );
+	header.numFrames = static_cast<uint32>( s_cameraPath.size() );
+
+	FileSystem::WriteFile( &header, sizeof( header ), handle );
+	FileSystem::WriteFile( s_cameraPath.data(), static_cast<fsSize_t>( s_cameraPath.size() * sizeof( cameraPathFrame_t ) ), handle );
+	FileSystem::CloseFile( handle );
+
+	Com_Printf( "Wrote %u frames to %s\n", header.numFrames, fileName );
+
+	s_cameraPath.clear();
+}
+
+CON_COMMAND( r_recordCameraPath, "Records the view of every frame until run again. Usage: r_recordCameraPath <name>", 0 )
+{
+	if ( s_recordingCameraPath )
+	{
+		R_StopCameraPath();
+		return;
+	}
+
+	if ( Cmd_Argc() < 2 )
+	{
+		Com_Print( "Usage: r_recordCameraPath <name>\n" );
+		return;
+	}
+
+	if ( !r_worldmodel )
+	{
+		Com_Print( S_COLOR_YELLOW "No map loaded, can't record a camera path\n" );
+		return;
+	}
+
+	Q_strcpy_s( s_cameraPathName, Cmd_Argv( 1 ) );
+	s_cameraPath.clear();
+	s_recordingCameraPath = true;
+
+	Com_Printf( "Recording camera path %s, run r_recordCameraPath again to stop\n", s_cameraPathName );
+}
+
+//
+// Loads a camera path for one of the benchmarks, returns null and complains on failure.
+// Free buffer with FileSystem::FreeFile
+//
+static const cameraPathFrame_t *R_LoadCameraPath( const char *name, byte *&buffer, uint32 &numFrames )
+{
+	char fileName[MAX_OSPATH];
+	R_CameraPathFileName( name, fileName, sizeof( fileName ) );
+
+	buffer = nullptr;
+	const fsSize_t fileSize = FileSystem::LoadFile( fileName, (void **)&buffer );
+	if ( fileSize <= 0 || !buffer )
+	{
+		Com_Printf( S_COLOR_YELLOW "Couldn't load %s\n", fileName );
+		return nullptr;
+	}
+
+	const cameraPathHeader_t *header = (const cameraPathHeader_t *)buffer;
+	if ( fileSize < (fsSize_t)sizeof( *header ) || header->ident != CAMERAPATH_IDENT || header->version != CAMERAPATH_VERSION
+		|| fileSize < (fsSize_t)( sizeof( *header ) + header->numFrames * sizeof( cameraPathFrame_t ) ) || header->numFrames == 0 )
+	{
+		Com_Printf( S_COLOR_YELLOW "%s is not a valid camera path\n", fileName );
+		FileSystem::FreeFile( buffer );
+		buffer = nullptr;
+		return nullptr;
+	}
+
+	if ( Q_strcmp( header->mapName, r_worldmodel->name ) != 0 )
+	{
+		Com_Printf( S_COLOR_YELLOW "%s was recorded on %s, not %s\n", fileName, header->mapName, r_worldmodel->name );
+	}
+
+	numFrames = header->numFrames;
+
+	return (const cameraPathFrame_t *)( header + 1 );
+}
+
+//
+// Sets up the view like R_RenderView would for a recorded frame
+//
+static void R_SetCameraPathView( const cameraPathFrame_t &frame )
+{
+	VectorCopy( frame.vieworg, tr.refdef.vieworg );
+	VectorCopy( frame.viewangles, tr.refdef.viewangles );
+	tr.refdef.fov_x = frame.fov_x;
+	tr.refdef.fov_y = frame.fov_y;
+	tr.refdef.areabits = const_cast<byte *>( frame.areabits );
+	tr.refdef.rdflags &= ~RDF_NOWORLDMODEL;
+	VectorCopy( frame.vieworg, modelorg );
+
+	R_SetupFrame();
+	R_SetFrustum();
+}
+
+static bool R_CheckBenchmarkWorld( const char *usage )
+{
+	if ( Cmd_Argc() < 2 )
+	{
+		Com_Printf( "Usage: %s\n", usage );
+		return false;
+	}
+
+	if ( !r_worldmodel || !g_worldData.initialised )
+	{
+		Com_Print( S_COLOR_YELLOW "No map loaded, can't benchmark the world\n" );
+		return false;
+	}
+
+	if ( s_recordingCameraPath )
+	{
+		Com_Print( S_COLOR_YELLOW "Stop recording the camera path first\n" );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+========================
+r_worldListBench
+
+Replays a camera path through R_UpdateWorldLists, once rebuilding
+the culled lists every frame like we used to and once with the
+cached lists, and reports how much of the index buffer each would
+have sent to the GPU. Nothing is drawn and the live lists are left
+alone, they just notice the visCount moved and rebuild next frame
+========================
+*/
+CON_COMMAND( r_worldListBench, "Times building the world lists over a recorded camera path. Usage: r_worldListBench <name> [iterations]", 0 )
+{
+	if ( !R_CheckBenchmarkWorld( "r_worldListBench <name> [iterations]" ) )
+	{
+		return;
+	}
+
+	const int iterations = Max( Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : 1, 1 );
+
+	byte *buffer;
+	uint32 numFrames;
+	const cameraPathFrame_t *frames = R_LoadCameraPath( Cmd_Argv( 1 ), buffer, numFrames );
+	if ( !frames )
+	{
+		return;
+	}
+
+	const refdef_t savedRefdef = tr.refdef;
+
+	memArena_t arena{};
+
+	struct benchResult_t
+	{
+		double	msPerFrame;
+		uint64	indicesSent;
+		uint64	indicesDrawn;
+		uint32	rebuilds;
+	};
+
+	auto runPath = [&]( bool useCache )
+	{
+		worldListCache_t cache{};
+		benchResult_t result{};
+
+		const double start = Time_FloatMilliseconds();
+
+		for ( int iter = 0; iter < iterations; ++iter )
+		{
+			for ( uint32 i = 0; i < numFrames; ++i )
+			{
+				R_SetCameraPathView( frames[i] );
+
+				Mem_ArenaReset( arena );
+				result.rebuilds += R_UpdateWorldLists( cache, arena, useCache );
+
+				// What R_UploadWorldIndices would have sent
+				result.indicesSent += cache.dirtyEnd - cache.dirtyFirst;
+				result.indicesDrawn += cache.indices.size();
+				cache.dirtyFirst = cache.dirtyEnd = 0;
+				cache.reallocate = false;
+			}
+		}
+
+		result.msPerFrame = ( Time_FloatMilliseconds() - start ) / ( (double)iterations * numFrames );
+
+		return result;
+	};
+
+	const benchResult_t culled = runPath( false );
+	const benchResult_t cached = runPath( true );
+
+	tr.refdef = savedRefdef;
+	Mem_ArenaFree( arena );
+	FileSystem::FreeFile( buffer );
+
+	const double totalFrames = (double)iterations * numFrames;
+
+	Com_Printf( "%u frames, %d iterations\n", numFrames, iterations );
+	Com_Printf( "culled every frame: %.4f ms/frame, %u rebuilds, %.1f KiB sent/frame, %.0f indices drawn/frame\n",
+		culled.msPerFrame, culled.rebuilds, culled.indicesSent * sizeof( worldIndex_t ) / 1024.0 / totalFrames, culled.indicesDrawn / totalFrames );
+	Com_Printf( "cached:             %.4f ms/frame, %u rebuilds, %.1f KiB sent/frame, %.0f indices drawn/frame\n",
+		cached.msPerFrame, cached.rebuilds, cached.indicesSent * sizeof( worldIndex_t ) / 1024.0 / totalFrames, cached.indicesDrawn / totalFrames );
+}
+
+/*
+========================
+r_worldTraversalBench
+
+Replays a camera path through R_RecursiveWorldNode and through
+R_TraverseWorld on one thread and on the job pool, all frustum and
+backface culled, and checks every frame came out with exactly the
+same surfaces in the same order
+========================
+*/
+CON_COMMAND( r_worldTraversalBench, "Times the recursive world traversal against the SIMD and parallel one. Usage: r_worldTraversalBench <name> [iterations]", 0 )
+{
+	if ( !R_CheckBenchmarkWorld( "r_worldTraversalBench <name> [iterations]" ) )
+	{
+		return;
+	}
+
+	const int iterations = Max( Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : 1, 1 );
+
+	byte *buffer;
+	uint32 numFrames;
+	const cameraPathFrame_t *frames = R_LoadCameraPath( Cmd_Argv( 1 ), buffer, numFrames );
+	if ( !frames )
+	{
+		return;
+	}
+
+	const refdef_t savedRefdef = tr.refdef;
+
+	memArena_t arena{};
+
+	auto worksMatch = []( const worldNodeWork_t &a, const worldNodeWork_t &b )
+	{
+		return a.numSurfaces == b.numSurfaces && a.numSkySurfaces == b.numSkySurfaces
+			&& memcmp( a.surfaces, b.surfaces, a.numSurfaces * sizeof( *a.surfaces ) ) == 0
+			&& memcmp( a.skySurfaces, b.skySurfaces, a.numSkySurfaces * sizeof( *a.skySurfaces ) ) == 0;
+	};
+
+	double recursiveTime = 0.0, serialTime = 0.0, parallelTime = 0.0;
+	uint64 totalSurfaces = 0;
+	uint32 mismatches = 0;
+
+	for ( int iter = 0; iter < iterations; ++iter )
+	{
+		for ( uint32 i = 0; i < numFrames; ++i )
+		{
+			R_SetCameraPathView( frames[i] );
+			R_MarkLeaves();
+
+			Mem_ArenaReset( arena );
+
+			worldNodeWork_t recursive, serial, parallel;
+			R_AllocWorldNodeWork( recursive, arena, true );
+			R_AllocWorldNodeWork( serial, arena, true );
+			R_AllocWorldNodeWork( parallel, arena, true );
+
+			double start = Time_FloatMilliseconds();
+			R_RecursiveWorldNode( recursive, r_worldmodel->nodes );
+			recursiveTime += Time_FloatMilliseconds() - start;
+
+			start = Time_FloatMilliseconds();
+			R_TraverseWorld( serial, arena, false );
+			serialTime += Time_FloatMilliseconds() - start;
+
+			start = Time_FloatMilliseconds();
+			R_TraverseWorld( parallel, arena, true );
+			parallelTime += Time_FloatMilliseconds() - start;
+
+			totalSurfaces += recursive.numSurfaces;
+			if ( !worksMatch( recursive, serial ) || !worksMatch( recursive, parallel ) )
+			{
+				++mismatches;
+			}
+		}
+	}
+
+	tr.refdef = savedRefdef;
+	Mem_ArenaFree( arena );
+	FileSystem::FreeFile( buffer );
+
+	const double totalFrames = (double)iterations * numFrames;
+
+	Com_Printf( "%u frames, %d iterations, %.0f surfaces/frame, %d threads, %d wide\n",
+		numFrames, iterations, totalSurfaces / totalFrames, Jobs_NumThreads(), SIMD_WIDTH );
+	Com_Printf( "recursive: %.4f ms/frame\n", recursiveTime / totalFrames );
+	Com_Printf( "serial:    %.4f ms/frame\n", serialTime / totalFrames );
+	Com_Printf( "parallel:  %.4f ms/frame\n", parallelTime / totalFrames );
+
+	if ( mismatches )
+	{
+		Com_Printf( S_COLOR_RED "%u frames didn't match the recursive traversal!\n", mismatches );
+	}
+	else
+	{
+		Com_Print( "Every frame matched the recursive traversal\n" );
+	}
+}
+
 /*
 ===================================================================================================
 
@@ -1310,19 +2231,18 @@ static void R_LoadExternalLightmap( const char *bspName )
 	char imageName[MAX_QPATH];
 	Q_sprintf_s( imageName, "world/%s.hdr", strippedName );
 
-	byte *pBuffer;
-	fsSize_t nBufLen = FileSystem::LoadFile( imageName, (void **)&pBuffer );
-	if ( !pBuffer )
+	FileSystem::mappedFile_t file;
+	if ( !FileSystem::MapFile( imageName, file ) )
 	{
 		return;
 	}
 
-	Assert( nBufLen > 32 ); // Sanity check
+	Assert( file.size > 32 ); // Sanity check
 
 	int width, height;
-	float *hdrData = stbi_loadf_from_memory( pBuffer, nBufLen, &width, &height, nullptr, 0 );
+	float *hdrData = stbi_loadf_from_memory( file.data, (int)file.size, &width, &height, nullptr, 0 );
 
-	FileSystem::FreeFile( pBuffer );
+	FileSystem::UnmapFile( file );
 
 	if ( !hdrData )
 	{
@@ -1348,6 +2268,34 @@ static void R_LoadExternalLightmap( const char *bspName )
 	Mem_Free( hdrData );
 }
 
+//
+// Gives every texinfo a dense index for its material, so the world lists can bucket
+// surfaces with an array lookup instead of searching
+//
+static void R_IndexWorldMaterials( model_t *worldModel )
+{
+	std::vector<mtexinfo_t *> &materialTexinfos = g_worldData.materialTexinfos;
+	materialTexinfos.clear();
+
+	std::vector<mtexinfo_t *> sorted( worldModel->numtexinfo );
+	for ( int i = 0; i < worldModel->numtexinfo; ++i )
+	{
+		sorted[i] = worldModel->texinfo + i;
+	}
+
+	// Stable so each material keeps its first texinfo, like the old material sets did
+	std::stable_sort( sorted.begin(), sorted.end(), []( const mtexinfo_t *a, const mtexinfo_t *b ) { return std::less<const material_t *>()( a->material, b->material ); } );
+
+	for ( mtexinfo_t *texinfo : sorted )
+	{
+		if ( materialTexinfos.empty() || materialTexinfos.back()->material != texinfo->material )
+		{
+			materialTexinfos.push_back( texinfo );
+		}
+		texinfo->materialIndex = static_cast<uint32>( materialTexinfos.size() - 1 );
+	}
+}
+
 static void R_UploadBuffers( model_t *worldModel )
 {
 	worldVertex_t *vertexData = g_worldData.vertices.data();
@@ -1516,6 +2464,8 @@ void R_BuildWorldLists( model_t *model )
 	//
 	// Upload our big fat vertex buffer
 	//
+	R_IndexWorldMaterials( model );
+	R_FlattenWorldNodes( model );
 	R_UploadBuffers( model );
 }
 
@@ -1530,9 +2480,19 @@ void R_EraseWorldLists()
 		g_worldData.indices.clear();
 		g_worldData.lastMaterial = nullptr;
 		g_worldData.meshes.clear();
+		g_worldData.materialTexinfos.clear();
+		for ( int j = 0; j < 3; ++j )
+		{
+			g_worldData.nodeMins[j].clear();
+			g_worldData.nodeMaxs[j].clear();
+		}
+		g_worldData.subtreeSurfaces.clear();
 
 		g_worldData.initialised = false;
 	}
+
+	// The index buffer went with the rest
+	s_worldListCache = worldListCache_t{};
 }
 
 /*
@@ -1882,24 +2842,25 @@ bool BspExt_Load( model_t *worldModel )
 	char bspExtName[MAX_QPATH];
 	BspExt_GetBspExtName( worldModel->name, bspExtName, sizeof( bspExtName ) );
 
-	byte *buffer;
-	fsSize_t bspExtSize = FileSystem::LoadFile( bspExtName, (void **)&buffer );
-	if ( !buffer )
+	FileSystem::mappedFile_t file;
+	if ( !FileSystem::MapFile( bspExtName, file ) )
 	{
 		return false;
 	}
 
-	if ( bspExtSize <= sizeof( bspExtHeader_t ) )
+	if ( file.size <= sizeof( bspExtHeader_t ) )
 	{
-		FileSystem::FreeFile( buffer );
+		FileSystem::UnmapFile( file );
 		return false;
 	}
 
+	// the loaders only ever read from the file
+	byte *buffer = const_cast<byte *>( file.data );
 	bspExtHeader_t *hdr = (bspExtHeader_t *)buffer;
 
 	if ( hdr->ident != BSPEXT_IDENT || hdr->version != BSPEXT_VERSION )
 	{
-		FileSystem::FreeFile( buffer );
+		FileSystem::UnmapFile( file );
 		return false;
 	}
 
@@ -1912,10 +2873,12 @@ bool BspExt_Load( model_t *worldModel )
 	BspExt_LoadModelsExt( worldModel, buffer, hdr->lumps + LUMP_MODELS_EXT );
 	BspExt_LoadFacesExt( worldModel, buffer, hdr->lumps + LUMP_FACES_EXT );
 
-	FileSystem::FreeFile( buffer );
+	FileSystem::UnmapFile( file );
 
 	BspExt_SortSurfacesByMaterial( worldModel );
 
+	R_IndexWorldMaterials( worldModel );
+	R_FlattenWorldNodes( worldModel );
 	R_UploadBuffers( worldModel );
 
 	if ( worldModel->flags & BSPFLAG_EXTERNAL_LIGHTMAP )
@@ -48,6 +48,8 @@ struct entity_t
 	material_t	*skin;				// NULL for inline skin
 	int			flags;
 
+	int			entnum;				// for things cached per entity, 0 if it isn't a server entity
+
 };
 
 struct particle_t
@@ -24,6 +24,8 @@ void ShowRenderStats()
 	ImGui::TextUnformatted( workBuf, workBuf + length );
 	length = Q_sprintf_s( workBuf, "%-20s: %d", "world draw calls", tr.pc.worldDrawCalls );
 	ImGui::TextUnformatted( workBuf, workBuf + length );
+	length = Q_sprintf_s( workBuf, "%-20s: %d", "world indices sent", tr.pc.worldIndicesUploaded );
+	ImGui::TextUnformatted( workBuf, workBuf + length );
 }
 
 }
@@ -1,6 +1,8 @@
 
 #include "sv_local.h"
 
+#include "../../core/jobs.h"
+
 /*
 ===================================================================================================
 
@@ -22,7 +24,6 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
-	int		bits;
 
 #if 0
 	if ( numprojs )
@@ -81,28 +82,14 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 		if ( newnum > oldnum )
 		{
 			// the old entity isn't present in the new message
-			bits = U_REMOVE;
-			if ( oldnum >= 256 ) {
-				bits |= U_NUMBER16 | U_MOREBITS1;
-			}
-
-			MSG_WriteByte( msg, bits & 255 );
-			if ( bits & 0x0000ff00 ) {
-				MSG_WriteByte( msg, ( bits >> 8 ) & 255 );
-			}
-
-			if ( bits & U_NUMBER16 ) {
-				MSG_WriteShort( msg, oldnum );
-			} else {
-				MSG_WriteByte( msg, oldnum );
-			}
+			MSG_WriteRemoveEntity( msg, oldnum );
 
 			oldindex++;
 			continue;
 		}
 	}
 
-	MSG_WriteShort( msg, 0 );	// end of packetentities
+	MSG_WriteEntityListEnd( msg );
 
 #if 0
 	if ( numprojs )
@@ -117,11 +104,8 @@ SV_WritePlayerstateToClient
 */
 static void SV_WritePlayerstateToClient( clientSnapshot_t *from, clientSnapshot_t *to, sizebuf_t *msg )
 {
-	int				i;
-	int				pflags;
 	player_state_t	*ps, *ops;
 	player_state_t	dummy;
-	int				statbits;
 
 	ps = &to->ps;
 	if ( !from ) {
@@ -132,202 +116,8 @@ static void SV_WritePlayerstateToClient( clientSnapshot_t *from, clientSnapshot_
 		ops = &from->ps;
 	}
 
-	//
-	// determine what needs to be sent
-	//
-	pflags = 0;
-
-	if ( ps->pmove.pm_type != ops->pmove.pm_type ) {
-		pflags |= PS_M_TYPE;
-	}
-
-	if ( ps->pmove.origin[0] != ops->pmove.origin[0]
-		|| ps->pmove.origin[1] != ops->pmove.origin[1]
-		|| ps->pmove.origin[2] != ops->pmove.origin[2] )
-	{
-		pflags |= PS_M_ORIGIN;
-	}
-
-	if ( ps->pmove.velocity[0] != ops->pmove.velocity[0]
-		|| ps->pmove.velocity[1] != ops->pmove.velocity[1]
-		|| ps->pmove.velocity[2] != ops->pmove.velocity[2] )
-	{
-		pflags |= PS_M_VELOCITY;
-	}
-
-	if ( ps->pmove.pm_time != ops->pmove.pm_time ) {
-		pflags |= PS_M_TIME;
-	}
-
-	if ( ps->pmove.pm_flags != ops->pmove.pm_flags ) {
-		pflags |= PS_M_FLAGS;
-	}
-
-	if ( ps->pmove.gravity != ops->pmove.gravity ) {
-		pflags |= PS_M_GRAVITY;
-	}
-
-	if ( ps->pmove.delta_angles[0] != ops->pmove.delta_angles[0]
-		|| ps->pmove.delta_angles[1] != ops->pmove.delta_angles[1]
-		|| ps->pmove.delta_angles[2] != ops->pmove.delta_angles[2] )
-	{
-		pflags |= PS_M_DELTA_ANGLES;
-	}
-
-
-	if ( ps->viewoffset[0] != ops->viewoffset[0]
-		|| ps->viewoffset[1] != ops->viewoffset[1]
-		|| ps->viewoffset[2] != ops->viewoffset[2] )
-	{
-		pflags |= PS_VIEWOFFSET;
-	}
-
-	if ( ps->viewangles[0] != ops->viewangles[0]
-		|| ps->viewangles[1] != ops->viewangles[1]
-		|| ps->viewangles[2] != ops->viewangles[2] )
-	{
-		pflags |= PS_VIEWANGLES;
-	}
-
-	if ( ps->kick_angles[0] != ops->kick_angles[0]
-		|| ps->kick_angles[1] != ops->kick_angles[1]
-		|| ps->kick_angles[2] != ops->kick_angles[2] )
-	{
-		pflags |= PS_KICKANGLES;
-	}
-
-	if ( ps->blend[0] != ops->blend[0]
-		|| ps->blend[1] != ops->blend[1]
-		|| ps->blend[2] != ops->blend[2]
-		|| ps->blend[3] != ops->blend[3] )
-	{
-		pflags |= PS_BLEND;
-	}
-
-	if ( ps->fov != ops->fov ) {
-		pflags |= PS_FOV;
-	}
-
-	if ( ps->rdflags != ops->rdflags ) {
-		pflags |= PS_RDFLAGS;
-	}
-
-	if ( ps->gunframe != ops->gunframe )
-	{
-		pflags |= PS_WEAPONFRAME;
-	}
-
-	pflags |= PS_WEAPONINDEX;
-
-	//
-	// write it
-	//
 	MSG_WriteByte( msg, svc_playerinfo );
-	MSG_WriteShort( msg, pflags );
-
-	//
-	// write the pmove_state_t
-	//
-	if ( pflags & PS_M_TYPE ) {
-		MSG_WriteByte( msg, ps->pmove.pm_type );
-	}
-
-	if ( pflags & PS_M_ORIGIN )
-	{
-		MSG_WriteFloat( msg, ps->pmove.origin[0] );
-		MSG_WriteFloat( msg, ps->pmove.origin[1] );
-		MSG_WriteFloat( msg, ps->pmove.origin[2] );
-	}
-
-	if ( pflags & PS_M_VELOCITY )
-	{
-		MSG_WriteFloat( msg, ps->pmove.velocity[0] );
-		MSG_WriteFloat( msg, ps->pmove.velocity[1] );
-		MSG_WriteFloat( msg, ps->pmove.velocity[2] );
-	}
-
-	if ( pflags & PS_M_TIME ) {
-		MSG_WriteByte( msg, ps->pmove.pm_time );
-	}
-
-	if ( pflags & PS_M_FLAGS ) {
-		MSG_WriteByte( msg, ps->pmove.pm_flags );
-	}
-
-	if ( pflags & PS_M_GRAVITY ) {
-		MSG_WriteShort( msg, ps->pmove.gravity );
-	}
-
-	if ( pflags & PS_M_DELTA_ANGLES )
-	{
-		MSG_WriteFloat( msg, ps->pmove.delta_angles[0] );
-		MSG_WriteFloat( msg, ps->pmove.delta_angles[1] );
-		MSG_WriteFloat( msg, ps->pmove.delta_angles[2] );
-	}
-
-	//
-	// write the rest of the player_state_t
-	//
-	if ( pflags & PS_VIEWOFFSET )
-	{
-		MSG_WriteFloat( msg, ps->viewoffset[0] );
-		MSG_WriteFloat( msg, ps->viewoffset[1] );
-		MSG_WriteFloat( msg, ps->viewoffset[2] );
-	}
-
-	if ( pflags & PS_VIEWANGLES )
-	{
-		MSG_WriteFloat( msg, ps->viewangles[0] );
-		MSG_WriteFloat( msg, ps->viewangles[1] );
-		MSG_WriteFloat( msg, ps->viewangles[2] );
-	}
-
-	if ( pflags & PS_KICKANGLES )
-	{
-		MSG_WriteFloat( msg, ps->kick_angles[0] );
-		MSG_WriteFloat( msg, ps->kick_angles[1] );
-		MSG_WriteFloat( msg, ps->kick_angles[2] );
-	}
-
-	if ( pflags & PS_WEAPONINDEX )
-	{
-		MSG_WriteByte( msg, ps->gunindex );
-	}
-
-	if ( pflags & PS_WEAPONFRAME )
-	{
-		MSG_WriteByte( msg, ps->gunframe );
-	}
-
-	if ( pflags & PS_BLEND )
-	{
-		MSG_WriteByte( msg, ps->blend[0] * 255 );
-		MSG_WriteByte( msg, ps->blend[1] * 255 );
-		MSG_WriteByte( msg, ps->blend[2] * 255 );
-		MSG_WriteByte( msg, ps->blend[3] * 255 );
-	}
-	if ( pflags & PS_FOV ) {
-		MSG_WriteByte( msg, ps->fov );
-	}
-	if ( pflags & PS_RDFLAGS ) {
-		MSG_WriteByte( msg, ps->rdflags );
-	}
-
-	// send stats
-	statbits = 0;
-	for ( i = 0; i < MAX_STATS; i++ )
-	{
-		if ( ps->stats[i] != ops->stats[i] ) {
-			statbits |= 1 << i;
-		}
-	}
-	MSG_WriteLong( msg, statbits );
-	for ( i = 0; i < MAX_STATS; i++ )
-	{
-		if ( statbits & ( 1 << i ) ) {
-			MSG_WriteShort( msg, ps->stats[i] );
-		}
-	}
+	MSG_WriteDeltaPlayerstate( ops, ps, msg );
 }
 
 /*
@@ -387,10 +177,27 @@ void SV_WriteFrameToClient( client_t *client, sizebuf_t *msg )
 
 	Build a client frame structure
 
+	Deciding what a client can see only reads the world, so it's done for every client at once
+	on the job pool, each into its own scratch space. A cheap serial commit then copies the
+	entity states into svs.client_entities in client order, so the circular buffer ends up
+	exactly as if the clients were built one after another.
+
 ===================================================================================================
 */
 
-static byte fatpvs[MAX_MAP_LEAFS];
+#define MAX_FATPVS_LEAFS	64
+
+struct clientFrameBuild_t
+{
+	byte	fatpvs[MAX_MAP_LEAFS/8];
+	int		numEntities;				// -1 if the client isn't in game yet
+	int		entities[MAX_EDICTS];		// edict numbers, ascending
+};
+
+static clientFrameBuild_t *	sv_frameBuilds;
+static int					sv_numFrameBuilds;
+
+static StaticCvar sv_parallelFrames( "sv_parallelFrames", "1", 0, "Build client frames on the job pool." );
 
 /*
 ========================
@@ -400,9 +207,9 @@ The client will interpolate the view position,
 so we can't use a single PVS point
 ========================
 */
-static void SV_FatPVS( vec3_t org )
+static void SV_FatPVS( const vec3_t org, byte *fatpvs )
 {
-	int		leafs[64];
+	int		leafs[MAX_FATPVS_LEAFS];
 	int		i, j, count;
 	int		longs;
 	byte *	src;
@@ -414,7 +221,7 @@ static void SV_FatPVS( vec3_t org )
 		maxs[i] = org[i] + 8;
 	}
 
-	count = CM_BoxLeafnums( mins, maxs, leafs, 64, NULL );
+	count = CM_BoxLeafnums( mins, maxs, leafs, MAX_FATPVS_LEAFS, NULL );
 	if ( count < 1 ) {
 		Com_FatalError( "SV_FatPVS: count < 1\n" );
 	}
@@ -450,30 +257,40 @@ static void SV_FatPVS( vec3_t org )
 
 /*
 ========================
-SV_BuildClientFrame
+SV_AddVisibleEntities
 
-Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+Lists the edicts seen from org into build, clent is always visible.
+Safe to call from any thread as long as nothing moves the edicts
 ========================
 */
-void SV_BuildClientFrame( client_t *client )
+static void SV_AddVisibleEntities( vec3_t org, int clientarea, int clientcluster, edict_t *clent, clientFrameBuild_t *build )
 {
-	int		e, i;
+	SV_FatPVS( org, build->fatpvs );
+
+	build->numEntities = SV_VisibleEntities( org, clientarea, build->fatpvs, CM_ClusterPHS( clientcluster ), clent, build->entities );
+}
+
+/*
+========================
+SV_PrepareClientFrame
+
+The parallel half of building a frame, everything written
+belongs to this client or its scratch space
+========================
+*/
+static void SV_PrepareClientFrame( client_t *client, clientFrameBuild_t *build )
+{
+	int		i;
 	vec3_t	org;
-	edict_t *ent;
 	edict_t *clent;
 	clientSnapshot_t *frame;
-	entity_state_t *state;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	int		c_fullsend;
-	byte *	clientphs;
-	byte *	bitvector;
 
 	clent = client->edict;
 	if ( !clent->client ) {
 		// not in game yet
+		build->numEntities = -1;
 		return;
 	}
 
@@ -501,101 +318,39 @@ void SV_BuildClientFrame( client_t *client )
 	// grab the current player_state_t
 	frame->ps = clent->client->ps;
 
-
-	SV_FatPVS( org );
-	clientphs = CM_ClusterPHS( clientcluster );
-
 	// build up the list of visible entities
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
-
-	c_fullsend = 0;
+	SV_AddVisibleEntities( org, clientarea, clientcluster, clent, build );
+}
 
-	for ( e = 1; e < ge->num_edicts; e++ )
-	{
-		ent = EDICT_NUM( e );
+/*
+========================
+SV_CommitClientFrame
 
-		// ignore ents without visible models
-		if ( ent->svflags & SVF_NOCLIENT ) {
-			continue;
-		}
+Copies the visible entities into the circular client_entities array,
+must be called in client order from the main thread
+========================
+*/
+static void SV_CommitClientFrame( client_t *client, const clientFrameBuild_t *build )
+{
+	clientSnapshot_t *frame;
+	entity_state_t *state;
+	edict_t *ent;
+	int		e, i;
 
-		// ignore ents without visible models unless they have an effect
-		if ( !ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event ) {
-			continue;
-		}
+	if ( build->numEntities < 0 ) {
+		return;
+	}
 
-		// ignore if not touching a PV leaf
-		if ( ent != clent )
-		{
-			// check area
-			if ( !CM_AreasConnected( clientarea, ent->areanum ) )
-			{
-				// doors can legally straddle two areas, so
-				// we may need to check another one
-				if ( !ent->areanum2 || !CM_AreasConnected( clientarea, ent->areanum2 ) ) {
-					// blocked by a door
-					continue;
-				}
-			}
+	frame = &client->frames[sv.framenum & UPDATE_MASK];
 
-			// beams just check one point for PHS
-			if ( ent->s.renderfx & RF_BEAM )
-			{
-				l = ent->clusternums[0];
-				if ( !( clientphs[l >> 3] & ( 1 << ( l & 7 ) ) ) ) {
-					continue;
-				}
-			}
-			else
-			{
-				// FIXME: if an ent has a model and a sound, but isn't
-				// in the PVS, only the PHS, clear the model
-				if ( ent->s.sound ) {
-					bitvector = fatpvs;		//clientphs;
-				} else {
-					bitvector = fatpvs;
-				}
-
-				if ( ent->num_clusters == -1 )
-				{
-					// too many leafs for individual check, go by headnode
-					if ( !CM_HeadnodeVisible( ent->headnode, bitvector ) ) {
-						continue;
-					}
-					c_fullsend++;
-				}
-				else
-				{	// check individual leafs
-					for ( i = 0; i < ent->num_clusters; i++ )
-					{
-						l = ent->clusternums[i];
-						if ( bitvector[l >> 3] & ( 1 << ( l & 7 ) ) ) {
-							break;
-						}
-					}
-					if ( i == ent->num_clusters ) {
-						// not visible
-						continue;
-					}
-				}
-
-				if ( !ent->s.modelindex )
-				{
-					// don't send sounds if they will be attenuated away
-					if ( VectorDistance( org, ent->s.origin ) > 400 ) {
-						continue;
-					}
-				}
-			}
-		}
+	frame->num_entities = build->numEntities;
+	frame->first_entity = svs.next_client_entities;
 
-#if 0
-		if ( SV_AddProjectileUpdate( ent ) )
-			continue; // added as a special projectile
-#endif
+	for ( i = 0; i < build->numEntities; i++ )
+	{
+		e = build->entities[i];
+		ent = EDICT_NUM( e );
 
-		// add it to the circular client_entities array
 		state = &svs.client_entities[svs.next_client_entities % svs.num_client_entities];
 		if ( ent->s.number != e )
 		{
@@ -610,10 +365,197 @@ void SV_BuildClientFrame( client_t *client )
 		}
 
 		svs.next_client_entities++;
-		frame->num_entities++;
 	}
 }
 
+static void SV_ReserveFrameBuilds( int count )
+{
+	if ( count <= sv_numFrameBuilds ) {
+		return;
+	}
+
+	if ( sv_frameBuilds ) {
+		Mem_Free( sv_frameBuilds );
+	}
+	sv_frameBuilds = (clientFrameBuild_t *)Mem_Alloc( sizeof( clientFrameBuild_t ) * count );
+	sv_numFrameBuilds = count;
+}
+
+/*
+========================
+SV_BuildClientFrames
+
+Decides which entities are going to be visible to each client, and
+copies off the playerstate and areabits.
+========================
+*/
+void SV_BuildClientFrames( client_t **clients, int numClients )
+{
+	if ( numClients <= 0 ) {
+		return;
+	}
+
+	SV_ReserveFrameBuilds( numClients );
+	SV_BuildVisIndex();
+
+	if ( sv_parallelFrames.GetBool() )
+	{
+		Jobs_ParallelFor( numClients, [clients]( int i )
+		{
+			SV_PrepareClientFrame( clients[i], &sv_frameBuilds[i] );
+		} );
+	}
+	else
+	{
+		for ( int i = 0; i < numClients; i++ )
+		{
+			SV_PrepareClientFrame( clients[i], &sv_frameBuilds[i] );
+		}
+	}
+
+	for ( int i = 0; i < numClients; i++ )
+	{
+		SV_CommitClientFrame( clients[i], &sv_frameBuilds[i] );
+	}
+}
+
+/*
+========================
+sv_frameBench
+
+Replays the current server frame from a set of synthetic viewpoints,
+spread over the spots where edicts are, testing every edict, through
+the visibility index, and on the job pool, and checks they all came
+up with the same entity lists
+========================
+*/
+CON_COMMAND( sv_frameBench, "Times building client frames linearly, indexed and in parallel. Usage: sv_frameBench [numclients] [iterations]", 0 )
+{
+	if ( sv.state != ss_game )
+	{
+		Com_Print( "No game running\n" );
+		return;
+	}
+
+	int numClients = Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 64;
+	int iterations = Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : 20;
+	numClients = Clamp( numClients, 1, MAX_CLIENTS );
+	iterations = Max( iterations, 1 );
+
+	struct benchView_t
+	{
+		vec3_t	org;
+		int		area, cluster;
+	};
+
+	// view from the edicts that are out in the world, like players would be
+	benchView_t views[MAX_CLIENTS];
+	int numViews = 0;
+
+	for ( int e = 1; e < ge->num_edicts && numViews < numClients; e++ )
+	{
+		edict_t *ent = EDICT_NUM( e );
+		if ( !ent->inuse || ent->areanum == 0 ) {
+			continue;
+		}
+		VectorCopy( ent->s.origin, views[numViews].org );
+		views[numViews].org[2] += 22.0f;
+		numViews++;
+	}
+	if ( numViews == 0 )
+	{
+		Com_Print( "No edicts to view from\n" );
+		return;
+	}
+	// wrap around if there aren't enough
+	for ( int i = numViews; i < numClients; i++ )
+	{
+		views[i] = views[i % numViews];
+	}
+
+	for ( int i = 0; i < numClients; i++ )
+	{
+		int leafnum = CM_PointLeafnum( views[i].org );
+		views[i].area = CM_LeafArea( leafnum );
+		views[i].cluster = CM_LeafCluster( leafnum );
+	}
+
+	// linear, indexed and pooled results side by side
+	SV_ReserveFrameBuilds( numClients * 3 );
+	clientFrameBuild_t *linear = sv_frameBuilds;
+	clientFrameBuild_t *indexed = sv_frameBuilds + numClients;
+	clientFrameBuild_t *parallel = sv_frameBuilds + numClients * 2;
+
+	auto buildView = [&views]( int i, clientFrameBuild_t *build, bool useIndex )
+	{
+		SV_FatPVS( views[i].org, build->fatpvs );
+		const byte *clientphs = CM_ClusterPHS( views[i].cluster );
+		if ( useIndex ) {
+			build->numEntities = SV_IndexedVisibleEntities( views[i].org, views[i].area, build->fatpvs, clientphs, nullptr, build->entities );
+		} else {
+			build->numEntities = SV_LinearVisibleEntities( views[i].org, views[i].area, build->fatpvs, clientphs, nullptr, build->entities );
+		}
+	};
+
+	double start = Time_FloatMilliseconds();
+	for ( int iter = 0; iter < iterations; iter++ )
+	{
+		for ( int i = 0; i < numClients; i++ )
+		{
+			buildView( i, &linear[i], false );
+		}
+	}
+	double linearTime = ( Time_FloatMilliseconds() - start ) / iterations;
+
+	// index rebuilds are part of the cost
+	start = Time_FloatMilliseconds();
+	for ( int iter = 0; iter < iterations; iter++ )
+	{
+		SV_BuildVisIndex();
+		for ( int i = 0; i < numClients; i++ )
+		{
+			buildView( i, &indexed[i], true );
+		}
+	}
+	double indexedTime = ( Time_FloatMilliseconds() - start ) / iterations;
+
+	start = Time_FloatMilliseconds();
+	for ( int iter = 0; iter < iterations; iter++ )
+	{
+		SV_BuildVisIndex();
+		Jobs_ParallelFor( numClients, [&buildView, parallel]( int i )
+		{
+			buildView( i, &parallel[i], true );
+		} );
+	}
+	double parallelTime = ( Time_FloatMilliseconds() - start ) / iterations;
+
+	auto buildsMatch = []( const clientFrameBuild_t &a, const clientFrameBuild_t &b )
+	{
+		return a.numEntities == b.numEntities && memcmp( a.entities, b.entities, a.numEntities * sizeof( int ) ) == 0;
+	};
+
+	int mismatches = 0;
+	int totalEntities = 0;
+	for ( int i = 0; i < numClients; i++ )
+	{
+		totalEntities += linear[i].numEntities;
+		if ( !buildsMatch( linear[i], indexed[i] ) || !buildsMatch( linear[i], parallel[i] ) )
+		{
+			++mismatches;
+		}
+	}
+
+	Com_Printf( "%d clients, %d edicts, %.1f visible each\n", numClients, ge->num_edicts, (float)totalEntities / numClients );
+	Com_Printf( "linear %.3f ms, indexed %.3f ms (%.2fx), %d threads %.3f ms (%.2fx)\n",
+		linearTime, indexedTime, linearTime / Max( indexedTime, 0.001 ),
+		Jobs_NumThreads(), parallelTime, linearTime / Max( parallelTime, 0.001 ) );
+
+	if ( mismatches )
+	{
+		Com_Printf( S_COLOR_RED "%d clients did not match the linear results!\n", mismatches );
+	}
+}
 
 /*
 ========================
@@ -662,7 +604,7 @@ void SV_RecordDemoMessage()
 		ent = EDICT_NUM( e );
 	}
 
-	MSG_WriteShort( &buf, 0 );		// end of packetentities
+	MSG_WriteEntityListEnd( &buf );
 
 	// now add the accumulated multicast information
 	SZ_Write( &buf, svs.demo_multicast.data, svs.demo_multicast.cursize );
@@ -338,6 +338,7 @@ void SV_InitGameProgs()
 	gi.unlinkentity = SV_UnlinkEntity;
 	gi.BoxEdicts = SV_AreaEntities;
 	gi.trace = SV_Trace;
+	gi.traceBatch = SV_TraceBatch;
 	gi.pointcontents = SV_PointContents;
 	gi.setmodel = PF_setmodel;
 	gi.inPVS = PF_inPVS;
@@ -173,6 +173,7 @@ static void SV_SpawnServer( const char *server, const char *spawnpoint, serverSt
 
 	// wipe the entire per-level structure
 	memset( &sv, 0, sizeof( sv ) );
+	SV_ResetVisIndex();
 	svs.realtime = 0;
 	sv.loadgame = loadgame;
 	sv.attractloop = attractloop;
@@ -321,9 +322,11 @@ void SV_InitGame()
 	svs.clients = (client_t *)Mem_ClearedAlloc( sizeof( client_t ) * maxclients->GetInt() );
 	svs.num_client_entities = maxclients->GetInt() * UPDATE_BACKUP * 64;
 	svs.client_entities = (entity_state_t *)Mem_ClearedAlloc( sizeof( entity_state_t ) * svs.num_client_entities );
+	SV_RebuildClientHash();
 
 	// init network stuff
 	NET_Config( ( maxclients->GetInt() > 1 ) );
+	NET_StartIOThread( NS_SERVER );
 
 	// heartbeats will always be sent to the id master
 	svs.last_heartbeat = -99999;		// send immediately
@@ -147,6 +147,7 @@ struct serverStatic_t
 {
 	qboolean	initialized;				// sv_init has completed
 	int			realtime;					// always increasing, no clamping, etc
+	int			packettime;					// realtime when net_message arrived
 
 	char		mapcmd[MAX_TOKEN_CHARS];	// ie: *intro.cin+base 
 
@@ -202,6 +203,8 @@ int SV_ImageIndex( const char *name );
 
 void SV_UserinfoChanged( client_t *cl );
 
+void SV_RebuildClientHash();
+
 void Master_Heartbeat();
 
 //
@@ -253,7 +256,19 @@ void SV_InitOperatorCommands();
 //
 void SV_WriteFrameToClient (client_t *client, sizebuf_t *msg);
 void SV_RecordDemoMessage (void);
-void SV_BuildClientFrame (client_t *client);
+void SV_BuildClientFrames (client_t **clients, int numClients);
+
+//
+// sv_vis.c
+//
+void SV_ClearVisIndex();
+void SV_ResetVisIndex();
+void SV_BuildVisIndex();
+bool SV_EntityVisible( edict_t *ent, vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs );
+int SV_LinearVisibleEntities( vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs, edict_t *clent, int *list );
+int SV_IndexedVisibleEntities( vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs, edict_t *clent, int *list );
+int SV_VisibleEntities( vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs, edict_t *clent, int *list );
+void SV_ClientViewLeaf( client_t *client, int *cluster, int *area );
 
 //
 // sv_game.c
@@ -311,3 +326,6 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceBatch (const traceRequest_t *requests, int count, trace_t *results);
+// runs many traces at once, results[i] is the same as SV_Trace for requests[i]
+
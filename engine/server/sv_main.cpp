@@ -254,6 +254,7 @@ static void SVC_DirectConnect()
 	int			version;
 	int			qport;
 	int			challenge;
+	bool		compress;
 
 	adr = net_from;
 
@@ -273,6 +274,9 @@ static void SVC_DirectConnect()
 
 	Q_strcpy_s( userinfo, Cmd_Argv( 4 ) );
 
+	// compress if both ends want to, there's nothing to gain over loopback
+	compress = Q_atoi( Cmd_Argv( 5 ) ) != 0 && net_compress->GetBool() && !NET_IsLocalAddress( adr );
+
 	// force the IP key/value pair so the game can filter based on ip
 	Info_SetValueForKey( userinfo, "ip", NET_NetadrToString( net_from ) );
 
@@ -354,6 +358,7 @@ gotnewcl:
 	// build a new connection
 	// accept the new client
 	// this is the only place a client_t is ever initialized
+	Netchan_Shutdown( &newcl->netchan );
 	*newcl = temp;
 	sv_client = newcl;
 	edictnum = ( newcl - svs.clients ) + 1;
@@ -380,11 +385,12 @@ gotnewcl:
 	SV_UserinfoChanged( newcl );
 
 	// send the connect packet to the client
-	Netchan_OutOfBandPrint( NS_SERVER, adr, "client_connect" );
+	Netchan_OutOfBandPrint( NS_SERVER, adr, "client_connect %i", compress ? 1 : 0 );
 
-	Netchan_Setup( NS_SERVER, &newcl->netchan, adr, qport );
+	Netchan_Setup( NS_SERVER, &newcl->netchan, adr, qport, compress );
 
 	newcl->state = cs_connected;
+	SV_RebuildClientHash();
 
 	SZ_Init( &newcl->datagram, newcl->datagram_buf, sizeof( newcl->datagram_buf ) );
 	newcl->datagram.allowoverflow = true;
@@ -593,6 +599,98 @@ static void SV_GiveMsec()
 	}
 }
 
+/*
+===================================================================================================
+
+	Client lookup
+
+	Maps a packet's base address and qport to the client it belongs to, so reading a frame's
+	worth of packets doesn't scan every client slot for each one. Entries are slot + 1 with
+	zero meaning empty, and are rebuilt whenever a client connects. Stale entries left behind
+	by dropped clients are harmless since lookups check the slot still matches.
+
+===================================================================================================
+*/
+
+#define CLIENT_HASH_SIZE	( MAX_CLIENTS * 4 )		// power of two, at most a quarter full
+
+static uint16 s_clientHash[CLIENT_HASH_SIZE];
+
+static uint SV_ClientHashKey( const netadr_t &adr, int qport )
+{
+	uint key = ( adr.type == NA_IP ) ? adr.ip.ui : 0;
+
+	key ^= ( (uint)adr.type << 16 ) ^ (uint)qport;
+	key *= 0x9E3779B1u;
+	key ^= key >> 15;
+
+	return key & ( CLIENT_HASH_SIZE - 1 );
+}
+
+/*
+========================
+SV_RebuildClientHash
+========================
+*/
+void SV_RebuildClientHash()
+{
+	memset( s_clientHash, 0, sizeof( s_clientHash ) );
+
+	if ( !svs.clients ) {
+		return;
+	}
+
+	for ( int i = 0; i < maxclients->GetInt(); ++i )
+	{
+		const client_t *cl = &svs.clients[i];
+		if ( cl->state == cs_free ) {
+			continue;
+		}
+
+		uint slot = SV_ClientHashKey( cl->netchan.remote_address, cl->netchan.qport );
+		while ( s_clientHash[slot] != 0 )
+		{
+			slot = ( slot + 1 ) & ( CLIENT_HASH_SIZE - 1 );
+		}
+		s_clientHash[slot] = (uint16)( i + 1 );
+	}
+}
+
+/*
+========================
+SV_FindClient
+
+Returns the connected client a packet from adr with qport belongs to
+========================
+*/
+static client_t *SV_FindClient( const netadr_t &adr, int qport )
+{
+	uint slot = SV_ClientHashKey( adr, qport );
+
+	for ( ; s_clientHash[slot] != 0; slot = ( slot + 1 ) & ( CLIENT_HASH_SIZE - 1 ) )
+	{
+		int index = s_clientHash[slot] - 1;
+		if ( index >= maxclients->GetInt() ) {
+			continue;
+		}
+
+		client_t *cl = &svs.clients[index];
+		if ( cl->state == cs_free ) {
+			continue;
+		}
+		if ( !NET_CompareBaseNetadr( adr, cl->netchan.remote_address ) ) {
+			continue;
+		}
+		if ( cl->netchan.qport != qport ) {
+			continue;
+		}
+
+		return cl;
+	}
+
+	return nullptr;
+}
+
 /*
 ========================
 SV_ReadPackets
@@ -600,58 +698,43 @@ SV_ReadPackets
 */
 static void SV_ReadPackets()
 {
-	int			i;
-	client_t *	cl;
-	int			qport;
+	client_t *		cl;
+	netPacketInfo_t	info;
 
-	while ( NET_GetPacket( NS_SERVER, &net_from, &net_message ) )
+	while ( NET_GetPacket( NS_SERVER, &net_from, &net_message, &info ) )
 	{
 		// check for connectionless packet (0xffffffff) first
-		if ( *(int *)net_message.data == -1 )
+		if ( info.connectionless )
 		{
 			SV_ConnectionlessPacket();
 			continue;
 		}
 
-		// read the qport out of the message so we can fix up
+		// the qport was read out of the message so we can fix up
 		// stupid address translating routers
-		MSG_BeginReading( &net_message );
-		MSG_ReadLong( &net_message );		// sequence number
-		MSG_ReadLong( &net_message );		// sequence number
-		qport = MSG_ReadShort( &net_message ) & 0xffff;
+		cl = SV_FindClient( net_from, info.qport );
+		if ( !cl ) {
+			continue;
+		}
 
-		// check for packets from connected clients
-		for ( i = 0, cl = svs.clients; i < maxclients->GetInt(); i++, cl++ )
+		// packets can sit in the queue for a whole frame, so
+		// latency is measured from when this one really arrived
+		svs.packettime = svs.realtime - Max( Sys_Milliseconds() - info.time, 0 );
+
+		if ( cl->netchan.remote_address.port != net_from.port )
 		{
-			if ( cl->state == cs_free ) {
-				continue;
-			}
-			if ( !NET_CompareBaseNetadr( net_from, cl->netchan.remote_address ) ) {
-				continue;
-			}
-			if ( cl->netchan.qport != qport ) {
-				continue;
-			}
-			if ( cl->netchan.remote_address.port != net_from.port )
-			{
-				Com_Printf( "SV_ReadPackets: fixing up a translated port\n" );
-				cl->netchan.remote_address.port = net_from.port;
-			}
+			Com_Printf( "SV_ReadPackets: fixing up a translated port\n" );
+			cl->netchan.remote_address.port = net_from.port;
+		}
 
-			if ( Netchan_Process( &cl->netchan, &net_message ) )
+		if ( Netchan_Process( &cl->netchan, &net_message ) )
+		{
+			// this is a valid, sequenced packet, so process it
+			if ( cl->state != cs_zombie )
 			{
-				// this is a valid, sequenced packet, so process it
-				if ( cl->state != cs_zombie )
-				{
-					cl->lastmessage = svs.realtime;	// don't timeout
-					SV_ExecuteClientMessage( cl );
-				}
+				cl->lastmessage = svs.realtime;	// don't timeout
+				SV_ExecuteClientMessage( cl );
 			}
-			break;
-		}
-
-		if ( i != maxclients->GetInt() ) {
-			continue;
 		}
 	}
 }
@@ -1061,6 +1144,9 @@ void SV_Shutdown( const char *finalmsg, bool reconnect )
 	Master_Shutdown();
 	SV_ShutdownGameProgs();
 
+	// after the final message so it still goes out
+	NET_StopIOThread( NS_SERVER );
+
 	// free current level
 	if ( sv.demofile ) {
 		FileSystem::CloseFile( sv.demofile );
@@ -1069,7 +1155,11 @@ void SV_Shutdown( const char *finalmsg, bool reconnect )
 	Com_SetServerState( sv.state );
 
 	// free server static data
-	if ( svs.clients ) {
+	if ( svs.clients )
+	{
+		for ( int i = 0; i < maxclients->GetInt(); ++i ) {
+			Netchan_Shutdown( &svs.clients[i].netchan );
+		}
 		Mem_Free( svs.clients );
 	}
 	if ( svs.client_entities ) {
@@ -196,9 +196,7 @@ void SV_Multicast( vec3_t origin, multicast_t to )
 
 		if ( mask )
 		{
-			leafnum = CM_PointLeafnum( client->edict->s.origin );
-			cluster = CM_LeafCluster( leafnum );
-			area2 = CM_LeafArea( leafnum );
+			SV_ClientViewLeaf( client, &cluster, &area2 );
 			if ( !CM_AreasConnected( area1, area2 ) ) {
 				continue;
 			}
@@ -377,6 +375,8 @@ void SV_StartSound( vec3_t origin, edict_t *entity, int channel,
 /*
 ========================
 SV_SendClientDatagram
+
+The frame must have been built with SV_BuildClientFrames
 ========================
 */
 static void SV_SendClientDatagram( client_t *client )
@@ -384,8 +384,6 @@ static void SV_SendClientDatagram( client_t *client )
 	byte		msg_buf[MAX_MSGLEN];
 	sizebuf_t	msg;
 
-	SV_BuildClientFrame( client );
-
 	SZ_Init( &msg, msg_buf, sizeof( msg_buf ) );
 	msg.allowoverflow = true;
 
@@ -481,8 +479,11 @@ void SV_SendClientMessages()
 	int			msglen;
 	byte		msgbuf[MAX_MSGLEN];
 	int			r;
+	client_t *	datagramClients[MAX_CLIENTS];
+	int			numDatagramClients;
 
 	msglen = 0;
+	numDatagramClients = 0;
 
 	// read the next demo message if needed
 	if ( sv.state == ss_demo && sv.demofile )
@@ -518,6 +519,9 @@ void SV_SendClientMessages()
 		}
 	}
 
+	// queue everything up so it goes out together at the end
+	NET_BeginPacketBatch( NS_SERVER );
+
 	// send a message to each connected client
 	for ( i = 0, c = svs.clients; i < maxclients->GetInt(); i++, c++ )
 	{
@@ -545,7 +549,8 @@ void SV_SendClientMessages()
 				continue;
 			}
 
-			SV_SendClientDatagram( c );
+			// frames are built for everyone at once below
+			datagramClients[numDatagramClients++] = c;
 		}
 		else
 		{
@@ -555,4 +560,13 @@ void SV_SendClientMessages()
 			}
 		}
 	}
+
+	SV_BuildClientFrames( datagramClients, numDatagramClients );
+
+	for ( i = 0; i < numDatagramClients; i++ )
+	{
+		SV_SendClientDatagram( datagramClients[i] );
+	}
+
+	NET_FlushPackets( NS_SERVER );
 }
@@ -256,9 +256,13 @@ static void SV_NextDownload_f()
 		return;
 	}
 
+	// the net channel fragments anything too big for one datagram, so send as much
+	// as the connect commands do rather than a round trip per kilobyte
 	r = sv_client->downloadsize - sv_client->downloadcount;
-	if ( r > 1024 ) {
-		r = 1024;
+	r = Min( r, MAX_MSGLEN / 2 );
+	r = Min( r, sv_client->netchan.message.maxsize - sv_client->netchan.message.cursize - 4 );
+	if ( r < 0 ) {
+		r = 0;
 	}
 
 	MSG_WriteByte( &sv_client->netchan.message, svc_download );
@@ -582,7 +586,7 @@ void SV_ExecuteClientMessage( client_t *cl )
 				cl->lastframe = lastframe;
 				if ( cl->lastframe > 0 ) {
 					cl->frame_latency[cl->lastframe & ( LATENCY_COUNTS - 1 )] =
-						svs.realtime - cl->frames[cl->lastframe & UPDATE_MASK].senttime;
+						svs.packettime - cl->frames[cl->lastframe & UPDATE_MASK].senttime;
 				}
 			}
 
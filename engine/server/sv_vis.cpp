@@ -0,0 +1,460 @@
+// Entity visibility index
+
+#include "sv_local.h"
+
+#include <bit>
+
+/*
+===================================================================================================
+
+	Entity visibility index
+
+	Rebuilt once per server frame after the game has linked everything. Instead of testing
+	every edict against every client's PVS, edicts are bucketed by the clusters and areas
+	they touch, so a client's visible set is the OR of the cluster buckets in its PVS ANDed
+	with the OR of the area buckets it's connected to, a handful of words per bucket.
+
+	Edicts the buckets can't describe, beams that only check one point against the PHS and
+	edicts touching too many leafs that go by headnode, stay on a short list and are tested
+	one by one like before.
+
+===================================================================================================
+*/
+
+#define VIS_WORDS		( MAX_EDICTS / 64 )
+
+struct visBits_t
+{
+	uint64	words[VIS_WORDS];
+};
+
+struct visBuckets_t
+{
+	int *		bucketOf;		// [maxKeys], -1 when nothing touches the key
+	int *		keys;			// [maxKeys], the key of each used bucket
+	visBits_t *	bits;			// [maxKeys]
+	int			maxKeys;
+	int			numBuckets;
+};
+
+struct visIndex_t
+{
+	visBuckets_t	clusters;
+	visBuckets_t	areas;
+
+	visBits_t		candidates;			// everything that could be sent at all
+	visBits_t		bucketed;			// candidates decided by the buckets
+	visBits_t		soundOnly;			// no model, dropped past 400 units
+
+	int				numSpecial;
+	int				special[MAX_EDICTS];
+};
+
+// the view point of every client, for multicasts
+struct visClientPoint_t
+{
+	vec3_t	origin;
+	int		cluster;
+	int		area;
+	bool	valid;
+};
+
+static visIndex_t		sv_visIndex;
+static visClientPoint_t	sv_visClientPoints[MAX_CLIENTS];
+
+static StaticCvar sv_useVisIndex( "sv_useVisIndex", "1", 0, "Cull client frames with the cluster and area buckets." );
+
+static inline void VisBits_Set( visBits_t &bits, int n )
+{
+	bits.words[n >> 6] |= 1ull << ( n & 63 );
+}
+
+static inline bool VisBits_Test( const visBits_t &bits, int n )
+{
+	return ( bits.words[n >> 6] >> ( n & 63 ) ) & 1;
+}
+
+static inline void VisBits_Or( visBits_t &out, const visBits_t &in )
+{
+	for ( int i = 0; i < VIS_WORDS; ++i )
+	{
+		out.words[i] |= in.words[i];
+	}
+}
+
+static void VisBuckets_Reserve( visBuckets_t &buckets, int maxKeys )
+{
+	if ( maxKeys <= buckets.maxKeys ) {
+		return;
+	}
+
+	if ( buckets.bucketOf )
+	{
+		Mem_Free( buckets.bucketOf );
+		Mem_Free( buckets.keys );
+		Mem_Free( buckets.bits );
+	}
+
+	buckets.bucketOf = (int *)Mem_Alloc( sizeof( int ) * maxKeys );
+	buckets.keys = (int *)Mem_Alloc( sizeof( int ) * maxKeys );
+	buckets.bits = (visBits_t *)Mem_Alloc( sizeof( visBits_t ) * maxKeys );
+	buckets.maxKeys = maxKeys;
+	buckets.numBuckets = 0;
+
+	for ( int i = 0; i < maxKeys; ++i )
+	{
+		buckets.bucketOf[i] = -1;
+	}
+}
+
+static void VisBuckets_Clear( visBuckets_t &buckets )
+{
+	for ( int i = 0; i < buckets.numBuckets; ++i )
+	{
+		buckets.bucketOf[buckets.keys[i]] = -1;
+	}
+	buckets.numBuckets = 0;
+}
+
+static void VisBuckets_Add( visBuckets_t &buckets, int key, int entnum )
+{
+	if ( key < 0 || key >= buckets.maxKeys ) {
+		Com_Errorf( "VisBuckets_Add: bad key %d\n", key );
+	}
+
+	int bucket = buckets.bucketOf[key];
+	if ( bucket == -1 )
+	{
+		bucket = buckets.numBuckets++;
+		buckets.bucketOf[key] = bucket;
+		buckets.keys[bucket] = key;
+		memset( &buckets.bits[bucket], 0, sizeof( visBits_t ) );
+	}
+
+	VisBits_Set( buckets.bits[bucket], entnum );
+}
+
+/*
+========================
+SV_ClearVisIndex
+
+Empties the buckets, every frame before they are filled again
+========================
+*/
+void SV_ClearVisIndex()
+{
+	VisBuckets_Clear( sv_visIndex.clusters );
+	VisBuckets_Clear( sv_visIndex.areas );
+
+	memset( &sv_visIndex.candidates, 0, sizeof( sv_visIndex.candidates ) );
+	memset( &sv_visIndex.bucketed, 0, sizeof( sv_visIndex.bucketed ) );
+	memset( &sv_visIndex.soundOnly, 0, sizeof( sv_visIndex.soundOnly ) );
+	sv_visIndex.numSpecial = 0;
+}
+
+/*
+========================
+SV_ResetVisIndex
+
+Called when a new map is loaded, cluster and area numbers mean something else now
+========================
+*/
+void SV_ResetVisIndex()
+{
+	SV_ClearVisIndex();
+
+	for ( int i = 0; i < MAX_CLIENTS; ++i )
+	{
+		sv_visClientPoints[i].valid = false;
+	}
+}
+
+/*
+========================
+SV_BuildVisIndex
+
+Buckets every edict that could be sent to a client,
+call after the game frame and before building client frames
+========================
+*/
+void SV_BuildVisIndex()
+{
+	edict_t *ent;
+	int		e, i;
+
+	SV_ClearVisIndex();
+
+	VisBuckets_Reserve( sv_visIndex.clusters, Max( CM_NumClusters(), 1 ) );
+	VisBuckets_Reserve( sv_visIndex.areas, MAX_MAP_AREAS );
+
+	for ( e = 1; e < ge->num_edicts; e++ )
+	{
+		ent = EDICT_NUM( e );
+
+		// same filters as the linear path
+		if ( ent->svflags & SVF_NOCLIENT ) {
+			continue;
+		}
+		if ( !ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event ) {
+			continue;
+		}
+
+		VisBits_Set( sv_visIndex.candidates, e );
+
+		if ( ( ent->s.renderfx & RF_BEAM ) || ent->num_clusters == -1 )
+		{
+			sv_visIndex.special[sv_visIndex.numSpecial++] = e;
+			continue;
+		}
+
+		VisBits_Set( sv_visIndex.bucketed, e );
+
+		if ( !ent->s.modelindex ) {
+			VisBits_Set( sv_visIndex.soundOnly, e );
+		}
+
+		for ( i = 0; i < ent->num_clusters; i++ )
+		{
+			VisBuckets_Add( sv_visIndex.clusters, ent->clusternums[i], e );
+		}
+
+		VisBuckets_Add( sv_visIndex.areas, ent->areanum, e );
+		if ( ent->areanum2 ) {
+			VisBuckets_Add( sv_visIndex.areas, ent->areanum2, e );
+		}
+	}
+}
+
+/*
+========================
+SV_EntityVisible
+
+The per edict test, clent itself is handled by the callers
+========================
+*/
+bool SV_EntityVisible( edict_t *ent, vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs )
+{
+	const byte *bitvector;
+	int		i, l;
+
+	// check area
+	if ( !CM_AreasConnected( clientarea, ent->areanum ) )
+	{
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !ent->areanum2 || !CM_AreasConnected( clientarea, ent->areanum2 ) ) {
+			// blocked by a door
+			return false;
+		}
+	}
+
+	// beams just check one point for PHS
+	if ( ent->s.renderfx & RF_BEAM )
+	{
+		l = ent->clusternums[0];
+		return ( clientphs[l >> 3] & ( 1 << ( l & 7 ) ) ) != 0;
+	}
+
+	// FIXME: if an ent has a model and a sound, but isn't
+	// in the PVS, only the PHS, clear the model
+	if ( ent->s.sound ) {
+		bitvector = fatpvs;		//clientphs;
+	} else {
+		bitvector = fatpvs;
+	}
+
+	if ( ent->num_clusters == -1 )
+	{
+		// too many leafs for individual check, go by headnode
+		if ( !CM_HeadnodeVisible( ent->headnode, (byte *)bitvector ) ) {
+			return false;
+		}
+	}
+	else
+	{	// check individual leafs
+		for ( i = 0; i < ent->num_clusters; i++ )
+		{
+			l = ent->clusternums[i];
+			if ( bitvector[l >> 3] & ( 1 << ( l & 7 ) ) ) {
+				break;
+			}
+		}
+		if ( i == ent->num_clusters ) {
+			// not visible
+			return false;
+		}
+	}
+
+	if ( !ent->s.modelindex )
+	{
+		// don't send sounds if they will be attenuated away
+		if ( VectorDistance( org, ent->s.origin ) > 400 ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+========================
+SV_LinearVisibleEntities
+
+Tests every edict, the reference for the index
+========================
+*/
+int SV_LinearVisibleEntities( vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs, edict_t *clent, int *list )
+{
+	edict_t *ent;
+	int		e;
+	int		count = 0;
+
+	for ( e = 1; e < ge->num_edicts; e++ )
+	{
+		ent = EDICT_NUM( e );
+
+		// ignore ents without visible models
+		if ( ent->svflags & SVF_NOCLIENT ) {
+			continue;
+		}
+
+		// ignore ents without visible models unless they have an effect
+		if ( !ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event ) {
+			continue;
+		}
+
+		// ignore if not touching a PV leaf
+		if ( ent != clent && !SV_EntityVisible( ent, org, clientarea, fatpvs, clientphs ) ) {
+			continue;
+		}
+
+		list[count++] = e;
+	}
+
+	return count;
+}
+
+/*
+========================
+SV_IndexedVisibleEntities
+
+Same results as SV_LinearVisibleEntities from the buckets,
+read only so any number of threads can use it at once
+========================
+*/
+int SV_IndexedVisibleEntities( vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs, edict_t *clent, int *list )
+{
+	const visIndex_t &index = sv_visIndex;
+	visBits_t	clusterVis{};
+	visBits_t	areaVis{};
+	visBits_t	vis;
+	int			i, key;
+
+	for ( i = 0; i < index.clusters.numBuckets; i++ )
+	{
+		key = index.clusters.keys[i];
+		if ( fatpvs[key >> 3] & ( 1 << ( key & 7 ) ) ) {
+			VisBits_Or( clusterVis, index.clusters.bits[i] );
+		}
+	}
+
+	for ( i = 0; i < index.areas.numBuckets; i++ )
+	{
+		if ( CM_AreasConnected( clientarea, index.areas.keys[i] ) ) {
+			VisBits_Or( areaVis, index.areas.bits[i] );
+		}
+	}
+
+	for ( i = 0; i < VIS_WORDS; i++ )
+	{
+		vis.words[i] = clusterVis.words[i] & areaVis.words[i] & index.bucketed.words[i];
+	}
+
+	// sounds that will be attenuated away
+	for ( i = 0; i < VIS_WORDS; i++ )
+	{
+		uint64 sounds = vis.words[i] & index.soundOnly.words[i];
+		while ( sounds )
+		{
+			int bit = std::countr_zero( sounds );
+			sounds &= sounds - 1;
+
+			edict_t *ent = EDICT_NUM( i * 64 + bit );
+			if ( VectorDistance( org, ent->s.origin ) > 400 ) {
+				vis.words[i] &= ~( 1ull << bit );
+			}
+		}
+	}
+
+	for ( i = 0; i < index.numSpecial; i++ )
+	{
+		edict_t *ent = EDICT_NUM( index.special[i] );
+		if ( ent != clent && SV_EntityVisible( ent, org, clientarea, fatpvs, clientphs ) ) {
+			VisBits_Set( vis, index.special[i] );
+		}
+	}
+
+	// the client always sees itself
+	if ( clent )
+	{
+		int clentnum = NUM_FOR_EDICT( clent );
+		if ( VisBits_Test( index.candidates, clentnum ) ) {
+			VisBits_Set( vis, clentnum );
+		}
+	}
+
+	int count = 0;
+	for ( i = 0; i < VIS_WORDS; i++ )
+	{
+		uint64 word = vis.words[i];
+		while ( word )
+		{
+			list[count++] = i * 64 + std::countr_zero( word );
+			word &= word - 1;
+		}
+	}
+
+	return count;
+}
+
+/*
+========================
+SV_VisibleEntities
+
+Lists the edicts visible from org in ascending order, returns the count
+========================
+*/
+int SV_VisibleEntities( vec3_t org, int clientarea, const byte *fatpvs, const byte *clientphs, edict_t *clent, int *list )
+{
+	if ( sv_useVisIndex.GetBool() ) {
+		return SV_IndexedVisibleEntities( org, clientarea, fatpvs, clientphs, clent, list );
+	}
+
+	return SV_LinearVisibleEntities( org, clientarea, fatpvs, clientphs, clent, list );
+}
+
+/*
+========================
+SV_ClientViewLeaf
+
+Cluster and area of a client's origin for multicasts, only looked
+up again when the client has actually moved
+========================
+*/
+void SV_ClientViewLeaf( client_t *client, int *cluster, int *area )
+{
+	visClientPoint_t &point = sv_visClientPoints[client - svs.clients];
+	const float *origin = client->edict->s.origin;
+
+	if ( !point.valid || !VectorCompare( point.origin, origin ) )
+	{
+		int leafnum = CM_PointLeafnum( (float *)origin );
+		point.cluster = CM_LeafCluster( leafnum );
+		point.area = CM_LeafArea( leafnum );
+		VectorCopy( origin, point.origin );
+		point.valid = true;
+	}
+
+	*cluster = point.cluster;
+	*area = point.area;
+}
@@ -690,6 +690,39 @@ static void SV_TraceBounds( const vec3_t start, const vec3_t mins, const vec3_t
 #endif
 }
 
+/*
+========================
+SV_ClipTraceToEntities
+
+Takes a trace that has been clipped to the world and clips it against
+all the solid entities along the move
+========================
+*/
+static void SV_ClipTraceToEntities( moveclip_t &clip, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask )
+{
+	clip.trace.ent = ge->edicts;
+	if ( clip.trace.fraction == 0.0f ) {
+		// blocked by the world
+		return;
+	}
+
+	clip.contentmask = contentmask;
+	clip.start = start;
+	clip.end = end;
+	clip.mins = mins;
+	clip.maxs = maxs;
+	clip.passedict = passedict;
+
+	VectorCopy( mins, clip.mins2 );
+	VectorCopy( maxs, clip.maxs2 );
+
+	// create the bounding box of the entire move
+	SV_TraceBounds( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+
+	// clip to other solid entities
+	SV_ClipMoveToEntities( clip );
+}
+
 /*
 ========================
 SV_Trace
@@ -714,27 +747,36 @@ trace_t SV_Trace( vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *p
 
 	// clip to world
 	clip.trace = CM_BoxTrace( start, end, mins, maxs, 0, contentmask );
-	clip.trace.ent = ge->edicts;
-	if ( clip.trace.fraction == 0.0f ) {
-		// blocked by the world
-		return clip.trace;
-	}
 
-	clip.contentmask = contentmask;
-	clip.start = start;
-	clip.end = end;
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.passedict = passedict;
+	SV_ClipTraceToEntities( clip, start, mins, maxs, end, passedict, contentmask );
 
-	VectorCopy( mins, clip.mins2 );
-	VectorCopy( maxs, clip.maxs2 );
+	return clip.trace;
+}
 
-	// create the bounding box of the entire move
-	SV_TraceBounds( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+/*
+========================
+SV_TraceBatch
 
-	// clip to other solid entities
-	SV_ClipMoveToEntities( clip );
+Runs count traces at once, results[i] is what SV_Trace would return for
+requests[i]. The world part of every trace goes down the BSP together.
+========================
+*/
+void SV_TraceBatch( const traceRequest_t *requests, int count, trace_t *results )
+{
+	// clip to world
+	CM_BoxTraceBatch( requests, count, results, 0 );
 
-	return clip.trace;
+	for ( int i = 0; i < count; ++i )
+	{
+		traceRequest_t request = requests[i];
+		moveclip_t clip;
+
+		memset( &clip, 0, sizeof( moveclip_t ) );
+
+		clip.trace = results[i];
+
+		SV_ClipTraceToEntities( clip, request.start, request.mins, request.maxs, request.end, request.passent, request.contentmask );
+
+		results[i] = clip.trace;
+	}
 }
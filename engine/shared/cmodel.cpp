@@ -5,10 +5,10 @@
 #include "engine.h"
 
 #include <vector>
+#include <thread>
+#include <bit>
 
-#include <Jolt/Jolt.h>
-#include <Jolt/Math/Float3.h>
-#include <Jolt/Geometry/IndexedTriangle.h>
+#include "../../core/simd.h"
 
 #include "cmodel.h"
 
@@ -38,7 +38,6 @@ struct cbrush_t
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;		// to avoid repeated testings
 };
 
 struct carea_t
@@ -57,6 +56,7 @@ private:
 	T *data;
 	int count;		// The amount of Ts in use
 	int reserved;	// The amount of Ts we have reserved
+	T *allocation;	// What we own, data points somewhere else when borrowing
 
 public:
 
@@ -65,7 +65,7 @@ public:
 	// Return a reference to an element in this array
 	T &Data( int index )
 	{
-		Assert( index < reserved );	// Kinda sucks, we need to do this for the secret box hull crap
+		Assert( index < ( data == allocation ? reserved : count ) );	// Kinda sucks, we need to do this for the secret box hull crap
 		return data[index];
 	}
 
@@ -89,6 +89,7 @@ public:
 	// Set all used elements in this array to 0
 	void Clear()
 	{
+		Assert( data == allocation );
 		memset( data, 0, SizeInBytes() );
 	}
 
@@ -97,6 +98,7 @@ public:
 	// Make clients forget about the data in here
 	void Forget()
 	{
+		data = allocation;
 		count = 0;
 	}
 
@@ -107,24 +109,34 @@ public:
 		{
 			reserved = newcount + extra;
 			// SlartTodo: Is it more efficient to realloc here? We don't care about our data at this point
-			if ( data )
+			if ( allocation )
 			{
-				Mem_Free( data );
+				Mem_Free( allocation );
 			}
-			data = (T *)Mem_Alloc( reserved * sizeof( T ) );
+			allocation = (T *)Mem_Alloc( reserved * sizeof( T ) );
 		}
+		data = allocation;
 		// Don't bother clearing memory, it will be written over by clients
 	}
 
+	// Point at memory we don't own, like a lump in the mapped map file.
+	// Our own allocation is kept around for the next PrepForNewData
+	void Borrow( T *borrowed, int newcount )
+	{
+		data = borrowed;
+		count = newcount;
+	}
+
 	void Free()
 	{
-		if ( data )
+		if ( allocation )
 		{
-			Mem_Free( data );
-			data = nullptr;
+			Mem_Free( allocation );
+			allocation = nullptr;
 			reserved = 0;
-			count = 0;
 		}
+		data = nullptr;
+		count = 0;
 	}
 };
 
@@ -153,10 +165,12 @@ struct cmMapData_t
 
 	IPhysicsShape *				pPhysicsShape;
 
+	FileSystem::mappedFile_t	file;				// Lumps that match the runtime layout are read in place
+
 	int			numclusters = 1;
 
 	int			floodvalid;
-	int			checkcount;
+	int			sequence;			// bumped on every load, lets trace contexts know their brush stamps are stale
 
 	cmArray_t<bool>		portalopen;
 
@@ -178,9 +192,9 @@ struct cmMapData_t
 		areas.Forget();
 		areaportals.Forget();
 
-		checkcount = 0;
-
 		portalopen.Forget();
+
+		FileSystem::UnmapFile( file );
 	}
 
 	// Clear all allocated memory
@@ -200,6 +214,8 @@ struct cmMapData_t
 		areaportals.Free();
 
 		portalopen.Free();
+
+		FileSystem::UnmapFile( file );
 	}
 };
 
@@ -208,9 +224,9 @@ csurface_t			s_nullsurface;
 
 static StaticCvar cm_noAreas( "cm_noAreas", "0", 0, "If true, ignore areas and areaportals.\n" );
 
-// Counters
-int		c_pointcontents;
-int		c_traces, c_brush_traces;
+// Counters, per thread so traces running in parallel don't fight over them
+thread_local int	c_pointcontents;
+thread_local int	c_traces, c_brush_traces;
 
 void	CM_InitBoxHull (void);
 void	FloodAreaConnections (void);
@@ -581,6 +597,13 @@ static void CMod_LoadVisibility( byte *cmod_base, lump_t *l )
 		return;
 	}
 
+	if ( std::endian::native == std::endian::little && !cm.file.loaded )
+	{
+		// Nothing to swap, read it straight out of the file
+		cm.vis.Borrow( cmod_base + l->fileofs, count );
+		return;
+	}
+
 	cm.vis.PrepForNewData( count );
 
 	memcpy( cm.vis.Base(), cmod_base + l->fileofs, count );
@@ -610,20 +633,233 @@ static void CMod_LoadEntityString( byte *cmod_base, lump_t *l )
 		return;
 	}
 
-	cm.entitystring.PrepForNewData( count );
+	char *in = (char *)( cmod_base + l->fileofs );
+
+	// Parsed in place, but only if we can't run off the end
+	if ( in[count - 1] == '\0' && !cm.file.loaded )
+	{
+		cm.entitystring.Borrow( in, count );
+		return;
+	}
+
+	cm.entitystring.PrepForNewData( count + 1 );
 
-	memcpy( cm.entitystring.Base(), cmod_base + l->fileofs, count );
+	memcpy( cm.entitystring.Base(), in, count );
+	cm.entitystring.Data( count ) = '\0';
 }
 
-//
-// Builds a horrid collision mesh for Jolt
-//
-static void CM_BuildCollisionMesh( const byte *base )
+/*
+===============================================================================
+
+JOLT WORLD COLLISION
+
+The world goes to Jolt as the convex hulls of its solid brushes rather than a
+triangle soup of the render faces. Hulls are grouped by the node they sit
+entirely inside a few levels down the tree, so each group becomes a sub
+compound with tight bounds. The built shape is cached in Jolt's own binary
+format, keyed on the map checksum.
+
+===============================================================================
+*/
+
+#define WORLD_REGION_DEPTH		6		// how far down the tree brushes get grouped
+#define WORLD_PLANE_EPSILON		0.1f	// corners can sit this far outside a side
+#define WORLD_POINT_EPSILON		0.1f	// corners closer than this are the same one
+
+#define PHYSCACHE_IDENT			MakeFourCC( 'J', 'P', 'H', 'Y' )
+#define PHYSCACHE_VERSION		1
+
+struct physCacheHeader_t
+{
+	uint32	ident;
+	uint32	version;
+	uint32	checksum;		// of the bsp it was built from
+	uint32	dataSize;
+};
+
+static StaticCvar cm_physicsCache( "cm_physicsCache", "1", 0, "Load and save the Jolt world collision in the cache directory.\n" );
+
+/*
+=================
+CM_AddBrushPoints
+
+Appends the corners of a brush, every point where three
+sides meet that isn't outside any of the others
+=================
+*/
+static void CM_AddBrushPoints( const cbrush_t &brush, std::vector<vec3> &points )
+{
+	const size_t firstPoint = points.size();
+	const cbrushside_t *sides = cm.brushsides.Base() + brush.firstbrushside;
+
+	for ( int i = 0; i < brush.numsides; ++i )
+	{
+		const cplane_t *p1 = sides[i].plane;
+
+		for ( int j = i + 1; j < brush.numsides; ++j )
+		{
+			const cplane_t *p2 = sides[j].plane;
+
+			vec3_t cross12;
+			CrossProduct( p1->normal, p2->normal, cross12 );
+
+			for ( int k = j + 1; k < brush.numsides; ++k )
+			{
+				const cplane_t *p3 = sides[k].plane;
+
+				const float det = DotProduct( cross12, p3->normal );
+				if ( fabsf( det ) < 1e-6f )
+				{
+					continue;
+				}
+
+				vec3_t cross23, cross31, point;
+				CrossProduct( p2->normal, p3->normal, cross23 );
+				CrossProduct( p3->normal, p1->normal, cross31 );
+
+				VectorScale( cross23, p1->dist, point );
+				VectorMA( point, p2->dist, cross31, point );
+				VectorMA( point, p3->dist, cross12, point );
+				VectorScale( point, 1.0f / det, point );
+
+				bool inside = true;
+				for ( int s = 0; s < brush.numsides && inside; ++s )
+				{
+					inside = DotProduct( point, sides[s].plane->normal ) - sides[s].plane->dist <= WORLD_PLANE_EPSILON;
+				}
+				if ( !inside )
+				{
+					continue;
+				}
+
+				bool duplicate = false;
+				for ( size_t p = firstPoint; p < points.size() && !duplicate; ++p )
+				{
+					vec3_t delta;
+					VectorSubtract( point, points[p].v, delta );
+					duplicate = VectorLengthSquare( delta ) < WORLD_POINT_EPSILON * WORLD_POINT_EPSILON;
+				}
+				if ( !duplicate )
+				{
+					points.emplace_back( point );
+				}
+			}
+		}
+	}
+}
+
+/*
+=================
+CM_MarkWorldBrushes_r
+=================
+*/
+static void CM_MarkWorldBrushes_r( int nodenum, std::vector<bool> &used )
+{
+	while ( nodenum >= 0 )
+	{
+		const cnode_t &node = cm.nodes.Data( nodenum );
+		CM_MarkWorldBrushes_r( node.children[0], used );
+		nodenum = node.children[1];
+	}
+
+	const cleaf_t &leaf = cm.leafs.Data( -1 - nodenum );
+
+	for ( int i = 0; i < leaf.numleafbrushes; ++i )
+	{
+		used[cm.leafbrushes.Data( leaf.firstleafbrush + i )] = true;
+	}
+}
+
+/*
+=================
+CM_BrushRegion
+
+The deepest node within WORLD_REGION_DEPTH that has
+the whole brush on one side of every plane above it
+=================
+*/
+static int CM_BrushRegion( const vec3 *points, int numPoints )
+{
+	int nodenum = cm.cmodels.Data( 0 ).headnode;
+
+	for ( int depth = 0; depth < WORLD_REGION_DEPTH && nodenum >= 0; ++depth )
+	{
+		const cnode_t &node = cm.nodes.Data( nodenum );
+
+		bool front = false, back = false;
+		for ( int i = 0; i < numPoints; ++i )
+		{
+			const float d = DotProduct( points[i].v, node.plane->normal ) - node.plane->dist;
+			front |= d > WORLD_PLANE_EPSILON;
+			back |= d < -WORLD_PLANE_EPSILON;
+		}
+
+		if ( front && back )
+		{
+			break;
+		}
+
+		nodenum = node.children[back ? 1 : 0];
+	}
+
+	return nodenum;
+}
+
+/*
+=================
+CM_BuildWorldShape
+
+Builds the world from the solid brushes reachable from model 0
+=================
+*/
+static IPhysicsShape *CM_BuildWorldShape()
+{
+	const int numBrushes = cm.brushes.Count();
+
+	std::vector<bool> used( numBrushes );
+	CM_MarkWorldBrushes_r( cm.cmodels.Data( 0 ).headnode, used );
+
+	std::vector<vec3> points;
+	std::vector<physConvexHull_t> hulls;
+
+	for ( int i = 0; i < numBrushes; ++i )
+	{
+		const cbrush_t &brush = cm.brushes.Data( i );
+
+		if ( !used[i] || !( brush.contents & MASK_SOLID ) )
+		{
+			continue;
+		}
+
+		physConvexHull_t &hull = hulls.emplace_back();
+		hull.firstPoint = static_cast<int>( points.size() );
+		CM_AddBrushPoints( brush, points );
+		hull.numPoints = static_cast<int>( points.size() ) - hull.firstPoint;
+		hull.region = CM_BrushRegion( points.data() + hull.firstPoint, hull.numPoints );
+	}
+
+	if ( hulls.empty() )
+	{
+		return nullptr;
+	}
+
+	return PhysicsImpl::GetSystem()->CreateStaticHullCompound( hulls.data(), static_cast<int>( hulls.size() ), reinterpret_cast<const vec3_t *>( points.data() ) );
+}
+
+/*
+=================
+CM_BuildWorldMesh
+
+The old way, a triangle soup of model 0's faces.
+Only kept around for cm_physicsBench to compare against
+=================
+*/
+static IPhysicsShape *CM_BuildWorldMesh( const byte *base )
 {
 	const dheader_t *header = (const dheader_t *)base;
 
-	JPH::VertexList outVertexList;
-	JPH::IndexedTriangleList outIndexList;
+	std::vector<vec3> vertices;
+	std::vector<int> indices;
 
 	std::vector<uint16> faceIndexList;
 	faceIndexList.reserve( 16 );
@@ -631,12 +867,15 @@ static void CM_BuildCollisionMesh( const byte *base )
 	// Vertices
 	{
 		const lump_t *vertexLump = header->lumps + LUMP_VERTEXES;
-		const dvertex_t *vertices = (const dvertex_t *)( base + vertexLump->fileofs );
+		const dvertex_t *vertexData = (const dvertex_t *)( base + vertexLump->fileofs );
 		const int numVertices = vertexLump->filelen / sizeof( dvertex_t );
 
-		outVertexList.resize( numVertices );
+		vertices.resize( numVertices );
 
-		memcpy( outVertexList.data(), vertices, vertexLump->filelen );
+		for ( int i = 0; i < numVertices; ++i )
+		{
+			vertices[i] = vec3( vertexData[i].point );
+		}
 	}
 
 	// Indices
@@ -659,7 +898,6 @@ static void CM_BuildCollisionMesh( const byte *base )
 		{
 			const dface_t *face = faces + iFace;
 
-			const int firstEdge = face->firstedge;
 			const int numEdges = face->numedges;
 
 			for ( int iEdge = 0; iEdge < numEdges; ++iEdge )
@@ -676,20 +914,131 @@ static void CM_BuildCollisionMesh( const byte *base )
 
 			for ( int i = 0; i < numTriangles; ++i )
 			{
-				JPH::IndexedTriangle &triangle = outIndexList.emplace_back();
-
 				// Jolt expects CCW I think
-				triangle.mIdx[0] = faceIndexList[i + 2];
-				triangle.mIdx[1] = faceIndexList[i + 1];
-				triangle.mIdx[2] = faceIndexList[0];
-				triangle.mMaterialIndex = 0;
+				indices.push_back( faceIndexList[i + 2] );
+				indices.push_back( faceIndexList[i + 1] );
+				indices.push_back( faceIndexList[0] );
 			}
 
 			faceIndexList.clear();
 		}
 	}
 
-	PhysicsImpl::GetScene()->CreateAndAddBody_World( reinterpret_cast<void *>( &outVertexList ), reinterpret_cast<void *>( &outIndexList ) );
+	return PhysicsImpl::GetSystem()->CreateMeshShape( reinterpret_cast<const vec3_t *>( vertices.data() ), static_cast<int>( vertices.size() ),
+		indices.data(), static_cast<int>( indices.size() / 3 ) );
+}
+
+static void CM_PhysicsCacheName( const char *mapName, char *fileName, strlen_t maxLen )
+{
+	char baseName[MAX_QPATH];
+	COM_FileBase( mapName, baseName );
+
+	Q_sprintf_s( fileName, maxLen, "cache/%s.jphys", baseName );
+}
+
+/*
+=================
+CM_LoadWorldShapeCache
+
+Returns null if there's no cache or it's for a different build of the map
+=================
+*/
+static IPhysicsShape *CM_LoadWorldShapeCache( const char *fileName, unsigned checksum )
+{
+	byte *buffer = nullptr;
+	const fsSize_t fileSize = FileSystem::LoadFile( fileName, (void **)&buffer );
+	if ( fileSize <= 0 || !buffer )
+	{
+		return nullptr;
+	}
+
+	IPhysicsShape *pShape = nullptr;
+
+	physCacheHeader_t header;
+	if ( fileSize >= (fsSize_t)sizeof( header ) )
+	{
+		memcpy( &header, buffer, sizeof( header ) );
+
+		if ( header.ident == PHYSCACHE_IDENT && header.version == PHYSCACHE_VERSION && header.checksum == checksum
+			&& header.dataSize == fileSize - sizeof( header ) )
+		{
+			pShape = PhysicsImpl::GetSystem()->LoadShape( buffer + sizeof( header ), header.dataSize );
+		}
+	}
+
+	FileSystem::FreeFile( buffer );
+
+	return pShape;
+}
+
+/*
+=================
+CM_SaveWorldShapeCache
+=================
+*/
+static void CM_SaveWorldShapeCache( const char *fileName, unsigned checksum, const IPhysicsShape *pShape )
+{
+	std::vector<byte> data;
+	if ( !PhysicsImpl::GetSystem()->SaveShape( pShape, data ) )
+	{
+		Com_Printf( S_COLOR_YELLOW "Couldn't serialize the world collision for %s\n", fileName );
+		return;
+	}
+
+	fsHandle_t handle = FileSystem::OpenFileWrite( fileName );
+	if ( !handle )
+	{
+		Com_Printf( S_COLOR_YELLOW "Couldn't open %s for writing\n", fileName );
+		return;
+	}
+
+	physCacheHeader_t header;
+	header.ident = PHYSCACHE_IDENT;
+	header.version = PHYSCACHE_VERSION;
+	header.checksum = checksum;
+	header.dataSize = static_cast<uint32>( data.size() );
+
+	FileSystem::WriteFile( &header, sizeof( header ), handle );
+	FileSystem::WriteFile( data.data(), static_cast<fsSize_t>( data.size() ), handle );
+	FileSystem::CloseFile( handle );
+}
+
+/*
+=================
+CM_LoadWorldShape
+
+Loads or builds the world collision and hands it to the physics scene
+=================
+*/
+static void CM_LoadWorldShape( const char *mapName, unsigned checksum )
+{
+	if ( cm.pPhysicsShape )
+	{
+		PhysicsImpl::GetSystem()->DestroyShape( cm.pPhysicsShape );
+		cm.pPhysicsShape = nullptr;
+	}
+
+	char fileName[MAX_OSPATH];
+	CM_PhysicsCacheName( mapName, fileName, sizeof( fileName ) );
+
+	if ( cm_physicsCache.GetBool() )
+	{
+		cm.pPhysicsShape = CM_LoadWorldShapeCache( fileName, checksum );
+	}
+
+	if ( !cm.pPhysicsShape )
+	{
+		const double start = Time_FloatMilliseconds();
+		cm.pPhysicsShape = CM_BuildWorldShape();
+		Com_DPrintf( "Built world collision in %.2f ms\n", Time_FloatMilliseconds() - start );
+
+		if ( cm.pPhysicsShape && cm_physicsCache.GetBool() )
+		{
+			CM_SaveWorldShapeCache( fileName, checksum, cm.pPhysicsShape );
+		}
+	}
+
+	PhysicsImpl::GetScene()->SetWorldShape( cm.pPhysicsShape );
 }
 
 //=================================================================================================
@@ -727,13 +1076,15 @@ cmodel_t *CM_LoadMap( const char *name, bool clientload, unsigned *checksum )
 	//
 	// load the file
 	//
-	byte *buf;
-	fsSize_t length = FileSystem::LoadFile( name, (void **)&buf );
-	if ( !buf )
+	if ( !FileSystem::MapFile( name, cm.file ) )
 	{
 		Com_Errorf("Couldn't load %s", name );
 	}
 
+	// The mapping is read-only, the loaders only ever read from buf
+	byte *buf = const_cast<byte *>( cm.file.data );
+	fsSize_t length = cm.file.size;
+
 	last_checksum = LittleLong( Com_BlockChecksum( buf, length ) );
 	*checksum = last_checksum;
 
@@ -763,12 +1114,18 @@ cmodel_t *CM_LoadMap( const char *name, bool clientload, unsigned *checksum )
 	CMod_LoadVisibility( buf, &header->lumps[LUMP_VISIBILITY] );
 	CMod_LoadEntityString( buf, &header->lumps[LUMP_ENTITIES] );
 
-	CM_BuildCollisionMesh( buf );
+	CM_LoadWorldShape( name, last_checksum );
 
-	FileSystem::FreeFile( buf );
+	// A copy isn't worth keeping around for a couple of lumps
+	if ( cm.file.loaded )
+	{
+		FileSystem::UnmapFile( cm.file );
+	}
 
 	CM_InitBoxHull();
 
+	cm.sequence++;
+
 	cm.portalopen.Clear();
 	FloodAreaConnections();
 
@@ -841,6 +1198,60 @@ int CM_LeafArea( int leafnum )
 
 //=======================================================================
 
+/*
+===============================================================================
+
+TRACE CONTEXTS
+
+Everything a single trace needs to remember lives in a trace context,
+including the brush stamps that stop a brush being tested twice and the
+planes of the box hull. Any number of traces can run at the same time as
+long as every thread uses its own context.
+
+The context-less functions use a context owned by the calling thread.
+
+===============================================================================
+*/
+
+#define NUM_BOX_PLANES		12
+
+// the state of one trace in flight
+struct cmTraceWork_t
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		extents;
+
+	trace_t		trace;
+	int			contents;
+	int			checkcount;
+	uint32		laneBit;			// which lane of a packet this is, 1 for single traces
+	bool		ispoint;			// optimized case
+};
+
+struct cmTraceContext_t
+{
+	cmTraceWork_t	work;			// for single traces
+
+	cplane_t	boxPlanes[NUM_BOX_PLANES];
+
+	int *		brushChecks = nullptr;	// checkcount of the last trace that tested each brush
+	uint32 *	brushLanes = nullptr;	// the lanes of that trace or packet that have tested it
+	int			numBrushChecks = 0;
+	int			checkcount = 0;
+	int			mapSequence = -1;
+
+	~cmTraceContext_t()
+	{
+		if ( brushChecks )
+		{
+			Mem_Free( brushChecks );
+			Mem_Free( brushLanes );
+		}
+	}
+};
+
+static thread_local cmTraceContext_t	s_threadTraceContext;
 
 cplane_t	*box_planes;
 int			box_headnode;
@@ -849,53 +1260,155 @@ cleaf_t		*box_leaf;
 
 /*
 ===================
-CM_InitBoxHull
-
-Set up the planes and nodes so that the six floats of a bounding box
-can just be stored out and get a proper clipping hull structure.
+CM_AllocTraceContext
 ===================
 */
-void CM_InitBoxHull (void)
+cmTraceContext_t *CM_AllocTraceContext()
 {
-	int			i;
-	int			side;
-	cnode_t		*c;
-	cplane_t	*p;
-	cbrushside_t	*s;
+	return new cmTraceContext_t;
+}
 
-#if 0
-	if ( cm.nodes.Count()+6 > MAX_MAP_NODES
-		|| cm.brushes.Count()+1 > MAX_MAP_BRUSHES
-		|| cm.leafbrushes.Count()+1 > MAX_MAP_LEAFBRUSHES
-		|| cm.brushsides.Count()+6 > MAX_MAP_BRUSHSIDES
-		|| cm.planes.Count()+12 > MAX_MAP_PLANES )
-		Com_Error("Not enough room for box tree" );
-#endif
+void CM_FreeTraceContext( cmTraceContext_t *ctx )
+{
+	delete ctx;
+}
 
-	// Slart: This code assumes a spoof of the count, evil
+/*
+===================
+CM_BeginTrace
 
-	box_headnode = cm.nodes.Count();
-	box_planes = &cm.planes.Data( cm.planes.Count() );
+Makes sure the brush stamps fit the loaded map and returns a fresh checkcount
+===================
+*/
+static int CM_BeginTrace( cmTraceContext_t *ctx )
+{
+	if ( ctx->mapSequence != cm.sequence )
+	{
+		// the box brush lives one past the end
+		const int numBrushes = cm.brushes.Count() + 1;
 
-	box_brush = &cm.brushes.Data( cm.brushes.Count() );
-	box_brush->numsides = 6;
-	box_brush->firstbrushside = cm.brushsides.Count();
-	box_brush->contents = CONTENTS_MONSTER;
+		if ( numBrushes > ctx->numBrushChecks )
+		{
+			if ( ctx->brushChecks )
+			{
+				Mem_Free( ctx->brushChecks );
+				Mem_Free( ctx->brushLanes );
+			}
+			ctx->brushChecks = (int *)Mem_Alloc( numBrushes * sizeof( int ) );
+			ctx->brushLanes = (uint32 *)Mem_Alloc( numBrushes * sizeof( uint32 ) );
+			ctx->numBrushChecks = numBrushes;
+		}
 
-	box_leaf = &cm.leafs.Data( cm.leafs.Count() );
-	box_leaf->contents = CONTENTS_MONSTER;
-	box_leaf->firstleafbrush = cm.leafbrushes.Count();
-	box_leaf->numleafbrushes = 1;
+		memset( ctx->brushChecks, 0, ctx->numBrushChecks * sizeof( int ) );
+		ctx->checkcount = 0;
+		ctx->mapSequence = cm.sequence;
+	}
 
-	cm.leafbrushes.Data( cm.leafbrushes.Count() ) = cm.brushes.Count();
+	ctx->checkcount++;	// for multi-check avoidance
 
-	for (i=0 ; i<6 ; i++)
+	if ( ctx->checkcount == INT_MAX )
 	{
-		side = i&1;
+		// wrapped, start over
+		memset( ctx->brushChecks, 0, ctx->numBrushChecks * sizeof( int ) );
+		ctx->checkcount = 1;
+	}
 
-		// brush sides
-		s = &cm.brushsides.Data(cm.brushsides.Count()+i);
-		s->plane = &cm.planes.Data(cm.planes.Count()+i*2+side);
+	return ctx->checkcount;
+}
+
+/*
+===================
+CM_CheckBrush
+
+Returns true the first time a trace gets to a brush. The lanes of a packet
+share one checkcount, so each brush is stamped once per packet and every
+lane keeps its own bit
+===================
+*/
+static inline bool CM_CheckBrush( cmTraceContext_t *ctx, const cmTraceWork_t *work, int brushnum )
+{
+	if ( ctx->brushChecks[brushnum] != work->checkcount )
+	{
+		ctx->brushChecks[brushnum] = work->checkcount;
+		ctx->brushLanes[brushnum] = work->laneBit;
+		return true;
+	}
+
+	if ( ctx->brushLanes[brushnum] & work->laneBit )
+	{
+		return false;	// already checked this brush in another leaf
+	}
+
+	ctx->brushLanes[brushnum] |= work->laneBit;
+	return true;
+}
+
+/*
+===================
+CM_ContextPlane
+
+The box hull planes are per context, redirect any plane that belongs to it
+===================
+*/
+static inline cplane_t *CM_ContextPlane( cmTraceContext_t *ctx, cplane_t *plane )
+{
+	const ptrdiff_t index = plane - box_planes;
+	if ( index >= 0 && index < NUM_BOX_PLANES )
+	{
+		return ctx->boxPlanes + index;
+	}
+	return plane;
+}
+
+/*
+===================
+CM_InitBoxHull
+
+Set up the planes and nodes so that the six floats of a bounding box
+can just be stored out and get a proper clipping hull structure.
+===================
+*/
+void CM_InitBoxHull (void)
+{
+	int			i;
+	int			side;
+	cnode_t		*c;
+	cplane_t	*p;
+	cbrushside_t	*s;
+
+#if 0
+	if ( cm.nodes.Count()+6 > MAX_MAP_NODES
+		|| cm.brushes.Count()+1 > MAX_MAP_BRUSHES
+		|| cm.leafbrushes.Count()+1 > MAX_MAP_LEAFBRUSHES
+		|| cm.brushsides.Count()+6 > MAX_MAP_BRUSHSIDES
+		|| cm.planes.Count()+12 > MAX_MAP_PLANES )
+		Com_Error("Not enough room for box tree" );
+#endif
+
+	// Slart: This code assumes a spoof of the count, evil
+
+	box_headnode = cm.nodes.Count();
+	box_planes = &cm.planes.Data( cm.planes.Count() );
+
+	box_brush = &cm.brushes.Data( cm.brushes.Count() );
+	box_brush->numsides = 6;
+	box_brush->firstbrushside = cm.brushsides.Count();
+	box_brush->contents = CONTENTS_MONSTER;
+
+	box_leaf = &cm.leafs.Data( cm.leafs.Count() );
+	box_leaf->contents = CONTENTS_MONSTER;
+	box_leaf->firstleafbrush = cm.leafbrushes.Count();
+	box_leaf->numleafbrushes = 1;
+
+	cm.leafbrushes.Data( cm.leafbrushes.Count() ) = cm.brushes.Count();
+
+	for (i=0 ; i<6 ; i++)
+	{
+		side = i&1;
+
+		// brush sides
+		s = &cm.brushsides.Data(cm.brushsides.Count()+i);
+		s->plane = &cm.planes.Data(cm.planes.Count()+i*2+side);
 		s->surface = &s_nullsurface;
 
 		// nodes
@@ -919,7 +1432,7 @@ void CM_InitBoxHull (void)
 		p->signbits = 0;
 		VectorClear (p->normal);
 		p->normal[i>>1] = -1;
-	}	
+	}
 }
 
 
@@ -931,24 +1444,34 @@ To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 ===================
 */
-int	CM_HeadnodeForBox (vec3_t mins, vec3_t maxs)
+int	CM_HeadnodeForBox (cmTraceContext_t *ctx, vec3_t mins, vec3_t maxs)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
+	cplane_t *planes = ctx->boxPlanes;
+
+	// type and normal never change, only the distances do
+	memcpy (planes, box_planes, sizeof(cplane_t)*NUM_BOX_PLANES);
+
+	planes[0].dist = maxs[0];
+	planes[1].dist = -maxs[0];
+	planes[2].dist = mins[0];
+	planes[3].dist = -mins[0];
+	planes[4].dist = maxs[1];
+	planes[5].dist = -maxs[1];
+	planes[6].dist = mins[1];
+	planes[7].dist = -mins[1];
+	planes[8].dist = maxs[2];
+	planes[9].dist = -maxs[2];
+	planes[10].dist = mins[2];
+	planes[11].dist = -mins[2];
 
 	return box_headnode;
 }
 
+int	CM_HeadnodeForBox (vec3_t mins, vec3_t maxs)
+{
+	return CM_HeadnodeForBox (&s_threadTraceContext, mins, maxs);
+}
+
 
 /*
 ==================
@@ -956,7 +1479,7 @@ CM_PointLeafnum_r
 
 ==================
 */
-int CM_PointLeafnum_r( vec3_t p, int num )
+static int CM_PointLeafnum_r( cmTraceContext_t *ctx, vec3_t p, int num )
 {
 	float		d;
 	cnode_t		*node;
@@ -965,7 +1488,7 @@ int CM_PointLeafnum_r( vec3_t p, int num )
 	while ( num >= 0 )
 	{
 		node = &cm.nodes.Data( num );
-		plane = node->plane;
+		plane = CM_ContextPlane( ctx, node->plane );
 
 		if ( plane->type < 3 )
 			d = p[plane->type] - plane->dist;
@@ -986,7 +1509,7 @@ int CM_PointLeafnum( vec3_t p )
 {
 	if ( cm.planes.Count() == 0 )
 		return 0;		// sound may call this without map loaded
-	return CM_PointLeafnum_r( p, 0 );
+	return CM_PointLeafnum_r( &s_threadTraceContext, p, 0 );
 }
 
 
@@ -997,12 +1520,16 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-int		leaf_count, leaf_maxcount;
-int		*leaf_list;
-float	*leaf_mins, *leaf_maxs;
-int		leaf_topnode;
+struct boxLeafnums_t
+{
+	cmTraceContext_t	*ctx;		// for the box hull planes
+	int		count, maxcount;
+	int		*list;
+	float	*mins, *maxs;
+	int		topnode;
+};
 
-void CM_BoxLeafnums_r( int nodenum )
+static void CM_BoxLeafnums_r( boxLeafnums_t &work, int nodenum )
 {
 	cplane_t *plane;
 	cnode_t *node;
@@ -1012,54 +1539,57 @@ void CM_BoxLeafnums_r( int nodenum )
 	{
 		if ( nodenum < 0 )
 		{
-			if ( leaf_count >= leaf_maxcount )
+			if ( work.count >= work.maxcount )
 			{
 //				Com_Printf ("CM_BoxLeafnums_r: overflow\n");
 				return;
 			}
-			leaf_list[leaf_count++] = -1 - nodenum;
+			work.list[work.count++] = -1 - nodenum;
 			return;
 		}
 
 		node = &cm.nodes.Data( nodenum );
-		plane = node->plane;
-		s = BoxOnPlaneSide( leaf_mins, leaf_maxs, plane );
+		plane = CM_ContextPlane( work.ctx, node->plane );
+		s = BoxOnPlaneSide( work.mins, work.maxs, plane );
 		if ( s == 1 )
 			nodenum = node->children[0];
 		else if ( s == 2 )
 			nodenum = node->children[1];
 		else
 		{	// go down both
-			if ( leaf_topnode == -1 )
-				leaf_topnode = nodenum;
-			CM_BoxLeafnums_r( node->children[0] );
+			if ( work.topnode == -1 )
+				work.topnode = nodenum;
+			CM_BoxLeafnums_r( work, node->children[0] );
 			nodenum = node->children[1];
 		}
 
 	}
 }
 
-int	CM_BoxLeafnums_headnode (vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
+static int CM_BoxLeafnums_headnode (cmTraceContext_t *ctx, vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	boxLeafnums_t work;
 
-	leaf_topnode = -1;
+	work.ctx = ctx;
+	work.list = list;
+	work.count = 0;
+	work.maxcount = listsize;
+	work.mins = mins;
+	work.maxs = maxs;
 
-	CM_BoxLeafnums_r (headnode);
+	work.topnode = -1;
+
+	CM_BoxLeafnums_r (work, headnode);
 
 	if (topnode)
-		*topnode = leaf_topnode;
+		*topnode = work.topnode;
 
-	return leaf_count;
+	return work.count;
 }
 
 int	CM_BoxLeafnums( vec3_t mins, vec3_t maxs, int *list, int listsize, int *topnode )
 {
-	return CM_BoxLeafnums_headnode( mins, maxs, list,
+	return CM_BoxLeafnums_headnode( &s_threadTraceContext, mins, maxs, list,
 		listsize, cm.cmodels.Base()->headnode, topnode );
 }
 
@@ -1077,7 +1607,7 @@ int CM_PointContents( vec3_t p, int headnode )
 	if ( cm.nodes.Count() == 0 )	// map not loaded
 		return 0;
 
-	l = CM_PointLeafnum_r( p, headnode );
+	l = CM_PointLeafnum_r( &s_threadTraceContext, p, headnode );
 
 	return cm.leafs.Data( l ).contents;
 }
@@ -1112,7 +1642,7 @@ int	CM_TransformedPointContents( vec3_t p, int headnode, vec3_t origin, vec3_t a
 		p_l[2] = DotProduct( temp, up );
 	}
 
-	l = CM_PointLeafnum_r( p_l, headnode );
+	l = CM_PointLeafnum_r( &s_threadTraceContext, p_l, headnode );
 
 	return cm.leafs.Data( l ).contents;
 }
@@ -1131,22 +1661,16 @@ BOX TRACING
 
 #define NEVER_UPDATED	-99999.0f
 
-static vec3_t	trace_start, trace_end;
-static vec3_t	trace_mins, trace_maxs;
-static vec3_t	trace_extents;
-
-static trace_t	trace_trace;
-static int		trace_contents;
-static bool		trace_ispoint;		// optimized case
-
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
-					  trace_t *trace, cbrush_t *brush)
+static void CM_ClipBoxToBrush (cmTraceContext_t *ctx, cmTraceWork_t *work, cbrush_t *brush)
 {
+	float		*mins = work->mins, *maxs = work->maxs;
+	float		*p1 = work->start, *p2 = work->end;
+	trace_t		*trace = &work->trace;
 	int			i;
 	cplane_t	*plane, *clipplane;
 	float		dist;
@@ -1173,11 +1697,11 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 	for (i=0 ; i<brush->numsides ; i++)
 	{
 		side = &cm.brushsides.Data(brush->firstbrushside+i);
-		plane = side->plane;
+		plane = CM_ContextPlane (ctx, side->plane);
 
 		// FIXME: special case for axial
 
-		if (!trace_ispoint)
+		if (!work->ispoint)
 		{	// general box case
 
 			// push the plane out apropriately for mins/maxs
@@ -1280,9 +1804,11 @@ void CM_ClipBoxToBrush (vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
 CM_TestBoxInBrush
 ================
 */
-void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
-					  trace_t *trace, cbrush_t *brush)
+static void CM_TestBoxInBrush (cmTraceContext_t *ctx, cmTraceWork_t *work, cbrush_t *brush)
 {
+	float		*mins = work->mins, *maxs = work->maxs;
+	float		*p1 = work->start;
+	trace_t		*trace = &work->trace;
 	int			i;
 	cplane_t	*plane;
 	float		dist;
@@ -1296,7 +1822,7 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 	for (i=0 ; i<brush->numsides ; i++)
 	{
 		side = &cm.brushsides.Data(brush->firstbrushside+i);
-		plane = side->plane;
+		plane = CM_ContextPlane (ctx, side->plane);
 
 		// FIXME: special case for axial
 
@@ -1330,7 +1856,7 @@ void CM_TestBoxInBrush (vec3_t mins, vec3_t maxs, vec3_t p1,
 CM_TraceToLeaf
 ================
 */
-void CM_TraceToLeaf (int leafnum)
+static void CM_TraceToLeaf (cmTraceContext_t *ctx, cmTraceWork_t *work, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1338,21 +1864,20 @@ void CM_TraceToLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &cm.leafs.Data(leafnum);
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & work->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = cm.leafbrushes.Data(leaf->firstleafbrush+k);
-		b = &cm.brushes.Data(brushnum);
-		if (b->checkcount == cm.checkcount)
+		if (!CM_CheckBrush (ctx, work, brushnum))
 			continue;	// already checked this brush in another leaf
-		b->checkcount = cm.checkcount;
 
-		if ( !(b->contents & trace_contents))
+		b = &cm.brushes.Data(brushnum);
+		if ( !(b->contents & work->contents))
 			continue;
-		CM_ClipBoxToBrush (trace_mins, trace_maxs, trace_start, trace_end, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_ClipBoxToBrush (ctx, work, b);
+		if (!work->trace.fraction)
 			return;
 	}
 
@@ -1364,7 +1889,7 @@ void CM_TraceToLeaf (int leafnum)
 CM_TestInLeaf
 ================
 */
-void CM_TestInLeaf (int leafnum)
+static void CM_TestInLeaf (cmTraceContext_t *ctx, cmTraceWork_t *work, int leafnum)
 {
 	int			k;
 	int			brushnum;
@@ -1372,21 +1897,20 @@ void CM_TestInLeaf (int leafnum)
 	cbrush_t	*b;
 
 	leaf = &cm.leafs.Data(leafnum);
-	if ( !(leaf->contents & trace_contents))
+	if ( !(leaf->contents & work->contents))
 		return;
 	// trace line against all brushes in the leaf
 	for (k=0 ; k<leaf->numleafbrushes ; k++)
 	{
 		brushnum = cm.leafbrushes.Data(leaf->firstleafbrush+k);
-		b = &cm.brushes.Data(brushnum);
-		if (b->checkcount == cm.checkcount)
+		if (!CM_CheckBrush (ctx, work, brushnum))
 			continue;	// already checked this brush in another leaf
-		b->checkcount = cm.checkcount;
 
-		if ( !(b->contents & trace_contents))
+		b = &cm.brushes.Data(brushnum);
+		if ( !(b->contents & work->contents))
 			continue;
-		CM_TestBoxInBrush (trace_mins, trace_maxs, trace_start, &trace_trace, b);
-		if (!trace_trace.fraction)
+		CM_TestBoxInBrush (ctx, work, b);
+		if (!work->trace.fraction)
 			return;
 	}
 
@@ -1399,7 +1923,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static void CM_RecursiveHullCheck (cmTraceContext_t *ctx, cmTraceWork_t *work, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
 	cnode_t		*node;
 	cplane_t	*plane;
@@ -1410,7 +1934,7 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	int			side;
 	float		midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (work->trace.fraction <= p1f)
 		return;		// already hit something nearer
 
 	//
@@ -1420,25 +1944,25 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	while( num >= 0 )
 	{
 		node = &cm.nodes.Data(num);
-		plane = node->plane;
+		plane = CM_ContextPlane (ctx, node->plane);
 
 		if (plane->type < 3)
 		{
 			t1 = p1[plane->type] - plane->dist;
 			t2 = p2[plane->type] - plane->dist;
-			offset = trace_extents[plane->type];
+			offset = work->extents[plane->type];
 		}
 		else
 		{
 			t1 = DotProduct (plane->normal, p1) - plane->dist;
 			t2 = DotProduct (plane->normal, p2) - plane->dist;
-			if (trace_ispoint)
+			if (work->ispoint)
 				offset = 0.0f;
 			else
 #if 1
-				offset = (fabs(trace_extents[0]*plane->normal[0]) +
-					fabs(trace_extents[1]*plane->normal[1]) +
-					fabs(trace_extents[2]*plane->normal[2]) * 3.0f);
+				offset = (fabs(work->extents[0]*plane->normal[0]) +
+					fabs(work->extents[1]*plane->normal[1]) +
+					fabs(work->extents[2]*plane->normal[2]) * 3.0f);
 #else
 				// Quake 3 does this instead?
 				// Q3 dev: "this is silly"
@@ -1464,7 +1988,7 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	// if < 0, we are in a leaf node
 	if (num < 0)
 	{
-		CM_TraceToLeaf (-1-num);
+		CM_TraceToLeaf (ctx, work, -1-num);
 		return;
 	}
 
@@ -1495,14 +2019,14 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	midf = p1f + (p2f - p1f)*frac;
 	VectorLerp( p1, p2, frac, mid );
 
-	CM_RecursiveHullCheck (node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck (ctx, work, node->children[side], p1f, midf, p1, mid);
 
 	// go past the node
 	frac2 = Clamp( frac2, 0.0f, 1.0f );
 	midf = p1f + (p2f - p1f)*frac2;
 	VectorLerp( p1, p2, frac2, mid );
 
-	CM_RecursiveHullCheck (node->children[side^1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck (ctx, work, node->children[side^1], midf, p2f, mid, p2);
 }
 
 
@@ -1511,91 +2035,347 @@ void CM_RecursiveHullCheck (int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 
 /*
 ==================
-CM_BoxTrace
+CM_BeginTraceWork
+
+Fills in a default trace, returns false if there is no map to trace against
 ==================
 */
-trace_t CM_BoxTrace (vec3_t start, vec3_t end,
-					 vec3_t mins, vec3_t maxs,
-					 int headnode, int brushmask)
+static bool CM_BeginTraceWork (cmTraceContext_t *ctx, cmTraceWork_t *work,
+							   const vec3_t start, const vec3_t end,
+							   const vec3_t mins, const vec3_t maxs, int brushmask,
+							   int checkcount = 0, uint32 laneBit = 1)
 {
-	cm.checkcount++;	// for multi-check avoidance
-
 	c_traces++;			// for statistics, may be zeroed
 
 	// fill in a default trace
-	memset (&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &s_nullsurface;
+	memset (&work->trace, 0, sizeof(work->trace));
+	work->trace.fraction = 1;
+	work->trace.surface = &s_nullsurface;
 
 	if (cm.nodes.Count() == 0)	// map not loaded
-		return trace_trace;
+		return false;
+
+	// packets pass in the checkcount their lanes share
+	work->checkcount = checkcount ? checkcount : CM_BeginTrace (ctx);
+	work->laneBit = laneBit;
 
-	trace_contents = brushmask;
-	VectorCopy (start, trace_start);
-	VectorCopy (end, trace_end);
-	VectorCopy (mins, trace_mins);
-	VectorCopy (maxs, trace_maxs);
+	work->contents = brushmask;
+	VectorCopy (start, work->start);
+	VectorCopy (end, work->end);
+	VectorCopy (mins, work->mins);
+	VectorCopy (maxs, work->maxs);
 
 	//
-	// check for position test special case
+	// check for point special case
 	//
-	if (VectorCompare(start, end))
+	if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
+		&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
+	{
+		work->ispoint = true;
+		VectorClear (work->extents);
+	}
+	else
 	{
-		int		leafs[1024];
-		int		i, numleafs;
-		vec3_t	c1, c2;
-		int		topnode;
+		work->ispoint = false;
+		work->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		work->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		work->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+	}
 
-		VectorAdd (start, mins, c1);
-		VectorAdd (start, maxs, c2);
-		for (i=0 ; i<3 ; i++)
-		{
-			c1[i] -= 1;
-			c2[i] += 1;
-		}
+	return true;
+}
 
-		numleafs = CM_BoxLeafnums_headnode (c1, c2, leafs, 1024, headnode, &topnode);
-		for (i=0 ; i<numleafs ; i++)
-		{
-			CM_TestInLeaf (leafs[i]);
-			if (trace_trace.allsolid)
-				break;
-		}
-		VectorCopy (start, trace_trace.endpos);
-		return trace_trace;
+/*
+==================
+CM_TestPosition
+
+Position test special case, start == end
+==================
+*/
+static void CM_TestPosition (cmTraceContext_t *ctx, cmTraceWork_t *work, int headnode)
+{
+	int		leafs[1024];
+	int		i, numleafs;
+	vec3_t	c1, c2;
+	int		topnode;
+
+	VectorAdd (work->start, work->mins, c1);
+	VectorAdd (work->start, work->maxs, c2);
+	for (i=0 ; i<3 ; i++)
+	{
+		c1[i] -= 1;
+		c2[i] += 1;
 	}
 
-	//
-	// check for point special case
-	//
-	if (mins[0] == 0 && mins[1] == 0 && mins[2] == 0
-		&& maxs[0] == 0 && maxs[1] == 0 && maxs[2] == 0)
+	numleafs = CM_BoxLeafnums_headnode (ctx, c1, c2, leafs, 1024, headnode, &topnode);
+	for (i=0 ; i<numleafs ; i++)
 	{
-		trace_ispoint = true;
-		VectorClear (trace_extents);
+		CM_TestInLeaf (ctx, work, leafs[i]);
+		if (work->trace.allsolid)
+			break;
+	}
+	VectorCopy (work->start, work->trace.endpos);
+}
+
+static void CM_FinishTraceWork (cmTraceWork_t *work)
+{
+	if (work->trace.fraction == 1.0f)
+	{
+		VectorCopy (work->end, work->trace.endpos);
 	}
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		VectorLerp( work->start, work->end, work->trace.fraction, work->trace.endpos );
+	}
+}
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+trace_t CM_BoxTrace (cmTraceContext_t *ctx,
+					 vec3_t start, vec3_t end,
+					 vec3_t mins, vec3_t maxs,
+					 int headnode, int brushmask)
+{
+	cmTraceWork_t *work = &ctx->work;
+
+	if (!CM_BeginTraceWork (ctx, work, start, end, mins, maxs, brushmask))
+		return work->trace;
+
+	if (VectorCompare(start, end))
+	{
+		CM_TestPosition (ctx, work, headnode);
+		return work->trace;
 	}
 
 	//
 	// general sweeping through world
 	//
-	CM_RecursiveHullCheck (headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck (ctx, work, headnode, 0, 1, work->start, work->end);
+
+	CM_FinishTraceWork (work);
+
+	return work->trace;
+}
+
+trace_t CM_BoxTrace (vec3_t start, vec3_t end,
+					 vec3_t mins, vec3_t maxs,
+					 int headnode, int brushmask)
+{
+	return CM_BoxTrace (&s_threadTraceContext, start, end, mins, maxs, headnode, brushmask);
+}
+
+
+/*
+===============================================================================
 
-	if (trace_trace.fraction == 1.0f)
+BATCHED TRACING
+
+Traces are walked down the tree in packets of TRACE_PACKET_SIZE, testing
+the node plane against every lane at once. As long as a lane's whole sweep
+stays on one side of each plane it rides along with the packet. The moment
+it straddles a plane (or gets too close to call) it drops out and finishes
+with CM_RecursiveHullCheck from that node, which is exactly where the
+serial path would have started splitting it, so the results are identical.
+
+===============================================================================
+*/
+
+#define TRACE_PACKET_SIZE	SIMD_WIDTH
+
+// lanes closer than this to a plane are handed to the serial path, this
+// soaks up any rounding difference between the vector and scalar maths
+#define PACKET_PLANE_EPSILON	0.125f
+
+// structure of arrays copy of a packet of traces
+struct cmTracePacket_t
+{
+	float		p1[3][TRACE_PACKET_SIZE];
+	float		p2[3][TRACE_PACKET_SIZE];
+	float		extents[3][TRACE_PACKET_SIZE];
+	float		pointMask[TRACE_PACKET_SIZE];		// all bits set for point traces
+
+	cmTraceWork_t *work[TRACE_PACKET_SIZE];
+};
+
+/*
+==================
+CM_RecursiveHullCheckPacket
+==================
+*/
+static void CM_RecursiveHullCheckPacket (cmTraceContext_t *ctx, cmTracePacket_t &packet, int lanes, int num)
+{
+	const simdFloat_t signMask = Simd_Set1( -0.0f );
+	const simdFloat_t three = Simd_Set1( 3.0f );
+	const simdFloat_t epsilon = Simd_Set1( PACKET_PLANE_EPSILON );
+	const simdFloat_t pointMask = Simd_Load( packet.pointMask );
+
+	while (num >= 0)
 	{
-		VectorCopy (end, trace_trace.endpos);
+		cnode_t *node = &cm.nodes.Data(num);
+		cplane_t *plane = CM_ContextPlane (ctx, node->plane);
+
+		simdFloat_t t1, t2, offset;
+
+		if (plane->type < 3)
+		{
+			const simdFloat_t dist = Simd_Set1( plane->dist );
+			t1 = Simd_Sub( Simd_Load( packet.p1[plane->type] ), dist );
+			t2 = Simd_Sub( Simd_Load( packet.p2[plane->type] ), dist );
+			offset = Simd_Load( packet.extents[plane->type] );
+		}
+		else
+		{
+			const simdFloat_t nx = Simd_Set1( plane->normal[0] );
+			const simdFloat_t ny = Simd_Set1( plane->normal[1] );
+			const simdFloat_t nz = Simd_Set1( plane->normal[2] );
+			const simdFloat_t dist = Simd_Set1( plane->dist );
+
+			t1 = Simd_Add( Simd_Add( Simd_Mul( nx, Simd_Load( packet.p1[0] ) ), Simd_Mul( ny, Simd_Load( packet.p1[1] ) ) ), Simd_Mul( nz, Simd_Load( packet.p1[2] ) ) );
+			t2 = Simd_Add( Simd_Add( Simd_Mul( nx, Simd_Load( packet.p2[0] ) ), Simd_Mul( ny, Simd_Load( packet.p2[1] ) ) ), Simd_Mul( nz, Simd_Load( packet.p2[2] ) ) );
+			t1 = Simd_Sub( t1, dist );
+			t2 = Simd_Sub( t2, dist );
+
+			// matches the serial offset, including the odd * 3 on z
+			offset = Simd_Add( Simd_Add(
+				Simd_AndNot( signMask, Simd_Mul( Simd_Load( packet.extents[0] ), nx ) ),
+				Simd_AndNot( signMask, Simd_Mul( Simd_Load( packet.extents[1] ), ny ) ) ),
+				Simd_Mul( Simd_AndNot( signMask, Simd_Mul( Simd_Load( packet.extents[2] ), nz ) ), three ) );
+			offset = Simd_AndNot( pointMask, offset );
+		}
+
+		const simdFloat_t frontDist = Simd_Add( offset, epsilon );
+		const simdFloat_t backDist = Simd_Sub( Simd_Set1( 0.0f ), frontDist );
+
+		int front = Simd_MoveMask( Simd_And( Simd_CmpGt( t1, frontDist ), Simd_CmpGt( t2, frontDist ) ) ) & lanes;
+		int back = Simd_MoveMask( Simd_And( Simd_CmpLt( t1, backDist ), Simd_CmpLt( t2, backDist ) ) ) & lanes;
+		int split = lanes & ~( front | back );
+
+		// lanes that straddle the plane continue on their own
+		while (split)
+		{
+			const int lane = std::countr_zero( (uint)split );
+			split &= split - 1;
+
+			cmTraceWork_t *work = packet.work[lane];
+			CM_RecursiveHullCheck (ctx, work, num, 0, 1, work->start, work->end);
+		}
+
+		if (front && back)
+		{
+			CM_RecursiveHullCheckPacket (ctx, packet, back, node->children[1]);
+		}
+
+		if (front)
+		{
+			lanes = front;
+			num = node->children[0];
+		}
+		else if (back)
+		{
+			lanes = back;
+			num = node->children[1];
+		}
+		else
+		{
+			return;
+		}
 	}
-	else
+
+	// every remaining lane ends up in the same leaf
+	while (lanes)
+	{
+		const int lane = std::countr_zero( (uint)lanes );
+		lanes &= lanes - 1;
+
+		CM_TraceToLeaf (ctx, packet.work[lane], -1-num);
+	}
+}
+
+/*
+==================
+CM_BoxTraceBatch
+
+Traces count boxes at once against headnode, results[i] is the same as
+calling CM_BoxTrace with requests[i], using requests[i].contentmask as the
+brushmask. requests[i].passent is ignored.
+==================
+*/
+void CM_BoxTraceBatch (cmTraceContext_t *ctx, const traceRequest_t *requests, int count, trace_t *results, int headnode)
+{
+	cmTraceWork_t		works[TRACE_PACKET_SIZE];
+	cmTracePacket_t		packet;
+
+	for (int first = 0; first < count; first += TRACE_PACKET_SIZE)
 	{
-		VectorLerp( start, end, trace_trace.fraction, trace_trace.endpos );
+		const int numLanes = Min( count - first, TRACE_PACKET_SIZE );
+		const int checkcount = cm.nodes.Count() ? CM_BeginTrace (ctx) : 0;
+		int lanes = 0;
+
+		for (int lane = 0; lane < TRACE_PACKET_SIZE; ++lane)
+		{
+			packet.work[lane] = &works[lane];
+
+			if (lane >= numLanes)
+			{
+				// unused lanes have to hold something sane for the vector maths
+				for (int j = 0; j < 3; ++j)
+				{
+					packet.p1[j][lane] = packet.p2[j][lane] = packet.extents[j][lane] = 0.0f;
+				}
+				packet.pointMask[lane] = 0.0f;
+				continue;
+			}
+
+			const traceRequest_t &request = requests[first + lane];
+			cmTraceWork_t *work = &works[lane];
+
+			if (!CM_BeginTraceWork (ctx, work, request.start, request.end, request.mins, request.maxs, request.contentmask, checkcount, 1u << lane))
+			{
+				results[first + lane] = work->trace;
+				continue;
+			}
+
+			if (VectorCompare(work->start, work->end))
+			{
+				CM_TestPosition (ctx, work, headnode);
+				results[first + lane] = work->trace;
+				continue;
+			}
+
+			for (int j = 0; j < 3; ++j)
+			{
+				packet.p1[j][lane] = work->start[j];
+				packet.p2[j][lane] = work->end[j];
+				packet.extents[j][lane] = work->extents[j];
+			}
+			uint32 pointBits = work->ispoint ? 0xFFFFFFFF : 0;
+			memcpy (&packet.pointMask[lane], &pointBits, sizeof(float));
+
+			lanes |= 1 << lane;
+		}
+
+		if (!lanes)
+			continue;
+
+		CM_RecursiveHullCheckPacket (ctx, packet, lanes, headnode);
+
+		while (lanes)
+		{
+			const int lane = std::countr_zero( (uint)lanes );
+			lanes &= lanes - 1;
+
+			CM_FinishTraceWork (&works[lane]);
+			results[first + lane] = works[lane].trace;
+		}
 	}
-	return trace_trace;
+}
+
+void CM_BoxTraceBatch (const traceRequest_t *requests, int count, trace_t *results, int headnode)
+{
+	CM_BoxTraceBatch (&s_threadTraceContext, requests, count, results, headnode);
 }
 
 
@@ -1607,7 +2387,8 @@ Handles offseting and rotation of the end points for moving and
 rotating entities
 ==================
 */
-void CM_TransformedBoxTrace( vec3_t start, vec3_t end,
+void CM_TransformedBoxTrace( cmTraceContext_t *ctx,
+							 vec3_t start, vec3_t end,
 							 vec3_t mins, vec3_t maxs,
 							 int headnode, int brushmask,
 							 vec3_t origin, vec3_t angles,
@@ -1642,7 +2423,7 @@ void CM_TransformedBoxTrace( vec3_t start, vec3_t end,
 	}
 
 	// sweep the box through the model
-	trace = CM_BoxTrace( start_l, end_l, mins, maxs, headnode, brushmask );
+	trace = CM_BoxTrace( ctx, start_l, end_l, mins, maxs, headnode, brushmask );
 
 	if ( rotated && trace.fraction != 1.0f )
 	{
@@ -1659,6 +2440,14 @@ void CM_TransformedBoxTrace( vec3_t start, vec3_t end,
 	VectorLerp( start, end, trace.fraction, trace.endpos );
 }
 
+void CM_TransformedBoxTrace( vec3_t start, vec3_t end,
+							 vec3_t mins, vec3_t maxs,
+							 int headnode, int brushmask,
+							 vec3_t origin, vec3_t angles,
+							 trace_t &trace )
+{
+	CM_TransformedBoxTrace( &s_threadTraceContext, start, end, mins, maxs, headnode, brushmask, origin, angles, trace );
+}
 
 /*
 ===============================================================================
@@ -1715,8 +2504,9 @@ void CM_DecompressVis (byte *in, byte *out)
 	} while (out_p - out < row);
 }
 
-byte	pvsrow[MAX_MAP_LEAFS/8];
-byte	phsrow[MAX_MAP_LEAFS/8];
+// per thread so the server can build client frames in parallel
+static thread_local byte	pvsrow[MAX_MAP_LEAFS/8];
+static thread_local byte	phsrow[MAX_MAP_LEAFS/8];
 
 byte *CM_ClusterPVS (int cluster)
 {
@@ -1931,5 +2721,365 @@ void CM_Init()
 
 void CM_Shutdown()
 {
+	if ( cm.pPhysicsShape )
+	{
+		PhysicsImpl::GetScene()->SetWorldShape( nullptr );
+		PhysicsImpl::GetSystem()->DestroyShape( cm.pPhysicsShape );
+		cm.pPhysicsShape = nullptr;
+	}
+
 	cm.Free();
 }
+
+/*
+===============================================================================
+
+TRACE STRESS TEST
+
+===============================================================================
+*/
+
+struct cmBenchTrace_t
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	vec3_t		boxMins, boxMaxs;		// used when useBox is set
+	bool		useBox;
+	int			expectSolid;			// for position tests against the box, -1 if too close to call
+	trace_t		trace;
+};
+
+static void CM_RunBenchTraces( cmTraceContext_t *ctx, cmBenchTrace_t *traces, int first, int last, int stride )
+{
+	for ( int i = first; i < last; i += stride )
+	{
+		cmBenchTrace_t &t = traces[i];
+
+		int headnode = cm.cmodels.Base()->headnode;
+		int brushmask = MASK_SOLID;
+		if ( t.useBox )
+		{
+			// the box brush is a monster, like it is for every entity that uses it
+			headnode = CM_HeadnodeForBox( ctx, t.boxMins, t.boxMaxs );
+			brushmask |= CONTENTS_MONSTER;
+		}
+
+		t.trace = CM_BoxTrace( ctx, t.start, t.end, t.mins, t.maxs, headnode, brushmask );
+	}
+}
+
+static bool CM_BenchTracesMatch( const trace_t &a, const trace_t &b )
+{
+	return a.fraction == b.fraction
+		&& VectorCompare( a.endpos, b.endpos )
+		&& VectorCompare( a.plane.normal, b.plane.normal )
+		&& a.plane.dist == b.plane.dist
+		&& a.surface == b.surface
+		&& a.contents == b.contents
+		&& a.allsolid == b.allsolid
+		&& a.startsolid == b.startsolid;
+}
+
+/*
+==================
+cm_traceBench
+
+Traces random rays and boxes through the loaded map serially, then again
+from many threads with a context each, and checks the results are identical
+==================
+*/
+CON_COMMAND( cm_traceBench, "Stress tests parallel traces against the serial path. Usage: cm_traceBench [numtraces] [numthreads]", 0 )
+{
+	if ( cm.nodes.Count() == 0 )
+	{
+		Com_Print( "No map loaded\n" );
+		return;
+	}
+
+	int numTraces = Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 100000;
+	int numThreads = Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : (int)std::thread::hardware_concurrency();
+	numTraces = Max( numTraces, 1 );
+	numThreads = Clamp( numThreads, 1, 256 );
+
+	const cmodel_t *world = cm.cmodels.Base();
+
+	std::vector<cmBenchTrace_t> serial( numTraces );
+
+	for ( cmBenchTrace_t &t : serial )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			t.start[j] = world->mins[j] + frand() * ( world->maxs[j] - world->mins[j] );
+			t.end[j] = world->mins[j] + frand() * ( world->maxs[j] - world->mins[j] );
+		}
+
+		const int kind = rand() % 8;
+
+		if ( kind == 0 )
+		{
+			// position test
+			VectorCopy( t.start, t.end );
+		}
+		if ( kind < 4 )
+		{
+			// player sized box
+			VectorSet( t.mins, -16.0f, -16.0f, -24.0f );
+			VectorSet( t.maxs, 16.0f, 16.0f, 32.0f );
+		}
+		else
+		{
+			VectorClear( t.mins );
+			VectorClear( t.maxs );
+		}
+
+		// some against a box hull, offset so they actually hit it
+		t.useBox = ( kind == 7 );
+		t.expectSolid = -1;
+		if ( t.useBox )
+		{
+			const float size = 8.0f + frand() * 64.0f;
+			VectorSet( t.boxMins, -size, -size, -size );
+			VectorSet( t.boxMaxs, size, size, size );
+			VectorScale( t.start, 0.01f, t.start );
+			VectorScale( t.end, -0.01f, t.end );
+		}
+		else if ( kind == 6 )
+		{
+			// position test against a box away from the origin, where the answer is known
+			t.useBox = true;
+			VectorCopy( t.start, t.end );
+
+			const float size = 8.0f + frand() * 64.0f;
+			bool overlaps = true, closeCall = false;
+
+			for ( int j = 0; j < 3; ++j )
+			{
+				t.boxMins[j] = t.start[j] + ( frand() * 4.0f - 2.0f ) * size - size;
+				t.boxMaxs[j] = t.boxMins[j] + size * 2.0f;
+
+				const float gapLow = t.boxMins[j] - ( t.start[j] + t.maxs[j] );
+				const float gapHigh = ( t.start[j] + t.mins[j] ) - t.boxMaxs[j];
+
+				overlaps &= gapLow < 0.0f && gapHigh < 0.0f;
+				closeCall |= fabsf( gapLow ) < 1.0f || fabsf( gapHigh ) < 1.0f;
+			}
+
+			if ( !closeCall )
+			{
+				t.expectSolid = overlaps ? 1 : 0;
+			}
+		}
+	}
+
+	std::vector<cmBenchTrace_t> parallel( serial );
+
+	// serial
+	cmTraceContext_t *serialContext = CM_AllocTraceContext();
+	double start = Time_FloatMilliseconds();
+	CM_RunBenchTraces( serialContext, serial.data(), 0, numTraces, 1 );
+	double serialTime = Time_FloatMilliseconds() - start;
+	CM_FreeTraceContext( serialContext );
+
+	// parallel, interleaved so every thread hits every part of the map
+	std::vector<std::thread> threads;
+	threads.reserve( numThreads );
+
+	start = Time_FloatMilliseconds();
+	for ( int i = 0; i < numThreads; ++i )
+	{
+		threads.emplace_back( [&parallel, i, numTraces, numThreads]()
+		{
+			cmTraceContext_t *ctx = CM_AllocTraceContext();
+			CM_RunBenchTraces( ctx, parallel.data(), i, numTraces, numThreads );
+			CM_FreeTraceContext( ctx );
+		} );
+	}
+	for ( std::thread &thread : threads )
+	{
+		thread.join();
+	}
+	double parallelTime = Time_FloatMilliseconds() - start;
+
+	int mismatches = 0, wrongPositions = 0, numPositions = 0;
+	for ( int i = 0; i < numTraces; ++i )
+	{
+		if ( !CM_BenchTracesMatch( serial[i].trace, parallel[i].trace ) )
+		{
+			++mismatches;
+		}
+
+		if ( serial[i].expectSolid != -1 )
+		{
+			++numPositions;
+			if ( serial[i].trace.startsolid != ( serial[i].expectSolid == 1 ) )
+			{
+				++wrongPositions;
+			}
+		}
+	}
+
+	Com_Printf( "%d traces, serial %.2f ms, %d threads %.2f ms (%.2fx)\n",
+		numTraces, serialTime, numThreads, parallelTime, serialTime / Max( parallelTime, 0.001 ) );
+
+	if ( mismatches )
+	{
+		Com_Printf( S_COLOR_RED "%d traces did not match the serial results!\n", mismatches );
+	}
+	else
+	{
+		Com_Print( "All traces match the serial results\n" );
+	}
+
+	if ( wrongPositions )
+	{
+		Com_Printf( S_COLOR_RED "%d of %d position tests against an offset box got the wrong answer!\n", wrongPositions, numPositions );
+	}
+	else
+	{
+		Com_Printf( "All %d position tests against an offset box are right\n", numPositions );
+	}
+}
+
+/*
+===============================================================================
+
+WORLD COLLISION BENCHMARK
+
+===============================================================================
+*/
+
+struct cmPhysicsBenchTrace_t
+{
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+};
+
+static double CM_RunPhysicsBenchTraces( const IPhysicsShape *pShape, const std::vector<cmPhysicsBenchTrace_t> &traces, int &hits )
+{
+	IPhysicsSystem *pSystem = PhysicsImpl::GetSystem();
+	const vec3_t origin{}, angles{};
+
+	hits = 0;
+
+	const double start = Time_FloatMilliseconds();
+
+	for ( const cmPhysicsBenchTrace_t &t : traces )
+	{
+		trace_t trace;
+		pSystem->Trace( rayCast_t( t.start, t.end, t.mins, t.maxs ), pShape, origin, angles, trace );
+
+		if ( trace.fraction < 1.0f )
+		{
+			++hits;
+		}
+	}
+
+	return Time_FloatMilliseconds() - start;
+}
+
+static void CM_BenchWorldShape( const char *label, const IPhysicsShape *pShape, double buildTime,
+	const std::vector<cmPhysicsBenchTrace_t> &rays, const std::vector<cmPhysicsBenchTrace_t> &boxes )
+{
+	IPhysicsSystem *pSystem = PhysicsImpl::GetSystem();
+
+	if ( !pShape )
+	{
+		Com_Printf( S_COLOR_YELLOW "%s: failed to build\n", label );
+		return;
+	}
+
+	std::vector<byte> data;
+	double start = Time_FloatMilliseconds();
+	pSystem->SaveShape( pShape, data );
+	const double saveTime = Time_FloatMilliseconds() - start;
+
+	start = Time_FloatMilliseconds();
+	IPhysicsShape *pLoaded = pSystem->LoadShape( data.data(), data.size() );
+	const double loadTime = Time_FloatMilliseconds() - start;
+
+	if ( pLoaded )
+	{
+		pSystem->DestroyShape( pLoaded );
+	}
+
+	int rayHits, boxHits;
+	const double rayTime = CM_RunPhysicsBenchTraces( pShape, rays, rayHits );
+	const double boxTime = CM_RunPhysicsBenchTraces( pShape, boxes, boxHits );
+
+	Com_Printf( "%-6s build %.2f ms, %.1f KB in memory, cache %.1f KB saved in %.2f ms, loaded in %.2f ms%s\n",
+		label, buildTime, pSystem->GetShapeMemoryUsage( pShape ) / 1024.0, data.size() / 1024.0, saveTime, loadTime,
+		pLoaded ? "" : S_COLOR_RED " (failed)" );
+	Com_Printf( "       %d rays %.2f ms (%d hit), %d boxes %.2f ms (%d hit)\n",
+		(int)rays.size(), rayTime, rayHits, (int)boxes.size(), boxTime, boxHits );
+}
+
+/*
+==================
+cm_physicsBench
+
+Builds the old face triangle soup and the brush hull compound for the loaded map,
+then compares build time, memory, cache save and load, and the same random traces
+==================
+*/
+CON_COMMAND( cm_physicsBench, "Compares the brush hull world collision against the old triangle soup. Usage: cm_physicsBench [numtraces]", 0 )
+{
+	if ( cm.nodes.Count() == 0 || !cm.name[0] )
+	{
+		Com_Print( "No map loaded\n" );
+		return;
+	}
+
+	int numTraces = Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 20000;
+	numTraces = Max( numTraces, 1 );
+
+	// The face lumps aren't kept around after loading
+	byte *buffer = nullptr;
+	if ( FileSystem::LoadFile( cm.name, (void **)&buffer ) <= 0 || !buffer )
+	{
+		Com_Printf( S_COLOR_YELLOW "Couldn't load %s\n", cm.name );
+		return;
+	}
+
+	const cmodel_t *world = cm.cmodels.Base();
+
+	std::vector<cmPhysicsBenchTrace_t> rays( numTraces ), boxes( numTraces );
+
+	for ( int i = 0; i < numTraces; ++i )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			rays[i].start[j] = world->mins[j] + frand() * ( world->maxs[j] - world->mins[j] );
+			rays[i].end[j] = world->mins[j] + frand() * ( world->maxs[j] - world->mins[j] );
+		}
+		VectorClear( rays[i].mins );
+		VectorClear( rays[i].maxs );
+
+		// player sized box along the same path
+		boxes[i] = rays[i];
+		VectorSet( boxes[i].mins, -16.0f, -16.0f, -24.0f );
+		VectorSet( boxes[i].maxs, 16.0f, 16.0f, 32.0f );
+	}
+
+	double start = Time_FloatMilliseconds();
+	IPhysicsShape *pMesh = CM_BuildWorldMesh( buffer );
+	const double meshTime = Time_FloatMilliseconds() - start;
+
+	FileSystem::FreeFile( buffer );
+
+	start = Time_FloatMilliseconds();
+	IPhysicsShape *pHulls = CM_BuildWorldShape();
+	const double hullTime = Time_FloatMilliseconds() - start;
+
+	CM_BenchWorldShape( "soup", pMesh, meshTime, rays, boxes );
+	CM_BenchWorldShape( "hulls", pHulls, hullTime, rays, boxes );
+
+	IPhysicsSystem *pSystem = PhysicsImpl::GetSystem();
+	if ( pMesh )
+	{
+		pSystem->DestroyShape( pMesh );
+	}
+	if ( pHulls )
+	{
+		pSystem->DestroyShape( pHulls );
+	}
+}
@@ -18,8 +18,18 @@ int			CM_NumClusters( void );
 int			CM_NumInlineModels( void );
 char		*CM_EntityString( void );
 
+// trace contexts hold all per-trace state, traces are safe to run from
+// many threads at once as long as each thread uses its own context.
+// the functions without a context use one owned by the calling thread
+struct cmTraceContext_t;
+
+cmTraceContext_t *CM_AllocTraceContext();
+void		CM_FreeTraceContext( cmTraceContext_t *ctx );
+
 // creates a clipping hull for an arbitrary box
+// the hull stays valid for traces in the same context until the next call
 int			CM_HeadnodeForBox( vec3_t mins, vec3_t maxs );
+int			CM_HeadnodeForBox( cmTraceContext_t *ctx, vec3_t mins, vec3_t maxs );
 
 
 // returns an ORed contents mask
@@ -35,6 +45,22 @@ void		CM_TransformedBoxTrace( vec3_t start, vec3_t end,
 								vec3_t origin, vec3_t angles,
 								trace_t &trace);
 
+// traces many boxes at once, each request's contentmask is used as the
+// brushmask and passent is ignored. results match CM_BoxTrace exactly
+void		CM_BoxTraceBatch( const traceRequest_t *requests, int count, trace_t *results, int headnode );
+
+trace_t		CM_BoxTrace( cmTraceContext_t *ctx,
+					vec3_t start, vec3_t end,
+					vec3_t mins, vec3_t maxs,
+					int headnode, int brushmask );
+void		CM_TransformedBoxTrace( cmTraceContext_t *ctx,
+								vec3_t start, vec3_t end,
+								vec3_t mins, vec3_t maxs,
+								int headnode, int brushmask,
+								vec3_t origin, vec3_t angles,
+								trace_t &trace);
+void		CM_BoxTraceBatch( cmTraceContext_t *ctx, const traceRequest_t *requests, int count, trace_t *results, int headnode );
+
 byte		*CM_ClusterPVS( int cluster );
 byte		*CM_ClusterPHS( int cluster );
 
@@ -757,8 +757,8 @@ void Com_Frame( int frameTime )
 	if ( com_showTrace->GetBool() )
 	{
 		// cmodel
-		extern int c_traces, c_brush_traces;
-		extern int c_pointcontents;
+		extern thread_local int c_traces, c_brush_traces;
+		extern thread_local int c_pointcontents;
 
 		Com_Printf( "%4i traces  %4i points\n", c_traces, c_pointcontents );
 		c_traces = 0;
@@ -191,7 +191,7 @@ namespace img
 
 	struct LoadPNG_UserData_t
 	{
-		byte *buffer;
+		const byte *buffer;
 		size_t offset;
 	};
 
@@ -218,7 +218,7 @@ namespace img
 		Com_DPrintf( "PNG load warning: %s\n\n", msg );
 	}
 
-	byte *LoadPNG( byte *buf, int &width, int &height )
+	byte *LoadPNG( const byte *buf, int &width, int &height )
 	{
 		png_structp png_ptr;
 		png_infop info_ptr;
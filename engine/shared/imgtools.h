@@ -27,7 +27,7 @@ namespace img
 	// Return true if the first 8 bytes of the buffer match the fixed PNG ID
 	bool	TestPNG( const byte *buf );
 
-	byte *	LoadPNG( byte *buf, int &width, int &height );
+	byte *	LoadPNG( const byte *buf, int &width, int &height );
 	bool	WritePNG( int width, int height, bool b32bit, byte *buffer, fsHandle_t handle );
 
 	//-------------------------------------------------------------------------------------------------
@@ -13,6 +13,7 @@
 // q_shared
 struct usercmd_t;
 struct entity_state_t;
+struct player_state_t;
 
 //
 // Writing
@@ -29,7 +30,6 @@ void	MSG_WritePos( sizebuf_t *sb, vec3_t pos );
 void	MSG_WriteAngle( sizebuf_t *sb, float f );
 void	MSG_WriteAngle16( sizebuf_t *sb, float f );
 void	MSG_WriteDeltaUsercmd( sizebuf_t *sb, usercmd_t *from, usercmd_t *cmd );
-void	MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity );
 void	MSG_WriteDir( sizebuf_t *sb, vec3_t vector );
 
 //
@@ -54,4 +54,50 @@ void	MSG_ReadDeltaUsercmd( sizebuf_t *sb, usercmd_t *from, usercmd_t *cmd );
 
 void	MSG_ReadDir( sizebuf_t *sb, vec3_t vector );
 
-void	MSG_ReadData( sizebuf_t *sb, void *buffer, int size );
\ No newline at end of file
+void	MSG_ReadData( sizebuf_t *sb, void *buffer, int size );
+
+//
+// Bit packing
+//
+// Values are packed least significant bit first. A block of them always ends on a byte
+// boundary, so the byte-aligned functions above carry on straight after it
+//
+
+struct bitWriter_t
+{
+	sizebuf_t *	msg;
+	uint64		bits;
+	int			numBits;
+};
+
+struct bitReader_t
+{
+	sizebuf_t *	msg;
+	uint64		bits;
+	int			numBits;
+};
+
+void	MSG_BeginWritingBits( bitWriter_t &writer, sizebuf_t *msg );
+void	MSG_WriteBits( bitWriter_t &writer, uint value, int numBits );
+void	MSG_EndWritingBits( bitWriter_t &writer );
+
+// Bytes are only taken from msg as they're needed, so there's nothing to end
+void	MSG_BeginReadingBits( bitReader_t &reader, sizebuf_t *msg );
+uint	MSG_ReadBits( bitReader_t &reader, int numBits );
+
+//
+// Delta compression of entity_state_t and player_state_t, driven by tables of their fields
+//
+
+// Each entity record is a bit-packed block that starts with the entity number
+void	MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity );
+void	MSG_WriteRemoveEntity( sizebuf_t *msg, int number );
+void	MSG_WriteEntityListEnd( sizebuf_t *msg );
+
+// Starts reading a record, returns 0 at the end of the list. A record that isn't a
+// removal continues with MSG_ReadDeltaEntity, to must already hold the old state
+int		MSG_ReadEntityNumber( bitReader_t &reader, sizebuf_t *msg, bool *remove );
+void	MSG_ReadDeltaEntity( bitReader_t &reader, entity_state_t *to );
+
+void	MSG_WriteDeltaPlayerstate( const player_state_t *from, const player_state_t *to, sizebuf_t *msg );
+void	MSG_ReadDeltaPlayerstate( sizebuf_t *msg, player_state_t *to );
@@ -0,0 +1,1284 @@
+//=================================================================================================
+// Delta compression of entity and player states
+//
+// Rather than a hand written comparison and write for every field, each struct has a table of
+// the fields that go over the net. Changes are found by XORing the old and new states a word
+// at a time, and values are bit-packed at widths chosen for what each field usually holds
+//=================================================================================================
+
+#include "engine.h"
+
+#include "msg.h"
+
+#define ENTITYNUM_BITS		10
+#define FLOAT_INT_BITS		13		// whole numbers in this range skip the full 32 bits
+#define FLOAT_INT_BIAS		( 1 << ( FLOAT_INT_BITS - 1 ) )
+
+static_assert( MAX_EDICTS <= ( 1 << ENTITYNUM_BITS ) );
+static_assert( MAX_STATS == 32 );
+
+/*
+===================================================================================================
+
+	Bit packing
+
+===================================================================================================
+*/
+
+void MSG_BeginWritingBits( bitWriter_t &writer, sizebuf_t *msg )
+{
+	writer.msg = msg;
+	writer.bits = 0;
+	writer.numBits = 0;
+}
+
+void MSG_WriteBits( bitWriter_t &writer, uint value, int numBits )
+{
+	Assert( numBits > 0 && numBits <= 32 );
+
+	if ( numBits < 32 ) {
+		value &= ( 1u << numBits ) - 1;
+	}
+
+	writer.bits |= (uint64)value << writer.numBits;
+	writer.numBits += numBits;
+
+	// a word at a time, the rest waits in bits
+	if ( writer.numBits >= 32 )
+	{
+		byte *out = (byte *)SZ_GetSpace( writer.msg, 4 );
+		out[0] = writer.bits & 0xff;
+		out[1] = ( writer.bits >> 8 ) & 0xff;
+		out[2] = ( writer.bits >> 16 ) & 0xff;
+		out[3] = ( writer.bits >> 24 ) & 0xff;
+
+		writer.bits >>= 32;
+		writer.numBits -= 32;
+	}
+}
+
+void MSG_EndWritingBits( bitWriter_t &writer )
+{
+	const int numBytes = ( writer.numBits + 7 ) / 8;
+
+	if ( numBytes != 0 )
+	{
+		byte *out = (byte *)SZ_GetSpace( writer.msg, numBytes );
+		for ( int i = 0; i < numBytes; ++i ) {
+			out[i] = ( writer.bits >> ( i * 8 ) ) & 0xff;
+		}
+	}
+
+	writer.bits = 0;
+	writer.numBits = 0;
+}
+
+void MSG_BeginReadingBits( bitReader_t &reader, sizebuf_t *msg )
+{
+	reader.msg = msg;
+	reader.bits = 0;
+	reader.numBits = 0;
+}
+
+uint MSG_ReadBits( bitReader_t &reader, int numBits )
+{
+	Assert( numBits > 0 && numBits <= 32 );
+
+	while ( reader.numBits < numBits )
+	{
+		// past the end reads as zeros, readcount going past cursize is how callers find out
+		const int c = MSG_ReadByte( reader.msg );
+
+		reader.bits |= (uint64)( c < 0 ? 0 : c ) << reader.numBits;
+		reader.numBits += 8;
+	}
+
+	const uint value = (uint)( reader.bits & ( ( (uint64)1 << numBits ) - 1 ) );
+
+	reader.bits >>= numBits;
+	reader.numBits -= numBits;
+
+	return value;
+}
+
+/*
+===================================================================================================
+
+	Field tables
+
+===================================================================================================
+*/
+
+enum netFieldType_t : uint8
+{
+	NETF_INT,		// bits wide when it fits, otherwise all 32
+	NETF_FLOAT,		// small whole numbers in FLOAT_INT_BITS, otherwise all 32
+	NETF_UNORM8		// 0 to 1 in a byte, lossy
+};
+
+struct netField_t
+{
+	const char *	name;
+	uint16			word;		// the 32-bit word of the struct that holds it
+	uint8			shift;		// and where it starts in that word
+	uint8			size;		// 1, 2 or 4 bytes
+	netFieldType_t	type;
+	uint8			bits;
+	bool			fromZero;	// compared against zero rather than the old state
+};
+
+#define NETF( s, field, type, bits ) \
+	{ #field, offsetof( s, field ) / 4, ( offsetof( s, field ) & 3 ) * 8, sizeof( ( (s *)0 )->field ), type, bits, false }
+
+#define NETF_FROM_ZERO( s, field, type, bits ) \
+	{ #field, offsetof( s, field ) / 4, ( offsetof( s, field ) & 3 ) * 8, sizeof( ( (s *)0 )->field ), type, bits, true }
+
+// The most often changed go first, the last changed field decides how many are written
+static const netField_t s_entityFields[]
+{
+	NETF( entity_state_t, origin[0], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, origin[1], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, origin[2], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, angles[1], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, frame, NETF_INT, 10 ),
+	NETF_FROM_ZERO( entity_state_t, event, NETF_INT, 8 ),		// events only last a frame
+	NETF( entity_state_t, angles[0], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, angles[2], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, modelindex, NETF_INT, 8 ),
+	NETF( entity_state_t, effects, NETF_INT, 16 ),
+	NETF( entity_state_t, renderfx, NETF_INT, 16 ),
+	NETF( entity_state_t, skinnum, NETF_INT, 8 ),
+	NETF( entity_state_t, sound, NETF_INT, 8 ),
+	NETF( entity_state_t, solid, NETF_INT, 16 ),
+	NETF( entity_state_t, modelindex2, NETF_INT, 8 ),
+	NETF( entity_state_t, modelindex3, NETF_INT, 8 ),
+	NETF( entity_state_t, modelindex4, NETF_INT, 8 ),
+};
+
+// Not delta compressed, sent for new entities and beams and taken from the old origin otherwise
+static const netField_t s_oldOriginFields[]
+{
+	NETF( entity_state_t, old_origin[0], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, old_origin[1], NETF_FLOAT, 0 ),
+	NETF( entity_state_t, old_origin[2], NETF_FLOAT, 0 ),
+};
+
+// Stats are sent separately, time_step_sound, step_left and swim_time never are
+static const netField_t s_playerFields[]
+{
+	NETF( player_state_t, pmove.origin[0], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.origin[1], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.origin[2], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.velocity[0], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.velocity[1], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.velocity[2], NETF_FLOAT, 0 ),
+	NETF( player_state_t, viewangles[0], NETF_FLOAT, 0 ),
+	NETF( player_state_t, viewangles[1], NETF_FLOAT, 0 ),
+	NETF( player_state_t, viewangles[2], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.pm_time, NETF_INT, 8 ),
+	NETF( player_state_t, pmove.pm_flags, NETF_INT, 8 ),
+	NETF( player_state_t, gunframe, NETF_INT, 8 ),
+	NETF( player_state_t, viewoffset[0], NETF_FLOAT, 0 ),
+	NETF( player_state_t, viewoffset[1], NETF_FLOAT, 0 ),
+	NETF( player_state_t, viewoffset[2], NETF_FLOAT, 0 ),
+	NETF( player_state_t, kick_angles[0], NETF_FLOAT, 0 ),
+	NETF( player_state_t, kick_angles[1], NETF_FLOAT, 0 ),
+	NETF( player_state_t, kick_angles[2], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.delta_angles[0], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.delta_angles[1], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.delta_angles[2], NETF_FLOAT, 0 ),
+	NETF( player_state_t, pmove.pm_type, NETF_INT, 4 ),
+	NETF( player_state_t, pmove.gravity, NETF_INT, 12 ),
+	NETF( player_state_t, gunindex, NETF_INT, 8 ),
+	NETF( player_state_t, blend[0], NETF_UNORM8, 8 ),
+	NETF( player_state_t, blend[1], NETF_UNORM8, 8 ),
+	NETF( player_state_t, blend[2], NETF_UNORM8, 8 ),
+	NETF( player_state_t, blend[3], NETF_UNORM8, 8 ),
+	NETF( player_state_t, fov, NETF_FLOAT, 0 ),
+	NETF( player_state_t, rdflags, NETF_INT, 8 ),
+};
+
+static constexpr int BitsForCount( int count )
+{
+	int bits = 1;
+	while ( ( 1 << bits ) <= count ) {
+		++bits;
+	}
+	return bits;
+}
+
+static constexpr int cNumEntityFields = countof( s_entityFields );
+static constexpr int cNumPlayerFields = countof( s_playerFields );
+static constexpr int cEntityFieldBits = BitsForCount( cNumEntityFields );
+static constexpr int cPlayerFieldBits = BitsForCount( cNumPlayerFields );
+
+// the changed fields are gathered in a 32-bit mask
+static_assert( cNumEntityFields <= 32 && cNumPlayerFields <= 32 );
+
+static_assert( sizeof( entity_state_t ) % 4 == 0 && sizeof( player_state_t ) % 4 == 0 );
+
+/*
+========================
+MSG_DiffWords
+
+XORs two states a word at a time, returns false if they're the same
+========================
+*/
+template<typename T>
+static bool MSG_DiffWords( const T &from, const T &to, uint32 *diff )
+{
+	const uint32 *a = (const uint32 *)&from;
+	const uint32 *b = (const uint32 *)&to;
+
+	uint32 any = 0;
+	for ( size_t i = 0; i < sizeof( T ) / 4; ++i )
+	{
+		diff[i] = a[i] ^ b[i];
+		any |= diff[i];
+	}
+
+	return any != 0;
+}
+
+static uint32 MSG_FieldMask( const netField_t &field )
+{
+	return ~0u >> ( 32 - field.size * 8 );
+}
+
+/*
+========================
+MSG_LoadField
+
+Shorts are sign extended, so small negative values still read as small
+========================
+*/
+static uint32 MSG_LoadField( const void *base, const netField_t &field )
+{
+	const uint32 value = ( ( (const uint32 *)base )[field.word] >> field.shift ) & MSG_FieldMask( field );
+
+	if ( field.size == 2 ) {
+		return (uint32)(int32)(int16)value;
+	}
+	return value;
+}
+
+static void MSG_StoreField( void *base, const netField_t &field, uint32 value )
+{
+	byte *out = (byte *)base + field.word * 4 + field.shift / 8;
+
+	if ( field.size == 1 ) {
+		*out = (byte)value;
+	} else if ( field.size == 2 ) {
+		*(uint16 *)out = (uint16)value;
+	} else {
+		*(uint32 *)out = value;
+	}
+}
+
+/*
+========================
+MSG_ChangedFields
+
+Returns a mask of the fields of table that differ, and the number up to the last of them
+========================
+*/
+static uint32 MSG_ChangedFields( const netField_t *fields, int numFields, const uint32 *diff, const void *to, int &lastChanged )
+{
+	uint32 changed = 0;
+	lastChanged = 0;
+
+	for ( int i = 0; i < numFields; ++i )
+	{
+		const netField_t &field = fields[i];
+
+		const bool fieldChanged = field.fromZero
+			? MSG_LoadField( to, field ) != 0
+			: ( ( diff[field.word] >> field.shift ) & MSG_FieldMask( field ) ) != 0;
+
+		if ( fieldChanged )
+		{
+			changed |= 1u << i;
+			lastChanged = i + 1;
+		}
+	}
+
+	return changed;
+}
+
+/*
+========================
+MSG_WriteField
+
+Zero gets a bit of its own, it's where most fields start and end up
+========================
+*/
+static void MSG_WriteField( bitWriter_t &writer, const netField_t &field, uint32 value )
+{
+	if ( value == 0 )
+	{
+		MSG_WriteBits( writer, 0, 1 );
+		return;
+	}
+
+	MSG_WriteBits( writer, 1, 1 );
+
+	switch ( field.type )
+	{
+	case NETF_INT:
+		if ( field.bits < 32 )
+		{
+			const bool fits = value < ( 1u << field.bits );
+
+			MSG_WriteBits( writer, fits ? 0 : 1, 1 );
+			if ( fits )
+			{
+				MSG_WriteBits( writer, value, field.bits );
+				break;
+			}
+		}
+		MSG_WriteBits( writer, value, 32 );
+		break;
+
+	case NETF_FLOAT:
+	{
+		float f;
+		memcpy( &f, &value, sizeof( f ) );
+
+		// -0 would come back as 0
+		if ( f >= -FLOAT_INT_BIAS && f < FLOAT_INT_BIAS && (float)(int)f == f && value != 0x80000000 )
+		{
+			MSG_WriteBits( writer, 0, 1 );
+			MSG_WriteBits( writer, (int)f + FLOAT_INT_BIAS, FLOAT_INT_BITS );
+		}
+		else
+		{
+			MSG_WriteBits( writer, 1, 1 );
+			MSG_WriteBits( writer, value, 32 );
+		}
+		break;
+	}
+
+	case NETF_UNORM8:
+	{
+		float f;
+		memcpy( &f, &value, sizeof( f ) );
+
+		MSG_WriteBits( writer, Clamp( (int)( f * 255 ), 0, 255 ), 8 );
+		break;
+	}
+	}
+}
+
+static uint32 MSG_ReadField( bitReader_t &reader, const netField_t &field )
+{
+	if ( !MSG_ReadBits( reader, 1 ) ) {
+		return 0;
+	}
+
+	uint32 value;
+	float f;
+
+	switch ( field.type )
+	{
+	case NETF_INT:
+		if ( field.bits < 32 && !MSG_ReadBits( reader, 1 ) ) {
+			return MSG_ReadBits( reader, field.bits );
+		}
+		return MSG_ReadBits( reader, 32 );
+
+	case NETF_FLOAT:
+		if ( MSG_ReadBits( reader, 1 ) ) {
+			return MSG_ReadBits( reader, 32 );
+		}
+		f = (float)( (int)MSG_ReadBits( reader, FLOAT_INT_BITS ) - FLOAT_INT_BIAS );
+		break;
+
+	case NETF_UNORM8:
+	default:
+		f = MSG_ReadBits( reader, 8 ) / 255.0f;
+		break;
+	}
+
+	memcpy( &value, &f, sizeof( value ) );
+	return value;
+}
+
+/*
+===================================================================================================
+
+	Entities
+
+	number		ENTITYNUM_BITS, 0 ends the list
+	remove		1
+	lastChanged	cEntityFieldBits, then a changed bit and maybe a value for each field up to it
+	oldOrigin	1, then the old origin if set
+
+===================================================================================================
+*/
+
+/*
+==================
+MSG_WriteDeltaEntity
+
+Writes part of a packetentities message.
+Can delta from either a baseline or a previous packet_entity
+==================
+*/
+void MSG_WriteDeltaEntity( entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity )
+{
+	uint32 diff[sizeof( entity_state_t ) / 4];
+
+	if ( !to->number ) {
+		Com_FatalError( "Unset entity number\n" );
+	}
+	if ( to->number >= MAX_EDICTS ) {
+		Com_FatalError( "Entity number >= MAX_EDICTS\n" );
+	}
+
+	const bool sendOldOrigin = newentity || ( to->renderfx & RF_BEAM );
+
+	// most entities don't change from one frame to the next
+	if ( !MSG_DiffWords( *from, *to, diff ) && !to->event && !sendOldOrigin && !force ) {
+		return;
+	}
+
+	int lastChanged;
+	const uint32 changed = MSG_ChangedFields( s_entityFields, cNumEntityFields, diff, to, lastChanged );
+
+	if ( !changed && !sendOldOrigin && !force ) {
+		return;		// nothing to send!
+	}
+
+	bitWriter_t writer;
+	MSG_BeginWritingBits( writer, msg );
+
+	MSG_WriteBits( writer, to->number, ENTITYNUM_BITS );
+	MSG_WriteBits( writer, 0, 1 );
+	MSG_WriteBits( writer, lastChanged, cEntityFieldBits );
+
+	for ( int i = 0; i < lastChanged; ++i )
+	{
+		const bool fieldChanged = ( changed >> i ) & 1;
+
+		MSG_WriteBits( writer, fieldChanged, 1 );
+		if ( fieldChanged ) {
+			MSG_WriteField( writer, s_entityFields[i], MSG_LoadField( to, s_entityFields[i] ) );
+		}
+	}
+
+	MSG_WriteBits( writer, sendOldOrigin, 1 );
+	if ( sendOldOrigin )
+	{
+		for ( const netField_t &field : s_oldOriginFields ) {
+			MSG_WriteField( writer, field, MSG_LoadField( to, field ) );
+		}
+	}
+
+	MSG_EndWritingBits( writer );
+}
+
+/*
+========================
+MSG_WriteRemoveEntity
+========================
+*/
+void MSG_WriteRemoveEntity( sizebuf_t *msg, int number )
+{
+	bitWriter_t writer;
+	MSG_BeginWritingBits( writer, msg );
+
+	MSG_WriteBits( writer, number, ENTITYNUM_BITS );
+	MSG_WriteBits( writer, 1, 1 );
+
+	MSG_EndWritingBits( writer );
+}
+
+/*
+========================
+MSG_WriteEntityListEnd
+========================
+*/
+void MSG_WriteEntityListEnd( sizebuf_t *msg )
+{
+	bitWriter_t writer;
+	MSG_BeginWritingBits( writer, msg );
+
+	MSG_WriteBits( writer, 0, ENTITYNUM_BITS );
+
+	MSG_EndWritingBits( writer );
+}
+
+/*
+========================
+MSG_ReadEntityNumber
+========================
+*/
+int MSG_ReadEntityNumber( bitReader_t &reader, sizebuf_t *msg, bool *remove )
+{
+	MSG_BeginReadingBits( reader, msg );
+
+	const int number = MSG_ReadBits( reader, ENTITYNUM_BITS );
+
+	*remove = number != 0 && MSG_ReadBits( reader, 1 ) != 0;
+
+	return number;
+}
+
+/*
+========================
+MSG_ReadDeltaEntity
+========================
+*/
+void MSG_ReadDeltaEntity( bitReader_t &reader, entity_state_t *to )
+{
+	const int lastChanged = MSG_ReadBits( reader, cEntityFieldBits );
+
+	if ( lastChanged > cNumEntityFields ) {
+		Com_Errorf( "MSG_ReadDeltaEntity: bad field count %d", lastChanged );
+	}
+
+	for ( int i = 0; i < lastChanged; ++i )
+	{
+		if ( MSG_ReadBits( reader, 1 ) ) {
+			MSG_StoreField( to, s_entityFields[i], MSG_ReadField( reader, s_entityFields[i] ) );
+		}
+	}
+
+	if ( MSG_ReadBits( reader, 1 ) )
+	{
+		for ( const netField_t &field : s_oldOriginFields ) {
+			MSG_StoreField( to, field, MSG_ReadField( reader, field ) );
+		}
+	}
+}
+
+/*
+===================================================================================================
+
+	Player states
+
+	lastChanged	cPlayerFieldBits, then a changed bit and maybe a value for each field up to it
+	stats		1, then a mask of the changed stats and 16 bits for each of them
+
+===================================================================================================
+*/
+
+/*
+========================
+MSG_WriteDeltaPlayerstate
+========================
+*/
+void MSG_WriteDeltaPlayerstate( const player_state_t *from, const player_state_t *to, sizebuf_t *msg )
+{
+	uint32 diff[sizeof( player_state_t ) / 4];
+
+	MSG_DiffWords( *from, *to, diff );
+
+	int lastChanged;
+	const uint32 changed = MSG_ChangedFields( s_playerFields, cNumPlayerFields, diff, to, lastChanged );
+
+	uint32 statbits = 0;
+	for ( int i = 0; i < MAX_STATS; ++i )
+	{
+		if ( to->stats[i] != from->stats[i] ) {
+			statbits |= 1u << i;
+		}
+	}
+
+	bitWriter_t writer;
+	MSG_BeginWritingBits( writer, msg );
+
+	MSG_WriteBits( writer, lastChanged, cPlayerFieldBits );
+
+	for ( int i = 0; i < lastChanged; ++i )
+	{
+		const bool fieldChanged = ( changed >> i ) & 1;
+
+		MSG_WriteBits( writer, fieldChanged, 1 );
+		if ( fieldChanged ) {
+			MSG_WriteField( writer, s_playerFields[i], MSG_LoadField( to, s_playerFields[i] ) );
+		}
+	}
+
+	MSG_WriteBits( writer, statbits != 0, 1 );
+	if ( statbits )
+	{
+		MSG_WriteBits( writer, statbits, MAX_STATS );
+		for ( int i = 0; i < MAX_STATS; ++i )
+		{
+			if ( statbits & ( 1u << i ) ) {
+				MSG_WriteBits( writer, (uint16)to->stats[i], 16 );
+			}
+		}
+	}
+
+	MSG_EndWritingBits( writer );
+}
+
+/*
+========================
+MSG_ReadDeltaPlayerstate
+
+to must already hold the state being delta'd from
+========================
+*/
+void MSG_ReadDeltaPlayerstate( sizebuf_t *msg, player_state_t *to )
+{
+	bitReader_t reader;
+	MSG_BeginReadingBits( reader, msg );
+
+	const int lastChanged = MSG_ReadBits( reader, cPlayerFieldBits );
+
+	if ( lastChanged > cNumPlayerFields ) {
+		Com_Errorf( "MSG_ReadDeltaPlayerstate: bad field count %d", lastChanged );
+	}
+
+	for ( int i = 0; i < lastChanged; ++i )
+	{
+		if ( MSG_ReadBits( reader, 1 ) ) {
+			MSG_StoreField( to, s_playerFields[i], MSG_ReadField( reader, s_playerFields[i] ) );
+		}
+	}
+
+	if ( MSG_ReadBits( reader, 1 ) )
+	{
+		const uint32 statbits = MSG_ReadBits( reader, MAX_STATS );
+		for ( int i = 0; i < MAX_STATS; ++i )
+		{
+			if ( statbits & ( 1u << i ) ) {
+				to->stats[i] = (int16)MSG_ReadBits( reader, 16 );
+			}
+		}
+	}
+}
+
+/*
+===================================================================================================
+
+	Benchmark
+
+	Server demos hold every entity of every frame, so they can be run back through both
+	encoders as if each frame were a snapshot delta'd from the one before. Demos recorded
+	before protocol 37 are read with the old decoder
+
+===================================================================================================
+*/
+
+#define BENCH_PROTOCOL_BITPACKED	37
+#define BENCH_BUFFER_SIZE			( 256 * 1024 )
+
+struct benchFrame_t
+{
+	int		first;
+	int		count;
+};
+
+/*
+==================
+MSG_WriteDeltaEntityBytes
+
+The encoder from before protocol 37, byte-aligned with a hand written comparison per field
+==================
+*/
+static void MSG_WriteDeltaEntityBytes (const entity_state_t *from, const entity_state_t *to, sizebuf_t *msg, qboolean force, qboolean newentity)
+{
+	int		bits;
+
+	if (!to->number)
+		Com_FatalError("Unset entity number\n");
+	if (to->number >= MAX_EDICTS)
+		Com_FatalError("Entity number >= MAX_EDICTS\n");
+
+// send an update
+	bits = 0;
+
+	if (to->number >= 256)
+		bits |= U_NUMBER16;		// number8 is implicit otherwise
+
+	if (to->origin[0] != from->origin[0])
+		bits |= U_ORIGIN1;
+	if (to->origin[1] != from->origin[1])
+		bits |= U_ORIGIN2;
+	if (to->origin[2] != from->origin[2])
+		bits |= U_ORIGIN3;
+
+	if ( to->angles[0] != from->angles[0] )
+		bits |= U_ANGLE1;		
+	if ( to->angles[1] != from->angles[1] )
+		bits |= U_ANGLE2;
+	if ( to->angles[2] != from->angles[2] )
+		bits |= U_ANGLE3;
+		
+	if ( to->skinnum != from->skinnum )
+	{
+		if ((unsigned)to->skinnum < 256)
+			bits |= U_SKIN8;
+		else if ((unsigned)to->skinnum < 0x10000)
+			bits |= U_SKIN16;
+		else
+			bits |= (U_SKIN8|U_SKIN16);
+	}
+		
+	if ( to->frame != from->frame )
+	{
+		if (to->frame < 256)
+			bits |= U_FRAME8;
+		else
+			bits |= U_FRAME16;
+	}
+
+	if ( to->effects != from->effects )
+	{
+		if (to->effects < 256)
+			bits |= U_EFFECTS8;
+		else if (to->effects < 0x8000)
+			bits |= U_EFFECTS16;
+		else
+			bits |= U_EFFECTS8|U_EFFECTS16;
+	}
+	
+	if ( to->renderfx != from->renderfx )
+	{
+		if (to->renderfx < 256)
+			bits |= U_RENDERFX8;
+		else if (to->renderfx < 0x8000)
+			bits |= U_RENDERFX16;
+		else
+			bits |= U_RENDERFX8|U_RENDERFX16;
+	}
+	
+	if ( to->solid != from->solid )
+		bits |= U_SOLID;
+
+	// event is not delta compressed, just 0 compressed
+	if ( to->event  )
+		bits |= U_EVENT;
+	
+	if ( to->modelindex != from->modelindex )
+		bits |= U_MODEL;
+	if ( to->modelindex2 != from->modelindex2 )
+		bits |= U_MODEL2;
+	if ( to->modelindex3 != from->modelindex3 )
+		bits |= U_MODEL3;
+	if ( to->modelindex4 != from->modelindex4 )
+		bits |= U_MODEL4;
+
+	if ( to->sound != from->sound )
+		bits |= U_SOUND;
+
+	if (newentity || (to->renderfx & RF_BEAM))
+		bits |= U_OLDORIGIN;
+
+	//
+	// write the message
+	//
+	if (!bits && !force)
+		return;		// nothing to send!
+
+	//----------
+
+	if (bits & 0xff000000)
+		bits |= U_MOREBITS3 | U_MOREBITS2 | U_MOREBITS1;
+	else if (bits & 0x00ff0000)
+		bits |= U_MOREBITS2 | U_MOREBITS1;
+	else if (bits & 0x0000ff00)
+		bits |= U_MOREBITS1;
+
+	MSG_WriteByte (msg,	bits&255 );
+
+	if (bits & 0xff000000)
+	{
+		MSG_WriteByte (msg,	(bits>>8)&255 );
+		MSG_WriteByte (msg,	(bits>>16)&255 );
+		MSG_WriteByte (msg,	(bits>>24)&255 );
+	}
+	else if (bits & 0x00ff0000)
+	{
+		MSG_WriteByte (msg,	(bits>>8)&255 );
+		MSG_WriteByte (msg,	(bits>>16)&255 );
+	}
+	else if (bits & 0x0000ff00)
+	{
+		MSG_WriteByte (msg,	(bits>>8)&255 );
+	}
+
+	//----------
+
+	if (bits & U_NUMBER16)
+		MSG_WriteShort (msg, to->number);
+	else
+		MSG_WriteByte (msg,	to->number);
+
+	if (bits & U_MODEL)
+		MSG_WriteByte (msg,	to->modelindex);
+	if (bits & U_MODEL2)
+		MSG_WriteByte (msg,	to->modelindex2);
+	if (bits & U_MODEL3)
+		MSG_WriteByte (msg,	to->modelindex3);
+	if (bits & U_MODEL4)
+		MSG_WriteByte (msg,	to->modelindex4);
+
+	if (bits & U_FRAME8)
+		MSG_WriteByte (msg, to->frame);
+	if (bits & U_FRAME16)
+		MSG_WriteShort (msg, to->frame);
+
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))		//used for laser colors
+		MSG_WriteLong (msg, to->skinnum);
+	else if (bits & U_SKIN8)
+		MSG_WriteByte (msg, to->skinnum);
+	else if (bits & U_SKIN16)
+		MSG_WriteShort (msg, to->skinnum);
+
+
+	if ( (bits & (U_EFFECTS8|U_EFFECTS16)) == (U_EFFECTS8|U_EFFECTS16) )
+		MSG_WriteLong (msg, to->effects);
+	else if (bits & U_EFFECTS8)
+		MSG_WriteByte (msg, to->effects);
+	else if (bits & U_EFFECTS16)
+		MSG_WriteShort (msg, to->effects);
+
+	if ( (bits & (U_RENDERFX8|U_RENDERFX16)) == (U_RENDERFX8|U_RENDERFX16) )
+		MSG_WriteLong (msg, to->renderfx);
+	else if (bits & U_RENDERFX8)
+		MSG_WriteByte (msg, to->renderfx);
+	else if (bits & U_RENDERFX16)
+		MSG_WriteShort (msg, to->renderfx);
+
+	if (bits & U_ORIGIN1)
+		MSG_WriteCoord (msg, to->origin[0]);		
+	if (bits & U_ORIGIN2)
+		MSG_WriteCoord (msg, to->origin[1]);
+	if (bits & U_ORIGIN3)
+		MSG_WriteCoord (msg, to->origin[2]);
+
+	if (bits & U_ANGLE1)
+		MSG_WriteAngle(msg, to->angles[0]);
+	if (bits & U_ANGLE2)
+		MSG_WriteAngle(msg, to->angles[1]);
+	if (bits & U_ANGLE3)
+		MSG_WriteAngle(msg, to->angles[2]);
+
+	if (bits & U_OLDORIGIN)
+	{
+		MSG_WritePos (msg, const_cast<float *>(to->old_origin));
+	}
+
+	if (bits & U_SOUND)
+		MSG_WriteByte (msg, to->sound);
+	if (bits & U_EVENT)
+		MSG_WriteByte (msg, to->event);
+	if (bits & U_SOLID)
+		MSG_WriteShort (msg, to->solid);
+}
+
+/*
+==================
+MSG_ReadDeltaEntityBytes
+
+The decoder for MSG_WriteDeltaEntityBytes, returns the entity number
+==================
+*/
+static int MSG_ReadDeltaEntityBytes( sizebuf_t *msg, entity_state_t *to )
+{
+	uint bits = MSG_ReadByte( msg );
+	if ( bits & U_MOREBITS1 ) {
+		bits |= MSG_ReadByte( msg ) << 8;
+	}
+	if ( bits & U_MOREBITS2 ) {
+		bits |= MSG_ReadByte( msg ) << 16;
+	}
+	if ( bits & U_MOREBITS3 ) {
+		bits |= MSG_ReadByte( msg ) << 24;
+	}
+
+	const int number = ( bits & U_NUMBER16 ) ? MSG_ReadShort( msg ) : MSG_ReadByte( msg );
+	if ( number <= 0 || ( bits & U_REMOVE ) ) {
+		return number;
+	}
+
+	if ( bits & U_MODEL ) to->modelindex = MSG_ReadByte( msg );
+	if ( bits & U_MODEL2 ) to->modelindex2 = MSG_ReadByte( msg );
+	if ( bits & U_MODEL3 ) to->modelindex3 = MSG_ReadByte( msg );
+	if ( bits & U_MODEL4 ) to->modelindex4 = MSG_ReadByte( msg );
+
+	if ( bits & U_FRAME8 ) to->frame = MSG_ReadByte( msg );
+	if ( bits & U_FRAME16 ) to->frame = MSG_ReadShort( msg );
+
+	if ( ( bits & U_SKIN8 ) && ( bits & U_SKIN16 ) ) to->skinnum = MSG_ReadLong( msg );
+	else if ( bits & U_SKIN8 ) to->skinnum = MSG_ReadByte( msg );
+	else if ( bits & U_SKIN16 ) to->skinnum = MSG_ReadShort( msg );
+
+	if ( ( bits & ( U_EFFECTS8 | U_EFFECTS16 ) ) == ( U_EFFECTS8 | U_EFFECTS16 ) ) to->effects = MSG_ReadLong( msg );
+	else if ( bits & U_EFFECTS8 ) to->effects = MSG_ReadByte( msg );
+	else if ( bits & U_EFFECTS16 ) to->effects = MSG_ReadShort( msg );
+
+	if ( ( bits & ( U_RENDERFX8 | U_RENDERFX16 ) ) == ( U_RENDERFX8 | U_RENDERFX16 ) ) to->renderfx = MSG_ReadLong( msg );
+	else if ( bits & U_RENDERFX8 ) to->renderfx = MSG_ReadByte( msg );
+	else if ( bits & U_RENDERFX16 ) to->renderfx = MSG_ReadShort( msg );
+
+	if ( bits & U_ORIGIN1 ) to->origin[0] = MSG_ReadCoord( msg );
+	if ( bits & U_ORIGIN2 ) to->origin[1] = MSG_ReadCoord( msg );
+	if ( bits & U_ORIGIN3 ) to->origin[2] = MSG_ReadCoord( msg );
+
+	if ( bits & U_ANGLE1 ) to->angles[0] = MSG_ReadAngle( msg );
+	if ( bits & U_ANGLE2 ) to->angles[1] = MSG_ReadAngle( msg );
+	if ( bits & U_ANGLE3 ) to->angles[2] = MSG_ReadAngle( msg );
+
+	if ( bits & U_OLDORIGIN ) MSG_ReadPos( msg, to->old_origin );
+
+	if ( bits & U_SOUND ) to->sound = MSG_ReadByte( msg );
+	if ( bits & U_EVENT ) to->event = MSG_ReadByte( msg );
+	if ( bits & U_SOLID ) to->solid = MSG_ReadShort( msg );
+
+	return number;
+}
+
+static void MSG_WriteRemoveEntityBytes( sizebuf_t *msg, int number )
+{
+	if ( number >= 256 )
+	{
+		MSG_WriteByte( msg, U_REMOVE | U_MOREBITS1 );
+		MSG_WriteByte( msg, U_NUMBER16 >> 8 );
+		MSG_WriteShort( msg, number );
+	}
+	else
+	{
+		MSG_WriteByte( msg, U_REMOVE );
+		MSG_WriteByte( msg, number );
+	}
+}
+
+/*
+========================
+MSG_BenchReadDemo
+
+Pulls the entity lists out of a server demo
+========================
+*/
+static bool MSG_BenchReadDemo( byte *data, int size, std::vector<entity_state_t> &states, std::vector<benchFrame_t> &frames )
+{
+	bool bitPacked = false;
+
+	for ( int offset = 0, block = 0; offset + 4 <= size; ++block )
+	{
+		int length;
+		memcpy( &length, data + offset, sizeof( length ) );
+		length = LittleLong( length );
+		offset += 4;
+
+		if ( length == -1 ) {
+			break;
+		}
+		if ( length < 0 || length > size - offset )
+		{
+			Com_Print( "msg_deltaBench: truncated demo\n" );
+			return false;
+		}
+
+		sizebuf_t msg;
+		SZ_Init( &msg, data + offset, length );
+		msg.cursize = length;
+		offset += length;
+
+		if ( block == 0 )
+		{
+			if ( MSG_ReadByte( &msg ) != svc_serverdata )
+			{
+				Com_Print( "msg_deltaBench: not a demo\n" );
+				return false;
+			}
+
+			const int protocol = MSG_ReadLong( &msg );
+			MSG_ReadLong( &msg );	// spawn count
+
+			// only server demos hold complete entity lists
+			if ( MSG_ReadByte( &msg ) != 2 )
+			{
+				Com_Print( "msg_deltaBench: not a server demo, record one with serverrecord\n" );
+				return false;
+			}
+
+			bitPacked = protocol >= BENCH_PROTOCOL_BITPACKED;
+			continue;
+		}
+
+		if ( MSG_ReadByte( &msg ) != svc_frame ) {
+			continue;
+		}
+		MSG_ReadLong( &msg );
+		if ( MSG_ReadByte( &msg ) != svc_packetentities ) {
+			continue;
+		}
+
+		benchFrame_t frame;
+		frame.first = (int)states.size();
+
+		// every entity is delta'd from nothing
+		while ( true )
+		{
+			entity_state_t state{};
+			int number;
+
+			if ( bitPacked )
+			{
+				bitReader_t reader;
+				bool remove;
+
+				number = MSG_ReadEntityNumber( reader, &msg, &remove );
+				if ( number > 0 && !remove )
+				{
+					MSG_ReadDeltaEntity( reader, &state );
+				}
+			}
+			else
+			{
+				number = MSG_ReadDeltaEntityBytes( &msg, &state );
+			}
+
+			if ( msg.readcount > msg.cursize || number < 0 || number >= MAX_EDICTS )
+			{
+				Com_Print( "msg_deltaBench: bad entity in demo\n" );
+				return false;
+			}
+			if ( number == 0 ) {
+				break;
+			}
+
+			state.number = number;
+			states.push_back( state );
+		}
+
+		frame.count = (int)states.size() - frame.first;
+		frames.push_back( frame );
+	}
+
+	return true;
+}
+
+/*
+========================
+MSG_BenchEmit
+
+What SV_EmitPacketEntities does, with either encoder
+========================
+*/
+static void MSG_BenchEmit( const entity_state_t *from, int numFrom, const entity_state_t *to, int numTo, sizebuf_t *msg, bool bitPacked )
+{
+	entity_state_t nullstate{};
+
+	int oldindex = 0, newindex = 0;
+
+	while ( newindex < numTo || oldindex < numFrom )
+	{
+		const int newnum = newindex < numTo ? to[newindex].number : 9999;
+		const int oldnum = oldindex < numFrom ? from[oldindex].number : 9999;
+
+		if ( newnum == oldnum || newnum < oldnum )
+		{
+			const entity_state_t *base = ( newnum == oldnum ) ? &from[oldindex++] : &nullstate;
+			const bool isNew = ( base == &nullstate );
+
+			if ( bitPacked ) {
+				MSG_WriteDeltaEntity( const_cast<entity_state_t *>( base ), const_cast<entity_state_t *>( &to[newindex] ), msg, isNew, isNew );
+			} else {
+				MSG_WriteDeltaEntityBytes( base, &to[newindex], msg, isNew, isNew );
+			}
+			newindex++;
+			continue;
+		}
+
+		if ( bitPacked ) {
+			MSG_WriteRemoveEntity( msg, oldnum );
+		} else {
+			MSG_WriteRemoveEntityBytes( msg, oldnum );
+		}
+		oldindex++;
+	}
+
+	if ( bitPacked ) {
+		MSG_WriteEntityListEnd( msg );
+	} else {
+		MSG_WriteShort( msg, 0 );
+	}
+}
+
+/*
+========================
+MSG_BenchVerify
+
+Decodes a bit-packed list the way the client does and checks it against what was sent.
+The old origin is left out, it's only sent when the client couldn't work it out
+========================
+*/
+static bool MSG_BenchVerify( const entity_state_t *from, int numFrom, const entity_state_t *to, int numTo, sizebuf_t *msg, std::vector<entity_state_t> &decoded )
+{
+	decoded.clear();
+
+	const auto unchanged = [&decoded]( const entity_state_t &old )
+	{
+		entity_state_t &state = decoded.emplace_back( old );
+		VectorCopy( old.origin, state.old_origin );
+		state.event = 0;
+	};
+
+	int oldindex = 0;
+	bitReader_t reader;
+	bool remove;
+
+	MSG_BeginReading( msg );
+
+	while ( const int newnum = MSG_ReadEntityNumber( reader, msg, &remove ) )
+	{
+		if ( msg->readcount > msg->cursize || newnum >= MAX_EDICTS ) {
+			return false;
+		}
+
+		while ( oldindex < numFrom && from[oldindex].number < newnum ) {
+			unchanged( from[oldindex++] );
+		}
+
+		const bool delta = oldindex < numFrom && from[oldindex].number == newnum;
+
+		if ( remove )
+		{
+			if ( !delta ) {
+				return false;
+			}
+			oldindex++;
+			continue;
+		}
+
+		entity_state_t state{};
+		if ( delta ) {
+			state = from[oldindex++];
+		}
+		VectorCopy( state.origin, state.old_origin );
+		state.number = newnum;
+		state.event = 0;
+
+		MSG_ReadDeltaEntity( reader, &state );
+		decoded.push_back( state );
+	}
+
+	while ( oldindex < numFrom ) {
+		unchanged( from[oldindex++] );
+	}
+
+	if ( (int)decoded.size() != numTo ) {
+		return false;
+	}
+
+	for ( int i = 0; i < numTo; ++i )
+	{
+		entity_state_t a = decoded[i];
+		entity_state_t b = to[i];
+		VectorClear( a.old_origin );
+		VectorClear( b.old_origin );
+
+		if ( memcmp( &a, &b, sizeof( a ) ) != 0 ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+CON_COMMAND( msg_deltaBench, "Runs the entities of a server demo through the old byte-aligned delta encoder and the bit-packed one, comparing size and speed. Usage: msg_deltaBench <demo> [passes]", 0 )
+{
+	if ( Cmd_Argc() < 2 )
+	{
+		Com_Print( "Usage: msg_deltaBench <demo> [passes]\n" );
+		return;
+	}
+
+	const int passes = Cmd_Argc() > 2 ? Clamp( Q_atoi( Cmd_Argv( 2 ) ), 1, 1000 ) : 10;
+
+	char name[MAX_QPATH];
+	Q_sprintf_s( name, "demos/%s.dm2", Cmd_Argv( 1 ) );
+
+	byte *data;
+	const fsSize_t size = FileSystem::LoadFile( name, (void **)&data );
+	if ( size <= 0 || !data )
+	{
+		Com_Printf( "msg_deltaBench: couldn't load %s\n", name );
+		return;
+	}
+
+	std::vector<entity_state_t> states;
+	std::vector<benchFrame_t> frames;
+
+	const bool loaded = MSG_BenchReadDemo( data, (int)size, states, frames );
+	FileSystem::FreeFile( data );
+
+	if ( !loaded ) {
+		return;
+	}
+	if ( frames.empty() )
+	{
+		Com_Print( "msg_deltaBench: no frames in demo\n" );
+		return;
+	}
+
+	byte *buffer = (byte *)Mem_Alloc( BENCH_BUFFER_SIZE );
+	sizebuf_t msg;
+
+	int64 bytes[2]{};
+	double msec[2]{};
+
+	for ( int bitPacked = 0; bitPacked < 2; ++bitPacked )
+	{
+		const double start = Time_FloatMilliseconds();
+
+		for ( int pass = 0; pass < passes; ++pass )
+		{
+			for ( size_t i = 0; i < frames.size(); ++i )
+			{
+				const benchFrame_t &to = frames[i];
+				const benchFrame_t from = i > 0 ? frames[i - 1] : benchFrame_t{ 0, 0 };
+
+				SZ_Init( &msg, buffer, BENCH_BUFFER_SIZE );
+				MSG_BenchEmit( &states[from.first], from.count, &states[to.first], to.count, &msg, bitPacked != 0 );
+
+				if ( pass == 0 ) {
+					bytes[bitPacked] += msg.cursize;
+				}
+			}
+		}
+
+		msec[bitPacked] = Time_FloatMilliseconds() - start;
+	}
+
+	// and check the new encoding round trips
+	std::vector<entity_state_t> decoded;
+	int mismatches = 0;
+
+	for ( size_t i = 0; i < frames.size(); ++i )
+	{
+		const benchFrame_t &to = frames[i];
+		const benchFrame_t from = i > 0 ? frames[i - 1] : benchFrame_t{ 0, 0 };
+
+		SZ_Init( &msg, buffer, BENCH_BUFFER_SIZE );
+		MSG_BenchEmit( &states[from.first], from.count, &states[to.first], to.count, &msg, true );
+
+		if ( !MSG_BenchVerify( &states[from.first], from.count, &states[to.first], to.count, &msg, decoded ) ) {
+			++mismatches;
+		}
+	}
+
+	Mem_Free( buffer );
+
+	const double numFrames = (double)frames.size();
+	const double numEncodes = numFrames * passes;
+
+	Com_Printf( "msg_deltaBench: %d frames, %d entity states, %d passes\n", (int)frames.size(), (int)states.size(), passes );
+	Com_Printf( "  byte-aligned: %8.1f bytes/frame, %7.2f us/frame\n", bytes[0] / numFrames, msec[0] * 1000.0 / numEncodes );
+	Com_Printf( "  bit-packed:   %8.1f bytes/frame, %7.2f us/frame\n", bytes[1] / numFrames, msec[1] * 1000.0 / numEncodes );
+	Com_Printf( "  %.1f%% of the size, %.2fx the speed\n", bytes[0] ? 100.0 * bytes[1] / bytes[0] : 0.0, msec[1] > 0.0 ? msec[0] / msec[1] : 0.0 );
+
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_RED "  %d frames didn't decode to what was sent\n", mismatches );
+	} else {
+		Com_Print( "  every frame decoded to what was sent\n" );
+	}
+}
@@ -19,6 +19,10 @@
 #define	MAX_MSGLEN		32768		// max length of a message
 #define	MAX_PACKETLEN	32768		// max size of a network packet
 
+// Net channel packets with more payload than this go out as several datagrams that each fit in
+// a typical MTU, instead of leaving it to IP fragmentation where losing any piece loses the lot
+#define	NET_FRAGMENT_SIZE	1200
+
 // Short so netadr_t is a nice 8 bytes
 enum netadrtype_t : uint16 { NA_LOOPBACK, NA_BROADCAST, NA_IP };
 
@@ -40,9 +44,24 @@ void		NET_Shutdown();
 
 void		NET_Config( bool multiplayer );
 
-bool		NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message );
+// What the network layer already knows about a packet before anyone parses it
+struct netPacketInfo_t
+{
+	int			time;				// Sys_Milliseconds when it came off the socket
+	int			sequence;
+	int			sequenceAck;
+	int			qport;				// only clients send one, -1 if the packet is too short
+	bool		connectionless;		// starts with -1, the rest are unset
+};
+
+bool		NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message, netPacketInfo_t *info = nullptr );
 void		NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t &to );
 
+// Between these NET_SendPacket queues up packets for sock, so a whole
+// frame of them goes out in as few syscalls as the platform allows
+void		NET_BeginPacketBatch( netsrc_t sock );
+void		NET_FlushPackets( netsrc_t sock );
+
 bool		NET_CompareNetadr( const netadr_t &a, const netadr_t &b );
 bool		NET_CompareBaseNetadr( const netadr_t &a, const netadr_t &b );
 bool		NET_IsLocalAddress( const netadr_t &adr );
@@ -50,10 +69,40 @@ char		*NET_NetadrToString( const netadr_t &a );
 bool		NET_StringToNetadr( const char *s, netadr_t &a );
 void		NET_Sleep( int msec );
 
+//-------------------------------------------------------------------------------------------------
+// Network I/O thread
+//
+// While running, a thread owns the socket for sock. It reads packets as soon as they arrive and
+// sends whatever the main thread queued up, NET_GetPacket and NET_SendPacket on the main thread
+// just drain and fill the queues between them. Loopback packets never go near it
+//-------------------------------------------------------------------------------------------------
+
+void		NET_StartIOThread( netsrc_t sock );
+void		NET_StopIOThread( netsrc_t sock );
+
+// True when the I/O thread owns sock and this isn't it
+bool		NET_IOThreadOwns( netsrc_t sock );
+
+bool		NET_GetQueuedPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message, netPacketInfo_t *info );
+void		NET_QueueSendPacket( netsrc_t sock, int length, const void *data, const netadr_t &to );
+void		NET_HoldQueuedPackets( netsrc_t sock, bool hold );
+
+void		NET_ReadPacketInfo( const sizebuf_t &message, int time, netPacketInfo_t &info );
+
+// Implemented per platform for the I/O thread. NET_WaitForSocket blocks until the socket is
+// readable, NET_WakeSocketWait is called or msec passes
+bool		NET_OpenSocketWait( netsrc_t sock );
+void		NET_CloseSocketWait( netsrc_t sock );
+void		NET_WaitForSocket( netsrc_t sock, int msec );
+void		NET_WakeSocketWait( netsrc_t sock );
+bool		NET_ReadSocket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message );
+
 //-------------------------------------------------------------------------------------------------
 // Net channels
 //-------------------------------------------------------------------------------------------------
 
+struct netCompress_t;
+
 struct netchan_t
 {
 	netsrc_t	sock;
@@ -83,17 +132,28 @@ struct netchan_t
 
 // message is copied to this buffer when it is first transfered
 	int			reliable_length;
+	int			reliable_plain_length;	// reliable_length before compression
 	byte		reliable_buf[MAX_MSGLEN - 16];	// unacked reliable message
+
+// fragments of the packet being reassembled
+	int			fragment_sequence;
+	int			fragment_length;
+	byte		fragment_buf[MAX_PACKETLEN];
+
+// zlib streams, null unless both ends asked for compression when connecting
+	netCompress_t *	compress;
 };
 
 extern cvar_t *		net_qport;
+extern cvar_t *		net_compress;
 
 extern netadr_t		net_from;
 extern sizebuf_t	net_message;
 extern byte			net_message_buffer[MAX_MSGLEN];
 
 void		Netchan_Init( void );
-void		Netchan_Setup( netsrc_t sock, netchan_t *chan, netadr_t adr, int qport );
+void		Netchan_Setup( netsrc_t sock, netchan_t *chan, netadr_t adr, int qport, bool compress = false );
+void		Netchan_Shutdown( netchan_t *chan );
 
 qboolean	Netchan_NeedReliable( netchan_t *chan );
 void		Netchan_Transmit( netchan_t *chan, int length, byte *data );
@@ -3,16 +3,27 @@
 
 #include "net.h"
 
+#include "zlib.h"
+
 /*
 
 packet header
 -------------
-31	sequence
+30	sequence
+1	is this one fragment of a larger packet
 1	does this message contain a reliable payload
 31	acknowledge sequence
 1	acknowledge receipt of even/odd message
 16	qport
 
+fragments follow the header with
+15	offset of this fragment in the packet's payload
+1	more fragments follow
+
+compressed channels follow that with
+8	flags, NETCOMP_UNRELIABLE if the unreliable part is deflated
+16	reliable length on the wire, only if there is a reliable payload
+
 The remote connection never knows if it missed a reliable message, the
 local side detects that it has been dropped by seeing a sequence acknowledge
 higher thatn the last reliable sequence, but without the correct evon/odd
@@ -55,11 +66,48 @@ If there is no information that needs to be transfered on a given frame,
 such as during the connection stage while waiting for the client to load,
 then a packet only needs to be delivered if there is something in the
 unacknowledged reliable
+
+
+Packets with more than NET_FRAGMENT_SIZE bytes of payload are split into
+fragments that all go out at once with the same sequence. The receiver only
+accepts them in order and drops the lot if one goes missing, which the
+reliable retransmit already copes with. Loopback is never fragmented.
+
+When both ends ask for it at connect time, reliable messages are deflated
+through one zlib stream for the life of the channel. Each reliable message
+is delivered exactly once and in order, so the inflating side stays in step
+and later messages can refer back to configstrings that came before them.
+Unreliable parts can be lost, so they are deflated on their own and only
+when that makes them smaller.
 */
 
+#define FRAGMENT_BIT			( 1u << 30 )
+#define FRAGMENT_MORE			0x8000
+
+#define NETCOMP_UNRELIABLE		1
+#define NETCOMP_WINDOW_BITS		-12		// raw deflate with a 4k window, the streams are per client
+#define NETCOMP_MEM_LEVEL		5
+#define NETCOMP_MIN_UNRELIABLE	64		// not worth trying on anything smaller
+
+struct netCompress_t
+{
+	z_stream	deflater;		// outgoing reliable messages
+	z_stream	inflater;		// incoming reliable messages
+};
+
 static cvar_t *net_showPackets;
 static cvar_t *net_showDrop;
 cvar_t *net_qport;
+cvar_t *net_compress;
+
+// unreliable parts are deflated one at a time, so every channel shares these
+static z_stream		s_packetDeflater;
+static z_stream		s_packetInflater;
+static byte			s_compressBuf[MAX_MSGLEN];
+
+// where Netchan_Transmit sends packets, net_chanBench swaps in an in-memory queue
+using netSendFunc_t = void ( * )( netsrc_t sock, int length, const void *data, const netadr_t &to );
+static netSendFunc_t s_sendPacket = NET_SendPacket;
 
 netadr_t	net_from;
 sizebuf_t	net_message;
@@ -80,8 +128,292 @@ void Netchan_Init()
 	net_showPackets = Cvar_Get( "net_showPackets", "0", 0, "Log packet stats." );
 	net_showDrop = Cvar_Get( "net_showDrop", "0", 0, "Log dropped packets." );
 	net_qport = Cvar_Get( "net_qport", portStr, CVAR_INIT, "The network port." );
+	net_compress = Cvar_Get( "net_compress", "1", CVAR_ARCHIVE, "Ask for zlib compression of net channels, used when both ends agree. Takes effect on the next connect." );
+
+	deflateInit2( &s_packetDeflater, Z_BEST_SPEED, Z_DEFLATED, NETCOMP_WINDOW_BITS, NETCOMP_MEM_LEVEL, Z_DEFAULT_STRATEGY );
+	inflateInit2( &s_packetInflater, NETCOMP_WINDOW_BITS );
+}
+
+/*
+===================================================================================================
+
+	Compression
+
+===================================================================================================
+*/
+
+/*
+========================
+Netchan_Deflate
+
+Fails if the output doesn't fit in outSize, or Z_FINISH didn't end the stream
+========================
+*/
+static bool Netchan_Deflate( z_stream &stream, const byte *in, int inLength, byte *out, int outSize, int flush, int &outLength )
+{
+	stream.next_in = const_cast<Bytef *>( in );
+	stream.avail_in = inLength;
+	stream.next_out = out;
+	stream.avail_out = outSize;
+
+	const int result = deflate( &stream, flush );
+
+	if ( flush == Z_FINISH ? result != Z_STREAM_END : ( result != Z_OK || stream.avail_out == 0 ) ) {
+		return false;
+	}
+
+	outLength = outSize - stream.avail_out;
+	return true;
+}
+
+/*
+========================
+Netchan_Inflate
+========================
+*/
+static bool Netchan_Inflate( z_stream &stream, const byte *in, int inLength, byte *out, int outSize, int &outLength )
+{
+	stream.next_in = const_cast<Bytef *>( in );
+	stream.avail_in = inLength;
+	stream.next_out = out;
+	stream.avail_out = outSize;
+
+	const int result = inflate( &stream, Z_SYNC_FLUSH );
+
+	if ( ( result != Z_OK && result != Z_STREAM_END ) || stream.avail_in != 0 ) {
+		return false;
+	}
+
+	outLength = outSize - stream.avail_out;
+	return true;
+}
+
+/*
+========================
+Netchan_StageReliable
+
+Moves message into reliable_buf, deflating it on compressed channels
+========================
+*/
+static bool Netchan_StageReliable( netchan_t *chan )
+{
+	if ( chan->compress )
+	{
+		// once the stream has taken the data there's no going back, a message
+		// that won't fit is treated like any other overflow
+		if ( !Netchan_Deflate( chan->compress->deflater, chan->message_buf, chan->message.cursize,
+			chan->reliable_buf, sizeof( chan->reliable_buf ), Z_SYNC_FLUSH, chan->reliable_length ) ) {
+			return false;
+		}
+	}
+	else
+	{
+		memcpy( chan->reliable_buf, chan->message_buf, chan->message.cursize );
+		chan->reliable_length = chan->message.cursize;
+	}
+
+	chan->reliable_plain_length = chan->message.cursize;
+	return true;
+}
+
+/*
+========================
+Netchan_WriteUnreliable
+
+Returns false if there is no room for it
+========================
+*/
+static bool Netchan_WriteUnreliable( sizebuf_t *send, const byte *data, int length, byte *flags )
+{
+	const int space = send->maxsize - send->cursize;
+
+	if ( flags && length >= NETCOMP_MIN_UNRELIABLE )
+	{
+		int compressed;
+
+		deflateReset( &s_packetDeflater );
+
+		// anything that doesn't come out smaller fails to fit and goes as it is
+		if ( Netchan_Deflate( s_packetDeflater, data, length, s_compressBuf, Min( length - 1, space ), Z_FINISH, compressed ) )
+		{
+			*flags |= NETCOMP_UNRELIABLE;
+			SZ_Write( send, s_compressBuf, compressed );
+			return true;
+		}
+	}
+
+	if ( space < length ) {
+		return false;
+	}
+
+	SZ_Write( send, data, length );
+	return true;
+}
+
+/*
+========================
+Netchan_Decompress
+
+Replaces the payload of msg with what it was before the far end compressed it
+========================
+*/
+static bool Netchan_Decompress( netchan_t *chan, sizebuf_t *msg, bool reliable )
+{
+	const int start = msg->readcount;
+	const int flags = MSG_ReadByte( msg );
+	int length = 0;
+
+	if ( reliable )
+	{
+		const int compressed = MSG_ReadShort( msg ) & 0xffff;
+
+		if ( msg->readcount + compressed > msg->cursize ) {
+			return false;
+		}
+		if ( !Netchan_Inflate( chan->compress->inflater, msg->data + msg->readcount, compressed, s_compressBuf, sizeof( s_compressBuf ), length ) ) {
+			return false;
+		}
+		msg->readcount += compressed;
+	}
+
+	const int remaining = msg->cursize - msg->readcount;
+
+	if ( remaining < 0 ) {
+		return false;
+	}
+
+	if ( flags & NETCOMP_UNRELIABLE )
+	{
+		int unreliable;
+
+		inflateReset( &s_packetInflater );
+
+		if ( !Netchan_Inflate( s_packetInflater, msg->data + msg->readcount, remaining,
+			s_compressBuf + length, sizeof( s_compressBuf ) - length, unreliable ) ) {
+			return false;
+		}
+		length += unreliable;
+	}
+	else
+	{
+		if ( length + remaining > (int)sizeof( s_compressBuf ) ) {
+			return false;
+		}
+		memcpy( s_compressBuf + length, msg->data + msg->readcount, remaining );
+		length += remaining;
+	}
+
+	if ( start + length > msg->maxsize ) {
+		return false;
+	}
+
+	memcpy( msg->data + start, s_compressBuf, length );
+	msg->cursize = start + length;
+	msg->readcount = start;
+
+	return true;
+}
+
+/*
+===================================================================================================
+
+	Fragments
+
+===================================================================================================
+*/
+
+/*
+========================
+Netchan_SendFragments
+
+Sends the payload of packet in pieces, each with a copy of its header
+========================
+*/
+static void Netchan_SendFragments( netchan_t *chan, const sizebuf_t &packet, int headerLength, unsigned w1 )
+{
+	sizebuf_t	send;
+	byte		send_buf[NET_FRAGMENT_SIZE + 16];
+
+	const int payloadLength = packet.cursize - headerLength;
+
+	for ( int offset = 0; offset < payloadLength; offset += NET_FRAGMENT_SIZE )
+	{
+		const int fragmentLength = Min( payloadLength - offset, NET_FRAGMENT_SIZE );
+		const bool more = offset + fragmentLength < payloadLength;
+
+		SZ_Init( &send, send_buf, sizeof( send_buf ) );
+
+		MSG_WriteLong( &send, w1 | FRAGMENT_BIT );
+		SZ_Write( &send, packet.data + 4, headerLength - 4 );
+		MSG_WriteShort( &send, offset | ( more ? FRAGMENT_MORE : 0 ) );
+		SZ_Write( &send, packet.data + headerLength + offset, fragmentLength );
+
+		s_sendPacket( chan->sock, send.cursize, send.data, chan->remote_address );
+	}
+}
+
+/*
+========================
+Netchan_ReadFragment
+
+Returns true once the last fragment of a packet is in, with the whole
+payload put back in msg where it would have been unfragmented
+========================
+*/
+static bool Netchan_ReadFragment( netchan_t *chan, sizebuf_t *msg, int sequence )
+{
+	const int start = msg->readcount;
+	int offset = MSG_ReadShort( msg ) & 0xffff;
+	const bool more = ( offset & FRAGMENT_MORE ) != 0;
+	offset &= ~FRAGMENT_MORE;
+
+	// anything collected for an older packet is never going to be finished
+	if ( sequence != chan->fragment_sequence )
+	{
+		chan->fragment_sequence = sequence;
+		chan->fragment_length = 0;
+	}
+
+	const int length = msg->cursize - msg->readcount;
+
+	// fragments go out in order, after a gap the rest of the packet is useless
+	if ( length < 0 || offset != chan->fragment_length || offset + length > (int)sizeof( chan->fragment_buf ) )
+	{
+		if ( net_showDrop->GetBool() && chan->fragment_length >= 0 ) {
+			Com_Printf( "%s:Missing fragment at %i of %i\n", NET_NetadrToString( chan->remote_address ), chan->fragment_length, sequence );
+		}
+		chan->fragment_length = -1;
+		return false;
+	}
+
+	memcpy( chan->fragment_buf + offset, msg->data + msg->readcount, length );
+	chan->fragment_length += length;
+
+	if ( more ) {
+		return false;
+	}
+
+	if ( start + chan->fragment_length > msg->maxsize ) {
+		return false;
+	}
+
+	memcpy( msg->data + start, chan->fragment_buf, chan->fragment_length );
+	msg->cursize = start + chan->fragment_length;
+	msg->readcount = start;
+
+	chan->fragment_length = 0;
+
+	return true;
 }
 
+/*
+===================================================================================================
+
+	Channels
+
+===================================================================================================
+*/
+
 /*
 ========================
 Netchan_OutOfBand
@@ -130,8 +462,10 @@ Netchan_Setup
 called to open a channel to a remote system
 ==============
 */
-void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int qport)
+void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int qport, bool compress)
 {
+	Netchan_Shutdown (chan);
+
 	memset (chan, 0, sizeof(*chan));
 	
 	chan->sock = sock;
@@ -143,6 +477,31 @@ void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int qport)
 
 	SZ_Init (&chan->message, chan->message_buf, sizeof(chan->message_buf));
 	chan->message.allowoverflow = true;
+
+	if (compress)
+	{
+		chan->compress = (netCompress_t *)Mem_ClearedAlloc (sizeof(netCompress_t));
+		deflateInit2 (&chan->compress->deflater, Z_DEFAULT_COMPRESSION, Z_DEFLATED, NETCOMP_WINDOW_BITS, NETCOMP_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+		inflateInit2 (&chan->compress->inflater, NETCOMP_WINDOW_BITS);
+	}
+}
+
+/*
+==============
+Netchan_Shutdown
+
+frees what Netchan_Setup allocated, the channel can be set up again afterwards
+==============
+*/
+void Netchan_Shutdown (netchan_t *chan)
+{
+	if (!chan->compress)
+		return;
+
+	deflateEnd (&chan->compress->deflater);
+	inflateEnd (&chan->compress->inflater);
+	Mem_Free (chan->compress);
+	chan->compress = nullptr;
 }
 
 
@@ -197,6 +556,8 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	byte		send_buf[MAX_PACKETLEN];
 	qboolean	send_reliable;
 	unsigned	w1, w2;
+	int			header_length, plain_length;
+	byte		*flags;
 
 // check for message overflow
 	if (chan->message.overflowed)
@@ -210,8 +571,13 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 
 	if (!chan->reliable_length && chan->message.cursize)
 	{
-		memcpy (chan->reliable_buf, chan->message_buf, chan->message.cursize);
-		chan->reliable_length = chan->message.cursize;
+		if (!Netchan_StageReliable (chan))
+		{
+			Com_Printf ("%s:Outgoing message doesn't compress\n"
+				, NET_NetadrToString (chan->remote_address));
+			chan->message.overflowed = true;
+			return;
+		}
 		chan->message.cursize = 0;
 		chan->reliable_sequence ^= 1;
 	}
@@ -220,7 +586,7 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 // write the packet header
 	SZ_Init (&send, send_buf, sizeof(send_buf));
 
-	w1 = ( chan->outgoing_sequence & ~(1<<31) ) | (send_reliable<<31);
+	w1 = ( chan->outgoing_sequence & ~(FRAGMENT_BIT|(1u<<31)) ) | (send_reliable<<31);
 	w2 = ( chan->incoming_sequence & ~(1<<31) ) | (chan->incoming_reliable_sequence<<31);
 
 	chan->outgoing_sequence++;
@@ -233,21 +599,35 @@ void Netchan_Transmit (netchan_t *chan, int length, byte *data)
 	if (chan->sock == NS_CLIENT)
 		MSG_WriteShort (&send, net_qport->GetInt());
 
+	header_length = send.cursize;
+	plain_length = send.cursize;	// what the far end will have after decompressing
+
+	flags = nullptr;
+	if (chan->compress)
+	{
+		flags = send.data + send.cursize;
+		MSG_WriteByte (&send, 0);
+	}
+
 // copy the reliable message to the packet first
 	if (send_reliable)
 	{
+		if (chan->compress)
+			MSG_WriteShort (&send, chan->reliable_length);
 		SZ_Write (&send, chan->reliable_buf, chan->reliable_length);
+		plain_length += chan->reliable_plain_length;
 		chan->last_reliable_sequence = chan->outgoing_sequence;
 	}
 	
-// add the unreliable part if space is available
-	if (send.maxsize - send.cursize >= length)
-		SZ_Write (&send, data, length);
-	else
+// add the unreliable part if space is available, at both ends
+	if (plain_length + length > MAX_PACKETLEN || !Netchan_WriteUnreliable (&send, data, length, flags))
 		Com_Printf ("Netchan_Transmit: dumped unreliable\n");
 
 // send the datagram
-	NET_SendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
+	if (send.cursize - header_length > NET_FRAGMENT_SIZE && chan->remote_address.type != NA_LOOPBACK)
+		Netchan_SendFragments (chan, send, header_length, w1);
+	else
+		s_sendPacket (chan->sock, send.cursize, send.data, chan->remote_address);
 
 	if (net_showPackets->GetBool())
 	{
@@ -279,6 +659,7 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 {
 	unsigned	sequence, sequence_ack;
 	unsigned	reliable_ack, reliable_message;
+	qboolean	fragment;
 	int			qport;
 
 // get sequence numbers		
@@ -292,9 +673,10 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 
 	reliable_message = sequence >> 31;
 	reliable_ack = sequence_ack >> 31;
+	fragment = (sequence & FRAGMENT_BIT) != 0;
 
-	sequence &= ~(1<<31);
-	sequence_ack &= ~(1<<31);	
+	sequence &= ~(FRAGMENT_BIT|(1u<<31));
+	sequence_ack &= ~(1u<<31);	
 
 	if (net_showPackets->GetBool())
 	{
@@ -326,6 +708,20 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 		return false;
 	}
 
+//
+// hold on to fragments until the whole packet is here
+//
+	if (fragment && !Netchan_ReadFragment (chan, msg, sequence))
+		return false;
+
+	if (chan->compress && !Netchan_Decompress (chan, msg, reliable_message != 0))
+	{
+		Com_Printf ("%s:Couldn't decompress packet %i\n"
+			, NET_NetadrToString (chan->remote_address)
+			, sequence);
+		return false;
+	}
+
 //
 // dropped packets don't keep the message from being used
 //
@@ -365,3 +761,268 @@ qboolean Netchan_Process (netchan_t *chan, sizebuf_t *msg)
 	return true;
 }
 
+
+/*
+===================================================================================================
+
+	Benchmark
+
+	A connection's worth of configstrings and baselines, queued half a message at a time the
+	way SV_Configstrings_f and SV_Baselines_f do, plus a snapshot every frame. A pair of
+	channels passes it all through an in-memory queue instead of a socket
+
+===================================================================================================
+*/
+
+#define BENCH_MAX_PACKETS	64
+#define BENCH_MAX_FRAMES	100000
+#define BENCH_SNAPSHOT_SIZE	1400
+#define BENCH_USERCMD_SIZE	40
+#define BENCH_UDP_HEADER	28		// IPv4 and UDP headers, counted so fragmenting isn't free
+
+struct benchPacket_t
+{
+	int			length;
+	byte		data[NET_FRAGMENT_SIZE + 64];
+};
+
+struct benchQueue_t
+{
+	benchPacket_t	packets[BENCH_MAX_PACKETS];
+	int				count;
+
+	int				lossPercent;
+	uint32			seed;
+
+	int				packets_sent;		// from the server
+	int64			bytes_sent;
+};
+
+struct benchResult_t
+{
+	int			frames;
+	int			packets;
+	int64		bytes;
+	double		msec;
+	bool		intact;
+};
+
+static benchQueue_t *s_benchQueue;
+
+static void Netchan_BenchSend( netsrc_t sock, int length, const void *data, const netadr_t &to )
+{
+	benchQueue_t &queue = *s_benchQueue;
+
+	if ( sock == NS_SERVER )
+	{
+		queue.packets_sent++;
+		queue.bytes_sent += length + BENCH_UDP_HEADER;
+	}
+
+	// the same losses for every run
+	queue.seed = queue.seed * 1664525 + 1013904223;
+	if ( (int)( ( queue.seed >> 16 ) % 100 ) < queue.lossPercent ) {
+		return;
+	}
+
+	if ( queue.count == BENCH_MAX_PACKETS || length > (int)sizeof( queue.packets[0].data ) )
+	{
+		Com_Printf( "net_chanBench: dropped an unexpected %d byte packet\n", length );
+		return;
+	}
+
+	benchPacket_t &packet = queue.packets[queue.count++];
+	packet.length = length;
+	memcpy( packet.data, data, length );
+}
+
+/*
+========================
+Netchan_BenchFill
+
+Something shaped like configstrings followed by baselines, then a snapshot
+========================
+*/
+static void Netchan_BenchFill( byte *reliable, int reliableLength, byte *snapshot )
+{
+	static const char *dirs[] = { "models/monsters/", "models/items/", "models/weapons/", "sound/weapons/", "sound/world/", "sound/player/", "players/male/", "pics/" };
+	static const char *names[] = { "soldier", "gunner", "infantry", "tank", "armor", "health", "rocket", "shotgun", "blaster", "door", "lift", "pain" };
+	static const char *exts[] = { "/tris.md2", ".wav", ".pcx", ".sp2" };
+
+	sizebuf_t buf;
+	char string[MAX_QPATH];
+
+	// records stop short of the end rather than overflowing, which would clear the buffer
+	SZ_Init( &buf, reliable, reliableLength );
+
+	for ( int index = 0; buf.cursize < reliableLength / 2; ++index )
+	{
+		Q_sprintf_s( string, "%s%s%d%s", dirs[rand() % countof( dirs )], names[rand() % countof( names )], rand() % 4, exts[rand() % countof( exts )] );
+
+		MSG_WriteByte( &buf, svc_configstring );
+		MSG_WriteShort( &buf, index );
+		MSG_WriteString( &buf, string );
+	}
+
+	for ( int number = 1; buf.cursize + 16 <= buf.maxsize; ++number )
+	{
+		MSG_WriteByte( &buf, svc_spawnbaseline );
+		MSG_WriteLong( &buf, 0x0fc0 | ( rand() & 0x3f ) );
+		MSG_WriteShort( &buf, number );
+		MSG_WriteByte( &buf, 1 + rand() % 64 );
+		for ( int i = 0; i < 3; ++i ) {
+			MSG_WriteShort( &buf, ( rand() % 4096 - 2048 ) * 8 );
+		}
+		MSG_WriteByte( &buf, rand() % 4 * 64 );
+	}
+
+	memset( reliable + buf.cursize, 0, reliableLength - buf.cursize );
+
+	SZ_Init( &buf, snapshot, BENCH_SNAPSHOT_SIZE );
+
+	for ( int number = 1; buf.cursize + 6 <= buf.maxsize; ++number )
+	{
+		MSG_WriteByte( &buf, 0x80 | ( rand() & 0x0f ) );
+		MSG_WriteByte( &buf, number );
+		MSG_WriteShort( &buf, rand() % 64 - 32 );
+		MSG_WriteShort( &buf, rand() % 64 - 32 );
+	}
+
+	memset( snapshot + buf.cursize, 0, BENCH_SNAPSHOT_SIZE - buf.cursize );
+}
+
+/*
+========================
+Netchan_BenchDeliver
+
+Hands everything in the queue to chan, returns how many reliable bytes came out that
+matched what was expected, or -1 if any didn't
+========================
+*/
+static int Netchan_BenchDeliver( benchQueue_t &queue, netchan_t *chan, sizebuf_t &msg, const byte *expected, int expectedLength, int unreliableLength )
+{
+	int received = 0;
+
+	for ( int i = 0; i < queue.count; ++i )
+	{
+		const benchPacket_t &packet = queue.packets[i];
+
+		memcpy( msg.data, packet.data, packet.length );
+		msg.cursize = packet.length;
+
+		const int reliableSequence = chan->incoming_reliable_sequence;
+
+		if ( !Netchan_Process( chan, &msg ) || chan->incoming_reliable_sequence == reliableSequence ) {
+			continue;
+		}
+
+		const int length = msg.cursize - msg.readcount - unreliableLength;
+
+		if ( received < 0 || length < 0 || length > expectedLength - received || memcmp( msg.data + msg.readcount, expected + received, length ) != 0 )
+		{
+			received = -1;
+			continue;
+		}
+		received += length;
+	}
+
+	queue.count = 0;
+
+	return received;
+}
+
+/*
+========================
+Netchan_BenchRun
+========================
+*/
+static void Netchan_BenchRun( bool compress, const byte *reliable, int reliableLength, const byte *snapshot, int lossPercent, benchResult_t &result )
+{
+	netchan_t *server = (netchan_t *)Mem_ClearedAlloc( sizeof( netchan_t ) );
+	netchan_t *client = (netchan_t *)Mem_ClearedAlloc( sizeof( netchan_t ) );
+	benchQueue_t *queue = (benchQueue_t *)Mem_ClearedAlloc( sizeof( benchQueue_t ) );
+	byte *msgBuf = (byte *)Mem_Alloc( MAX_MSGLEN );
+
+	// anything but loopback, so big packets are fragmented like they would be for real
+	netadr_t adr{};
+	adr.type = NA_IP;
+
+	Netchan_Setup( NS_SERVER, server, adr, net_qport->GetInt(), compress );
+	Netchan_Setup( NS_CLIENT, client, adr, net_qport->GetInt(), compress );
+
+	queue->lossPercent = lossPercent;
+	queue->seed = 1;
+
+	s_benchQueue = queue;
+	s_sendPacket = Netchan_BenchSend;
+
+	sizebuf_t msg;
+	SZ_Init( &msg, msgBuf, MAX_MSGLEN );
+
+	byte usercmd[BENCH_USERCMD_SIZE]{};
+	int written = 0;
+	int received = 0;
+
+	const double start = Time_FloatMilliseconds();
+
+	for ( result.frames = 0; result.frames < BENCH_MAX_FRAMES && received >= 0 && received < reliableLength; ++result.frames )
+	{
+		// the client asks for the next lot once the last one has arrived
+		if ( written < reliableLength && written == received )
+		{
+			const int chunk = Min( reliableLength - written, MAX_MSGLEN / 2 );
+			SZ_Write( &server->message, reliable + written, chunk );
+			written += chunk;
+		}
+
+		Netchan_Transmit( server, BENCH_SNAPSHOT_SIZE, const_cast<byte *>( snapshot ) );
+
+		const int delivered = Netchan_BenchDeliver( *queue, client, msg, reliable + received, reliableLength - received, BENCH_SNAPSHOT_SIZE );
+		received = delivered < 0 ? -1 : received + delivered;
+
+		Netchan_Transmit( client, sizeof( usercmd ), usercmd );
+		Netchan_BenchDeliver( *queue, server, msg, nullptr, 0, sizeof( usercmd ) );
+	}
+
+	result.msec = Time_FloatMilliseconds() - start;
+	result.packets = queue->packets_sent;
+	result.bytes = queue->bytes_sent;
+	result.intact = ( received == reliableLength );
+
+	s_sendPacket = NET_SendPacket;
+	s_benchQueue = nullptr;
+
+	Netchan_Shutdown( server );
+	Netchan_Shutdown( client );
+
+	Mem_Free( msgBuf );
+	Mem_Free( queue );
+	Mem_Free( client );
+	Mem_Free( server );
+}
+
+CON_COMMAND( net_chanBench, "Sends a connection's worth of configstrings and baselines through a pair of in-memory net channels, with and without compression. Usage: net_chanBench [kilobytes] [loss percent]", 0 )
+{
+	const int kilobytes = Cmd_Argc() > 1 ? Clamp( Q_atoi( Cmd_Argv( 1 ) ), 1, 16384 ) : 256;
+	const int lossPercent = Cmd_Argc() > 2 ? Clamp( Q_atoi( Cmd_Argv( 2 ) ), 0, 50 ) : 0;
+
+	const int reliableLength = kilobytes * 1024;
+	byte *reliable = (byte *)Mem_Alloc( reliableLength );
+	byte snapshot[BENCH_SNAPSHOT_SIZE];
+
+	Netchan_BenchFill( reliable, reliableLength, snapshot );
+
+	Com_Printf( "net_chanBench: %d KB reliable, %d byte snapshots, %d%% loss\n", kilobytes, BENCH_SNAPSHOT_SIZE, lossPercent );
+
+	for ( int compress = 0; compress < 2; ++compress )
+	{
+		benchResult_t result;
+		Netchan_BenchRun( compress != 0, reliable, reliableLength, snapshot, lossPercent, result );
+
+		Com_Printf( "%-12s %6d frames, %7d packets, %10.1f KB on the wire, %8.2f ms%s\n",
+			compress ? "compressed" : "plain", result.frames, result.packets, result.bytes / 1024.0, result.msec,
+			result.intact ? "" : S_COLOR_RED " (data didn't arrive intact)" );
+	}
+
+	Mem_Free( reliable );
+}
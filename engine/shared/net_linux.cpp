@@ -5,14 +5,21 @@
 #include "engine.h"
 
 #include <unistd.h>
+#include <cerrno>
 
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <pcap/socket.h>
 
 #include "net.h"
 
 #define	MAX_LOOPBACK	16
 
+// Packets moved per recvmmsg / sendmmsg
+#define NET_BATCH_SIZE	32
+
 struct loopmsg_t
 {
 	byte	data[MAX_PACKETLEN];
@@ -25,11 +32,30 @@ struct loopback_t
 	int			get, send;
 };
 
+// Whole batches of packets are received into and sent from one of these,
+// the buffers are allocated the first time a ring is used
+struct packetRing_t
+{
+	mmsghdr		msgs[NET_BATCH_SIZE];
+	iovec		iovecs[NET_BATCH_SIZE];
+	sockaddr_in	addrs[NET_BATCH_SIZE];
+	byte *		buffers;			// NET_BATCH_SIZE packets of MAX_PACKETLEN
+	int			count;				// Packets in the ring
+	int			next;				// Next packet NET_GetPacket hands out
+};
+
 static cvar_t	*noudp;
 
 loopback_t	loopbacks[2];
 SOCKET		ip_sockets[2];
 
+static packetRing_t	recvRings[2];
+static packetRing_t	sendRings[2];
+static bool			sendBatching[2];
+
+// For the I/O thread, written to wake it up early
+static int			wakeFds[2] = { -1, -1 };
+
 /*
 ===================
 NET_ErrorString
@@ -37,7 +63,7 @@ NET_ErrorString
 */
 static const char *NET_ErrorString()
 {
-	return "NOT IMPLEMENTED!";
+	return strerror( errno );
 }
 
 /*
@@ -313,59 +339,187 @@ static void NET_SendLoopPacket( netsrc_t sock, int length, const void *data )
 
 //=============================================================================
 
+/*
+=============================================================================
+
+BATCHED SOCKET IO
+
+=============================================================================
+*/
+
+static void NET_AllocPacketRing( packetRing_t &ring )
+{
+	if ( !ring.buffers )
+	{
+		ring.buffers = (byte *)Mem_Alloc( NET_BATCH_SIZE * MAX_PACKETLEN );
+	}
+}
+
+static void NET_FreePacketRing( packetRing_t &ring )
+{
+	Mem_Free( ring.buffers );
+	ring.buffers = nullptr;
+	ring.count = 0;
+	ring.next = 0;
+}
+
+// Points a ring slot's header at its buffer and address
+static void NET_SetupRingMessage( packetRing_t &ring, int i, size_t length )
+{
+	ring.iovecs[i].iov_base = ring.buffers + i * MAX_PACKETLEN;
+	ring.iovecs[i].iov_len = length;
+
+	memset( &ring.msgs[i], 0, sizeof( ring.msgs[i] ) );
+	ring.msgs[i].msg_hdr.msg_name = &ring.addrs[i];
+	ring.msgs[i].msg_hdr.msg_namelen = sizeof( ring.addrs[i] );
+	ring.msgs[i].msg_hdr.msg_iov = &ring.iovecs[i];
+	ring.msgs[i].msg_hdr.msg_iovlen = 1;
+}
+
 /*
 ===================
-NET_GetPacket
+NET_ReceiveBatch
+
+Refills an empty ring with whatever is waiting on the socket,
+in one syscall. Returns the number of packets received
 ===================
 */
-bool NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message )
+static int NET_ReceiveBatch( SOCKET net_socket, packetRing_t &ring )
 {
-	int 	ret;
-	sockaddr_in from;
-	socklen_t	fromlen;
-	SOCKET	net_socket;
-	int		protocol;
-	int		err;
+	NET_AllocPacketRing( ring );
 
-	if ( NET_GetLoopPacket( sock, net_from, net_message ) ) {
-		return true;
+	for ( int i = 0; i < NET_BATCH_SIZE; ++i )
+	{
+		NET_SetupRingMessage( ring, i, MAX_PACKETLEN );
 	}
 
-	for ( protocol = 0; protocol < 1; ++protocol )
+	int ret = recvmmsg( net_socket, ring.msgs, NET_BATCH_SIZE, MSG_DONTWAIT, nullptr );
+
+	if ( ret == -1 )
 	{
-		if ( protocol == 0 ) {
-			net_socket = ip_sockets[sock];
+		if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+			Com_Printf( "NET_ReceiveBatch: %s\n", NET_ErrorString() );
 		}
-		/*else {
-			net_socket = ipx_sockets[sock];
-		}*/
+		ret = 0;
+	}
 
-		if ( !net_socket ) {
-			continue;
-		}
+	ring.count = ret;
+	ring.next = 0;
+
+	return ret;
+}
+
+/*
+===================
+NET_SendBatch
 
-		fromlen = sizeof( from );
-		ret = recvfrom( net_socket, (char *)net_message->data, net_message->maxsize, 0, (sockaddr *)&from, &fromlen );
+Sends everything queued in the ring and empties it,
+returns the number of syscalls it took
+===================
+*/
+static int NET_SendBatch( SOCKET net_socket, packetRing_t &ring )
+{
+	int sent = 0;
+	int calls = 0;
+
+	while ( sent < ring.count )
+	{
+		int ret = sendmmsg( net_socket, ring.msgs + sent, ring.count - sent, 0 );
+		++calls;
 
 		if ( ret == -1 )
 		{
-			Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
-			continue;
+			if ( errno == EINTR ) {
+				continue;
+			}
+
+			// only the first packet failed, drop it and carry on with the rest
+			Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+			ret = 1;
+		}
+
+		sent += ret;
+	}
+
+	ring.count = 0;
+
+	return calls;
+}
+
+static void NET_QueuePacket( packetRing_t &ring, int length, const void *data, const sockaddr_in &addr )
+{
+	const int i = ring.count++;
+
+	NET_SetupRingMessage( ring, i, length );
+	memcpy( ring.iovecs[i].iov_base, data, length );
+	ring.addrs[i] = addr;
+}
+
+//=============================================================================
+
+/*
+===================
+NET_ReadSocket
+
+The socket half of NET_GetPacket. Hands out packets from the
+receive ring, which is refilled a batch at a time once it runs dry
+===================
+*/
+bool NET_ReadSocket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message )
+{
+	SOCKET net_socket = ip_sockets[sock];
+	if ( !net_socket ) {
+		return false;
+	}
+
+	packetRing_t &ring = recvRings[sock];
+
+	while ( true )
+	{
+		if ( ring.next == ring.count && NET_ReceiveBatch( net_socket, ring ) == 0 ) {
+			return false;
 		}
 
-		NET_SockadrToNetadr( &from, net_from );
+		const int i = ring.next++;
+		const mmsghdr &msg = ring.msgs[i];
+
+		NET_SockadrToNetadr( &ring.addrs[i], net_from );
 
-		if ( ret > net_message->maxsize )
+		if ( ( msg.msg_hdr.msg_flags & MSG_TRUNC ) || (int)msg.msg_len > net_message->maxsize )
 		{
 			Com_Printf( "NET_GetPacket: oversize packet from %s\n", NET_NetadrToString( *net_from ) );
 			continue;
 		}
 
-		net_message->cursize = ret;
+		memcpy( net_message->data, ring.iovecs[i].iov_base, msg.msg_len );
+		net_message->cursize = (int)msg.msg_len;
 		return true;
 	}
+}
 
-	return false;
+/*
+===================
+NET_GetPacket
+===================
+*/
+bool NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message, netPacketInfo_t *info )
+{
+	if ( !NET_GetLoopPacket( sock, net_from, net_message ) )
+	{
+		// the I/O thread has already read the socket
+		if ( NET_IOThreadOwns( sock ) ) {
+			return NET_GetQueuedPacket( sock, net_from, net_message, info );
+		}
+		if ( !NET_ReadSocket( sock, net_from, net_message ) ) {
+			return false;
+		}
+	}
+
+	if ( info ) {
+		NET_ReadPacketInfo( *net_message, Sys_Milliseconds(), *info );
+	}
+
+	return true;
 }
 
 //=============================================================================
@@ -380,7 +534,6 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 	int			ret;
 	sockaddr_in	addr;
 	SOCKET		net_socket;
-	int			err;
 
 	if ( to.type == NA_LOOPBACK )
 	{
@@ -388,6 +541,12 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 		return;
 	}
 
+	if ( NET_IOThreadOwns( sock ) )
+	{
+		NET_QueueSendPacket( sock, length, data, to );
+		return;
+	}
+
 	switch ( to.type )
 	{
 	case NA_BROADCAST:
@@ -403,6 +562,18 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 
 	NET_NetadrToSockadr( &to, &addr );
 
+	if ( sendBatching[sock] )
+	{
+		packetRing_t &ring = sendRings[sock];
+		NET_AllocPacketRing( ring );
+
+		if ( ring.count == NET_BATCH_SIZE ) {
+			NET_SendBatch( net_socket, ring );
+		}
+		NET_QueuePacket( ring, length, data, addr );
+		return;
+	}
+
 	ret = sendto( net_socket, (char *)data, length, 0, (sockaddr *)&addr, sizeof( addr ) );
 	if ( ret == -1 )
 	{
@@ -410,6 +581,49 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 	}
 }
 
+/*
+===================
+NET_BeginPacketBatch
+===================
+*/
+void NET_BeginPacketBatch( netsrc_t sock )
+{
+	if ( NET_IOThreadOwns( sock ) )
+	{
+		NET_HoldQueuedPackets( sock, true );
+		return;
+	}
+
+	sendBatching[sock] = true;
+}
+
+/*
+===================
+NET_FlushPackets
+===================
+*/
+void NET_FlushPackets( netsrc_t sock )
+{
+	if ( NET_IOThreadOwns( sock ) )
+	{
+		NET_HoldQueuedPackets( sock, false );
+		return;
+	}
+
+	sendBatching[sock] = false;
+
+	packetRing_t &ring = sendRings[sock];
+
+	if ( ring.count == 0 ) {
+		return;
+	}
+
+	if ( ip_sockets[sock] ) {
+		NET_SendBatch( ip_sockets[sock], ring );
+	}
+	ring.count = 0;
+}
+
 //=============================================================================
 
 /*
@@ -559,11 +773,17 @@ void NET_Config( bool multiplayer )
 	{	// shut down any existing sockets
 		for ( i = 0; i < 2; ++i )
 		{
+			NET_StopIOThread( (netsrc_t)i );
+
 			if ( ip_sockets[i] )
 			{
 				close( ip_sockets[i] );
 				ip_sockets[i] = 0;
 			}
+
+			// anything left over was for the old sockets
+			NET_FreePacketRing( recvRings[i] );
+			NET_FreePacketRing( sendRings[i] );
 		}
 	}
 	else
@@ -576,14 +796,69 @@ void NET_Config( bool multiplayer )
 
 /*
 ===================
-NET_Sleep
+NET_OpenSocketWait
+===================
+*/
+bool NET_OpenSocketWait( netsrc_t sock )
+{
+	if ( !ip_sockets[sock] ) {
+		return false;
+	}
 
-sleeps msec or until net socket is ready
+	wakeFds[sock] = eventfd( 0, EFD_NONBLOCK );
+	if ( wakeFds[sock] == -1 )
+	{
+		Com_Printf( "WARNING: NET_OpenSocketWait: eventfd: %s\n", NET_ErrorString() );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+===================
+NET_CloseSocketWait
 ===================
 */
-void NET_Sleep( int msec )
+void NET_CloseSocketWait( netsrc_t sock )
 {
+	if ( wakeFds[sock] != -1 )
+	{
+		close( wakeFds[sock] );
+		wakeFds[sock] = -1;
+	}
+}
 
+/*
+===================
+NET_WaitForSocket
+===================
+*/
+void NET_WaitForSocket( netsrc_t sock, int msec )
+{
+	pollfd fds[2]{};
+	fds[0].fd = ip_sockets[sock];
+	fds[0].events = POLLIN;
+	fds[1].fd = wakeFds[sock];
+	fds[1].events = POLLIN;
+
+	if ( poll( fds, 2, msec ) > 0 && ( fds[1].revents & POLLIN ) )
+	{
+		// reset the counter before the caller drains anything
+		uint64 count;
+		read( wakeFds[sock], &count, sizeof( count ) );
+	}
+}
+
+/*
+===================
+NET_WakeSocketWait
+===================
+*/
+void NET_WakeSocketWait( netsrc_t sock )
+{
+	const uint64 one = 1;
+	write( wakeFds[sock], &one, sizeof( one ) );
 }
 
 //=============================================================================
@@ -609,3 +884,190 @@ void NET_Shutdown()
 {
 	NET_Config( false );	// close sockets
 }
+
+//=============================================================================
+
+/*
+===================
+NET_OpenLoopbackSocket
+
+A non-blocking socket on 127.0.0.1 with a big receive buffer, for net_loadBench
+===================
+*/
+static SOCKET NET_OpenLoopbackSocket( sockaddr_in &address )
+{
+	SOCKET newsocket = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+	if ( newsocket == INVALID_SOCKET ) {
+		return 0;
+	}
+
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	address.sin_port = 0;
+
+	socklen_t addressLength = sizeof( address );
+	int bufferSize = 4 * 1024 * 1024;
+
+	if ( bind( newsocket, (sockaddr *)&address, sizeof( address ) ) == -1
+		|| getsockname( newsocket, (sockaddr *)&address, &addressLength ) == -1
+		|| setsockopt( newsocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof( bufferSize ) ) == -1 )
+	{
+		close( newsocket );
+		return 0;
+	}
+
+	return newsocket;
+}
+
+/*
+========================
+net_loadBench
+
+A loopback load generator. Every frame numclients sockets each send the
+server socket a usercmd sized packet, and the server answers each one
+with a snapshot sized packet, first with a syscall per packet like
+NET_GetPacket and NET_SendPacket used to, then through the batched
+rings. Only the server's side is timed
+========================
+*/
+CON_COMMAND( net_loadBench, "Times per packet socket IO against recvmmsg/sendmmsg over loopback. Usage: net_loadBench [numclients] [frames]", 0 )
+{
+	int numClients = Cmd_Argc() > 1 ? Q_atoi( Cmd_Argv( 1 ) ) : 64;
+	int numFrames = Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : 200;
+	numClients = Clamp( numClients, 1, MAX_CLIENTS );
+	numFrames = Max( numFrames, 1 );
+
+	constexpr int usercmdSize = 64;
+	constexpr int snapshotSize = 1200;
+
+	sockaddr_in serverAddress;
+	sockaddr_in clientAddresses[MAX_CLIENTS];
+	SOCKET clientSockets[MAX_CLIENTS]{};
+
+	SOCKET serverSocket = NET_OpenLoopbackSocket( serverAddress );
+	bool opened = serverSocket != 0;
+
+	for ( int i = 0; i < numClients && opened; ++i )
+	{
+		clientSockets[i] = NET_OpenLoopbackSocket( clientAddresses[i] );
+		opened = clientSockets[i] != 0;
+	}
+
+	if ( !opened )
+	{
+		Com_Printf( S_COLOR_YELLOW "Couldn't open loopback sockets: %s\n", NET_ErrorString() );
+	}
+	else
+	{
+		byte *buffer = (byte *)Mem_ClearedAlloc( MAX_PACKETLEN );
+		packetRing_t recvRing{};
+		packetRing_t sendRing{};
+		NET_AllocPacketRing( sendRing );
+
+		struct benchResult_t
+		{
+			double	msPerFrame;
+			int64	syscalls;
+			int64	received;
+		};
+
+		auto runFrames = [&]( bool batched )
+		{
+			benchResult_t result{};
+			double time = 0.0;
+
+			for ( int frame = 0; frame < numFrames; ++frame )
+			{
+				for ( int i = 0; i < numClients; ++i )
+				{
+					sendto( clientSockets[i], buffer, usercmdSize, 0, (sockaddr *)&serverAddress, sizeof( serverAddress ) );
+				}
+
+				const double start = Time_FloatMilliseconds();
+
+				// read everything that came in, the last call finds nothing
+				if ( batched )
+				{
+					int received;
+					do
+					{
+						received = NET_ReceiveBatch( serverSocket, recvRing );
+						result.received += received;
+						++result.syscalls;
+					} while ( received > 0 );
+				}
+				else
+				{
+					sockaddr_in from;
+					socklen_t fromLength = sizeof( from );
+					while ( recvfrom( serverSocket, buffer, MAX_PACKETLEN, MSG_DONTWAIT, (sockaddr *)&from, &fromLength ) >= 0 )
+					{
+						++result.received;
+						++result.syscalls;
+						fromLength = sizeof( from );
+					}
+					++result.syscalls;
+				}
+
+				// and answer every client
+				for ( int i = 0; i < numClients; ++i )
+				{
+					if ( batched )
+					{
+						if ( sendRing.count == NET_BATCH_SIZE ) {
+							result.syscalls += NET_SendBatch( serverSocket, sendRing );
+						}
+						NET_QueuePacket( sendRing, snapshotSize, buffer, clientAddresses[i] );
+					}
+					else
+					{
+						sendto( serverSocket, buffer, snapshotSize, 0, (sockaddr *)&clientAddresses[i], sizeof( clientAddresses[i] ) );
+						++result.syscalls;
+					}
+				}
+				if ( batched ) {
+					result.syscalls += NET_SendBatch( serverSocket, sendRing );
+				}
+
+				time += Time_FloatMilliseconds() - start;
+
+				for ( int i = 0; i < numClients; ++i )
+				{
+					while ( recv( clientSockets[i], buffer, MAX_PACKETLEN, MSG_DONTWAIT ) >= 0 )
+					{
+					}
+				}
+			}
+
+			result.msPerFrame = time / numFrames;
+
+			return result;
+		};
+
+		const benchResult_t perPacket = runFrames( false );
+		const benchResult_t batched = runFrames( true );
+
+		const int64 expected = (int64)numClients * numFrames;
+
+		Com_Printf( "%d clients, %d frames\n", numClients, numFrames );
+		Com_Printf( "per packet: %.4f ms/frame, %.1f syscalls/frame, %lld/%lld packets\n",
+			perPacket.msPerFrame, (double)perPacket.syscalls / numFrames, perPacket.received, expected );
+		Com_Printf( "batched:    %.4f ms/frame, %.1f syscalls/frame, %lld/%lld packets\n",
+			batched.msPerFrame, (double)batched.syscalls / numFrames, batched.received, expected );
+
+		NET_FreePacketRing( recvRing );
+		NET_FreePacketRing( sendRing );
+		Mem_Free( buffer );
+	}
+
+	if ( serverSocket ) {
+		close( serverSocket );
+	}
+	for ( int i = 0; i < numClients; ++i )
+	{
+		if ( clientSockets[i] ) {
+			close( clientSockets[i] );
+		}
+	}
+}
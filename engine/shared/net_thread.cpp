@@ -0,0 +1,443 @@
+//=================================================================================================
+// Network I/O thread
+//
+// Reads a socket as packets arrive and sends for the main thread, talking to it through a pair
+// of single producer, single consumer queues so neither side ever takes a lock per packet
+//=================================================================================================
+
+#include "engine.h"
+
+#include "net.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#define NET_QUEUE_SIZE		( 1024 * 1024 )	// bytes, power of two
+#define NET_QUEUE_ALIGN		16
+#define NET_QUEUE_WRAP		0xFFFFFFFF		// in place of a length, the rest of the buffer is unused
+
+#define NET_IO_WAIT_MSEC	100				// the socket wait is woken for sends and shutdown anyway
+
+static StaticCvar net_ioThread( "net_ioThread", "1", 0, "Read and send server packets on their own thread, takes effect on the next map." );
+
+struct packetRecord_t
+{
+	uint32				length;				// of the data following this, or NET_QUEUE_WRAP
+	netadr_t			adr;				// where it came from or where it's going
+	netPacketInfo_t		info;
+};
+
+struct packetQueue_t
+{
+	byte *					buffer = nullptr;
+
+	alignas( 64 ) std::atomic<uint32>	head;	// only the producer writes this
+	alignas( 64 ) std::atomic<uint32>	tail;	// only the consumer writes this
+};
+
+struct netIOThread_t
+{
+	std::thread				thread;
+	std::atomic<bool>		quit;
+	bool					running;		// main thread only
+
+	packetQueue_t			received;		// I/O thread to main thread
+	packetQueue_t			outgoing;		// main thread to I/O thread
+	bool					holdOutgoing;	// main thread only, between NET_HoldQueuedPackets calls
+
+	std::atomic<int>		dropped;		// packets that didn't fit in received
+
+	// NET_Sleep waits on this for packets
+	std::mutex				mutex;
+	std::condition_variable	arrived;
+};
+
+static netIOThread_t		s_ioThreads[2];
+static thread_local bool	s_onIOThread;
+
+/*
+===================================================================================================
+
+	Packet queues
+
+	Records are padded out to NET_QUEUE_ALIGN so a wrap marker always fits before the end
+
+===================================================================================================
+*/
+
+static uint32 NET_RecordSize( uint32 length )
+{
+	return ( sizeof( packetRecord_t ) + length + NET_QUEUE_ALIGN - 1 ) & ~( NET_QUEUE_ALIGN - 1 );
+}
+
+static void NET_InitQueue( packetQueue_t &queue )
+{
+	queue.buffer = (byte *)Mem_Alloc( NET_QUEUE_SIZE );
+	queue.head.store( 0, std::memory_order_relaxed );
+	queue.tail.store( 0, std::memory_order_relaxed );
+}
+
+static void NET_FreeQueue( packetQueue_t &queue )
+{
+	Mem_Free( queue.buffer );
+	queue.buffer = nullptr;
+}
+
+static bool NET_QueueEmpty( const packetQueue_t &queue )
+{
+	return queue.head.load( std::memory_order_acquire ) == queue.tail.load( std::memory_order_relaxed );
+}
+
+/*
+===================
+NET_QueuePush
+
+Producer side, returns false if the queue is full
+===================
+*/
+static bool NET_QueuePush( packetQueue_t &queue, const packetRecord_t &record, const void *data )
+{
+	const uint32 recordSize = NET_RecordSize( record.length );
+
+	uint32 head = queue.head.load( std::memory_order_relaxed );
+	const uint32 tail = queue.tail.load( std::memory_order_acquire );
+
+	uint32 offset = head & ( NET_QUEUE_SIZE - 1 );
+	const uint32 skip = ( offset + recordSize > NET_QUEUE_SIZE ) ? NET_QUEUE_SIZE - offset : 0;
+
+	if ( ( head - tail ) + skip + recordSize > NET_QUEUE_SIZE ) {
+		return false;
+	}
+
+	if ( skip != 0 )
+	{
+		*(uint32 *)( queue.buffer + offset ) = NET_QUEUE_WRAP;
+		head += skip;
+		offset = 0;
+	}
+
+	memcpy( queue.buffer + offset, &record, sizeof( record ) );
+	memcpy( queue.buffer + offset + sizeof( record ), data, record.length );
+
+	queue.head.store( head + recordSize, std::memory_order_release );
+
+	return true;
+}
+
+/*
+===================
+NET_QueuePeek
+
+Consumer side, the record stays valid until NET_QueuePop
+===================
+*/
+static const packetRecord_t *NET_QueuePeek( packetQueue_t &queue )
+{
+	uint32 tail = queue.tail.load( std::memory_order_relaxed );
+	const uint32 head = queue.head.load( std::memory_order_acquire );
+
+	if ( tail == head ) {
+		return nullptr;
+	}
+
+	uint32 offset = tail & ( NET_QUEUE_SIZE - 1 );
+
+	if ( *(const uint32 *)( queue.buffer + offset ) == NET_QUEUE_WRAP )
+	{
+		tail += NET_QUEUE_SIZE - offset;
+		queue.tail.store( tail, std::memory_order_release );
+		offset = 0;
+	}
+
+	return (const packetRecord_t *)( queue.buffer + offset );
+}
+
+static void NET_QueuePop( packetQueue_t &queue, const packetRecord_t *record )
+{
+	const uint32 tail = queue.tail.load( std::memory_order_relaxed );
+
+	queue.tail.store( tail + NET_RecordSize( record->length ), std::memory_order_release );
+}
+
+/*
+===================================================================================================
+
+	The thread
+
+===================================================================================================
+*/
+
+/*
+===================
+NET_ReadPacketInfo
+===================
+*/
+void NET_ReadPacketInfo( const sizebuf_t &message, int time, netPacketInfo_t &info )
+{
+	int32 header[2]{};
+	uint16 qport;
+
+	memcpy( header, message.data, Min( message.cursize, (int)sizeof( header ) ) );
+
+	info.time = time;
+	info.connectionless = message.cursize >= 4 && header[0] == -1;
+	info.sequence = LittleLong( header[0] );
+	info.sequenceAck = LittleLong( header[1] );
+	info.qport = -1;
+
+	if ( message.cursize >= 10 )
+	{
+		memcpy( &qport, message.data + 8, sizeof( qport ) );
+		info.qport = LittleShort( qport ) & 0xffff;
+	}
+}
+
+/*
+===================
+NET_IOThreadLoop
+===================
+*/
+static void NET_IOThreadLoop( netsrc_t sock )
+{
+	netIOThread_t &io = s_ioThreads[sock];
+
+	byte			buffer[MAX_PACKETLEN];
+	sizebuf_t		message;
+	packetRecord_t	record;
+
+	s_onIOThread = true;
+
+	SZ_Init( &message, buffer, sizeof( buffer ) );
+
+	while ( true )
+	{
+		// read once quit is set too, it might be what woke us
+		const bool quit = io.quit.load( std::memory_order_acquire );
+
+		NET_WaitForSocket( sock, quit ? 0 : NET_IO_WAIT_MSEC );
+
+		bool arrived = false;
+
+		while ( NET_ReadSocket( sock, &record.adr, &message ) )
+		{
+			record.length = message.cursize;
+			NET_ReadPacketInfo( message, Sys_Milliseconds(), record.info );
+
+			if ( !NET_QueuePush( io.received, record, message.data ) )
+			{
+				io.dropped.fetch_add( 1, std::memory_order_relaxed );
+				continue;
+			}
+			arrived = true;
+		}
+
+		if ( arrived )
+		{
+			std::lock_guard<std::mutex> lock( io.mutex );
+			io.arrived.notify_one();
+		}
+
+		// send everything the main thread has queued up
+		NET_BeginPacketBatch( sock );
+
+		const packetRecord_t *outgoing;
+		while ( ( outgoing = NET_QueuePeek( io.outgoing ) ) != nullptr )
+		{
+			NET_SendPacket( sock, outgoing->length, outgoing + 1, outgoing->adr );
+			NET_QueuePop( io.outgoing, outgoing );
+		}
+
+		NET_FlushPackets( sock );
+
+		if ( quit ) {
+			break;
+		}
+	}
+}
+
+/*
+===================
+NET_StartIOThread
+===================
+*/
+void NET_StartIOThread( netsrc_t sock )
+{
+	netIOThread_t &io = s_ioThreads[sock];
+
+	if ( io.running || !net_ioThread.GetBool() ) {
+		return;
+	}
+
+	// no socket to own in single player
+	if ( !NET_OpenSocketWait( sock ) ) {
+		return;
+	}
+
+	NET_InitQueue( io.received );
+	NET_InitQueue( io.outgoing );
+	io.holdOutgoing = false;
+	io.dropped.store( 0, std::memory_order_relaxed );
+	io.quit.store( false, std::memory_order_relaxed );
+
+	io.thread = std::thread( NET_IOThreadLoop, sock );
+	io.running = true;
+}
+
+/*
+===================
+NET_StopIOThread
+
+Whatever was queued to send goes out before the thread exits
+===================
+*/
+void NET_StopIOThread( netsrc_t sock )
+{
+	netIOThread_t &io = s_ioThreads[sock];
+
+	if ( !io.running ) {
+		return;
+	}
+
+	io.quit.store( true, std::memory_order_release );
+	NET_WakeSocketWait( sock );
+	io.thread.join();
+	io.running = false;
+
+	NET_CloseSocketWait( sock );
+	NET_FreeQueue( io.received );
+	NET_FreeQueue( io.outgoing );
+}
+
+/*
+===================
+NET_IOThreadOwns
+===================
+*/
+bool NET_IOThreadOwns( netsrc_t sock )
+{
+	return !s_onIOThread && s_ioThreads[sock].running;
+}
+
+/*
+===================================================================================================
+
+	Main thread side
+
+===================================================================================================
+*/
+
+/*
+===================
+NET_GetQueuedPacket
+===================
+*/
+bool NET_GetQueuedPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message, netPacketInfo_t *info )
+{
+	netIOThread_t &io = s_ioThreads[sock];
+
+	const int dropped = io.dropped.exchange( 0, std::memory_order_relaxed );
+	if ( dropped != 0 ) {
+		Com_DPrintf( S_COLOR_YELLOW "NET_GetQueuedPacket: dropped %d packets, the main thread fell behind\n", dropped );
+	}
+
+	const packetRecord_t *record;
+	while ( ( record = NET_QueuePeek( io.received ) ) != nullptr )
+	{
+		if ( (int)record->length > net_message->maxsize )
+		{
+			Com_Printf( "NET_GetPacket: oversize packet from %s\n", NET_NetadrToString( record->adr ) );
+			NET_QueuePop( io.received, record );
+			continue;
+		}
+
+		*net_from = record->adr;
+		memcpy( net_message->data, record + 1, record->length );
+		net_message->cursize = record->length;
+		if ( info ) {
+			*info = record->info;
+		}
+
+		NET_QueuePop( io.received, record );
+		return true;
+	}
+
+	return false;
+}
+
+/*
+===================
+NET_QueueSendPacket
+
+Wakes the thread straight away unless packets are being held for a batch
+===================
+*/
+void NET_QueueSendPacket( netsrc_t sock, int length, const void *data, const netadr_t &to )
+{
+	netIOThread_t &io = s_ioThreads[sock];
+
+	packetRecord_t record;
+	record.length = length;
+	record.adr = to;
+	record.info = {};
+
+	if ( !NET_QueuePush( io.outgoing, record, data ) )
+	{
+		// the thread is behind, get it going and give it a moment
+		NET_WakeSocketWait( sock );
+		std::this_thread::yield();
+
+		if ( !NET_QueuePush( io.outgoing, record, data ) )
+		{
+			Com_DPrintf( S_COLOR_YELLOW "NET_QueueSendPacket: send queue full, dropped a packet to %s\n", NET_NetadrToString( to ) );
+			return;
+		}
+	}
+
+	if ( !io.holdOutgoing ) {
+		NET_WakeSocketWait( sock );
+	}
+}
+
+/*
+===================
+NET_HoldQueuedPackets
+
+The platform batch calls land here while the thread owns the socket
+===================
+*/
+void NET_HoldQueuedPackets( netsrc_t sock, bool hold )
+{
+	netIOThread_t &io = s_ioThreads[sock];
+
+	io.holdOutgoing = hold;
+
+	if ( !hold && !NET_QueueEmpty( io.outgoing ) ) {
+		NET_WakeSocketWait( sock );
+	}
+}
+
+/*
+===================
+NET_Sleep
+
+Sleeps msec or until the I/O thread has packets for the server
+===================
+*/
+void NET_Sleep( int msec )
+{
+	netIOThread_t &io = s_ioThreads[NS_SERVER];
+
+	if ( !dedicated || !dedicated->GetBool() ) {
+		return; // we're not a server, just run full speed
+	}
+
+	if ( !io.running || msec <= 0 ) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock( io.mutex );
+	io.arrived.wait_for( lock, std::chrono::milliseconds( msec ), [&io]() { return !NET_QueueEmpty( io.received ); } );
+}
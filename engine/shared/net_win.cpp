@@ -32,6 +32,10 @@ static cvar_t	*net_noudp;
 loopback_t	loopbacks[2];
 SOCKET		ip_sockets[2];
 
+// For the I/O thread, signalled when a socket is readable and to wake it up early
+static WSAEVENT	readEvents[2] = { WSA_INVALID_EVENT, WSA_INVALID_EVENT };
+static WSAEVENT	wakeEvents[2] = { WSA_INVALID_EVENT, WSA_INVALID_EVENT };
+
 /*
 ===================
 NET_ErrorString
@@ -367,10 +371,12 @@ static void NET_SendLoopPacket( netsrc_t sock, int length, const void *data )
 
 /*
 ===================
-NET_GetPacket
+NET_ReadSocket
+
+The socket half of NET_GetPacket
 ===================
 */
-bool NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message )
+bool NET_ReadSocket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message )
 {
 	int 	ret;
 	sockaddr_in from;
@@ -379,10 +385,6 @@ bool NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message )
 	int		protocol;
 	int		err;
 
-	if ( NET_GetLoopPacket( sock, net_from, net_message ) ) {
-		return true;
-	}
-
 	for ( protocol = 0; protocol < 1; ++protocol )
 	{
 		if ( protocol == 0 ) {
@@ -426,6 +428,31 @@ bool NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message )
 	return false;
 }
 
+/*
+===================
+NET_GetPacket
+===================
+*/
+bool NET_GetPacket( netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message, netPacketInfo_t *info )
+{
+	if ( !NET_GetLoopPacket( sock, net_from, net_message ) )
+	{
+		// the I/O thread has already read the socket
+		if ( NET_IOThreadOwns( sock ) ) {
+			return NET_GetQueuedPacket( sock, net_from, net_message, info );
+		}
+		if ( !NET_ReadSocket( sock, net_from, net_message ) ) {
+			return false;
+		}
+	}
+
+	if ( info ) {
+		NET_ReadPacketInfo( *net_message, Sys_Milliseconds(), *info );
+	}
+
+	return true;
+}
+
 //=============================================================================
 
 /*
@@ -446,6 +473,12 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 		return;
 	}
 
+	if ( NET_IOThreadOwns( sock ) )
+	{
+		NET_QueueSendPacket( sock, length, data, to );
+		return;
+	}
+
 	switch ( to.type )
 	{
 	case NA_BROADCAST:
@@ -480,6 +513,32 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 	}
 }
 
+/*
+===================
+NET_BeginPacketBatch
+
+WinSock has no sendmmsg, so packets just go out as they're sent
+===================
+*/
+void NET_BeginPacketBatch( netsrc_t sock )
+{
+	if ( NET_IOThreadOwns( sock ) ) {
+		NET_HoldQueuedPackets( sock, true );
+	}
+}
+
+/*
+===================
+NET_FlushPackets
+===================
+*/
+void NET_FlushPackets( netsrc_t sock )
+{
+	if ( NET_IOThreadOwns( sock ) ) {
+		NET_HoldQueuedPackets( sock, false );
+	}
+}
+
 //=============================================================================
 
 /*
@@ -628,6 +687,8 @@ void NET_Config( bool multiplayer )
 	{	// shut down any existing sockets
 		for ( i = 0; i < 2; ++i )
 		{
+			NET_StopIOThread( (netsrc_t)i );
+
 			if ( ip_sockets[i] )
 			{
 				closesocket( ip_sockets[i] );
@@ -645,32 +706,78 @@ void NET_Config( bool multiplayer )
 
 /*
 ===================
-NET_Sleep
-
-sleeps msec or until net socket is ready
+NET_OpenSocketWait
 ===================
 */
-void NET_Sleep( int msec )
+bool NET_OpenSocketWait( netsrc_t sock )
 {
-#if 0
-	timeval timeout;
-	fd_set	fdset;
-	int i;
+	if ( !ip_sockets[sock] ) {
+		return false;
+	}
+
+	readEvents[sock] = WSACreateEvent();
+	wakeEvents[sock] = WSACreateEvent();
 
-	if ( !dedicated || !dedicated->value ) {
-		return; // we're not a server, just run full speed
+	// this is what makes the read event fire
+	if ( WSAEventSelect( ip_sockets[sock], readEvents[sock], FD_READ ) == SOCKET_ERROR )
+	{
+		Com_Printf( "WARNING: NET_OpenSocketWait: WSAEventSelect: %s\n", NET_ErrorString() );
+		NET_CloseSocketWait( sock );
+		return false;
 	}
 
-	FD_ZERO( &fdset );
-	i = 0;
-	if ( ip_sockets[NS_SERVER] ) {
-		FD_SET( ip_sockets[NS_SERVER], &fdset ); // network socket
-		i = ip_sockets[NS_SERVER];
+	return true;
+}
+
+/*
+===================
+NET_CloseSocketWait
+===================
+*/
+void NET_CloseSocketWait( netsrc_t sock )
+{
+	if ( ip_sockets[sock] ) {
+		WSAEventSelect( ip_sockets[sock], nullptr, 0 );
 	}
-	timeout.tv_sec = msec / 1000;
-	timeout.tv_usec = ( msec % 1000 ) * 1000;
-	select( i + 1, &fdset, NULL, NULL, &timeout );
-#endif
+
+	if ( readEvents[sock] != WSA_INVALID_EVENT )
+	{
+		WSACloseEvent( readEvents[sock] );
+		readEvents[sock] = WSA_INVALID_EVENT;
+	}
+	if ( wakeEvents[sock] != WSA_INVALID_EVENT )
+	{
+		WSACloseEvent( wakeEvents[sock] );
+		wakeEvents[sock] = WSA_INVALID_EVENT;
+	}
+}
+
+/*
+===================
+NET_WaitForSocket
+
+Both events are reset before the caller drains anything, so nothing that
+arrives after this returns can be missed
+===================
+*/
+void NET_WaitForSocket( netsrc_t sock, int msec )
+{
+	const WSAEVENT events[2]{ readEvents[sock], wakeEvents[sock] };
+
+	WSAWaitForMultipleEvents( 2, events, FALSE, (DWORD)msec, FALSE );
+
+	WSAResetEvent( readEvents[sock] );
+	WSAResetEvent( wakeEvents[sock] );
+}
+
+/*
+===================
+NET_WakeSocketWait
+===================
+*/
+void NET_WakeSocketWait( netsrc_t sock )
+{
+	WSASetEvent( wakeEvents[sock] );
 }
 
 //=============================================================================
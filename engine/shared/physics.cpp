@@ -23,6 +23,11 @@ void Shutdown()
 	s_pSystem = nullptr;
 }
 
+IPhysicsSystem *GetSystem()
+{
+	return s_pSystem;
+}
+
 IPhysicsScene *GetScene()
 {
 	return s_pScene;
@@ -6,6 +6,7 @@ namespace PhysicsImpl {
 void Init();
 void Shutdown();
 
+IPhysicsSystem *GetSystem();
 IPhysicsScene *GetScene();
 
 }
@@ -4,7 +4,7 @@
 
 #pragma once
 
-#define	PROTOCOL_VERSION	35 // 34
+#define	PROTOCOL_VERSION	37 // 34
 
 //=========================================
 
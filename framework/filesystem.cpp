@@ -3,8 +3,20 @@
 
 	The Virtual Filesystem 2.0
 
+	Every search path is indexed when it's mounted, a hash of relative path to the search path
+	(or pack file) that has it, so opening a file is a single lookup and a single open call no
+	matter how many search paths there are. Files written through the filesystem are added to
+	the index as they're created, anything dropped into a search path from outside needs an
+	fs_reindex. fs_index 0 goes back to asking the OS in every search path.
+
+	Pack files are Quake 2 .pak files found in the root of a search path, they're memory
+	mapped and take priority over the loose files next to them, pak1 over pak0 and so on.
+
+	MapFile hands out read-only views so big files like maps can be parsed in place, loose files
+	get their own mapping and files inside packs just point into the pack. A mapped loose file
+	can't be overwritten on Windows until it's unmapped, fs_mapFiles 0 copies them instead.
+
 	TODO:
-	Pack files
 	RelativePathToAbsolutePath should return a std::string or something, not a static char *
 
 	MAYBE:
@@ -40,6 +52,13 @@
 
 #include "filesystem.h"
 
+#include "../../common/q_formats.h"
+
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
 #define FS_VERIFYPATH(a) ASSUME( a == FS_GAMEDIR || a == FS_WRITEDIR || a == FS_CONTENTDIR )
 
 // DLL interface
@@ -54,6 +73,15 @@ fsHandle_t OpenFileRead( const char *absPath );
 fsHandle_t OpenFileWrite( const char *absPath );
 fsHandle_t OpenFileAppend( const char *absPath );
 const char *GetAPIName();
+
+fsSize_t GetFileSize( fsHandle_t handle );
+void Seek( fsHandle_t handle, fsSize_t offset, fsSeek_t seek );
+fsSize_t Tell( fsHandle_t handle );
+void CloseFile( fsHandle_t handle );
+fsSize_t ReadFile( void *buffer, fsSize_t length, fsHandle_t handle );
+
+void *MapFile( const char *absPath, fsSize_t &size, void *&mapping );
+void UnmapFile( void *base, fsSize_t size, void *mapping );
 }
 
 namespace ModInfo
@@ -65,16 +93,51 @@ static void Shutdown();
 #define MODINFO_NAME		"modinfo.json"
 #define SAVEFOLDER_NAME		"Freeze Team/Project Moon"
 
+#define PACK_EXTENSION		".pak"
+#define MAX_PACK_HANDLES	256
+
 static cvar_t *fs_production;
 static cvar_t *fs_debug;
 static cvar_t *fs_mod;
+static cvar_t *fs_index;
+static cvar_t *fs_mapFiles;
+
+struct pack_t
+{
+	byte *			base;				// the whole file, mapped
+	fsSize_t		size;
+	void *			mapping;			// platform specific
+	int				numFiles;
+	dpackfile_t *	files;				// points into base
+};
 
 struct searchPath_t
 {
-	char			dirName[MAX_OSPATH]; // Absolute search path
+	char			dirName[MAX_OSPATH]; // Absolute search path, or the pack file
+	pack_t *		pack;				// Not null for pack files
+	int				priority;			// 0 is searched first
 	searchPath_t *	pNext;
 };
 
+// Where a relative path lives
+struct fileIndexEntry_t
+{
+	char *			name;				// null for empty slots
+	uint32			hash;
+	bool			isDirectory;
+	searchPath_t *	searchPath;
+	int				packFile;			// index into the pack directory, -1 for loose files
+};
+
+// Files opened out of a pack
+struct packHandle_t
+{
+	std::atomic<bool>	inUse;
+	const byte *		data;
+	fsSize_t			length;
+	fsSize_t			position;
+};
+
 static struct fileSystem_t
 {
 	// The root of the game filesystem, IE: "C:/Projects/Moon/game"
@@ -89,8 +152,16 @@ static struct fileSystem_t
 	// Singly-linked list of search paths
 	searchPath_t *searchPaths;
 
+	// Open addressed hash of every file in every search path,
+	// deleted files stay behind with a null searchPath
+	fileIndexEntry_t *index;
+	int indexSize;						// power of two
+	int indexCount;
+
 } fs;
 
+static packHandle_t s_packHandles[MAX_PACK_HANDLES];
+
 static void CreateAbsolutePath( char *path, strlen_t skipDist )
 {
 	for ( char *ofs = path + skipDist + 1; *ofs; ++ofs )
@@ -167,14 +238,400 @@ static void SetContentDirectory()
 	Q_strcpy_s( copyZone, sizeAfter, "content" );
 }
 
+/*
+===================================================================================================
+
+	Pack files
+
+===================================================================================================
+*/
+
+static pack_t *LoadPackFile( const char *packPath )
+{
+	fsSize_t size;
+	void *mapping;
+	byte *base = static_cast<byte *>( Internal::MapFile( packPath, size, mapping ) );
+	if ( !base ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't map %s\n", packPath );
+		return nullptr;
+	}
+
+	const dpackheader_t *header = reinterpret_cast<const dpackheader_t *>( base );
+
+	if ( size < sizeof( dpackheader_t ) || LittleLong( header->ident ) != IDPAKHEADER )
+	{
+		Com_Printf( S_COLOR_YELLOW "%s is not a pack file\n", packPath );
+		Internal::UnmapFile( base, size, mapping );
+		return nullptr;
+	}
+
+	int dirofs = LittleLong( header->dirofs );
+	int dirlen = LittleLong( header->dirlen );
+	int numFiles = dirlen / static_cast<int>( sizeof( dpackfile_t ) );
+
+	if ( dirofs < 0 || dirlen < 0 || (fsSize_t)dirofs + (fsSize_t)dirlen > size )
+	{
+		Com_Printf( S_COLOR_YELLOW "%s has a bad directory\n", packPath );
+		Internal::UnmapFile( base, size, mapping );
+		return nullptr;
+	}
+
+	dpackfile_t *files = reinterpret_cast<dpackfile_t *>( base + dirofs );
+
+	for ( int i = 0; i < numFiles; ++i )
+	{
+		int filepos = LittleLong( files[i].filepos );
+		int filelen = LittleLong( files[i].filelen );
+		if ( filepos < 0 || filelen < 0 || (fsSize_t)filepos + (fsSize_t)filelen > size )
+		{
+			Com_Printf( S_COLOR_YELLOW "%s has a bad entry (%d)\n", packPath, i );
+			Internal::UnmapFile( base, size, mapping );
+			return nullptr;
+		}
+	}
+
+	pack_t *pack = new pack_t;
+	pack->base = base;
+	pack->size = size;
+	pack->mapping = mapping;
+	pack->numFiles = numFiles;
+	pack->files = files;
+
+	return pack;
+}
+
+static void FreePackFile( pack_t *pack )
+{
+	Internal::UnmapFile( pack->base, pack->size, pack->mapping );
+	delete pack;
+}
+
+// Pack directory names aren't guaranteed to be terminated
+static void PackFileName( const dpackfile_t &file, char *name, strlen_t nameSize )
+{
+	strlen_t length = 0;
+	while ( length < sizeof( file.name ) && file.name[length] ) {
+		++length;
+	}
+	length = Min( length, nameSize - 1 );
+
+	memcpy( name, file.name, length );
+	name[length] = '\0';
+	Str_FixSlashes( name );
+}
+
+static bool IsPackHandle( fsHandle_t handle )
+{
+	const packHandle_t *packHandle = reinterpret_cast<const packHandle_t *>( handle );
+	return packHandle >= s_packHandles && packHandle < s_packHandles + MAX_PACK_HANDLES;
+}
+
+static fsHandle_t OpenPackHandle( const pack_t *pack, int fileIndex )
+{
+	for ( packHandle_t &packHandle : s_packHandles )
+	{
+		bool expected = false;
+		if ( packHandle.inUse.compare_exchange_strong( expected, true, std::memory_order_acquire ) )
+		{
+			packHandle.data = pack->base + LittleLong( pack->files[fileIndex].filepos );
+			packHandle.length = static_cast<fsSize_t>( LittleLong( pack->files[fileIndex].filelen ) );
+			packHandle.position = 0;
+			return reinterpret_cast<fsHandle_t>( &packHandle );
+		}
+	}
+
+	Com_Print( S_COLOR_RED "[FileSystem] Out of pack file handles\n" );
+	return FS_INVALID_HANDLE;
+}
+
+/*
+===================================================================================================
+
+	Search path index
+
+===================================================================================================
+*/
+
+static void ClearIndex()
+{
+	for ( int i = 0; i < fs.indexSize; ++i )
+	{
+		Mem_Free( fs.index[i].name );
+	}
+	Mem_Free( fs.index );
+
+	fs.index = nullptr;
+	fs.indexSize = 0;
+	fs.indexCount = 0;
+}
+
+static fileIndexEntry_t *FindIndexSlot( fileIndexEntry_t *index, int indexSize, const char *name, uint32 hash )
+{
+	const int mask = indexSize - 1;
+
+	for ( int slot = hash & mask; ; slot = ( slot + 1 ) & mask )
+	{
+		fileIndexEntry_t &entry = index[slot];
+		if ( !entry.name || ( entry.hash == hash && Q_stricmp( entry.name, name ) == 0 ) ) {
+			return &entry;
+		}
+	}
+}
+
+static void GrowIndex()
+{
+	int newSize = fs.indexSize ? fs.indexSize * 2 : 4096;
+	fileIndexEntry_t *newIndex = static_cast<fileIndexEntry_t *>( Mem_ClearedAlloc( sizeof( fileIndexEntry_t ) * newSize ) );
+
+	for ( int i = 0; i < fs.indexSize; ++i )
+	{
+		const fileIndexEntry_t &entry = fs.index[i];
+		if ( entry.name ) {
+			*FindIndexSlot( newIndex, newSize, entry.name, entry.hash ) = entry;
+		}
+	}
+
+	Mem_Free( fs.index );
+	fs.index = newIndex;
+	fs.indexSize = newSize;
+}
+
+static fileIndexEntry_t *FindIndexEntry( const char *name )
+{
+	if ( !fs.index ) {
+		return nullptr;
+	}
+
+	fileIndexEntry_t *entry = FindIndexSlot( fs.index, fs.indexSize, name, HashStringInsensitive( name ) );
+	return ( entry->name && entry->searchPath ) ? entry : nullptr;
+}
+
+// Files win over directories, then the higher priority search path wins
+static void AddIndexEntry( const char *name, searchPath_t *searchPath, int packFile, bool isDirectory )
+{
+	// keep the load under half
+	if ( ( fs.indexCount + 1 ) * 2 > fs.indexSize ) {
+		GrowIndex();
+	}
+
+	uint32 hash = HashStringInsensitive( name );
+	fileIndexEntry_t *entry = FindIndexSlot( fs.index, fs.indexSize, name, hash );
+
+	if ( entry->name && entry->searchPath )
+	{
+		bool replace;
+		if ( entry->isDirectory != isDirectory ) {
+			replace = !isDirectory;
+		} else {
+			replace = searchPath->priority < entry->searchPath->priority;
+		}
+		if ( !replace ) {
+			return;
+		}
+	}
+	else if ( !entry->name )
+	{
+		entry->name = Mem_CopyString( name );
+		entry->hash = hash;
+		++fs.indexCount;
+	}
+
+	entry->isDirectory = isDirectory;
+	entry->searchPath = searchPath;
+	entry->packFile = packFile;
+}
+
+// std::filesystem wants char8_t for UTF-8
+static std::filesystem::path UTF8ToPath( const char *str )
+{
+	return std::filesystem::path( reinterpret_cast<const char8_t *>( str ) );
+}
+
+static void PathToUTF8( const std::filesystem::path &path, char *buffer, strlen_t bufferSize )
+{
+	const std::u8string str = path.generic_u8string();
+	Q_strcpy_s( buffer, bufferSize, reinterpret_cast<const char *>( str.c_str() ) );
+}
+
+static void IndexDirectory( searchPath_t *searchPath )
+{
+	namespace stdfs = std::filesystem;
+
+	std::error_code error;
+	const stdfs::path root = UTF8ToPath( searchPath->dirName );
+	char relativePath[MAX_OSPATH];
+
+	// no exceptions in this codebase, use the error code flavours throughout
+	stdfs::recursive_directory_iterator it( root, stdfs::directory_options::skip_permission_denied, error );
+	for ( ; !error && it != stdfs::recursive_directory_iterator(); it.increment( error ) )
+	{
+		const stdfs::directory_entry &dirEntry = *it;
+
+		std::error_code typeError;
+		bool isDirectory = dirEntry.is_directory( typeError );
+		if ( !isDirectory && !dirEntry.is_regular_file( typeError ) ) {
+			continue;
+		}
+
+		PathToUTF8( dirEntry.path().lexically_relative( root ), relativePath, sizeof( relativePath ) );
+
+		AddIndexEntry( relativePath, searchPath, -1, isDirectory );
+	}
+}
+
+static void IndexPack( searchPath_t *searchPath )
+{
+	char name[MAX_OSPATH];
+
+	for ( int i = 0; i < searchPath->pack->numFiles; ++i )
+	{
+		PackFileName( searchPath->pack->files[i], name, sizeof( name ) );
+		AddIndexEntry( name, searchPath, i, false );
+	}
+}
+
+static void RebuildIndex()
+{
+	double start = Time_FloatMilliseconds();
+
+	ClearIndex();
+	GrowIndex();
+
+	for ( searchPath_t *pSP = fs.searchPaths; pSP; pSP = pSP->pNext )
+	{
+		if ( pSP->pack ) {
+			IndexPack( pSP );
+		} else {
+			IndexDirectory( pSP );
+		}
+	}
+
+	Com_Printf( "Indexed %d files and directories in %.2f ms\n", fs.indexCount, Time_FloatMilliseconds() - start );
+}
+
+// Adds a file that was just created in the write or game dir
+static void IndexNewFile( const char *directory, const char *filename )
+{
+	if ( !fs.index ) {
+		return;
+	}
+
+	char dirName[MAX_OSPATH];
+	Q_sprintf_s( dirName, "%s/%s", directory, fs.modDir );
+
+	for ( searchPath_t *pSP = fs.searchPaths; pSP; pSP = pSP->pNext )
+	{
+		if ( !pSP->pack && Q_stricmp( pSP->dirName, dirName ) == 0 )
+		{
+			AddIndexEntry( filename, pSP, -1, false );
+			return;
+		}
+	}
+}
+
+static void FixPath( const char *filename, char *buffer, strlen_t bufferSize )
+{
+	Q_strcpy_s( buffer, bufferSize, filename );
+	Str_FixSlashes( buffer );
+}
+
+static bool UseIndex()
+{
+	return fs.index && fs_index->GetBool();
+}
+
+/*
+========================
+FindFileLinear
+
+Finds the search path a relative path lives in by asking the OS
+and every pack in order, what happens when fs_index is 0
+========================
+*/
+static searchPath_t *FindFileLinear( const char *filename, int *packFile )
+{
+	char fullPath[MAX_OSPATH];
+	char name[MAX_OSPATH];
+
+	for ( searchPath_t *pSP = fs.searchPaths; pSP; pSP = pSP->pNext )
+	{
+		if ( pSP->pack )
+		{
+			for ( int i = 0; i < pSP->pack->numFiles; ++i )
+			{
+				PackFileName( pSP->pack->files[i], name, sizeof( name ) );
+				if ( Q_stricmp( name, filename ) == 0 )
+				{
+					*packFile = i;
+					return pSP;
+				}
+			}
+			continue;
+		}
+
+		Q_sprintf_s( fullPath, "%s/%s", pSP->dirName, filename );
+		if ( Sys_FileExists( fullPath ) )
+		{
+			*packFile = -1;
+			return pSP;
+		}
+	}
+
+	return nullptr;
+}
+
 // Does all the grunt work related to adding a new game directory (finding packs, etc)
 static void AddSearchPath( const char *baseDir, const char *dirName )
 {
 	searchPath_t *searchPath = new searchPath_t;
 	//Q_strcpy_s( searchPath->dirName, dirName );
 	Q_sprintf_s( searchPath->dirName, "%s/%s", baseDir, dirName );
+	searchPath->pack = nullptr;
 	searchPath->pNext = fs.searchPaths;
 	fs.searchPaths = searchPath;
+
+	// packs go in front of the directory, in name order so pak1 beats pak0
+	namespace stdfs = std::filesystem;
+
+	std::error_code error;
+	std::vector<std::string> packNames;
+	char packName[MAX_OSPATH];
+
+	for ( stdfs::directory_iterator it( UTF8ToPath( searchPath->dirName ), error ); !error && it != stdfs::directory_iterator(); it.increment( error ) )
+	{
+		std::error_code typeError;
+		if ( !it->is_regular_file( typeError ) ) {
+			continue;
+		}
+
+		PathToUTF8( it->path().filename(), packName, sizeof( packName ) );
+
+		const char *extension = strrchr( packName, '.' );
+		if ( extension && Q_stricmp( extension, PACK_EXTENSION ) == 0 ) {
+			packNames.push_back( packName );
+		}
+	}
+
+	std::sort( packNames.begin(), packNames.end() );
+
+	for ( const std::string &packName : packNames )
+	{
+		char packPath[MAX_OSPATH];
+		Q_sprintf_s( packPath, "%s/%s", searchPath->dirName, packName.c_str() );
+
+		pack_t *pack = LoadPackFile( packPath );
+		if ( !pack ) {
+			continue;
+		}
+
+		searchPath_t *packPathEntry = new searchPath_t;
+		Q_strcpy_s( packPathEntry->dirName, packPath );
+		packPathEntry->pack = pack;
+		packPathEntry->pNext = fs.searchPaths;
+		fs.searchPaths = packPathEntry;
+
+		Com_Printf( "Added %s (%d files)\n", packPath, pack->numFiles );
+	}
 }
 
 void Init()
@@ -187,6 +644,8 @@ void Init()
 	fs_production = Cvar_Get( "fs_production", "0", 0, "If true, file writes are forced to writeDir." );
 	fs_debug = Cvar_Get( "fs_debug", "0", 0, "Controls FS spew." );
 	fs_mod = Cvar_Get( "fs_mod", BASE_MODDIR, CVAR_INIT, "The primary mod dir." );
+	fs_index = Cvar_Get( "fs_index", "1", 0, "Look files up in the search path index instead of asking the OS." );
+	fs_mapFiles = Cvar_Get( "fs_mapFiles", "1", 0, "MapFile memory maps files instead of loading a copy." );
 
 	// Set gameDir
 	// Use the current working directory as the base dir.
@@ -229,11 +688,15 @@ void Init()
 	AddSearchPath( fs.writeDir, fs.modDir );
 
 	Com_Print( "Search paths:\n" );
+	int priority = 0;
 	for ( searchPath_t *pSP = fs.searchPaths; pSP; pSP = pSP->pNext )
 	{
+		pSP->priority = priority++;
 		Com_Printf( "  %s\n", pSP->dirName );
 	}
 
+	RebuildIndex();
+
 	Com_Print( "FileSystem initialized\n" "-----------------------------------------\n\n" );
 }
 
@@ -241,10 +704,15 @@ void Shutdown()
 {
 	ModInfo::Shutdown();
 
+	ClearIndex();
+
 	// Clean up search paths
 	while ( fs.searchPaths )
 	{
 		searchPath_t *pNext = fs.searchPaths->pNext;
+		if ( fs.searchPaths->pack ) {
+			FreePackFile( fs.searchPaths->pack );
+		}
 		delete fs.searchPaths;
 		fs.searchPaths = pNext;
 	}
@@ -362,29 +830,166 @@ void CreatePath( const char *path )
 	CreateAbsolutePath( fullPath, skipDist );
 }
 
-fsHandle_t OpenFileRead( const char *filename )
+//=============================================================================
+// Handles, pack file handles are served from memory
+
+fsSize_t GetFileSize( fsHandle_t handle )
+{
+	if ( IsPackHandle( handle ) ) {
+		return reinterpret_cast<packHandle_t *>( handle )->length;
+	}
+
+	return Internal::GetFileSize( handle );
+}
+
+void Seek( fsHandle_t handle, fsSize_t offset, fsSeek_t seek )
+{
+	if ( !IsPackHandle( handle ) )
+	{
+		Internal::Seek( handle, offset, seek );
+		return;
+	}
+
+	packHandle_t *packHandle = reinterpret_cast<packHandle_t *>( handle );
+
+	switch ( seek )
+	{
+	case FS_SEEK_CUR:
+		offset += packHandle->position;
+		break;
+	case FS_SEEK_END:
+		offset += packHandle->length;
+		break;
+	default:
+		break;
+	}
+
+	packHandle->position = Min( offset, packHandle->length );
+}
+
+fsSize_t Tell( fsHandle_t handle )
+{
+	if ( IsPackHandle( handle ) ) {
+		return reinterpret_cast<packHandle_t *>( handle )->position;
+	}
+
+	return Internal::Tell( handle );
+}
+
+void CloseFile( fsHandle_t handle )
+{
+	if ( IsPackHandle( handle ) )
+	{
+		reinterpret_cast<packHandle_t *>( handle )->inUse.store( false, std::memory_order_release );
+		return;
+	}
+
+	Internal::CloseFile( handle );
+}
+
+fsSize_t ReadFile( void *buffer, fsSize_t length, fsHandle_t handle )
+{
+	if ( !IsPackHandle( handle ) ) {
+		return Internal::ReadFile( buffer, length, handle );
+	}
+
+	Assert( length > 0 );
+
+	packHandle_t *packHandle = reinterpret_cast<packHandle_t *>( handle );
+
+	fsSize_t read = Min( length, packHandle->length - packHandle->position );
+	memcpy( buffer, packHandle->data + packHandle->position, read );
+	packHandle->position += read;
+
+	// return what the platform layer would
+#ifdef _WIN32
+	return read;
+#else
+	return ( read == length ) ? 1 : 0;
+#endif
+}
+
+static fsHandle_t OpenFileFrom( searchPath_t *searchPath, int packFile, const char *filename )
 {
+	if ( searchPath->pack )
+	{
+		if ( fs_debug->GetBool() ) {
+			Com_Printf( S_COLOR_YELLOW "[FileSystem] Reading %s from %s\n", filename, searchPath->dirName );
+		}
+
+		return OpenPackHandle( searchPath->pack, packFile );
+	}
+
 	char fullPath[MAX_OSPATH];
+	Q_sprintf_s( fullPath, "%s/%s", searchPath->dirName, filename );
+
+	fsHandle_t handle = Internal::OpenFileRead( fullPath );
+
+	if ( handle != FS_INVALID_HANDLE && fs_debug->GetBool() ) {
+		Com_Printf( S_COLOR_YELLOW "[FileSystem] Reading %s\n", fullPath );
+	}
+
+	return handle;
+}
+
+fsHandle_t OpenFileRead( const char *filename )
+{
+	char name[MAX_OSPATH];
+	FixPath( filename, name, sizeof( name ) );
+
+	if ( UseIndex() )
+	{
+		const fileIndexEntry_t *entry = FindIndexEntry( name );
+		if ( entry && !entry->isDirectory )
+		{
+			fsHandle_t handle = OpenFileFrom( entry->searchPath, entry->packFile, name );
+			if ( handle != FS_INVALID_HANDLE ) {
+				return handle;
+			}
+			// removed behind our back, the long way might still find it
+		}
+		else
+		{
+			if ( fs_debug->GetBool() ) {
+				Com_Printf( S_COLOR_RED "[FileSystem] Can't find %s\n", name );
+			}
+
+			return FS_INVALID_HANDLE;
+		}
+	}
 
 	// go through each search path until we find our file
 	for ( searchPath_t *pSP = fs.searchPaths; pSP; pSP = pSP->pNext )
 	{
-		Q_sprintf_s( fullPath, "%s/%s", pSP->dirName, filename );
+		int packFile = -1;
 
-		fsHandle_t handle = Internal::OpenFileRead( fullPath );
-		if ( handle == FS_INVALID_HANDLE ) {
-			continue;
+		if ( pSP->pack )
+		{
+			char packName[MAX_OSPATH];
+			for ( int i = 0; i < pSP->pack->numFiles; ++i )
+			{
+				PackFileName( pSP->pack->files[i], packName, sizeof( packName ) );
+				if ( Q_stricmp( packName, name ) == 0 )
+				{
+					packFile = i;
+					break;
+				}
+			}
+			if ( packFile == -1 ) {
+				continue;
+			}
 		}
 
-		if ( fs_debug->GetBool() ) {
-			Com_Printf( S_COLOR_YELLOW "[FileSystem] Reading %s\n", fullPath );
+		fsHandle_t handle = OpenFileFrom( pSP, packFile, name );
+		if ( handle == FS_INVALID_HANDLE ) {
+			continue;
 		}
 
 		return handle;
 	}
 
 	if ( fs_debug->GetBool() ) {
-		Com_Printf( S_COLOR_RED "[FileSystem] Can't find %s\n", filename );
+		Com_Printf( S_COLOR_RED "[FileSystem] Can't find %s\n", name );
 	}
 
 	return FS_INVALID_HANDLE;
@@ -415,6 +1020,10 @@ fsHandle_t OpenFileWrite( const char *filename, fsPath_t fsPath /*= FS_WRITEDIR*
 
 	fsHandle_t handle = Internal::OpenFileWrite( fullPath );
 
+	if ( handle ) {
+		IndexNewFile( directory, filename );
+	}
+
 	if ( fs_debug->GetBool() ) {
 		if ( handle ) {
 			Com_Printf( S_COLOR_YELLOW "[FileSystem] Writing %s\n", fullPath );
@@ -451,6 +1060,10 @@ fsHandle_t OpenFileAppend( const char *filename, fsPath_t fsPath /*= FS_WRITEDIR
 
 	fsHandle_t handle = Internal::OpenFileAppend( fullPath );
 
+	if ( handle ) {
+		IndexNewFile( directory, filename );
+	}
+
 	if ( fs_debug->GetBool() ) {
 		if ( handle ) {
 			Com_Printf( S_COLOR_YELLOW "[FileSystem] Appending %s\n", fullPath );
@@ -476,19 +1089,16 @@ bool FileExists( const char *filename, fsPath_t fsPath /*= FS_GAMEDIR*/ )
 	{
 	default: // FS_GAMEDIR
 	{
-		// go through each search path until we find our file
-		for ( searchPath_t *pSP = fs.searchPaths; pSP; pSP = pSP->pNext )
-		{
-			Q_sprintf_s( fullPath, "%s/%s", pSP->dirName, filename );
+		char name[MAX_OSPATH];
+		FixPath( filename, name, sizeof( name ) );
 
-			if ( !Sys_FileExists( fullPath ) ) {
-				continue;
-			}
-
-			return true;
+		if ( UseIndex() ) {
+			// directories count too
+			return FindIndexEntry( name ) != nullptr;
 		}
 
-		return false;
+		int packFile;
+		return FindFileLinear( name, &packFile ) != nullptr;
 	}
 	case FS_WRITEDIR:
 	{
@@ -505,12 +1115,23 @@ void RemoveFile( const char *filename )
 	char fullPath[MAX_OSPATH];
 	Q_sprintf_s( fullPath, "%s/%s/%s", fs.writeDir, fs.modDir, filename );
 
-	// FIXME: Doesn't consider pak files (when we re-introduce them)
 	if ( !Sys_FileExists( fullPath ) ) {
 		return;
 	}
 
 	Sys_DeleteFile( fullPath );
+
+	// whatever is further down the search paths shows through now
+	char name[MAX_OSPATH];
+	FixPath( filename, name, sizeof( name ) );
+
+	fileIndexEntry_t *entry = FindIndexEntry( name );
+	if ( entry )
+	{
+		int packFile = -1;
+		entry->searchPath = FindFileLinear( name, &packFile );
+		entry->packFile = packFile;
+	}
 }
 
 //=============================================================================
@@ -605,6 +1226,99 @@ void FreeFile( void *buffer )
 	Mem_Free( buffer );
 }
 
+// Finds the search path a file lives in, the same way OpenFileRead does
+static searchPath_t *FindFile( const char *name, int *packFile )
+{
+	if ( UseIndex() )
+	{
+		const fileIndexEntry_t *entry = FindIndexEntry( name );
+		if ( !entry || entry->isDirectory ) {
+			return nullptr;
+		}
+
+		*packFile = entry->packFile;
+		return entry->searchPath;
+	}
+
+	return FindFileLinear( name, packFile );
+}
+
+bool MapFile( const char *filename, mappedFile_t &file )
+{
+	Assert( filename && filename[0] );
+
+	file = mappedFile_t();
+
+	if ( !fs_mapFiles->GetBool() )
+	{
+		void *buffer;
+		fsSize_t length = LoadFile( filename, &buffer );
+		if ( !buffer ) {
+			return false;
+		}
+
+		file.data = static_cast<const byte *>( buffer );
+		file.size = length;
+		file.base = buffer;
+		file.loaded = true;
+		return true;
+	}
+
+	char name[MAX_OSPATH];
+	FixPath( filename, name, sizeof( name ) );
+
+	int packFile = -1;
+	searchPath_t *searchPath = FindFile( name, &packFile );
+	if ( !searchPath )
+	{
+		if ( fs_debug->GetBool() ) {
+			Com_Printf( S_COLOR_RED "[FileSystem] Can't find %s\n", name );
+		}
+		return false;
+	}
+
+	if ( searchPath->pack )
+	{
+		const pack_t *pack = searchPath->pack;
+		const dpackfile_t &packEntry = pack->files[packFile];
+
+		file.data = pack->base + LittleLong( packEntry.filepos );
+		file.size = LittleLong( packEntry.filelen );
+	}
+	else
+	{
+		char fullPath[MAX_OSPATH];
+		Q_sprintf_s( fullPath, "%s/%s", searchPath->dirName, name );
+
+		// fails on empty files too
+		file.base = Internal::MapFile( fullPath, file.size, file.mapping );
+		file.data = static_cast<const byte *>( file.base );
+	}
+
+	if ( !file.data || file.size == 0 )
+	{
+		file = mappedFile_t();
+		return false;
+	}
+
+	if ( fs_debug->GetBool() ) {
+		Com_Printf( S_COLOR_YELLOW "[FileSystem] Mapped %s from %s\n", name, searchPath->dirName );
+	}
+
+	return true;
+}
+
+void UnmapFile( mappedFile_t &file )
+{
+	if ( file.loaded ) {
+		FreeFile( file.base );
+	} else if ( file.base ) {
+		Internal::UnmapFile( file.base, file.size, file.mapping );
+	}
+
+	file = mappedFile_t();
+}
+
 //=============================================================================
 
 bool FindPhysicalFile( const char *filename, char *buffer, strlen_t bufferSize, fsPath_t fsPath /*= FS_GAMEDIR*/ )
@@ -639,6 +1353,106 @@ bool FindPhysicalFile( const char *filename, char *buffer, strlen_t bufferSize,
 	}
 }
 
+//=============================================================================
+
+CON_COMMAND( fs_reindex, "Rebuilds the search path index, for files added from outside the game.", 0 )
+{
+	RebuildIndex();
+}
+
+/*
+========================
+fs_loadBench
+
+Loads a set of files out of the index, and as many names that don't exist,
+first straight after remounting the index (cold), again (warm), then again
+with fs_index 0 to compare against asking the OS in every search path.
+The OS file cache isn't flushed, so cold only means cold for the index
+========================
+*/
+CON_COMMAND( fs_loadBench, "Times loading files through the index and without it. Usage: fs_loadBench [extension] [maxfiles]", 0 )
+{
+	const char *extension = Cmd_Argc() > 1 ? Cmd_Argv( 1 ) : "";
+	int maxFiles = Cmd_Argc() > 2 ? Q_atoi( Cmd_Argv( 2 ) ) : 2000;
+	maxFiles = Max( maxFiles, 1 );
+
+	if ( !fs.index )
+	{
+		Com_Print( "The filesystem isn't mounted\n" );
+		return;
+	}
+
+	std::vector<std::string> names;
+	for ( int i = 0; i < fs.indexSize && (int)names.size() < maxFiles; ++i )
+	{
+		const fileIndexEntry_t &entry = fs.index[i];
+		if ( !entry.name || !entry.searchPath || entry.isDirectory ) {
+			continue;
+		}
+		const char *fileExtension = strrchr( entry.name, '.' );
+		if ( extension[0] && ( !fileExtension || Q_stricmp( fileExtension + 1, extension[0] == '.' ? extension + 1 : extension ) != 0 ) ) {
+			continue;
+		}
+		names.push_back( entry.name );
+	}
+
+	if ( names.empty() )
+	{
+		Com_Print( "No files to load\n" );
+		return;
+	}
+
+	// misses are what the index saves the most on
+	const size_t numFound = names.size();
+	for ( size_t i = 0; i < numFound; ++i )
+	{
+		names.push_back( names[i] + ".missing" );
+	}
+
+	const bool oldIndex = fs_index->GetBool();
+
+	auto loadAll = []( const std::vector<std::string> &names, uint64 &bytes )
+	{
+		bytes = 0;
+		double start = Time_FloatMilliseconds();
+		for ( const std::string &name : names )
+		{
+			void *buffer;
+			fsSize_t length = LoadFile( name.c_str(), &buffer );
+			if ( buffer )
+			{
+				bytes += length;
+				FreeFile( buffer );
+			}
+		}
+		return Time_FloatMilliseconds() - start;
+	};
+
+	uint64 coldBytes, warmBytes, linearBytes;
+
+	Cvar_SetBool( fs_index, true );
+
+	double mountStart = Time_FloatMilliseconds();
+	RebuildIndex();
+	double mountTime = Time_FloatMilliseconds() - mountStart;
+
+	double coldTime = loadAll( names, coldBytes );
+	double warmTime = loadAll( names, warmBytes );
+
+	Cvar_SetBool( fs_index, false );
+	double linearTime = loadAll( names, linearBytes );
+
+	Cvar_SetBool( fs_index, oldIndex );
+
+	Com_Printf( "%d files (%.2f MB) and %d misses\n", (int)numFound, coldBytes / ( 1024.0 * 1024.0 ), (int)numFound );
+	Com_Printf( "index: mount %.2f ms, cold %.2f ms, warm %.2f ms\n", mountTime, coldTime, warmTime );
+	Com_Printf( "no index: %.2f ms (%.2fx slower than warm)\n", linearTime, linearTime / Max( warmTime, 0.001 ) );
+
+	if ( coldBytes != warmBytes || coldBytes != linearBytes ) {
+		Com_Print( S_COLOR_RED "The index and the search paths loaded different data!\n" );
+	}
+}
+
 // Modinfo is a subsystem of the filesystem, since they're inherently closely related
 namespace ModInfo
 {
@@ -89,6 +89,29 @@ namespace FileSystem
 					// Frees the memory allocated by LoadFile.
 	void			FreeFile( void *buffer );
 
+					// A read-only view of a whole file, valid until UnmapFile.
+					// Loose files are memory mapped and files inside packs point
+					// straight into the pack's mapping, so nothing is copied.
+					// When fs_mapFiles is 0 this falls back to LoadFile.
+	struct mappedFile_t
+	{
+		const byte *	data = nullptr;
+		fsSize_t		size = 0;
+
+		// A heap copy from the fs_mapFiles 0 path, holding on to one
+		// to read from in place keeps the whole file in memory
+		bool			loaded = false;
+
+		// Private
+		void *			base = nullptr;		// What UnmapFile releases, null for views into a pack
+		void *			mapping = nullptr;
+	};
+
+					// Maps a complete file. Returns false on failure, fails on empty files like LoadFile.
+	bool			MapFile( const char *filename, mappedFile_t &file );
+					// Releases a view returned by MapFile and clears it, safe to call on an empty view.
+	void			UnmapFile( mappedFile_t &file );
+
 					// Finds a file without considering packfiles (for dlls), returns the absolute path.
 	bool			FindPhysicalFile( const char *name, char *buffer, strlen_t bufferSize, fsPath_t fsPath = FS_GAMEDIR );
 
@@ -6,6 +6,9 @@
 	This goes against the concept of having different files for platform specific stuff
 	but I don't want to mess with the premake script again
 
+	Handles that may come from a pack file (size, seek, tell, close and read) live in Internal,
+	filesystem.cpp wraps them
+
 	TODO: Is there any reason in the world why we wouldn't want to use stdio on all platforms?
 	the buffered IO seems to be a big win.
 
@@ -80,8 +83,6 @@ const char *GetAPIName()
 	return "the WinAPI";
 }
 
-} // namespace Internal
-
 fsSize_t GetFileSize( fsHandle_t handle )
 {
 	LONGLONG fileSize;
@@ -122,6 +123,8 @@ fsSize_t ReadFile( void *buffer, fsSize_t length, fsHandle_t handle )
 	return static_cast<fsSize_t>( bytesRead );
 }
 
+} // namespace Internal
+
 fsSize_t WriteFile( const void *buffer, fsSize_t length, fsHandle_t handle )
 {
 	Assert( length > 0 );
@@ -198,8 +201,6 @@ const char *GetAPIName()
 	return "stdio";
 }
 
-} // namespace Internal
-
 fsSize_t GetFileSize( fsHandle_t handle )
 {
 	long pos;
@@ -245,6 +246,8 @@ fsSize_t ReadFile( void *buffer, fsSize_t length, fsHandle_t handle )
 	return read;
 }
 
+} // namespace Internal
+
 fsSize_t WriteFile( const void *buffer, fsSize_t length, fsHandle_t handle )
 {
 	Assert( length > 0 );
@@ -282,3 +285,104 @@ void FlushFile( fsHandle_t handle )
 } // namespace FileSystem
 
 #endif
+
+/*
+=======================================
+	Memory mapping
+=======================================
+*/
+
+#ifdef _WIN32
+#include "../../core/sys_includes.h"
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace FileSystem::Internal
+{
+
+#ifdef _WIN32
+
+void *MapFile( const char *absPath, fsSize_t &size, void *&mapping )
+{
+	wchar_t wideAbsPath[MAX_OSPATH];
+	Sys_UTF8ToUTF16( absPath, Q_strlen( absPath ) + 1, wideAbsPath, countof( wideAbsPath ) );
+
+	HANDLE file = CreateFileW( wideAbsPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return nullptr;
+	}
+
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart == 0 || fileSize.QuadPart > UINT32_MAX )
+	{
+		CloseHandle( file );
+		return nullptr;
+	}
+
+	// the mapping keeps the file open
+	HANDLE fileMapping = CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	CloseHandle( file );
+	if ( !fileMapping ) {
+		return nullptr;
+	}
+
+	void *base = MapViewOfFile( fileMapping, FILE_MAP_READ, 0, 0, 0 );
+	if ( !base )
+	{
+		CloseHandle( fileMapping );
+		return nullptr;
+	}
+
+	size = static_cast<fsSize_t>( fileSize.QuadPart );
+	mapping = reinterpret_cast<void *>( fileMapping );
+
+	return base;
+}
+
+void UnmapFile( void *base, fsSize_t size, void *mapping )
+{
+	UnmapViewOfFile( base );
+	CloseHandle( reinterpret_cast<HANDLE>( mapping ) );
+}
+
+#else
+
+void *MapFile( const char *absPath, fsSize_t &size, void *&mapping )
+{
+	int fd = open( absPath, O_RDONLY );
+	if ( fd == -1 ) {
+		return nullptr;
+	}
+
+	struct stat st;
+	if ( fstat( fd, &st ) == -1 || st.st_size == 0 || st.st_size > UINT32_MAX )
+	{
+		close( fd );
+		return nullptr;
+	}
+
+	// the mapping keeps the file open
+	void *base = mmap( nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( base == MAP_FAILED ) {
+		return nullptr;
+	}
+
+	size = static_cast<fsSize_t>( st.st_size );
+	mapping = nullptr;
+
+	return base;
+}
+
+void UnmapFile( void *base, fsSize_t size, void *mapping )
+{
+	munmap( base, (size_t)size );
+}
+
+#endif
+
+} // namespace FileSystem::Internal
@@ -270,11 +270,18 @@ qboolean visible (edict_t *self, edict_t *other)
 	vec3_t	spot1;
 	vec3_t	spot2;
 	trace_t	trace;
+	int		cached;
 
 	VectorCopy (self->s.origin, spot1);
 	spot1[2] += self->viewheight;
 	VectorCopy (other->s.origin, spot2);
 	spot2[2] += other->viewheight;
+
+	// the think scheduler may have looked already
+	cached = G_CachedSight (self, other, spot1, spot2);
+	if (cached != -1)
+		return cached;
+
 	trace = gi.trace (spot1, vec3_origin, vec3_origin, spot2, self, MASK_OPAQUE);
 	
 	if (trace.fraction == 1.0)
@@ -361,7 +368,7 @@ void FoundTarget (edict_t *self)
 	self->monsterinfo.aiflags |= AI_COMBAT_POINT;
 
 	// clear the targetname, that point is ours!
-	self->movetarget->targetname = NULL;
+	G_SetTargetname (self->movetarget, NULL);
 	self->monsterinfo.pausetime = 0;
 
 	// run for it
@@ -218,7 +218,7 @@ void Cmd_Give_f (edict_t *ent)
 	{
 		it = FindItem("Power Shield");
 		it_ent = G_Spawn();
-		it_ent->classname = it->classname;
+		G_SetClassname (it_ent, it->classname);
 		SpawnItem (it_ent, it);
 		Touch_Item (it_ent, ent, NULL, NULL);
 		if (it_ent->inuse)
@@ -272,7 +272,7 @@ void Cmd_Give_f (edict_t *ent)
 	else
 	{
 		it_ent = G_Spawn();
-		it_ent->classname = it->classname;
+		G_SetClassname (it_ent, it->classname);
 		SpawnItem (it_ent, it);
 		Touch_Item (it_ent, ent, NULL, NULL);
 		if (it_ent->inuse)
@@ -338,7 +338,7 @@ void Cmd_Spawn_f(edict_t *ent)
 	edict_t *edict;
 
 	edict = G_Spawn ();
-	edict->classname = classname;
+	G_SetClassname (edict, classname);
 
 	// origin
 
@@ -15,6 +15,12 @@ qboolean CanDamage (edict_t *targ, edict_t *inflictor)
 	vec3_t	dest;
 	trace_t	trace;
 
+	// the four corners, all from the same start so they go down the tree together
+	static const float	offsets[4][2] = { {15, 15}, {15, -15}, {-15, 15}, {-15, -15} };
+	traceRequest_t	requests[4];
+	trace_t			traces[4];
+	int				i;
+
 // bmodels need special checking because their origin is 0,0,0
 	if (targ->movetype == MOVETYPE_PUSH)
 	{
@@ -27,44 +33,35 @@ qboolean CanDamage (edict_t *targ, edict_t *inflictor)
 			return true;
 		return false;
 	}
-	
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, targ->s.origin, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
 
-	VectorCopy (targ->s.origin, dest);
-	dest[0] += 15.0;
-	dest[1] += 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
-
-	VectorCopy (targ->s.origin, dest);
-	dest[0] += 15.0;
-	dest[1] -= 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
+	// a target out in the open only costs the one trace
+	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, targ->s.origin, inflictor, MASK_SOLID);
 	if (trace.fraction == 1.0)
 		return true;
 
-	VectorCopy (targ->s.origin, dest);
-	dest[0] -= 15.0;
-	dest[1] += 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
+	for (i=0 ; i<4 ; i++)
+	{
+		VectorCopy (inflictor->s.origin, requests[i].start);
+		VectorClear (requests[i].mins);
+		VectorClear (requests[i].maxs);
+		VectorCopy (targ->s.origin, requests[i].end);
+		requests[i].end[0] += offsets[i][0];
+		requests[i].end[1] += offsets[i][1];
+		requests[i].passent = inflictor;
+		requests[i].contentmask = MASK_SOLID;
+	}
 
-	VectorCopy (targ->s.origin, dest);
-	dest[0] -= 15.0;
-	dest[1] -= 15.0;
-	trace = gi.trace (inflictor->s.origin, vec3_origin, vec3_origin, dest, inflictor, MASK_SOLID);
-	if (trace.fraction == 1.0)
-		return true;
+	gi.traceBatch (requests, 4, traces);
 
+	for (i=0 ; i<4 ; i++)
+	{
+		if (traces[i].fraction == 1.0)
+			return true;
+	}
 
 	return false;
 }
 
-
 /*
 ============
 Killed
@@ -1420,7 +1420,7 @@ void SP_func_water (edict_t *self)
 	if (self->wait == -1)
 		self->spawnflags |= DOOR_TOGGLE;
 
-	self->classname = "func_door";
+	G_SetClassname (self, "func_door");
 
 	gi.linkentity (self);
 }
@@ -2009,7 +2009,7 @@ void SP_func_door_secret (edict_t *ent)
 		ent->touch = door_touch;
 	}
 	
-	ent->classname = "func_door";
+	G_SetClassname (ent, "func_door");
 
 	gi.linkentity (ent);
 }
@@ -0,0 +1,796 @@
+#include "g_local.h"
+
+#include <algorithm>
+#include <vector>
+
+/*
+===================================================================================================
+
+	Entity index
+
+	A loose grid of everything the server has linked, for findradius, and hash chains of
+	classnames and targetnames, for G_Find. Both hand entities back in edict order so the
+	searches visit them in the same order as walking g_edicts would.
+
+	Entities go in the grid cell holding the centre of their abs box, anything wider than a
+	cell goes on a list of its own that every query checks. They stay where they were last
+	linked until they're freed, the same as the linear search would still find them unlinked
+
+===================================================================================================
+*/
+
+#define GRID_CELL_SIZE		256
+#define GRID_BUCKETS		4096					// power of two
+#define GRID_LARGE			GRID_BUCKETS			// the bucket for anything bigger than a cell
+
+#define NAME_BUCKETS		1024					// power of two
+
+enum entityNameField_t
+{
+	NAMEFIELD_CLASSNAME,
+	NAMEFIELD_TARGETNAME,
+
+	NUM_NAME_FIELDS
+};
+
+struct entityLinks_t
+{
+	int				gridBucket;						// -1 when not in the grid
+	int				gridPrev, gridNext;
+
+	const char *	names[NUM_NAME_FIELDS];			// what the chains were built from
+	int				nameBucket[NUM_NAME_FIELDS];	// -1 when not indexed
+	int				namePrev[NUM_NAME_FIELDS], nameNext[NUM_NAME_FIELDS];
+};
+
+static entityLinks_t *	s_links;
+static int				s_gridHeads[GRID_BUCKETS + 1];
+static uint				s_gridVisits[GRID_BUCKETS + 1];
+static uint				s_gridVisit;
+static int				s_nameHeads[NUM_NAME_FIELDS][NAME_BUCKETS];
+
+// findradius keeps the candidates from its last query while the grid doesn't change
+struct radiusQuery_t
+{
+	int *		candidates;
+	int			numCandidates;
+	int			next;				// where the last returned entity was in candidates, plus one
+	vec3_t		org;
+	float		rad;
+	uint		generation;
+	bool		valid;
+};
+
+static radiusQuery_t	s_radiusQuery;
+static uint				s_gridGeneration;		// bumped whenever an entity changes bucket
+
+static void	( *s_engineLinkEntity )( edict_t *ent );
+static void	( *s_engineUnlinkEntity )( edict_t *ent );
+static void	( *s_engineSetModel )( edict_t *ent, const char *name );
+
+static const char *G_NameField( const edict_t *ent, int field )
+{
+	return field == NAMEFIELD_CLASSNAME ? ent->classname : ent->targetname;
+}
+
+/*
+===================================================================================================
+
+	Grid
+
+===================================================================================================
+*/
+
+static int G_GridCell( float f )
+{
+	return (int)floorf( f * ( 1.0f / GRID_CELL_SIZE ) );
+}
+
+static int G_GridBucket( int x, int y )
+{
+	return ( (uint)x * 73856093u ^ (uint)y * 19349663u ) & ( GRID_BUCKETS - 1 );
+}
+
+static void G_GridRemove( int e )
+{
+	entityLinks_t &links = s_links[e];
+
+	if ( links.gridBucket == -1 ) {
+		return;
+	}
+
+	if ( links.gridPrev != -1 ) {
+		s_links[links.gridPrev].gridNext = links.gridNext;
+	} else {
+		s_gridHeads[links.gridBucket] = links.gridNext;
+	}
+	if ( links.gridNext != -1 ) {
+		s_links[links.gridNext].gridPrev = links.gridPrev;
+	}
+
+	links.gridBucket = -1;
+	++s_gridGeneration;
+}
+
+/*
+========================
+G_GridUpdate
+
+Called whenever the server has linked an entity, its abs box is up to date
+========================
+*/
+static void G_GridUpdate( edict_t *ent )
+{
+	const int e = ent - g_edicts;
+
+	if ( !ent->inuse || e == 0 )
+	{
+		G_GridRemove( e );
+		return;
+	}
+
+	int bucket;
+
+	if ( ent->absmax[0] - ent->absmin[0] > GRID_CELL_SIZE || ent->absmax[1] - ent->absmin[1] > GRID_CELL_SIZE )
+	{
+		bucket = GRID_LARGE;
+	}
+	else
+	{
+		const int x = G_GridCell( ( ent->absmin[0] + ent->absmax[0] ) * 0.5f );
+		const int y = G_GridCell( ( ent->absmin[1] + ent->absmax[1] ) * 0.5f );
+		bucket = G_GridBucket( x, y );
+	}
+
+	entityLinks_t &links = s_links[e];
+
+	if ( links.gridBucket == bucket ) {
+		return;
+	}
+
+	G_GridRemove( e );
+
+	links.gridBucket = bucket;
+	links.gridPrev = -1;
+	links.gridNext = s_gridHeads[bucket];
+	if ( links.gridNext != -1 ) {
+		s_links[links.gridNext].gridPrev = e;
+	}
+	s_gridHeads[bucket] = e;
+
+	++s_gridGeneration;
+}
+
+static void G_GridGatherBucket( int bucket, int *list, int &count )
+{
+	if ( s_gridVisits[bucket] == s_gridVisit ) {
+		return;
+	}
+	s_gridVisits[bucket] = s_gridVisit;
+
+	for ( int e = s_gridHeads[bucket]; e != -1; e = s_links[e].gridNext ) {
+		list[count++] = e;
+	}
+}
+
+/*
+========================
+G_GridGather
+
+Everything that could have its centre within rad of org, sorted by edict number
+========================
+*/
+static int G_GridGather( const vec3_t org, float rad, int *list )
+{
+	int count = 0;
+
+	// a bucket can come up more than once when cells share it
+	if ( ++s_gridVisit == 0 )
+	{
+		memset( s_gridVisits, 0, sizeof( s_gridVisits ) );
+		s_gridVisit = 1;
+	}
+
+	// centres are never more than half a cell out of theirs
+	const float reach = rad + GRID_CELL_SIZE * 0.5f;
+
+	const int x0 = G_GridCell( org[0] - reach ), x1 = G_GridCell( org[0] + reach );
+	const int y0 = G_GridCell( org[1] - reach ), y1 = G_GridCell( org[1] + reach );
+
+	if ( (int64)( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) >= GRID_BUCKETS )
+	{
+		for ( int bucket = 0; bucket < GRID_BUCKETS; ++bucket ) {
+			G_GridGatherBucket( bucket, list, count );
+		}
+	}
+	else
+	{
+		for ( int y = y0; y <= y1; ++y )
+		{
+			for ( int x = x0; x <= x1; ++x ) {
+				G_GridGatherBucket( G_GridBucket( x, y ), list, count );
+			}
+		}
+	}
+
+	G_GridGatherBucket( GRID_LARGE, list, count );
+
+	std::sort( list, list + count );
+
+	return count;
+}
+
+/*
+===================================================================================================
+
+	Names
+
+	Each chain is kept sorted by edict number
+
+===================================================================================================
+*/
+
+static int G_NameBucket( const char *name )
+{
+	uint hash = 2166136261u;
+
+	for ( ; *name; ++name ) {
+		hash = ( hash ^ (byte)tolower( (byte)*name ) ) * 16777619u;
+	}
+
+	return hash & ( NAME_BUCKETS - 1 );
+}
+
+static void G_NameRemove( int e, int field )
+{
+	entityLinks_t &links = s_links[e];
+
+	const int bucket = links.nameBucket[field];
+	if ( bucket == -1 ) {
+		return;
+	}
+
+	if ( links.namePrev[field] != -1 ) {
+		s_links[links.namePrev[field]].nameNext[field] = links.nameNext[field];
+	} else {
+		s_nameHeads[field][bucket] = links.nameNext[field];
+	}
+	if ( links.nameNext[field] != -1 ) {
+		s_links[links.nameNext[field]].namePrev[field] = links.namePrev[field];
+	}
+
+	links.nameBucket[field] = -1;
+}
+
+static void G_NameInsert( int e, int field, const char *name )
+{
+	entityLinks_t &links = s_links[e];
+
+	const int bucket = G_NameBucket( name );
+
+	int prev = -1;
+	int next = s_nameHeads[field][bucket];
+	while ( next != -1 && next < e )
+	{
+		prev = next;
+		next = s_links[next].nameNext[field];
+	}
+
+	links.nameBucket[field] = bucket;
+	links.namePrev[field] = prev;
+	links.nameNext[field] = next;
+
+	if ( prev != -1 ) {
+		s_links[prev].nameNext[field] = e;
+	} else {
+		s_nameHeads[field][bucket] = e;
+	}
+	if ( next != -1 ) {
+		s_links[next].namePrev[field] = e;
+	}
+}
+
+/*
+========================
+G_IndexNames
+
+Brings the chains up to date with the entity's classname and targetname.
+Anything that sets them directly rather than through G_SetClassname or
+G_SetTargetname has to call this after
+========================
+*/
+void G_IndexNames( edict_t *ent )
+{
+	const int e = ent - g_edicts;
+	entityLinks_t &links = s_links[e];
+
+	for ( int field = 0; field < NUM_NAME_FIELDS; ++field )
+	{
+		const char *name = G_NameField( ent, field );
+
+		if ( name == links.names[field] ) {
+			continue;
+		}
+
+		G_NameRemove( e, field );
+		links.names[field] = name;
+
+		if ( name ) {
+			G_NameInsert( e, field, name );
+		}
+	}
+}
+
+void G_SetClassname( edict_t *ent, const char *classname )
+{
+	ent->classname = classname;
+	G_IndexNames( ent );
+}
+
+void G_SetTargetname( edict_t *ent, const char *targetname )
+{
+	ent->targetname = targetname;
+	G_IndexNames( ent );
+}
+
+/*
+===================================================================================================
+
+	Upkeep
+
+===================================================================================================
+*/
+
+static void G_LinkEntity( edict_t *ent )
+{
+	AssertMsg( !G_InThinkJob(), "linkentity from a think job" );
+
+	s_engineLinkEntity( ent );
+	G_GridUpdate( ent );
+	G_SightLinkChanged( ent, true );
+}
+
+static void G_UnlinkEntity( edict_t *ent )
+{
+	AssertMsg( !G_InThinkJob(), "unlinkentity from a think job" );
+
+	s_engineUnlinkEntity( ent );
+	G_SightLinkChanged( ent, false );
+}
+
+static void G_SetModel( edict_t *ent, const char *name )
+{
+	const int linkcount = ent->linkcount;
+
+	// inline models link themselves
+	s_engineSetModel( ent, name );
+
+	if ( ent->linkcount != linkcount ) {
+		G_GridUpdate( ent );
+		G_SightLinkChanged( ent, true );
+	}
+}
+
+/*
+========================
+G_HookEntityLinking
+
+Everything the server links the game about goes through the index first
+========================
+*/
+void G_HookEntityLinking()
+{
+	s_engineLinkEntity = gi.linkentity;
+	s_engineUnlinkEntity = gi.unlinkentity;
+	s_engineSetModel = gi.setmodel;
+
+	gi.linkentity = G_LinkEntity;
+	gi.unlinkentity = G_UnlinkEntity;
+	gi.setmodel = G_SetModel;
+}
+
+/*
+========================
+G_InitEntityIndex
+
+The links live in the game arena, so this has to follow every reset of it
+========================
+*/
+void G_InitEntityIndex()
+{
+	s_links = Mem_ArenaAllocArray<entityLinks_t>( g_gameArena, game.maxentities );
+	s_radiusQuery.candidates = Mem_ArenaAllocArray<int>( g_gameArena, game.maxentities );
+
+	G_ClearEntityIndex();
+}
+
+/*
+========================
+G_ClearEntityIndex
+
+For when the edicts have all been wiped
+========================
+*/
+void G_ClearEntityIndex()
+{
+	for ( int e = 0; e < game.maxentities; ++e )
+	{
+		entityLinks_t &links = s_links[e];
+
+		links.gridBucket = -1;
+		for ( int field = 0; field < NUM_NAME_FIELDS; ++field )
+		{
+			links.names[field] = nullptr;
+			links.nameBucket[field] = -1;
+		}
+	}
+
+	memset( s_gridHeads, -1, sizeof( s_gridHeads ) );
+	memset( s_nameHeads, -1, sizeof( s_nameHeads ) );
+
+	s_radiusQuery.valid = false;
+	++s_gridGeneration;
+}
+
+/*
+========================
+G_RemoveFromIndex
+
+For G_FreeEdict
+========================
+*/
+void G_RemoveFromIndex( edict_t *ent )
+{
+	const int e = ent - g_edicts;
+
+	G_GridRemove( e );
+
+	for ( int field = 0; field < NUM_NAME_FIELDS; ++field )
+	{
+		G_NameRemove( e, field );
+		s_links[e].names[field] = nullptr;
+	}
+}
+
+/*
+========================
+G_RebuildEntityIndex
+
+For when the edicts have been copied back wholesale, everything that has
+ever been linked goes back in the grid where it was last linked
+========================
+*/
+void G_RebuildEntityIndex()
+{
+	G_ClearEntityIndex();
+
+	for ( int e = 0; e < globals.num_edicts; ++e )
+	{
+		edict_t *ent = &g_edicts[e];
+
+		if ( !ent->inuse ) {
+			continue;
+		}
+
+		G_IndexNames( ent );
+		if ( ent->linkcount ) {
+			G_GridUpdate( ent );
+		}
+	}
+}
+
+/*
+========================
+G_CheckEntityIndex
+
+Catches names that were set without the index hearing about it
+========================
+*/
+void G_CheckEntityIndex()
+{
+	for ( int e = 0; e < globals.num_edicts; ++e )
+	{
+		edict_t *ent = &g_edicts[e];
+
+		if ( !ent->inuse ) {
+			continue;
+		}
+
+		for ( int field = 0; field < NUM_NAME_FIELDS; ++field )
+		{
+			if ( G_NameField( ent, field ) != s_links[e].names[field] )
+			{
+				gi.dprintf( S_COLOR_YELLOW "G_CheckEntityIndex: %s of entity %d changed behind the index's back\n",
+					field == NAMEFIELD_CLASSNAME ? "classname" : "targetname", e );
+				G_IndexNames( ent );
+			}
+		}
+	}
+}
+
+/*
+===================================================================================================
+
+	Searches
+
+===================================================================================================
+*/
+
+/*
+=============
+G_Find
+
+Searches all active entities for the next one that holds
+the matching string at fieldofs (use the FOFS() macro) in the structure.
+
+Searches beginning at the edict after from, or the beginning if NULL
+NULL will be returned if the end of the list is reached.
+
+=============
+*/
+edict_t *G_Find (edict_t *from, int fieldofs, const char *match)
+{
+	const char	*s;
+	int			field;
+
+	if (fieldofs == FOFS(classname))
+		field = NAMEFIELD_CLASSNAME;
+	else if (fieldofs == FOFS(targetname))
+		field = NAMEFIELD_TARGETNAME;
+	else
+		field = -1;
+
+	// anything else isn't indexed
+	if (field == -1)
+	{
+		if (!from)
+			from = g_edicts;
+		else
+			from++;
+
+		for ( ; from < &g_edicts[globals.num_edicts] ; from++)
+		{
+			if (!from->inuse)
+				continue;
+			s = *(const char **) ((byte *)from + fieldofs);
+			if (!s)
+				continue;
+			if (!Q_stricmp (s, match))
+				return from;
+		}
+
+		return NULL;
+	}
+
+	const int after = from ? from - g_edicts : -1;
+
+	for (int e = s_nameHeads[field][G_NameBucket (match)] ; e != -1 ; e = s_links[e].nameNext[field])
+	{
+		if (e <= after)
+			continue;
+
+		edict_t *ent = &g_edicts[e];
+		if (!ent->inuse)
+			continue;
+		s = G_NameField (ent, field);
+		if (s && !Q_stricmp (s, match))
+			return ent;
+	}
+
+	return NULL;
+}
+
+/*
+=================
+findradius
+
+Returns entities that have origins within a spherical area
+
+findradius (origin, radius)
+=================
+*/
+edict_t *findradius (edict_t *from, vec3_t org, float rad)
+{
+	radiusQuery_t	&query = s_radiusQuery;
+	vec3_t			eorg;
+	int				j;
+
+	// carry on from the last call unless something moved between cells since
+	if (!from || !query.valid || query.generation != s_gridGeneration || query.rad != rad || !VectorCompare (query.org, org)
+		|| query.next <= 0 || query.candidates[query.next - 1] != from - g_edicts)
+	{
+		query.numCandidates = G_GridGather (org, rad, query.candidates);
+		query.next = from ? std::upper_bound (query.candidates, query.candidates + query.numCandidates, (int)(from - g_edicts)) - query.candidates : 0;
+		VectorCopy (org, query.org);
+		query.rad = rad;
+		query.generation = s_gridGeneration;
+		query.valid = true;
+	}
+
+	for ( ; query.next < query.numCandidates; query.next++)
+	{
+		edict_t *ent = &g_edicts[query.candidates[query.next]];
+
+		if (!ent->inuse)
+			continue;
+		if (ent->solid == SOLID_NOT)
+			continue;
+		for (j=0 ; j<3 ; j++)
+			eorg[j] = org[j] - (ent->s.origin[j] + (ent->mins[j] + ent->maxs[j])*0.5f);
+		if (VectorLength(eorg) > rad)
+			continue;
+
+		query.next++;
+		return ent;
+	}
+
+	return NULL;
+}
+
+/*
+===================================================================================================
+
+	Benchmark
+
+===================================================================================================
+*/
+
+#define FINDBENCH_NAMES		64
+#define FINDBENCH_EXTENT	4096.0f
+#define FINDBENCH_RADIUS	256.0f
+
+static edict_t *G_FindLinear( edict_t *from, int fieldofs, const char *match )
+{
+	from = from ? from + 1 : g_edicts;
+
+	for ( ; from < &g_edicts[globals.num_edicts]; from++ )
+	{
+		if ( !from->inuse ) {
+			continue;
+		}
+		const char *s = *(const char **)( (byte *)from + fieldofs );
+		if ( s && !Q_stricmp( s, match ) ) {
+			return from;
+		}
+	}
+
+	return nullptr;
+}
+
+static edict_t *findradiusLinear( edict_t *from, const vec3_t org, float rad )
+{
+	from = from ? from + 1 : g_edicts;
+
+	for ( ; from < &g_edicts[globals.num_edicts]; from++ )
+	{
+		if ( !from->inuse || from->solid == SOLID_NOT ) {
+			continue;
+		}
+
+		vec3_t eorg;
+		for ( int j = 0; j < 3; j++ ) {
+			eorg[j] = org[j] - ( from->s.origin[j] + ( from->mins[j] + from->maxs[j] ) * 0.5f );
+		}
+		if ( VectorLength( eorg ) <= rad ) {
+			return from;
+		}
+	}
+
+	return nullptr;
+}
+
+/*
+========================
+Svcmd_FindBench_f
+
+sv findbench [numents] [queries]
+
+Scatters point entities around the first player and times findradius and
+targetname searches against walking every edict, checking they agree
+========================
+*/
+void Svcmd_FindBench_f()
+{
+	static char names[FINDBENCH_NAMES][16];
+
+	int numEnts = ( gi.argc() > 2 ) ? atoi( gi.argv( 2 ) ) : 800;
+	int numQueries = ( gi.argc() > 3 ) ? atoi( gi.argv( 3 ) ) : 1000;
+
+	numEnts = Clamp( numEnts, 1, game.maxentities - globals.num_edicts - 64 );
+	numQueries = Clamp( numQueries, 1, 1000000 );
+
+	if ( numEnts < 1 )
+	{
+		gi.cprintf( nullptr, PRINT_HIGH, "Not enough free edicts for a benchmark\n" );
+		return;
+	}
+
+	for ( int i = 0; i < FINDBENCH_NAMES; ++i ) {
+		Q_sprintf_s( names[i], "findbench%d", i );
+	}
+
+	vec3_t base{};
+	if ( g_edicts[1].inuse ) {
+		VectorCopy( g_edicts[1].s.origin, base );
+	}
+
+	std::vector<edict_t *> ents( numEnts );
+
+	for ( int i = 0; i < numEnts; ++i )
+	{
+		edict_t *ent = G_Spawn();
+		G_SetClassname( ent, "findbench" );
+		G_SetTargetname( ent, names[i % FINDBENCH_NAMES] );
+
+		ent->s.origin[0] = base[0] + crandom() * FINDBENCH_EXTENT;
+		ent->s.origin[1] = base[1] + crandom() * FINDBENCH_EXTENT;
+		ent->s.origin[2] = base[2] + crandom() * 256.0f;
+		VectorSet( ent->mins, -16, -16, -16 );
+		VectorSet( ent->maxs, 16, 16, 16 );
+		ent->solid = SOLID_TRIGGER;
+		ent->svflags = SVF_NOCLIENT;
+
+		gi.linkentity( ent );
+		ents[i] = ent;
+	}
+
+	struct findBenchPoint_t { vec3_t org; };
+	std::vector<findBenchPoint_t> points( numQueries );
+	for ( findBenchPoint_t &point : points )
+	{
+		point.org[0] = base[0] + crandom() * FINDBENCH_EXTENT;
+		point.org[1] = base[1] + crandom() * FINDBENCH_EXTENT;
+		point.org[2] = base[2];
+	}
+
+	int64 found[4]{};
+	double msec[4]{};
+	double start;
+
+	start = Time_FloatMilliseconds();
+	for ( findBenchPoint_t &point : points )
+	{
+		for ( edict_t *ent = nullptr; ( ent = findradiusLinear( ent, point.org, FINDBENCH_RADIUS ) ); ) {
+			found[0] += ent - g_edicts;
+		}
+	}
+	msec[0] = Time_FloatMilliseconds() - start;
+
+	start = Time_FloatMilliseconds();
+	for ( findBenchPoint_t &point : points )
+	{
+		for ( edict_t *ent = nullptr; ( ent = findradius( ent, point.org, FINDBENCH_RADIUS ) ); ) {
+			found[1] += ent - g_edicts;
+		}
+	}
+	msec[1] = Time_FloatMilliseconds() - start;
+
+	start = Time_FloatMilliseconds();
+	for ( int i = 0; i < numQueries; ++i )
+	{
+		for ( edict_t *ent = nullptr; ( ent = G_FindLinear( ent, FOFS( targetname ), names[i % FINDBENCH_NAMES] ) ); ) {
+			found[2] += ent - g_edicts;
+		}
+	}
+	msec[2] = Time_FloatMilliseconds() - start;
+
+	start = Time_FloatMilliseconds();
+	for ( int i = 0; i < numQueries; ++i )
+	{
+		for ( edict_t *ent = nullptr; ( ent = G_Find( ent, FOFS( targetname ), names[i % FINDBENCH_NAMES] ) ); ) {
+			found[3] += ent - g_edicts;
+		}
+	}
+	msec[3] = Time_FloatMilliseconds() - start;
+
+	for ( edict_t *ent : ents )
+	{
+		G_FreeEdict( ent );
+	}
+
+	gi.cprintf( nullptr, PRINT_HIGH, "%d entities, %d edicts in use, %d queries each\n", numEnts, globals.num_edicts, numQueries );
+	gi.cprintf( nullptr, PRINT_HIGH, "findradius: %.3f us linear, %.3f us indexed per query%s\n",
+		msec[0] * 1000.0 / numQueries, msec[1] * 1000.0 / numQueries, found[0] == found[1] ? "" : S_COLOR_RED " (results differ)" );
+	gi.cprintf( nullptr, PRINT_HIGH, "G_Find:     %.3f us linear, %.3f us indexed per query%s\n",
+		msec[2] * 1000.0 / numQueries, msec[3] * 1000.0 / numQueries, found[2] == found[3] ? "" : S_COLOR_RED " (results differ)" );
+}
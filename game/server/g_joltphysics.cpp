@@ -43,8 +43,13 @@ void Phys_Simulate( float deltaTime )
 		return;
 	}
 
+	gi.physScene->SetStepRate( phys_stepRate->GetFloat(), phys_collisionSteps->GetInt(), phys_maxSteps->GetInt() );
 	gi.physScene->Simulate( deltaTime );
 
+	// The steps rarely line up with our frames, so publish where
+	// things are between the last two to keep them moving smoothly
+	const float fraction = gi.physScene->GetInterpolationFraction();
+
 	for ( int i = game.maxclients + 1; i < globals.num_edicts; ++i )
 	{
 		edict_t *ent = g_edicts + i;
@@ -54,7 +59,7 @@ void Phys_Simulate( float deltaTime )
 			continue;
 		}
 
-		ent->pPhysBody->GetPositionAndRotation( ent->s.origin, ent->s.angles );
+		ent->pPhysBody->GetInterpolatedPositionAndRotation( fraction, ent->s.origin, ent->s.angles );
 		ent->pPhysBody->GetLinearAndAngularVelocity( ent->velocity, ent->avelocity );
 
 		gi.linkentity( ent );
@@ -269,3 +274,92 @@ void Spawn_PhysBarrel( edict_t *self )
 	self->think = Think_Any;
 	self->nextthink = level.time + FRAMETIME;
 }
+
+/*
+===================================================================================================
+
+	Benchmark
+
+===================================================================================================
+*/
+
+#define PHYSBENCH_COLUMNS	8
+#define PHYSBENCH_SPACING	48.0f
+
+/*
+========================
+Svcmd_PhysBench_f
+
+sv physbench [numcubes] [seconds]
+
+Drops a stack of physcubes above the first player and times how long
+the scene takes to simulate them, per second of simulated time.
+Everything else with a physics body is stepped along with them
+========================
+*/
+void Svcmd_PhysBench_f()
+{
+	int numCubes = ( gi.argc() > 2 ) ? atoi( gi.argv( 2 ) ) : 256;
+	float seconds = ( gi.argc() > 3 ) ? (float)atof( gi.argv( 3 ) ) : 10.0f;
+
+	// leave some room for everything else
+	numCubes = Clamp( numCubes, 1, game.maxentities - globals.num_edicts - 64 );
+	seconds = Clamp( seconds, FRAMETIME, 600.0f );
+
+	if ( numCubes < 1 )
+	{
+		gi.cprintf( nullptr, PRINT_HIGH, "Not enough free edicts for a benchmark\n" );
+		return;
+	}
+
+	vec3_t base{};
+	if ( g_edicts[1].inuse ) {
+		VectorCopy( g_edicts[1].s.origin, base );
+	}
+	base[2] += 128.0f;
+
+	std::vector<edict_t *> cubes( numCubes );
+
+	const int perLayer = PHYSBENCH_COLUMNS * PHYSBENCH_COLUMNS;
+	const float halfWidth = ( PHYSBENCH_COLUMNS - 1 ) * PHYSBENCH_SPACING * 0.5f;
+
+	for ( int i = 0; i < numCubes; ++i )
+	{
+		edict_t *cube = G_Spawn();
+		G_SetClassname( cube, "physcube" );
+		cube->s.origin[0] = base[0] - halfWidth + ( i % PHYSBENCH_COLUMNS ) * PHYSBENCH_SPACING;
+		cube->s.origin[1] = base[1] - halfWidth + ( ( i % perLayer ) / PHYSBENCH_COLUMNS ) * PHYSBENCH_SPACING;
+		cube->s.origin[2] = base[2] + ( i / perLayer ) * PHYSBENCH_SPACING;
+		cube->s.angles[1] = (float)( ( i * 37 ) % 360 );
+
+		Spawn_PhysCube( cube );
+		cubes[i] = cube;
+	}
+
+	gi.physScene->SetStepRate( phys_stepRate->GetFloat(), phys_collisionSteps->GetInt(), phys_maxSteps->GetInt() );
+
+	const int numFrames = (int)( seconds / FRAMETIME + 0.5f );
+	double totalTime = 0.0, worstTime = 0.0;
+
+	for ( int frame = 0; frame < numFrames; ++frame )
+	{
+		const double start = Time_FloatMilliseconds();
+		gi.physScene->Simulate( FRAMETIME );
+		const double frameTime = Time_FloatMilliseconds() - start;
+
+		totalTime += frameTime;
+		worstTime = Max( worstTime, frameTime );
+	}
+
+	const float simulated = numFrames * FRAMETIME;
+
+	gi.cprintf( nullptr, PRINT_HIGH, "%d cubes, %.1f seconds at %g Hz with %d collision steps\n",
+		numCubes, simulated, phys_stepRate->GetFloat(), Max( phys_collisionSteps->GetInt(), 1 ) );
+	gi.cprintf( nullptr, PRINT_HIGH, "%.2f ms per simulated second, %.3f ms per frame, %.3f ms worst frame\n",
+		totalTime / simulated, totalTime / numFrames, worstTime );
+
+	for ( edict_t *cube : cubes )
+	{
+		G_FreeEdict( cube );
+	}
+}
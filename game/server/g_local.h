@@ -61,9 +61,9 @@
 #define FL_RESPAWN				0x80000000	// used for item respawning
 
 
-// memory tags to allow dynamic memory to be cleaned up
-#define	TAG_GAME	765		// clear when unloading the dll
-#define	TAG_LEVEL	766		// clear when loading a new level
+// arenas to allow dynamic memory to be cleaned up
+extern	memArena_t		g_gameArena;		// reset when unloading the dll or loading a game
+extern	memArena_t		g_levelArena;		// reset when loading a new level
 
 
 #define MELEE_DISTANCE	80
@@ -555,6 +555,11 @@ extern cvar_t	*sv_rollangle;
 extern cvar_t	*g_viewthing;
 extern cvar_t	*g_frametime;
 extern cvar_t	*g_playersOnly;
+extern cvar_t	*g_threadedThink;
+
+extern cvar_t	*phys_stepRate;
+extern cvar_t	*phys_collisionSteps;
+extern cvar_t	*phys_maxSteps;
 
 extern cvar_t	*run_pitch;
 extern cvar_t	*run_roll;
@@ -595,8 +600,8 @@ extern cvar_t	*sv_maplist;
 enum fieldtype_t {
 	F_INT, 
 	F_FLOAT,
-	F_LSTRING,			// string on disk, pointer in memory, TAG_LEVEL
-	F_GSTRING,			// string on disk, pointer in memory, TAG_GAME
+	F_LSTRING,			// string on disk, pointer in memory, g_levelArena
+	F_GSTRING,			// string on disk, pointer in memory, g_gameArena
 	F_VECTOR,
 	F_ANGLEHACK,
 	F_EDICT,			// index on disk, pointer in memory
@@ -656,8 +661,6 @@ void Touch_Item (edict_t *ent, edict_t *other, cplane_t *plane, csurface_t *surf
 //
 qboolean	KillBox (edict_t *ent);
 void		G_ProjectSource (vec3_t point, vec3_t distance, vec3_t forward, vec3_t right, vec3_t result);
-edict_t *	G_Find (edict_t *from, int fieldofs, const char *match);
-edict_t *	findradius (edict_t *from, vec3_t org, float rad);
 edict_t *	G_PickTarget (const char *targetname);
 void		G_UseTargets (edict_t *ent, edict_t *activator);
 void		G_SetMovedir (vec3_t angles, vec3_t movedir);
@@ -665,6 +668,10 @@ void		G_SetMovedir (vec3_t angles, vec3_t movedir);
 void		G_InitEdict (edict_t *e);
 edict_t	*	G_Spawn (void);
 void		G_FreeEdict (edict_t *e);
+void		G_InitEdictAllocator (void);
+void		G_ResetFreeEdicts (void);
+void		G_CompactEdicts (void);
+void		Svcmd_SpawnBench_f();
 
 void		G_TouchTriggers (edict_t *ent);
 void		G_TouchSolids (edict_t *ent);
@@ -675,6 +682,37 @@ char *		vtos (vec3_t v);
 float		vectoyaw( const vec3_t vec );
 void		vectoangles( const vec3_t vec, vec3_t angles );
 
+//
+// g_index.cpp
+//
+edict_t *	G_Find (edict_t *from, int fieldofs, const char *match);
+edict_t *	findradius (edict_t *from, vec3_t org, float rad);
+
+void		G_SetClassname( edict_t *ent, const char *classname );
+void		G_SetTargetname( edict_t *ent, const char *targetname );
+void		G_IndexNames( edict_t *ent );
+
+void		G_HookEntityLinking();
+void		G_InitEntityIndex();
+void		G_ClearEntityIndex();
+void		G_RemoveFromIndex( edict_t *ent );
+void		G_RebuildEntityIndex();
+void		G_CheckEntityIndex();
+
+void		Svcmd_FindBench_f();
+
+//
+// g_think.cpp
+//
+void		G_InitThink();
+void		G_PrepareThink();
+void		G_FinishThink();
+bool		G_InThinkJob();
+void		G_SightLinkChanged( edict_t *ent, bool linked );
+int			G_CachedSight( const edict_t *self, const edict_t *other, const vec3_t start, const vec3_t end );
+
+void		Svcmd_ThinkCheck_f();
+
 //
 // g_combat.c
 //
@@ -832,6 +870,7 @@ void G_RunEntity (edict_t *ent);
 //
 void SaveClientData (void);
 void FetchClientEntData (edict_t *ent);
+void G_ThinkEntities (void);
 
 //
 // g_chase.c
@@ -848,6 +887,7 @@ void Phys_CacheShape( IPhysicsShape *pShape );
 void Phys_DeleteCachedShapes();
 
 void Phys_Simulate( float deltaTime );
+void Svcmd_PhysBench_f();
 
 void Phys_SetupPhysicsForEntity( edict_t *ent, const bodyCreationSettings_t &settings, IPhysicsShape *pShape );
 
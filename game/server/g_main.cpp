@@ -1,6 +1,8 @@
 
 #include "g_local.h"
 
+#include "../../core/jobs.h"
+
 game_locals_t	game;
 level_locals_t	level;
 game_import_t	gi;
@@ -13,6 +15,9 @@ int meansOfDeath;
 
 edict_t		*g_edicts;
 
+memArena_t	g_gameArena;
+memArena_t	g_levelArena;
+
 cvar_t	*deathmatch;
 cvar_t	*coop;
 cvar_t	*dmflags;
@@ -42,6 +47,11 @@ cvar_t	*gun_z;
 cvar_t	*g_viewthing;
 cvar_t	*g_frametime;
 cvar_t	*g_playersOnly;
+cvar_t	*g_threadedThink;
+
+cvar_t	*phys_stepRate;
+cvar_t	*phys_collisionSteps;
+cvar_t	*phys_maxSteps;
 
 cvar_t	*run_pitch;
 cvar_t	*run_roll;
@@ -80,8 +90,11 @@ void ShutdownGame (void)
 
 	Phys_DeleteCachedShapes();
 
-	gi.FreeTags (TAG_LEVEL);
-	gi.FreeTags (TAG_GAME);
+	// the think scheduler's workers have to go before the DLL does
+	Jobs_Shutdown ();
+
+	Mem_ArenaFree (g_levelArena);
+	Mem_ArenaFree (g_gameArena);
 }
 
 /*
@@ -96,6 +109,9 @@ extern "C" DLLEXPORT game_export_t *GetGameAPI (game_import_t *import)
 {
 	gi = *import;
 
+	// the entity index needs to see everything that gets linked
+	G_HookEntityLinking ();
+
 	globals.apiversion = GAME_API_VERSION;
 	globals.Init = InitGame;
 	globals.Shutdown = ShutdownGame;
@@ -237,7 +253,7 @@ edict_t *CreateTargetChangeLevel(char *map)
 	edict_t *ent;
 
 	ent = G_Spawn ();
-	ent->classname = "target_changelevel";
+	G_SetClassname (ent, "target_changelevel");
 	Q_sprintf_s(level.nextmap, sizeof(level.nextmap), "%s", map);
 	ent->map = level.nextmap;
 	return ent;
@@ -410,29 +426,18 @@ void ExitLevel (void)
 
 /*
 ================
-G_RunFrame
+G_ThinkEntities
 
-Advances the world by 0.1 seconds
+Runs and moves everything in edict order, clients get their frame begun
 ================
 */
-void G_RunFrame (void)
+void G_ThinkEntities (void)
 {
 	int		i;
 	edict_t	*ent;
 
-	level.framenum++;
-	level.time = level.framenum*FRAMETIME;
-
-	// choose a client for monsters to target this frame
-	AI_SetSightClient ();
-
-	// exit intermissions
-
-	if (level.exitintermission)
-	{
-		ExitLevel ();
-		return;
-	}
+	// look ahead for the monsters about to think
+	G_PrepareThink ();
 
 	//
 	// treat each object in turn
@@ -467,6 +472,37 @@ void G_RunFrame (void)
 		G_RunEntity (ent);
 	}
 
+	G_FinishThink ();
+}
+
+/*
+================
+G_RunFrame
+
+Advances the world by 0.1 seconds
+================
+*/
+void G_RunFrame (void)
+{
+	level.framenum++;
+	level.time = level.framenum*FRAMETIME;
+
+	// hand back any free edicts at the end of the list
+	G_CompactEdicts ();
+
+	// choose a client for monsters to target this frame
+	AI_SetSightClient ();
+
+	// exit intermissions
+
+	if (level.exitintermission)
+	{
+		ExitLevel ();
+		return;
+	}
+
+	G_ThinkEntities ();
+
 	Phys_Simulate( FRAMETIME );
 
 	// see if it is time to end a deathmatch
@@ -477,5 +513,9 @@ void G_RunFrame (void)
 
 	// build the playerstate_t structures for all players
 	ClientEndServerFrames ();
+
+#ifdef Q_DEBUG
+	G_CheckEntityIndex ();
+#endif
 }
 
@@ -317,7 +317,7 @@ void ThrowDebris (edict_t *self, const char *modelname, float speed, vec3_t orig
 	chunk->nextthink = level.time + 5 + random()*5;
 	chunk->s.frame = 0;
 	chunk->flags = 0;
-	chunk->classname = "debris";
+	G_SetClassname (chunk, "debris");
 	chunk->takedamage = DAMAGE_YES;
 	chunk->die = debris_die;
 
@@ -1782,7 +1782,7 @@ void SP_func_clock (edict_t *self)
 
 	func_clock_reset (self);
 
-	self->message = (char*)gi.TagMalloc (CLOCK_MESSAGE_SIZE, TAG_LEVEL);
+	self->message = (char*)Mem_ArenaAlloc (g_levelArena, CLOCK_MESSAGE_SIZE, 1);
 
 	self->think = func_clock_think;
 
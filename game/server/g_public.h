@@ -6,7 +6,7 @@
 #include "../../common/filesystem_interface.h"
 #include "../../physics/phys_public.h"
 
-#define	GAME_API_VERSION	3
+#define	GAME_API_VERSION	4
 
 // edict->svflags
 
@@ -116,6 +116,7 @@ struct game_import_t
 
 	// collision detection
 	trace_t	(*trace) (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passent, int contentmask);
+	void	(*traceBatch) (const traceRequest_t *requests, int count, trace_t *results);	// same as calling trace for each request
 	int		(*pointcontents) (vec3_t point);
 	qboolean	(*inPVS) (vec3_t p1, vec3_t p2);
 	qboolean	(*inPHS) (vec3_t p1, vec3_t p2);
@@ -187,6 +187,12 @@ void InitGame (void)
 	g_viewthing = gi.cvar ("g_viewthing", "models/devtest/barneyhl1.smf", CVAR_ARCHIVE);
 	g_frametime = gi.cvar ("g_frametime", "0.1", 0);
 	g_playersOnly = gi.cvar ("g_playersOnly", "0", 0);
+	g_threadedThink = gi.cvar ("g_threadedThink", "1", 0);
+
+	// physics steps at a fixed rate of its own, independent of the server frame
+	phys_stepRate = gi.cvar ("phys_stepRate", "60", 0);
+	phys_collisionSteps = gi.cvar ("phys_collisionSteps", "1", 0);
+	phys_maxSteps = gi.cvar ("phys_maxSteps", "8", 0);
 
 	// items
 	InitItems ();
@@ -196,13 +202,16 @@ void InitGame (void)
 
 	// initialize all entities for this game
 	game.maxentities = maxentities->GetInt();
-	g_edicts = (edict_t*)gi.TagMalloc (game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
+	g_edicts = Mem_ArenaAllocArray<edict_t> (g_gameArena, game.maxentities);
 	globals.edicts = g_edicts;
 	globals.max_edicts = game.maxentities;
+	G_InitEntityIndex ();
+	G_InitEdictAllocator ();
+	G_InitThink ();
 
 	// initialize all clients for this game
 	game.maxclients = maxclients->GetInt();
-	game.clients = (gclient_t*)gi.TagMalloc (game.maxclients * sizeof(game.clients[0]), TAG_GAME);
+	game.clients = Mem_ArenaAllocArray<gclient_t> (g_gameArena, game.maxclients);
 	globals.num_edicts = game.maxclients+1;
 }
 
@@ -327,7 +336,7 @@ void ReadField (fsHandle_t f, field_t *field, byte *base)
 			*(char **)p = NULL;
 		else
 		{
-			*(char **)p = (char *)gi.TagMalloc (len, TAG_LEVEL);
+			*(char **)p = (char *)Mem_ArenaAlloc (g_levelArena, len, 1);
 			gi.fileSystem->ReadFile (*(char **)p, len, f);
 		}
 		break;
@@ -474,7 +483,7 @@ void ReadGame (char *filename)
 	int		i;
 	char	str[16];
 
-	gi.FreeTags (TAG_GAME);
+	Mem_ArenaReset (g_gameArena);
 
 	fsHandle_t f = gi.fileSystem->OpenFileRead (filename);
 	if (!f)
@@ -487,11 +496,14 @@ void ReadGame (char *filename)
 		gi.error ("Savegame from an older version.\n");
 	}
 
-	g_edicts = (edict_t*)gi.TagMalloc (game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
+	g_edicts = Mem_ArenaAllocArray<edict_t> (g_gameArena, game.maxentities);
 	globals.edicts = g_edicts;
+	G_InitEntityIndex ();
+	G_InitEdictAllocator ();
+	G_InitThink ();
 
 	gi.fileSystem->ReadFile (&game, sizeof(game), f);
-	game.clients = (gclient_t*)gi.TagMalloc (game.maxclients * sizeof(game.clients[0]), TAG_GAME);
+	game.clients = Mem_ArenaAllocArray<gclient_t> (g_gameArena, game.maxclients);
 	for (i=0 ; i<game.maxclients ; i++)
 		ReadClient (f, &game.clients[i]);
 
@@ -676,10 +688,11 @@ void ReadLevel (char *filename)
 
 	// free any dynamic memory allocated by loading the level
 	// base state
-	gi.FreeTags (TAG_LEVEL);
+	Mem_ArenaReset (g_levelArena);
 
 	// wipe all the entities
 	memset (g_edicts, 0, game.maxentities*sizeof(g_edicts[0]));
+	G_ClearEntityIndex ();
 	globals.num_edicts = maxclients->GetInt() + 1;
 
 	// check edict size
@@ -720,6 +733,7 @@ void ReadLevel (char *filename)
 
 		ent = &g_edicts[entnum];
 		ReadEdict (f, ent);
+		G_IndexNames (ent);
 
 		// let the server rebuild world links for this ent
 		memset (&ent->area, 0, sizeof(ent->area));
@@ -728,6 +742,8 @@ void ReadLevel (char *filename)
 
 	gi.fileSystem->CloseFile (f);
 
+	G_ResetFreeEdicts ();
+
 	// mark all clients as unconnected
 	for (i=0 ; i<maxclients->GetInt() ; i++)
 	{
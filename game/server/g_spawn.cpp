@@ -346,7 +346,7 @@ char *ED_NewString (char *string)
 	
 	l = Q_strlen(string) + 1;
 
-	newb = (char*)gi.TagMalloc (l, TAG_LEVEL);
+	newb = (char*)Mem_ArenaAlloc (g_levelArena, l, 1);
 
 	new_p = newb;
 
@@ -572,10 +572,12 @@ void SpawnEntities (const char *mapname, char *entities, const char *spawnpoint)
 
 	SaveClientData ();
 
-	gi.FreeTags (TAG_LEVEL);
+	Mem_ArenaReset (g_levelArena);
 
 	memset (&level, 0, sizeof(level));
 	memset (g_edicts, 0, game.maxentities * sizeof (g_edicts[0]));
+	G_ClearEntityIndex ();
+	G_ResetFreeEdicts ();
 
 	Q_strcpy_s (level.mapname, mapname);
 	Q_strcpy_s (game.spawnpoint, spawnpoint);
@@ -602,6 +604,7 @@ void SpawnEntities (const char *mapname, char *entities, const char *spawnpoint)
 		else
 			ent = G_Spawn ();
 		entities = ED_ParseEdict (entities, ent);
+		G_IndexNames (ent);
 
 		// remove things (except the world) from different skill levels or deathmatch
 		if (ent != g_edicts)
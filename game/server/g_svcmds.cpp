@@ -267,6 +267,14 @@ void	ServerCommand (void)
 		SVCmd_ListIP_f ();
 	else if (Q_stricmp (cmd, "writeip") == 0)
 		SVCmd_WriteIP_f ();
+	else if (Q_stricmp (cmd, "physbench") == 0)
+		Svcmd_PhysBench_f ();
+	else if (Q_stricmp (cmd, "findbench") == 0)
+		Svcmd_FindBench_f ();
+	else if (Q_stricmp (cmd, "spawnbench") == 0)
+		Svcmd_SpawnBench_f ();
+	else if (Q_stricmp (cmd, "thinkcheck") == 0)
+		Svcmd_ThinkCheck_f ();
 	else
 		gi.cprintf (NULL, PRINT_HIGH, "Unknown server command \"%s\"\n", cmd);
 }
@@ -0,0 +1,615 @@
+#include "g_local.h"
+
+#include "../../core/jobs.h"
+
+#include <vector>
+
+/*
+===================================================================================================
+
+	Think scheduling
+
+	What monsters spend their thinks on is looking: visible() towards the enemy, and towards
+	whoever FindTarget checks this frame. Those traces only read the world, so before the
+	entity loop every monster that's about to think has its sight lines traced on the job
+	pool. The thinks themselves still run one at a time in edict order, so linking, sounds,
+	spawns and damage all happen exactly where they always did, and nothing on the pool is
+	allowed to do any of them.
+
+	A precomputed answer is only handed out if the trace would go the same way now: both
+	ends have to be bit for bit where they were, and nothing that can block MASK_OPAQUE
+	(bmodels and physics bodies, boxes are CONTENTS_MONSTER) can have been linked since.
+	Pushers and team members never look ahead, nor does anything riding a pusher, they're
+	moved by others during the frame.
+
+	"sv thinkcheck" runs frames both ways from the same snapshot and compares hashes of the
+	results, see Svcmd_ThinkCheck_f.
+
+===================================================================================================
+*/
+
+#define MAX_SIGHT_LINES		3		// enemy, sight client and sight entity
+#define SIGHT_BATCH			8		// lines traced together by one job
+#define SIGHT_MIN_LINES		16		// fewer than this isn't worth waking the pool for
+
+enum thinkMode_t
+{
+	THINKMODE_CVAR,
+	THINKMODE_SERIAL,
+	THINKMODE_THREADED
+};
+
+struct sightLine_t
+{
+	int				other;					// edict number
+	vec3_t			start, end;
+	const edict_t *	owner;					// self->owner, which the trace skips
+	uint			generation;				// s_blockerGeneration when traced
+	qboolean		visible;
+};
+
+struct sightCache_t
+{
+	uint			frame;					// s_sight.frame when filled in
+	int				numLines;
+	sightLine_t		lines[MAX_SIGHT_LINES];
+};
+
+struct sightState_t
+{
+	sightCache_t *		caches;				// one per edict
+	traceRequest_t *	requests;
+	sightLine_t **		pending;			// where each request's answer goes
+	bool *				blocker;			// linked as something that blocks sight
+
+	uint				frame;
+	bool				active;				// during the entity loop only
+	bool				verify;				// trace anyway and compare, for thinkcheck
+
+	int					numTraced;
+	int					numReused;
+	int					numWrong;
+};
+
+static sightState_t		s_sight;
+static uint				s_blockerGeneration;
+static thinkMode_t		s_thinkMode;
+
+static thread_local bool	s_inThinkJob;
+
+/*
+========================
+G_InitThink
+
+The caches live in the game arena, so this has to follow every reset of it
+========================
+*/
+void G_InitThink()
+{
+	const int maxLines = game.maxentities * MAX_SIGHT_LINES;
+
+	s_sight.caches = Mem_ArenaAllocArray<sightCache_t>( g_gameArena, game.maxentities );
+	s_sight.requests = Mem_ArenaAllocArray<traceRequest_t>( g_gameArena, maxLines );
+	s_sight.pending = Mem_ArenaAllocArray<sightLine_t *>( g_gameArena, maxLines );
+	s_sight.blocker = Mem_ArenaAllocArray<bool>( g_gameArena, game.maxentities );
+
+	memset( s_sight.caches, 0, game.maxentities * sizeof( s_sight.caches[0] ) );
+	memset( s_sight.blocker, 0, game.maxentities * sizeof( s_sight.blocker[0] ) );
+
+	s_sight.active = false;
+	++s_blockerGeneration;
+}
+
+/*
+========================
+G_InThinkJob
+
+For the things that mustn't be called from the pool
+========================
+*/
+bool G_InThinkJob()
+{
+	return s_inThinkJob;
+}
+
+/*
+========================
+G_SightLinkChanged
+
+Called by the linking hooks, a bmodel or physics body going anywhere
+invalidates every precomputed sight line
+========================
+*/
+void G_SightLinkChanged( edict_t *ent, bool linked )
+{
+	if ( !s_sight.blocker ) {
+		return;
+	}
+
+	const int e = ent - g_edicts;
+	const bool blocker = linked && ( ent->solid == SOLID_BSP || ent->solid == SOLID_PHYSICS );
+
+	if ( blocker || s_sight.blocker[e] ) {
+		++s_blockerGeneration;
+	}
+
+	s_sight.blocker[e] = blocker;
+}
+
+/*
+========================
+G_SightSpots
+
+The same eye positions visible() uses
+========================
+*/
+static void G_SightSpots( const edict_t *self, const edict_t *other, vec3_t start, vec3_t end )
+{
+	VectorCopy( self->s.origin, start );
+	start[2] += self->viewheight;
+	VectorCopy( other->s.origin, end );
+	end[2] += other->viewheight;
+}
+
+/*
+========================
+G_CachedSight
+
+Returns what visible() would from a line traced ahead of time, or -1 when
+there isn't one or it might not hold any more
+========================
+*/
+int G_CachedSight( const edict_t *self, const edict_t *other, const vec3_t start, const vec3_t end )
+{
+	if ( !s_sight.active ) {
+		return -1;
+	}
+
+	const sightCache_t &cache = s_sight.caches[self - g_edicts];
+
+	if ( cache.frame != s_sight.frame ) {
+		return -1;
+	}
+
+	const int o = other - g_edicts;
+
+	for ( int i = 0; i < cache.numLines; ++i )
+	{
+		const sightLine_t &line = cache.lines[i];
+
+		if ( line.other != o ) {
+			continue;
+		}
+
+		if ( line.generation != s_blockerGeneration || line.owner != self->owner ||
+			!VectorCompare( line.start, start ) || !VectorCompare( line.end, end ) ) {
+			return -1;
+		}
+
+		++s_sight.numReused;
+
+		if ( s_sight.verify )
+		{
+			trace_t trace = gi.trace( const_cast<float *>( start ), vec3_origin, vec3_origin, const_cast<float *>( end ),
+				const_cast<edict_t *>( self ), MASK_OPAQUE );
+
+			if ( ( trace.fraction == 1.0f ) != ( line.visible != 0 ) )
+			{
+				gi.dprintf( S_COLOR_YELLOW "G_CachedSight: stale line from %d to %d\n", (int)( self - g_edicts ), o );
+				++s_sight.numWrong;
+			}
+		}
+
+		return line.visible;
+	}
+
+	return -1;
+}
+
+/*
+========================
+G_LooksAhead
+
+Whether an entity's sight lines can be traced before the loop gets to it
+========================
+*/
+static bool G_LooksAhead( const edict_t *ent )
+{
+	if ( !ent->inuse || ent->client || !( ent->svflags & SVF_MONSTER ) ) {
+		return false;
+	}
+	if ( ent->deadflag != DEAD_NO ) {
+		return false;
+	}
+
+	// pushers and teams move other entities, they stay strictly in order
+	if ( ent->movetype == MOVETYPE_PUSH || ent->movetype == MOVETYPE_STOP ) {
+		return false;
+	}
+	if ( ent->teammaster || ( ent->flags & FL_TEAMSLAVE ) ) {
+		return false;
+	}
+	if ( ent->groundentity && ent->groundentity->movetype == MOVETYPE_PUSH ) {
+		return false;
+	}
+
+	// the same test G_RunThink makes
+	return ent->nextthink > 0 && ent->nextthink <= level.time + 0.001f;
+}
+
+/*
+========================
+G_AddSightLine
+========================
+*/
+static void G_AddSightLine( edict_t *self, edict_t *other, bool nearOnly, int &numLines )
+{
+	if ( !other || other == self || !other->inuse ) {
+		return;
+	}
+
+	sightCache_t &cache = s_sight.caches[self - g_edicts];
+	const int o = other - g_edicts;
+
+	for ( int i = 0; i < cache.numLines; ++i )
+	{
+		if ( cache.lines[i].other == o ) {
+			return;
+		}
+	}
+
+	vec3_t delta;
+	VectorSubtract( self->s.origin, other->s.origin, delta );
+
+	// FindTarget gives up on anything at RANGE_FAR before it looks
+	if ( nearOnly && VectorLength( delta ) >= 1000.0f ) {
+		return;
+	}
+
+	sightLine_t &line = cache.lines[cache.numLines++];
+
+	line.other = o;
+	line.owner = self->owner;
+	line.generation = s_blockerGeneration;
+	line.visible = false;
+	G_SightSpots( self, other, line.start, line.end );
+
+	traceRequest_t &request = s_sight.requests[numLines];
+
+	VectorCopy( line.start, request.start );
+	VectorClear( request.mins );
+	VectorClear( request.maxs );
+	VectorCopy( line.end, request.end );
+	request.passent = self;
+	request.contentmask = MASK_OPAQUE;
+
+	s_sight.pending[numLines++] = &line;
+}
+
+/*
+========================
+G_PrepareThink
+
+Before the entity loop, traces the sight lines of every monster due to think
+========================
+*/
+void G_PrepareThink()
+{
+	s_sight.active = false;
+
+	if ( s_thinkMode == THINKMODE_SERIAL || ( s_thinkMode == THINKMODE_CVAR && !g_threadedThink->GetBool() ) ) {
+		return;
+	}
+
+	++s_sight.frame;
+
+	const bool sightEntity = level.sight_entity && level.sight_entity_framenum >= level.framenum - 1;
+	int numLines = 0;
+
+	for ( int e = game.maxclients + 1; e < globals.num_edicts; ++e )
+	{
+		edict_t *ent = &g_edicts[e];
+
+		if ( !G_LooksAhead( ent ) ) {
+			continue;
+		}
+
+		sightCache_t &cache = s_sight.caches[e];
+		cache.frame = s_sight.frame;
+		cache.numLines = 0;
+
+		G_AddSightLine( ent, ent->enemy, false, numLines );
+		G_AddSightLine( ent, level.sight_client, true, numLines );
+		if ( sightEntity ) {
+			G_AddSightLine( ent, level.sight_entity, true, numLines );
+		}
+	}
+
+	if ( numLines < SIGHT_MIN_LINES && s_thinkMode != THINKMODE_THREADED ) {
+		return;
+	}
+
+	Jobs_ParallelFor( ( numLines + SIGHT_BATCH - 1 ) / SIGHT_BATCH, [numLines]( int batch )
+	{
+		const int first = batch * SIGHT_BATCH;
+		const int count = Min( SIGHT_BATCH, numLines - first );
+		trace_t results[SIGHT_BATCH];
+
+		s_inThinkJob = true;
+
+		gi.traceBatch( s_sight.requests + first, count, results );
+
+		for ( int i = 0; i < count; ++i )
+		{
+			s_sight.pending[first + i]->visible = ( results[i].fraction == 1.0f );
+		}
+
+		s_inThinkJob = false;
+	} );
+
+	s_sight.numTraced += numLines;
+	s_sight.active = true;
+}
+
+/*
+========================
+G_FinishThink
+
+After the entity loop, visible() calls from anywhere else always trace
+========================
+*/
+void G_FinishThink()
+{
+	s_sight.active = false;
+}
+
+/*
+===================================================================================================
+
+	Determinism check
+
+===================================================================================================
+*/
+
+extern int trail_head;
+
+struct thinkSnapshot_t
+{
+	std::vector<edict_t>	edicts;
+	std::vector<gclient_t>	clients;
+	std::vector<bool>		linked;
+	game_locals_t			game;
+	level_locals_t			level;
+	int						numEdicts;
+	int						trailHead;
+};
+
+// FNV-1a over the parts of the game a frame can change
+struct frameHash_t
+{
+	uint32 value = 2166136261u;
+
+	void Bytes( const void *data, size_t size )
+	{
+		const byte *bytes = static_cast<const byte *>( data );
+		for ( size_t i = 0; i < size; ++i )
+		{
+			value = ( value ^ bytes[i] ) * 16777619u;
+		}
+	}
+
+	template< typename T >
+	void Add( const T &x )
+	{
+		Bytes( &x, sizeof( x ) );
+	}
+
+	void AddEdict( const edict_t *ent )
+	{
+		const int e = ent ? (int)( ent - g_edicts ) : -1;
+		Add( e );
+	}
+};
+
+/*
+========================
+G_FrameHash
+========================
+*/
+static uint32 G_FrameHash()
+{
+	frameHash_t hash;
+
+	hash.Add( globals.num_edicts );
+	hash.Add( level.framenum );
+	hash.AddEdict( level.sight_entity );
+	hash.Add( level.sight_entity_framenum );
+	hash.AddEdict( level.sound_entity );
+	hash.AddEdict( level.sound2_entity );
+	hash.Add( level.killed_monsters );
+	hash.Add( level.found_goals );
+
+	for ( int e = 0; e < globals.num_edicts; ++e )
+	{
+		const edict_t *ent = &g_edicts[e];
+
+		hash.Add( ent->inuse );
+		if ( !ent->inuse ) {
+			continue;
+		}
+
+		hash.Add( ent->s );
+		hash.Add( ent->velocity );
+		hash.Add( ent->avelocity );
+		hash.Add( ent->solid );
+		hash.Add( ent->svflags );
+		hash.Add( ent->flags );
+		hash.Add( ent->movetype );
+		hash.Add( ent->health );
+		hash.Add( ent->deadflag );
+		hash.Add( ent->nextthink );
+		hash.Add( ent->think );
+		hash.Add( ent->ideal_yaw );
+		hash.AddEdict( ent->enemy );
+		hash.AddEdict( ent->goalentity );
+		hash.AddEdict( ent->movetarget );
+		hash.AddEdict( ent->groundentity );
+
+		const monsterinfo_t &info = ent->monsterinfo;
+		hash.Add( info.currentmove );
+		hash.Add( info.aiflags );
+		hash.Add( info.nextframe );
+		hash.Add( info.pausetime );
+		hash.Add( info.attack_finished );
+		hash.Add( info.search_time );
+		hash.Add( info.trail_time );
+		hash.Add( info.last_sighting );
+		hash.Add( info.attack_state );
+		hash.Add( info.idle_time );
+
+		if ( ent->client )
+		{
+			const gclient_t *client = ent->client;
+			hash.Add( client->ps.pmove.origin );
+			hash.Add( client->ps.pmove.velocity );
+			hash.Add( client->ps.stats );
+			hash.Add( client->ps.gunframe );
+			hash.Add( client->resp.score );
+		}
+	}
+
+	return hash.value;
+}
+
+/*
+========================
+G_TakeSnapshot
+========================
+*/
+static void G_TakeSnapshot( thinkSnapshot_t &snap )
+{
+	snap.edicts.assign( g_edicts, g_edicts + game.maxentities );
+	snap.clients.assign( game.clients, game.clients + game.maxclients );
+	snap.linked.resize( game.maxentities );
+	for ( int e = 0; e < game.maxentities; ++e )
+	{
+		snap.linked[e] = g_edicts[e].area.prev != nullptr;
+	}
+	snap.game = game;
+	snap.level = level;
+	snap.numEdicts = globals.num_edicts;
+	snap.trailHead = trail_head;
+}
+
+/*
+========================
+G_RestoreSnapshot
+
+Puts the game back as it was and relinks everything in edict order, so the
+server's sector lists come out the same every time it's done from one snapshot
+========================
+*/
+static void G_RestoreSnapshot( const thinkSnapshot_t &snap )
+{
+	for ( int e = 0; e < globals.num_edicts; ++e )
+	{
+		if ( g_edicts[e].area.prev ) {
+			gi.unlinkentity( &g_edicts[e] );
+		}
+	}
+
+	memcpy( g_edicts, snap.edicts.data(), game.maxentities * sizeof( edict_t ) );
+	memcpy( game.clients, snap.clients.data(), game.maxclients * sizeof( gclient_t ) );
+	game = snap.game;
+	level = snap.level;
+	globals.num_edicts = snap.numEdicts;
+	trail_head = snap.trailHead;
+
+	for ( int e = 0; e < game.maxentities; ++e )
+	{
+		edict_t *ent = &g_edicts[e];
+
+		ent->area.prev = ent->area.next = nullptr;
+
+		if ( snap.linked[e] )
+		{
+			// linking bumps the count, which would look like movement to anything standing on it
+			const int linkcount = ent->linkcount;
+			gi.linkentity( ent );
+			ent->linkcount = linkcount;
+		}
+	}
+
+	G_RebuildEntityIndex();
+	G_ResetFreeEdicts();
+}
+
+/*
+========================
+Svcmd_ThinkCheck_f
+
+Runs frames serially and with the sight lines threaded, starting from the
+same state each time, and compares the hashes. Only the thinking part of the
+frame runs, physics doesn't step and nobody gets a snapshot, and anything
+the thinks send out goes out twice
+========================
+*/
+void Svcmd_ThinkCheck_f()
+{
+	int numFrames = ( gi.argc() > 2 ) ? atoi( gi.argv( 2 ) ) : 10;
+	numFrames = Clamp( numFrames, 1, 600 );
+
+	if ( !g_edicts || level.intermissiontime || level.exitintermission )
+	{
+		gi.cprintf( nullptr, PRINT_HIGH, "Nothing to check outside of a running level\n" );
+		return;
+	}
+
+	thinkSnapshot_t snap;
+	double msec[2] = { 0.0, 0.0 };
+	int numDiffering = 0;
+
+	s_sight.verify = true;
+	s_sight.numTraced = s_sight.numReused = s_sight.numWrong = 0;
+
+	for ( int frame = 0; frame < numFrames; ++frame )
+	{
+		G_TakeSnapshot( snap );
+
+		const uint seed = (uint)level.framenum;
+		uint32 hash[2];
+
+		for ( int pass = 0; pass < 2; ++pass )
+		{
+			G_RestoreSnapshot( snap );
+			srand( seed );
+
+			s_thinkMode = ( pass == 0 ) ? THINKMODE_SERIAL : THINKMODE_THREADED;
+
+			const double start = Time_FloatMilliseconds();
+
+			level.framenum++;
+			level.time = level.framenum * FRAMETIME;
+			G_CompactEdicts();
+			AI_SetSightClient();
+			G_ThinkEntities();
+
+			msec[pass] += Time_FloatMilliseconds() - start;
+			hash[pass] = G_FrameHash();
+		}
+
+		if ( hash[0] != hash[1] )
+		{
+			gi.cprintf( nullptr, PRINT_HIGH, "frame %d: serial %08x, threaded %08x\n", level.framenum, hash[0], hash[1] );
+			++numDiffering;
+		}
+	}
+
+	s_thinkMode = THINKMODE_CVAR;
+	s_sight.verify = false;
+
+	gi.cprintf( nullptr, PRINT_HIGH, "%d frames, %d differed\n", numFrames, numDiffering );
+	gi.cprintf( nullptr, PRINT_HIGH, "%d sight lines traced ahead, %d used, %d stale\n", s_sight.numTraced, s_sight.numReused, s_sight.numWrong );
+	gi.cprintf( nullptr, PRINT_HIGH, "serial: %.3f ms per frame, threaded: %.3f ms per frame (checking included)\n",
+		msec[0] / numFrames, msec[1] / numFrames );
+}
@@ -2,6 +2,9 @@
 
 #include "g_local.h"
 
+#include <random>
+#include <vector>
+
 
 void G_ProjectSource (vec3_t point, vec3_t distance, vec3_t forward, vec3_t right, vec3_t result)
 {
@@ -11,77 +14,6 @@ void G_ProjectSource (vec3_t point, vec3_t distance, vec3_t forward, vec3_t righ
 }
 
 
-/*
-=============
-G_Find
-
-Searches all active entities for the next one that holds
-the matching string at fieldofs (use the FOFS() macro) in the structure.
-
-Searches beginning at the edict after from, or the beginning if NULL
-NULL will be returned if the end of the list is reached.
-
-=============
-*/
-edict_t *G_Find (edict_t *from, int fieldofs, const char *match)
-{
-	char	*s;
-
-	if (!from)
-		from = g_edicts;
-	else
-		from++;
-
-	for ( ; from < &g_edicts[globals.num_edicts] ; from++)
-	{
-		if (!from->inuse)
-			continue;
-		s = *(char **) ((byte *)from + fieldofs);
-		if (!s)
-			continue;
-		if (!Q_stricmp (s, match))
-			return from;
-	}
-
-	return NULL;
-}
-
-
-/*
-=================
-findradius
-
-Returns entities that have origins within a spherical area
-
-findradius (origin, radius)
-=================
-*/
-edict_t *findradius (edict_t *from, vec3_t org, float rad)
-{
-	vec3_t	eorg;
-	int		j;
-
-	if (!from)
-		from = g_edicts;
-	else
-		from++;
-	for ( ; from < &g_edicts[globals.num_edicts]; from++)
-	{
-		if (!from->inuse)
-			continue;
-		if (from->solid == SOLID_NOT)
-			continue;
-		for (j=0 ; j<3 ; j++)
-			eorg[j] = org[j] - (from->s.origin[j] + (from->mins[j] + from->maxs[j])*0.5f);
-		if (VectorLength(eorg) > rad)
-			continue;
-		return from;
-	}
-
-	return NULL;
-}
-
-
 /*
 =============
 G_PickTarget
@@ -162,7 +94,7 @@ void G_UseTargets (edict_t *ent, edict_t *activator)
 	{
 	// create a temp object to fire at a later time
 		t = G_Spawn();
-		t->classname = "DelayedUse";
+		G_SetClassname (t, "DelayedUse");
 		t->nextthink = level.time + ent->delay;
 		t->think = Think_Delay;
 		t->activator = activator;
@@ -373,43 +305,183 @@ void vectoangles( const vec3_t value1, vec3_t angles )
 void G_InitEdict (edict_t *e)
 {
 	e->inuse = true;
-	e->classname = "noclass";
+	G_SetClassname (e, "noclass");
 	e->gravity = 1.0;
 	e->s.number = e - g_edicts;
 }
 
+/*
+==============================================================================
+
+Edict allocation
+
+Freed edicts queue up oldest first, so the front of the queue is always the
+next one that's safe to reuse and nothing behind it can be if it isn't.
+Each entry remembers the freetime it was queued with, an edict that has been
+grown back into and freed again since no longer matches and goes to the back
+
+==============================================================================
+*/
+
+struct freeEdicts_t
+{
+	int *	queue;		// a ring of edict numbers, game.maxentities long
+	float *	queueTime;	// freetime of each edict when it was queued
+	bool *	queued;		// has an entry in the ring, current or not
+	int		head;
+	int		count;
+};
+
+static freeEdicts_t	s_freeEdicts;
+
 /*
 =================
-G_Spawn
+G_EdictReusable
 
-Either finds a free edict, or allocates a new one.
 Try to avoid reusing an entity that was recently freed, because it
 can cause the client to think the entity morphed into something else
 instead of being removed and recreated, which can cause interpolated
 angles and bad trails.
 =================
 */
+static bool G_EdictReusable (const edict_t *e)
+{
+	// the first couple seconds of server time can involve a lot of
+	// freeing and allocating, so relax the replacement policy
+	return e->freetime < 2 || level.time - e->freetime > 0.5f;
+}
+
+static void G_PushFreeEdict (int num)
+{
+	freeEdicts_t &freeList = s_freeEdicts;
+	const int slot = (freeList.head + freeList.count) % game.maxentities;
+
+	freeList.queue[slot] = num;
+	freeList.queueTime[slot] = g_edicts[num].freetime;
+	freeList.queued[num] = true;
+	freeList.count++;
+}
+
+static void G_QueueFreeEdict (int num)
+{
+	// freed again before its old entry came up, that
+	// entry will see the new freetime and move back
+	if (s_freeEdicts.queued[num])
+		return;
+
+	G_PushFreeEdict (num);
+}
+
+/*
+=================
+G_InitEdictAllocator
+
+The queue lives in the game arena, so this has to follow every reset of it
+=================
+*/
+void G_InitEdictAllocator (void)
+{
+	s_freeEdicts.queue = Mem_ArenaAllocArray<int> (g_gameArena, game.maxentities);
+	s_freeEdicts.queueTime = Mem_ArenaAllocArray<float> (g_gameArena, game.maxentities);
+	s_freeEdicts.queued = Mem_ArenaAllocArray<bool> (g_gameArena, game.maxentities);
+	s_freeEdicts.head = 0;
+	s_freeEdicts.count = 0;
+	memset (s_freeEdicts.queued, 0, game.maxentities * sizeof (s_freeEdicts.queued[0]));
+}
+
+/*
+=================
+G_ResetFreeEdicts
+
+Queues up every free edict, for after the edicts have been wiped or loaded
+=================
+*/
+void G_ResetFreeEdicts (void)
+{
+	s_freeEdicts.head = 0;
+	s_freeEdicts.count = 0;
+	memset (s_freeEdicts.queued, 0, game.maxentities * sizeof (s_freeEdicts.queued[0]));
+
+	for (int i = maxclients->GetInt() + 1 ; i < globals.num_edicts ; i++)
+	{
+		if (!g_edicts[i].inuse)
+			G_QueueFreeEdict (i);
+	}
+}
+
+/*
+=================
+G_CompactEdicts
+
+Gives back the free edicts at the end of the list, once they're old enough
+that growing into them again would be safe.  Called once a frame
+=================
+*/
+void G_CompactEdicts (void)
+{
+	const int first = maxclients->GetInt() + 1;
+
+	while (globals.num_edicts > first)
+	{
+		const edict_t *e = &g_edicts[globals.num_edicts - 1];
+		if (e->inuse || !G_EdictReusable (e))
+			break;
+		globals.num_edicts--;
+	}
+}
+
+/*
+=================
+G_Spawn
+
+Either finds a free edict, or allocates a new one.
+=================
+*/
 edict_t *G_Spawn (void)
 {
-	int			i;
-	edict_t		*e;
+	freeEdicts_t	&freeList = s_freeEdicts;
+	edict_t			*e;
 
-	e = &g_edicts[maxclients->GetInt() + 1];
-	for ( i=maxclients->GetInt() + 1 ; i<globals.num_edicts ; i++, e++)
+	AssertMsg (!G_InThinkJob (), "G_Spawn from a think job");
+
+	while (freeList.count)
 	{
-		// the first couple seconds of server time can involve a lot of
-		// freeing and allocating, so relax the replacement policy
-		if (!e->inuse && ( e->freetime < 2 || level.time - e->freetime > 0.5f ) )
+		const int num = freeList.queue[freeList.head];
+		const float queueTime = freeList.queueTime[freeList.head];
+		e = &g_edicts[num];
+
+		// compacted away or grown back into since, either way it's
+		// not ours to hand out
+		const bool stale = num >= globals.num_edicts || e->inuse;
+
+		// freed again after growing back into it, it's only as old as that
+		const bool requeue = !stale && e->freetime != queueTime;
+
+		// the oldest isn't ready, so nothing is
+		if (!stale && !requeue && !G_EdictReusable (e))
+			break;
+
+		freeList.head = (freeList.head + 1) % game.maxentities;
+		freeList.count--;
+		freeList.queued[num] = false;
+
+		if (stale)
+			continue;
+
+		if (requeue)
 		{
-			G_InitEdict (e);
-			return e;
+			G_PushFreeEdict (num);
+			continue;
 		}
+
+		G_InitEdict (e);
+		return e;
 	}
-	
-	if (i == game.maxentities)
+
+	if (globals.num_edicts == game.maxentities)
 		gi.error ("ED_Alloc: no free edicts");
-		
-	globals.num_edicts++;
+
+	e = &g_edicts[globals.num_edicts++];
 	G_InitEdict (e);
 	return e;
 }
@@ -436,10 +508,14 @@ void G_FreeEdict (edict_t *ed)
 		gi.physScene->RemoveAndDestroyBody( ed->pPhysBody );
 	}
 
+	G_RemoveFromIndex (ed);
+
 	memset (ed, 0, sizeof(*ed));
 	ed->classname = "freed";
 	ed->freetime = level.time;
 	ed->inuse = false;
+
+	G_QueueFreeEdict (ed - g_edicts);
 }
 
 
@@ -541,3 +617,158 @@ qboolean KillBox (edict_t *ent)
 
 	return true;		// all clear
 }
+
+
+/*
+==============================================================================
+
+Allocation benchmark
+
+==============================================================================
+*/
+
+#define SPAWNBENCH_RESERVE	64		// edicts left alone for everything else
+
+struct spawnBenchEnt_t
+{
+	edict_t *	ent;
+	float		expires;
+};
+
+/*
+========================
+G_SpawnLinear
+
+How G_Spawn used to find a free edict, walking all of them
+========================
+*/
+static edict_t *G_SpawnLinear()
+{
+	int i = maxclients->GetInt() + 1;
+	edict_t *e = &g_edicts[i];
+
+	for ( ; i < globals.num_edicts; i++, e++ )
+	{
+		if ( !e->inuse && G_EdictReusable( e ) )
+		{
+			G_InitEdict( e );
+			return e;
+		}
+	}
+
+	if ( i == game.maxentities ) {
+		gi.error( "ED_Alloc: no free edicts" );
+	}
+
+	globals.num_edicts++;
+	G_InitEdict( e );
+	return e;
+}
+
+static void G_RunSpawnBench( bool linear, int perFrame, int numFrames, double &msec, int &numSpawns, int &peakEdicts )
+{
+	// the same fight both times
+	std::mt19937 rng( 1 );
+	std::uniform_real_distribution<float> gibLife( 0.5f, 2.0f );
+	std::uniform_real_distribution<float> projectileLife( 0.1f, 1.0f );
+
+	std::vector<spawnBenchEnt_t> live;
+	const int maxLive = game.maxentities - globals.num_edicts - SPAWNBENCH_RESERVE;
+
+	const float startTime = level.time;
+	numSpawns = 0;
+	peakEdicts = globals.num_edicts;
+
+	const double start = Time_FloatMilliseconds();
+
+	for ( int frame = 0; frame < numFrames; ++frame )
+	{
+		level.time = startTime + frame * FRAMETIME;
+
+		if ( !linear ) {
+			G_CompactEdicts();
+		}
+
+		for ( size_t i = 0; i < live.size(); )
+		{
+			if ( live[i].expires > level.time )
+			{
+				++i;
+				continue;
+			}
+			G_FreeEdict( live[i].ent );
+			live[i] = live.back();
+			live.pop_back();
+		}
+
+		for ( int i = 0; i < perFrame && (int)live.size() < maxLive; ++i )
+		{
+			edict_t *ent = linear ? G_SpawnLinear() : G_Spawn();
+
+			// half gibs, half rockets and blaster bolts
+			const bool gib = ( i & 1 ) != 0;
+			G_SetClassname( ent, gib ? "gib" : "rocket" );
+
+			live.push_back( { ent, level.time + ( gib ? gibLife( rng ) : projectileLife( rng ) ) } );
+			++numSpawns;
+		}
+
+		peakEdicts = Max( peakEdicts, globals.num_edicts );
+	}
+
+	msec = Time_FloatMilliseconds() - start;
+
+	for ( spawnBenchEnt_t &benchEnt : live ) {
+		G_FreeEdict( benchEnt.ent );
+	}
+
+	// none of it happened as far as the clients know, so don't hold the edicts back
+	level.time = startTime;
+	for ( int i = maxclients->GetInt() + 1; i < globals.num_edicts; ++i )
+	{
+		if ( !g_edicts[i].inuse && g_edicts[i].freetime > level.time ) {
+			g_edicts[i].freetime = 0;
+		}
+	}
+}
+
+/*
+========================
+Svcmd_SpawnBench_f
+
+sv spawnbench [perframe] [seconds]
+
+Spawns and frees gibs and projectiles as a heavy fight would, through the
+old linear search for a free edict and then the free queue
+========================
+*/
+void Svcmd_SpawnBench_f()
+{
+	int perFrame = ( gi.argc() > 2 ) ? atoi( gi.argv( 2 ) ) : 32;
+	float seconds = ( gi.argc() > 3 ) ? (float)atof( gi.argv( 3 ) ) : 30.0f;
+
+	perFrame = Clamp( perFrame, 1, 1024 );
+	seconds = Clamp( seconds, FRAMETIME, 600.0f );
+
+	if ( game.maxentities - globals.num_edicts - SPAWNBENCH_RESERVE < 1 )
+	{
+		gi.cprintf( nullptr, PRINT_HIGH, "Not enough free edicts for a benchmark\n" );
+		return;
+	}
+
+	const int numFrames = (int)( seconds / FRAMETIME + 0.5f );
+	const int numEdicts = globals.num_edicts;
+
+	double msec[2];
+	int numSpawns[2];
+	int peakEdicts[2];
+
+	G_RunSpawnBench( true, perFrame, numFrames, msec[0], numSpawns[0], peakEdicts[0] );
+	G_RunSpawnBench( false, perFrame, numFrames, msec[1], numSpawns[1], peakEdicts[1] );
+
+	gi.cprintf( nullptr, PRINT_HIGH, "%d frames, up to %d spawns a frame, %d edicts to start with\n", numFrames, perFrame, numEdicts );
+	gi.cprintf( nullptr, PRINT_HIGH, "linear:     %.3f ms per frame, %.1f ns per spawn, %d edicts at peak\n",
+		msec[0] / numFrames, msec[0] * 1000000.0 / Max( numSpawns[0], 1 ), peakEdicts[0] );
+	gi.cprintf( nullptr, PRINT_HIGH, "free queue: %.3f ms per frame, %.1f ns per spawn, %d edicts at peak\n",
+		msec[1] / numFrames, msec[1] * 1000000.0 / Max( numSpawns[1], 1 ), peakEdicts[1] );
+}
@@ -563,7 +563,7 @@ void SP_monster_flyer (edict_t *self)
 	// SlartHack
 	if (!Q_stricmp(level.mapname, "jail5") && (self->s.origin[2] == -104))
 	{
-		self->targetname = self->target;
+		G_SetTargetname (self, self->target);
 		self->target = NULL;
 	}
 
@@ -593,7 +593,7 @@ void medic_cable_attack (edict_t *self)
 		self->enemy->spawnflags = 0;
 		self->enemy->monsterinfo.aiflags = 0;
 		self->enemy->target = NULL;
-		self->enemy->targetname = NULL;
+		G_SetTargetname (self->enemy, NULL);
 		self->enemy->combattarget = NULL;
 		self->enemy->deathtarget = NULL;
 		self->enemy->owner = self;
@@ -14,6 +14,15 @@ void CPhysicsBody::GetPositionAndRotation( vec3_t position, vec3_t rotation )
 	JoltQuatToQuakeEuler( jphRotation, rotation );
 }
 
+void CPhysicsBody::GetInterpolatedPositionAndRotation( float fraction, vec3_t position, vec3_t rotation )
+{
+	JPH::Vec3 jphPosition = m_previousPosition + ( m_pBody->GetPosition() - m_previousPosition ) * fraction;
+	JPH::Quat jphRotation = m_previousRotation.SLERP( m_pBody->GetRotation(), fraction );
+
+	JoltPositionToQuake( jphPosition, position );
+	JoltQuatToQuakeEuler( jphRotation, rotation );
+}
+
 //-------------------------------------------------------------------------------------------------
 
 void CPhysicsBody::SetLinearAndAngularVelocity( const vec3_t velocity, const vec3_t avelocity )
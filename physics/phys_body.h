@@ -7,9 +7,11 @@ class CPhysicsBody final : public IPhysicsBody
 {
 public:
 	CPhysicsBody( JPH::Body *pBody, JPH::PhysicsSystem *pPhysicsSystem )
-		: m_pBody( pBody ), m_pPhysicsSystem( pPhysicsSystem ) {}
+		: m_pBody( pBody ), m_pPhysicsSystem( pPhysicsSystem ),
+		m_previousPosition( pBody->GetPosition() ), m_previousRotation( pBody->GetRotation() ) {}
 
 	void GetPositionAndRotation( vec3_t position, vec3_t rotation ) override;
+	void GetInterpolatedPositionAndRotation( float fraction, vec3_t position, vec3_t rotation ) override;
 
 	void SetLinearAndAngularVelocity( const vec3_t velocity, const vec3_t avelocity ) override;
 	void GetLinearAndAngularVelocity( vec3_t velocity, vec3_t avelocity ) override;
@@ -21,10 +23,20 @@ public:
 	JPH::BodyID GetBodyID() { return m_pBody->GetID(); }
 	JPH::Body *GetBody() { return m_pBody; }
 
+	// Called before the last step of a Simulate
+	void SavePreviousTransform()
+	{
+		m_previousPosition = m_pBody->GetPosition();
+		m_previousRotation = m_pBody->GetRotation();
+	}
+
 private:
 	JPH::Body *m_pBody;
 	JPH::PhysicsSystem *m_pPhysicsSystem;
 
+	JPH::Vec3 m_previousPosition;
+	JPH::Quat m_previousRotation;
+
 };
 
 } // namespace PhysicsPrivate
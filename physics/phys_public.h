@@ -6,6 +6,8 @@
 
 #include "../common/q_shared.h" // trace_t
 
+#include <vector>
+
 enum motionType_t : uint8
 {
 	MOTION_STATIC,
@@ -47,6 +49,19 @@ struct rayCast_t
 	}
 };
 
+// One convex hull out of the points passed alongside it, for building static world collision
+struct physConvexHull_t
+{
+	int firstPoint;
+	int numPoints;
+	int region;					// Hulls sharing a region are grouped into one sub compound
+};
+
+// Layer masks for scene queries
+inline constexpr uint32 PHYS_LAYER_STATIC = BIT( 0 );	// The world and anything else that never moves
+inline constexpr uint32 PHYS_LAYER_MOVING = BIT( 1 );
+inline constexpr uint32 PHYS_LAYER_ALL = PHYS_LAYER_STATIC | PHYS_LAYER_MOVING;
+
 // Forward declarations
 class IPhysicsScene;
 class IPhysicsShape;
@@ -66,11 +81,22 @@ public:
 	virtual void DestroyScene( IPhysicsScene *pScene ) = 0;
 
 	// Create / destroy various shapes
+	// The caller owns a reference to what comes back, DestroyShape releases it.
+	// Bodies hold their own, so a shape can be destroyed while bodies still use it
 	virtual IPhysicsShape *CreateBoxShape( vec3_t halfExtent ) = 0;
 	virtual IPhysicsShape *CreateSphereShape( float radius ) = 0;
-	//virtual IPhysicsShape *CreateMeshShape( JPH::VertexList &vertexList, JPH::IndexedTriangleList &indexList ) = 0;
+	virtual IPhysicsShape *CreateMeshShape( const vec3_t *vertices, int numVertices, const int *indices, int numTriangles ) = 0;
+	// A static compound of convex hulls, returns nullptr if none of them were valid
+	virtual IPhysicsShape *CreateStaticHullCompound( const physConvexHull_t *hulls, int numHulls, const vec3_t *points ) = 0;
 	virtual void DestroyShape( IPhysicsShape *pShape ) = 0;
 
+	// Jolt's binary format including all child shapes, only good for the same version of Jolt
+	virtual bool SaveShape( const IPhysicsShape *pShape, std::vector<byte> &data ) = 0;
+	virtual IPhysicsShape *LoadShape( const byte *data, size_t size ) = 0;
+
+	// Bytes used by a shape and all its children
+	virtual size_t GetShapeMemoryUsage( const IPhysicsShape *pShape ) = 0;
+
 	virtual void Trace( const rayCast_t &rayCast, const IPhysicsShape *shapeHandle, const vec3_t shapeOrigin, const vec3_t shapeAngles, trace_t &trace ) = 0;
 
 };
@@ -81,13 +107,29 @@ public:
 abstract_class IPhysicsScene
 {
 public:
+	// Steps the scene at a fixed rate, time that doesn't add up to a whole step carries over to the next call
 	virtual void Simulate( float deltaTime ) = 0;
 
+	// stepRate in Hz, each step runs collisionSteps rounds of collision detection,
+	// a single Simulate never takes more than maxSteps and drops the time it couldn't get to
+	virtual void SetStepRate( float stepRate, int collisionSteps, int maxSteps ) = 0;
+
+	// How far the leftover time is into the next step, 0 to 1. Interpolating bodies by this
+	// between their last two steps hides the steps not lining up with Simulate calls
+	virtual float GetInterpolationFraction() = 0;
+
 	virtual IPhysicsBody *CreateAndAddBody( const bodyCreationSettings_t &settings, IPhysicsShape *pShape, void *pUserData ) = 0;
-	virtual void CreateAndAddBody_World( void *vertexList, void *indexList ) = 0; // HACK
+	// Replaces the static world body with one using pShape, null just removes it
+	virtual void SetWorldShape( IPhysicsShape *pShape ) = 0;
 	virtual void SetWorldBodyUserData( void *pUserData ) = 0; // HACK
 	virtual void RemoveAndDestroyBody( IPhysicsBody *pBody ) = 0;
 
+	// Traces every request against all the bodies in layerMask at once through the broadphase,
+	// results[i] is for requests[i]. Bodies whose user data is the passent are skipped and
+	// trace.ent is set to the user data of the body hit. Requests without CONTENTS_SOLID
+	// in their contentmask don't hit anything
+	virtual void TraceBatch( const traceRequest_t *requests, int count, uint32 layerMask, trace_t *results ) = 0;
+
 	// Returns the JPH::PhysicsSystem
 	virtual void *GetInternalStructure() = 0;
 
@@ -111,6 +153,8 @@ abstract_class IPhysicsBody
 {
 public:
 	virtual void GetPositionAndRotation( vec3_t position, vec3_t rotation ) = 0;
+	// Between the previous step and the current one, see IPhysicsScene::GetInterpolationFraction
+	virtual void GetInterpolatedPositionAndRotation( float fraction, vec3_t position, vec3_t rotation ) = 0;
 
 	virtual void SetLinearAndAngularVelocity( const vec3_t velocity, const vec3_t avelocity ) = 0;
 	virtual void GetLinearAndAngularVelocity( vec3_t velocity, vec3_t avelocity ) = 0;
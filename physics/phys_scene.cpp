@@ -7,6 +7,8 @@
 
 #include "phys_scene.h"
 
+#include <algorithm>
+
 namespace PhysicsPrivate {
 
 //-------------------------------------------------------------------------------------------------
@@ -100,7 +102,6 @@ public:
 
 	void OnContactAdded( const JPH::Body &inBody1, const JPH::Body &inBody2, const JPH::ContactManifold &inManifold, JPH::ContactSettings &ioSettings ) override
 	{
-		Com_Print( "A contact was added\n" );
 #if 0
 		Com_DPrint( "A contact was added\n" );
 
@@ -185,16 +186,42 @@ CPhysicsScene::~CPhysicsScene()
 
 void CPhysicsScene::Simulate( float deltaTime )
 {
-	// We simulate the physics world in discrete time steps. 60 Hz is a good rate to update the physics system.
-	constexpr float cDeltaTime = 1.0f / 60.0f;
-
 	CPhysicsSystem *pSys = CPhysicsSystem::GetInstance();
 
-	constexpr uint numSteps = 8;
-	for ( uint step = 0; step < numSteps; ++step )
+	m_accumulator += deltaTime;
+
+	int numSteps = static_cast<int>( ( m_accumulator + cStepEpsilon ) / m_stepTime );
+	m_accumulator = Max( m_accumulator - numSteps * m_stepTime, 0.0 );
+
+	if ( numSteps > m_maxSteps )
+	{
+		// We can't keep up, lose the time rather than falling further behind every frame
+		numSteps = m_maxSteps;
+		m_accumulator = 0.0;
+	}
+
+	for ( int step = 0; step < numSteps; ++step )
 	{
-		m_physicsSystem.Update( cDeltaTime, 1, 1, pSys->GetTempAllocator(), pSys->GetJobSystem() );
+		// Interpolation only ever looks at the last two steps
+		if ( step == numSteps - 1 )
+		{
+			for ( CPhysicsBody *pBody : m_bodies )
+			{
+				pBody->SavePreviousTransform();
+			}
+		}
+
+		m_physicsSystem.Update( static_cast<float>( m_stepTime ), m_collisionSteps, 1, pSys->GetTempAllocator(), pSys->GetJobSystem() );
 	}
+
+	m_interpolationFraction = static_cast<float>( Min( m_accumulator / m_stepTime, 1.0 ) );
+}
+
+void CPhysicsScene::SetStepRate( float stepRate, int collisionSteps, int maxSteps )
+{
+	m_stepTime = 1.0 / Clamp( stepRate, 10.0f, 1000.0f );
+	m_collisionSteps = Max( collisionSteps, 1 );
+	m_maxSteps = Max( maxSteps, 1 );
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -232,49 +259,57 @@ IPhysicsBody *CPhysicsScene::CreateAndAddBody( const bodyCreationSettings_t &set
 
 	bodyInterface.AddBody( pBody->GetID(), activationState );
 
-	return new CPhysicsBody( pBody, &m_physicsSystem );
+	CPhysicsBody *pBodyInternal = new CPhysicsBody( pBody, &m_physicsSystem );
+	m_bodies.push_back( pBodyInternal );
+
+	return pBodyInternal;
 }
 
-void CPhysicsScene::CreateAndAddBody_World( void *secretVertexList, void *secretIndexList )
+void CPhysicsScene::SetWorldShape( IPhysicsShape *pShape )
 {
-	JPH::VertexList &vertexList = *reinterpret_cast<JPH::VertexList *>( secretVertexList );
-	JPH::IndexedTriangleList &indexList = *reinterpret_cast<JPH::IndexedTriangleList *>( secretIndexList );
+	JPH::BodyInterface &bodyInterface = m_physicsSystem.GetBodyInterfaceNoLock();
 
-	for ( JPH::Float3 &vert : vertexList )
+	if ( m_pWorldBody )
 	{
-		vert.x = QuakeToJolt( vert.x );
-		vert.y = QuakeToJolt( vert.y );
-		vert.z = QuakeToJolt( vert.z );
+		bodyInterface.RemoveBody( m_pWorldBody->GetID() );
+		bodyInterface.DestroyBody( m_pWorldBody->GetID() );
+		m_pWorldBody = nullptr;
 	}
 
-	// The main way to interact with the bodies in the physics system is through the body interface. There is a locking and a non-locking
-	// variant of this. We're going to use the locking version (even though we're not planning to access bodies from multiple threads)
-	JPH::BodyInterface &bodyInterface = m_physicsSystem.GetBodyInterfaceNoLock();
-
-	// Next we can create a rigid body to serve as the floor, we make a large box
-	// Create the settings for the collision volume (the shape). 
-	// Note that for simple shapes (like boxes) you can also directly construct a BoxShape.
-	JPH::MeshShapeSettings meshShapeSettings( vertexList, indexList );
+	if ( !pShape )
+	{
+		return;
+	}
 
-	// Create the shape
-	JPH::ShapeSettings::ShapeResult meshShapeResult = meshShapeSettings.Create();
-	JPH::ShapeRefC meshShape = meshShapeResult.Get(); // We don't expect an error here, but you can check floor_shape_result for HasError() / GetError()
+	// The body takes its own reference to the shape
+	JPH::BodyCreationSettings worldCreationSettings( reinterpret_cast<const JPH::Shape *>( pShape ), JPH::Vec3::sZero(), JPH::Quat::sIdentity(), JPH::EMotionType::Static, Layers::NON_MOVING );
 
-	// Create the settings for the body itself. Note that here you can also set other properties like the restitution / friction.
-	JPH::BodyCreationSettings meshCreationSettings( meshShape, JPH::Vec3::sZero(), JPH::Quat::sIdentity(), JPH::EMotionType::Static, Layers::NON_MOVING );
+	// Note that if we run out of bodies this can return nullptr
+	JPH::Body *body = bodyInterface.CreateBody( worldCreationSettings );
+	if ( !body )
+	{
+		Com_Print( S_COLOR_RED "CPhysicsScene::SetWorldShape: out of bodies\n" );
+		return;
+	}
 
-	// Create the actual rigid body
-	JPH::Body *body = bodyInterface.CreateBody( meshCreationSettings ); // Note that if we run out of bodies this can return nullptr
+	body->SetUserData( reinterpret_cast<uint64>( m_pWorldUserData ) );
 
 	bodyInterface.AddBody( body->GetID(), JPH::EActivation::DontActivate );
 
+	// Static bodies went in without building the broadphase tree for them
+	m_physicsSystem.OptimizeBroadPhase();
+
 	m_pWorldBody = body;
 }
 
 void CPhysicsScene::SetWorldBodyUserData( void *pUserData )
 {
-	Assert( m_pWorldBody );
-	m_pWorldBody->SetUserData( reinterpret_cast<uint64>( pUserData ) );
+	m_pWorldUserData = pUserData;
+
+	if ( m_pWorldBody )
+	{
+		m_pWorldBody->SetUserData( reinterpret_cast<uint64>( pUserData ) );
+	}
 }
 
 void CPhysicsScene::RemoveAndDestroyBody( IPhysicsBody *pBody )
@@ -286,6 +321,12 @@ void CPhysicsScene::RemoveAndDestroyBody( IPhysicsBody *pBody )
 	bodyInterface.RemoveBody( pBodyInternal->GetBodyID() );
 	bodyInterface.DestroyBody( pBodyInternal->GetBodyID() );
 
+	// Order doesn't matter, swap with the back
+	auto it = std::find( m_bodies.begin(), m_bodies.end(), pBodyInternal );
+	Assert( it != m_bodies.end() );
+	*it = m_bodies.back();
+	m_bodies.pop_back();
+
 	delete pBodyInternal;
 }
 
@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <vector>
+
 namespace PhysicsPrivate {
 
 class CPhysicsScene final : public IPhysicsScene
@@ -10,14 +12,22 @@ public:
 	~CPhysicsScene();
 
 	void Simulate( float deltaTime ) override;
+	void SetStepRate( float stepRate, int collisionSteps, int maxSteps ) override;
+	float GetInterpolationFraction() override { return m_interpolationFraction; }
 
 	virtual IPhysicsBody *CreateAndAddBody( const bodyCreationSettings_t &settings, IPhysicsShape *pShape, void *pUserData ) override;
-	virtual void CreateAndAddBody_World( void *vertexList, void *indexList ) override; // HACK
+	virtual void SetWorldShape( IPhysicsShape *pShape ) override;
 	virtual void SetWorldBodyUserData( void *pUserData ) override; // HACK
 	virtual void RemoveAndDestroyBody( IPhysicsBody *pBody ) override;
 
+	virtual void TraceBatch( const traceRequest_t *requests, int count, uint32 layerMask, trace_t *results ) override;
+
 	virtual void *GetInternalStructure() override;
 
+private:
+	// Returns a box for casting, cached per extent. Past the cache limit the box goes in uncached instead
+	const JPH::Shape *GetBoxShape( JPH::Vec3Arg halfExtent, std::vector<JPH::ShapeRefC> &uncached );
+
 private:
 	// This is the max amount of rigid bodies that you can add to the physics system. If you try to add more you'll get an error.
 	static constexpr uint cMaxBodies = 16384;
@@ -34,8 +44,33 @@ private:
 	// number then these contacts will be ignored and bodies will start interpenetrating / fall through the world.
 	static constexpr uint cMaxContactConstraints = cMaxBodies;
 
+	// Most traces are one of a handful of sizes, if there's more than this something is making them up
+	static constexpr size_t cMaxBoxShapes = 64;
+
+	// Slack for deltas that are meant to be a whole number of steps but come up a hair short
+	static constexpr double cStepEpsilon = 1.0e-5;
+
 	JPH::PhysicsSystem m_physicsSystem;
 	JPH::Body *m_pWorldBody = nullptr; // HACK
+	void *m_pWorldUserData = nullptr;		// Carried over when the world body is replaced
+
+	// Every body we created, for saving their transforms before a step
+	std::vector<CPhysicsBody *> m_bodies;
+
+	double m_stepTime = 1.0 / 60.0;
+	int m_collisionSteps = 1;
+	int m_maxSteps = 8;
+
+	double m_accumulator = 0.0;				// Time not simulated yet, always less than a step after Simulate
+	float m_interpolationFraction = 0.0f;
+
+	struct boxShape_t
+	{
+		JPH::Vec3 halfExtent;
+		JPH::ShapeRefC shape;
+	};
+
+	std::vector<boxShape_t> m_boxShapes;
 
 };
 
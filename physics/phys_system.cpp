@@ -56,6 +56,7 @@ void CPhysicsSystem::DestroyScene( IPhysicsScene *pScene )
 IPhysicsShape *CPhysicsSystem::CreateBoxShape( vec3_t halfExtent )
 {
 	JPH::BoxShape *pShape = new JPH::BoxShape( QuakePositionToJolt( halfExtent ) );
+	pShape->AddRef();
 
 	return reinterpret_cast<IPhysicsShape *>( pShape );
 }
@@ -63,13 +64,14 @@ IPhysicsShape *CPhysicsSystem::CreateBoxShape( vec3_t halfExtent )
 IPhysicsShape *CPhysicsSystem::CreateSphereShape( float radius )
 {
 	JPH::SphereShape *pShape = new JPH::SphereShape( QuakeToJolt( radius ) );
-	
+	pShape->AddRef();
+
 	return reinterpret_cast<IPhysicsShape *>( pShape );
 }
 
 void CPhysicsSystem::DestroyShape( IPhysicsShape *pShape )
 {
-	delete reinterpret_cast<JPH::Shape *>( pShape );
+	reinterpret_cast<JPH::Shape *>( pShape )->Release();
 }
 
 //-------------------------------------------------------------------------------------------------
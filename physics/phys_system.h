@@ -14,8 +14,15 @@ public:
 
 	IPhysicsShape *CreateBoxShape( vec3_t halfExtent ) override;
 	IPhysicsShape *CreateSphereShape( float radius ) override;
+	IPhysicsShape *CreateMeshShape( const vec3_t *vertices, int numVertices, const int *indices, int numTriangles ) override;
+	IPhysicsShape *CreateStaticHullCompound( const physConvexHull_t *hulls, int numHulls, const vec3_t *points ) override;
 	void DestroyShape( IPhysicsShape *pShape ) override;
 
+	bool SaveShape( const IPhysicsShape *pShape, std::vector<byte> &data ) override;
+	IPhysicsShape *LoadShape( const byte *data, size_t size ) override;
+
+	size_t GetShapeMemoryUsage( const IPhysicsShape *pShape ) override;
+
 	void Trace( const rayCast_t &rayCast, const IPhysicsShape *shapeHandle, const vec3_t shapeOrigin, const vec3_t shapeAngles, trace_t &trace ) override;
 
 public:
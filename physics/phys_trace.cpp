@@ -1,7 +1,12 @@
 
 #include "phys_local.h"
 
+#include "phys_layers.h"
 #include "phys_system.h"
+#include "phys_body.h"
+#include "phys_scene.h"
+
+#include "../core/jobs.h"
 
 extern csurface_t s_nullsurface;
 
@@ -11,6 +16,57 @@ static constexpr float kCollisionTolerance = 1.0e-3f;
 static constexpr float kCharacterPadding = 0.02f;
 static constexpr float kMinRequiredPenetration = 0.005f + kCharacterPadding;
 
+// Batched traces are handed to the job pool this many at a time
+static constexpr int kTraceBatchSize = 32;
+
+static_assert( PHYS_LAYER_STATIC == BIT( Layers::NON_MOVING ) && PHYS_LAYER_MOVING == BIT( Layers::MOVING ) );
+
+//-------------------------------------------------------------------------------------------------
+// Shared
+//-------------------------------------------------------------------------------------------------
+
+static JPH::ShapeCastSettings GetShapeCastSettings()
+{
+	JPH::ShapeCastSettings settings;
+	settings.mBackFaceModeTriangles = JPH::EBackFaceMode::CollideWithBackFaces;
+	settings.mBackFaceModeConvex = JPH::EBackFaceMode::CollideWithBackFaces;
+	settings.mUseShrunkenShapeAndConvexRadius = true;
+	settings.mReturnDeepestPoint = true;
+
+	return settings;
+}
+
+// Fills in the plane, fraction and solidity from a box cast, endpos is left for the caller
+static void TraceFromShapeCast( const JPH::ShapeCastResult &hit, JPH::Vec3Arg direction, trace_t &trace )
+{
+	// Get hit normal
+	JPH::Vec3 normal = -( hit.mPenetrationAxis.Normalized() );
+	VectorSet( trace.plane.normal, normal.GetX(), normal.GetY(), normal.GetZ() );
+
+	// Compute fraction, backed off a little so we don't end up touching
+	const float approach = normal.Dot( direction );
+	trace.fraction = hit.mFraction;
+	if ( approach < -FLT_EPSILON )
+	{
+		trace.fraction = Max( 0.0f, trace.fraction + kCharacterPadding / approach );
+	}
+
+	trace.contents = CONTENTS_SOLID;
+
+	trace.allsolid = hit.mPenetrationDepth > kMinRequiredPenetration && trace.fraction == 0.0f;
+	trace.startsolid = hit.mPenetrationDepth > kMinRequiredPenetration && trace.fraction == 0.0f;
+}
+
+static void SetTraceEnd( const vec3_t start, const vec3_t delta, trace_t &trace )
+{
+	VectorMA( start, trace.fraction, delta, trace.endpos );
+	trace.plane.dist = DotProduct( trace.endpos, trace.plane.normal );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Single shape
+//-------------------------------------------------------------------------------------------------
+
 void CPhysicsSystem::Trace( const rayCast_t &rayCast, const IPhysicsShape *shapeHandle, const vec3_t shapeOrigin, const vec3_t shapeAngles, trace_t &trace )
 {
 	memset( &trace, 0, sizeof( trace ) );
@@ -23,7 +79,6 @@ void CPhysicsSystem::Trace( const rayCast_t &rayCast, const IPhysicsShape *shape
 	JPH::Vec3 halfExtent = QuakePositionToJolt( rayCast.halfExtent );
 
 	bool isRay = halfExtent.ReduceMin() < JPH::cDefaultConvexRadius;
-	bool isCollide = direction.IsNearZero();
 
 	const JPH::Shape *shape = reinterpret_cast<const JPH::Shape *>( shapeHandle );
 
@@ -71,47 +126,199 @@ void CPhysicsSystem::Trace( const rayCast_t &rayCast, const IPhysicsShape *shape
 		JPH::BoxShape boxShape( halfExtent );
 		JPH::ShapeCast shapeCast( &boxShape, JPH::Vec3::sReplicate( 1.0f ), JPH::Mat44::sTranslation( origin ), direction );
 
-		JPH::ShapeCastSettings settings;
-		settings.mBackFaceModeTriangles = JPH::EBackFaceMode::CollideWithBackFaces;
-		settings.mBackFaceModeConvex = JPH::EBackFaceMode::CollideWithBackFaces;
-		settings.mUseShrunkenShapeAndConvexRadius = true;
-		settings.mReturnDeepestPoint = true;
-
 		JPH::ClosestHitCollisionCollector<JPH::CastShapeCollector> collector;
-		JPH::CollisionDispatch::sCastShapeVsShapeWorldSpace( shapeCast, settings, shape, JPH::Vec3::sReplicate( 1.0f ), JPH::ShapeFilter(), queryTransform, JPH::SubShapeIDCreator(), JPH::SubShapeIDCreator(), collector );
+		JPH::CollisionDispatch::sCastShapeVsShapeWorldSpace( shapeCast, GetShapeCastSettings(), shape, JPH::Vec3::sReplicate( 1.0f ), JPH::ShapeFilter(), queryTransform, JPH::SubShapeIDCreator(), JPH::SubShapeIDCreator(), collector );
 
 		if ( collector.HadHit() )
 		{
-			// Get hit normal
-			JPH::Vec3 normal = -( collector.mHit.mPenetrationAxis.Normalized() );
-			VectorSet( trace.plane.normal, normal.GetX(), normal.GetY(), normal.GetZ() );
+			TraceFromShapeCast( collector.mHit, direction, trace );
+		}
+		else
+		{
+			// We didn't hit anything, so we must be completely free right?
+			trace.fraction = 1.0f;
+			trace.allsolid = false;
+			trace.startsolid = false;
+		}
 
-			// Compute fraction
-			trace.fraction = Max( 0.0f, collector.mHit.mFraction + kCharacterPadding / normal.Dot( direction ) );
+		SetTraceEnd( rayCast.start, rayCast.direction, trace );
+	}
+}
 
-			// Compute endpos
-			vec3_t distance;
-			VectorScale( rayCast.direction, trace.fraction, distance );
-			VectorAdd( rayCast.start, distance, trace.endpos );
+//-------------------------------------------------------------------------------------------------
+// Whole scene
+//-------------------------------------------------------------------------------------------------
 
-			trace.plane.dist = DotProduct( trace.endpos, trace.plane.normal );
-			trace.contents = CONTENTS_SOLID;
+// Layer masks map straight onto the broadphase layers as they're one to one with object layers
+class CBroadPhaseLayerMaskFilter final : public JPH::BroadPhaseLayerFilter
+{
+public:
+	explicit CBroadPhaseLayerMaskFilter( uint32 mask ) : m_mask( mask ) {}
+
+	bool ShouldCollide( JPH::BroadPhaseLayer inLayer ) const override
+	{
+		return ( m_mask & BIT( static_cast<JPH::BroadPhaseLayer::Type>( inLayer ) ) ) != 0;
+	}
+
+private:
+	uint32 m_mask;
+};
+
+class CObjectLayerMaskFilter final : public JPH::ObjectLayerFilter
+{
+public:
+	explicit CObjectLayerMaskFilter( uint32 mask ) : m_mask( mask ) {}
+
+	bool ShouldCollide( JPH::ObjectLayer inLayer ) const override
+	{
+		return ( m_mask & BIT( inLayer ) ) != 0;
+	}
+
+private:
+	uint32 m_mask;
+};
+
+// Skips the body belonging to the entity doing the trace
+class CPassEntityBodyFilter final : public JPH::BodyFilter
+{
+public:
+	explicit CPassEntityBodyFilter( const edict_t *passent ) : m_passent( reinterpret_cast<uint64>( passent ) ) {}
+
+	bool ShouldCollideLocked( const JPH::Body &inBody ) const override
+	{
+		return m_passent == 0 || inBody.GetUserData() != m_passent;
+	}
 
-			trace.allsolid = collector.mHit.mPenetrationDepth > kMinRequiredPenetration && trace.fraction == 0.0f;
-			trace.startsolid = collector.mHit.mPenetrationDepth > kMinRequiredPenetration && trace.fraction == 0.0f;
+private:
+	uint64 m_passent;
+};
+
+const JPH::Shape *CPhysicsScene::GetBoxShape( JPH::Vec3Arg halfExtent, std::vector<JPH::ShapeRefC> &uncached )
+{
+	for ( const boxShape_t &box : m_boxShapes )
+	{
+		if ( box.halfExtent == halfExtent )
+		{
+			return box.shape.GetPtr();
 		}
-		else
+	}
+
+	JPH::ShapeRefC shape = new JPH::BoxShape( halfExtent );
+
+	if ( m_boxShapes.size() < cMaxBoxShapes )
+	{
+		m_boxShapes.push_back( { halfExtent, shape } );
+	}
+	else
+	{
+		uncached.push_back( shape );
+	}
+
+	return shape.GetPtr();
+}
+
+void CPhysicsScene::TraceBatch( const traceRequest_t *requests, int count, uint32 layerMask, trace_t *results )
+{
+	// Boxes are found up front, the cache isn't touched once the jobs are going
+	std::vector<const JPH::Shape *> castShapes( count );
+	std::vector<JPH::ShapeRefC> uncached;
+
+	for ( int i = 0; i < count; ++i )
+	{
+		vec3_t size;
+		VectorSubtract( requests[i].maxs, requests[i].mins, size );
+		VectorScale( size, 0.5f, size );
+
+		const JPH::Vec3 halfExtent = QuakePositionToJolt( size );
+
+		// Too thin to be a box, so it's a ray
+		castShapes[i] = halfExtent.ReduceMin() < JPH::cDefaultConvexRadius ? nullptr : GetBoxShape( halfExtent, uncached );
+	}
+
+	const JPH::NarrowPhaseQuery &query = m_physicsSystem.GetNarrowPhaseQuery();
+	const JPH::BodyInterface &bodyInterface = m_physicsSystem.GetBodyInterface();
+
+	const CBroadPhaseLayerMaskFilter broadPhaseFilter( layerMask );
+	const CObjectLayerMaskFilter objectFilter( layerMask );
+	const JPH::ShapeCastSettings settings = GetShapeCastSettings();
+
+	const int numBatches = ( count + kTraceBatchSize - 1 ) / kTraceBatchSize;
+
+	Jobs_ParallelFor( numBatches, [&]( int batch )
+	{
+		const int first = batch * kTraceBatchSize;
+		const int last = Min( first + kTraceBatchSize, count );
+
+		for ( int i = first; i < last; ++i )
 		{
+			const traceRequest_t &request = requests[i];
+			trace_t &trace = results[i];
+
+			memset( &trace, 0, sizeof( trace ) );
+			trace.surface = &s_nullsurface;
 			trace.fraction = 1.0f;
-			vec3_t distance;
-			VectorScale( rayCast.direction, trace.fraction, distance );
-			VectorAdd( rayCast.start, distance, trace.endpos );
+			VectorCopy( request.end, trace.endpos );
 
-			// We didn't hit anything, so we must be completely free right?
-			trace.allsolid = false;
-			trace.startsolid = false;
+			if ( !( request.contentmask & CONTENTS_SOLID ) )
+			{
+				continue;
+			}
+
+			// The casts are centred on the box, which isn't always centred on the start
+			vec3_t centre, delta;
+			VectorAdd( request.mins, request.maxs, centre );
+			VectorMA( request.start, 0.5f, centre, centre );
+			VectorSubtract( request.end, request.start, delta );
+
+			const JPH::Vec3 origin = QuakePositionToJolt( centre );
+			const JPH::Vec3 direction = QuakePositionToJolt( delta );
+
+			const CPassEntityBodyFilter bodyFilter( request.passent );
+
+			JPH::BodyID hitBody;
+
+			if ( !castShapes[i] )
+			{
+				const JPH::RRayCast ray{ origin, direction };
+				JPH::RayCastResult hit;
+
+				if ( !query.CastRay( ray, hit, broadPhaseFilter, objectFilter, bodyFilter ) )
+				{
+					continue;
+				}
+
+				const JPH::TransformedShape transformedShape = bodyInterface.GetTransformedShape( hit.mBodyID );
+				const JPH::Vec3 normal = transformedShape.GetWorldSpaceSurfaceNormal( hit.mSubShapeID2, ray.GetPointOnRay( hit.mFraction ) );
+
+				VectorSet( trace.plane.normal, normal.GetX(), normal.GetY(), normal.GetZ() );
+				trace.fraction = hit.mFraction;
+				trace.contents = CONTENTS_SOLID;
+				trace.allsolid = trace.fraction == 0.0f;
+				trace.startsolid = trace.fraction == 0.0f;
+
+				hitBody = hit.mBodyID;
+			}
+			else
+			{
+				const JPH::RShapeCast shapeCast( castShapes[i], JPH::Vec3::sReplicate( 1.0f ), JPH::RMat44::sTranslation( origin ), direction );
+
+				JPH::ClosestHitCollisionCollector<JPH::CastShapeCollector> collector;
+				query.CastShape( shapeCast, settings, JPH::RVec3::sZero(), collector, broadPhaseFilter, objectFilter, bodyFilter );
+
+				if ( !collector.HadHit() )
+				{
+					continue;
+				}
+
+				TraceFromShapeCast( collector.mHit, direction, trace );
+
+				hitBody = collector.mHit.mBodyID2;
+			}
+
+			SetTraceEnd( request.start, delta, trace );
+			trace.ent = reinterpret_cast<edict_t *>( bodyInterface.GetUserData( hitBody ) );
 		}
-	}
+	} );
 }
 
 } // namespace PhysicsPrivate
@@ -0,0 +1,270 @@
+
+#include "phys_local.h"
+
+#include "phys_system.h"
+
+#include "../core/jobs.h"
+
+#include <Jolt/Core/StreamIn.h>
+#include <Jolt/Core/StreamOut.h>
+#include <Jolt/Physics/Collision/Shape/ConvexHullShape.h>
+#include <Jolt/Physics/Collision/Shape/StaticCompoundShape.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace PhysicsPrivate {
+
+// Hulls are built on the job pool this many at a time
+static constexpr int cHullBatchSize = 64;
+
+//-------------------------------------------------------------------------------------------------
+// Streams
+//-------------------------------------------------------------------------------------------------
+
+class CVectorStreamOut final : public JPH::StreamOut
+{
+public:
+	explicit CVectorStreamOut( std::vector<byte> &data ) : m_data( data ) {}
+
+	void WriteBytes( const void *inData, size_t inNumBytes ) override
+	{
+		const byte *pBytes = static_cast<const byte *>( inData );
+		m_data.insert( m_data.end(), pBytes, pBytes + inNumBytes );
+	}
+
+	bool IsFailed() const override { return false; }
+
+private:
+	std::vector<byte> &m_data;
+};
+
+class CMemoryStreamIn final : public JPH::StreamIn
+{
+public:
+	CMemoryStreamIn( const byte *data, size_t size ) : m_data( data ), m_size( size ) {}
+
+	void ReadBytes( void *outData, size_t inNumBytes ) override
+	{
+		if ( m_failed || inNumBytes > m_size - m_offset )
+		{
+			m_failed = true;
+			memset( outData, 0, inNumBytes );
+			return;
+		}
+
+		memcpy( outData, m_data + m_offset, inNumBytes );
+		m_offset += inNumBytes;
+	}
+
+	bool IsEOF() const override { return m_offset >= m_size; }
+	bool IsFailed() const override { return m_failed; }
+
+private:
+	const byte *m_data;
+	size_t m_size;
+	size_t m_offset = 0;
+	bool m_failed = false;
+};
+
+//-------------------------------------------------------------------------------------------------
+// Shapes for static geometry
+//-------------------------------------------------------------------------------------------------
+
+IPhysicsShape *CPhysicsSystem::CreateMeshShape( const vec3_t *vertices, int numVertices, const int *indices, int numTriangles )
+{
+	JPH::VertexList vertexList( numVertices );
+	for ( int i = 0; i < numVertices; ++i )
+	{
+		vertexList[i] = JPH::Float3( QuakeToJolt( vertices[i][0] ), QuakeToJolt( vertices[i][1] ), QuakeToJolt( vertices[i][2] ) );
+	}
+
+	JPH::IndexedTriangleList triangleList( numTriangles );
+	for ( int i = 0; i < numTriangles; ++i )
+	{
+		triangleList[i] = JPH::IndexedTriangle( indices[i * 3 + 0], indices[i * 3 + 1], indices[i * 3 + 2] );
+	}
+
+	JPH::MeshShapeSettings meshShapeSettings( vertexList, triangleList );
+
+	JPH::ShapeSettings::ShapeResult result = meshShapeSettings.Create();
+	if ( result.HasError() )
+	{
+		Com_Printf( S_COLOR_YELLOW "CPhysicsSystem::CreateMeshShape: %s\n", result.GetError().c_str() );
+		return nullptr;
+	}
+
+	JPH::Shape *pShape = const_cast<JPH::Shape *>( result.Get().GetPtr() );
+	pShape->AddRef();
+
+	return reinterpret_cast<IPhysicsShape *>( pShape );
+}
+
+IPhysicsShape *CPhysicsSystem::CreateStaticHullCompound( const physConvexHull_t *hulls, int numHulls, const vec3_t *points )
+{
+	// Building the hulls is most of the work, and they don't depend on each other
+	std::vector<JPH::ShapeRefC> hullShapes( numHulls );
+
+	const int numBatches = ( numHulls + cHullBatchSize - 1 ) / cHullBatchSize;
+
+	Jobs_ParallelFor( numBatches, [&]( int batch )
+	{
+		const int first = batch * cHullBatchSize;
+		const int last = Min( first + cHullBatchSize, numHulls );
+
+		std::vector<JPH::Vec3> hullPoints;
+
+		for ( int i = first; i < last; ++i )
+		{
+			const physConvexHull_t &hull = hulls[i];
+
+			hullPoints.resize( hull.numPoints );
+			for ( int j = 0; j < hull.numPoints; ++j )
+			{
+				hullPoints[j] = QuakePositionToJolt( points[hull.firstPoint + j] );
+			}
+
+			JPH::ConvexHullShapeSettings hullSettings( hullPoints.data(), hull.numPoints );
+
+			JPH::ShapeSettings::ShapeResult result = hullSettings.Create();
+			if ( result.IsValid() )
+			{
+				hullShapes[i] = result.Get();
+			}
+		}
+	} );
+
+	// Group by region, keeping the original order within each one
+	std::vector<int> order( numHulls );
+	std::iota( order.begin(), order.end(), 0 );
+	std::stable_sort( order.begin(), order.end(), [hulls]( int a, int b ) { return hulls[a].region < hulls[b].region; } );
+
+	JPH::StaticCompoundShapeSettings worldSettings;
+	JPH::ShapeRefC lastShape;
+	int numShapes = 0;
+	int numDegenerate = 0;
+
+	for ( int start = 0; start < numHulls; )
+	{
+		const int region = hulls[order[start]].region;
+
+		JPH::StaticCompoundShapeSettings regionSettings;
+		JPH::ShapeRefC regionShape;
+		int numInRegion = 0;
+
+		int end = start;
+		for ( ; end < numHulls && hulls[order[end]].region == region; ++end )
+		{
+			const JPH::ShapeRefC &hullShape = hullShapes[order[end]];
+			if ( !hullShape )
+			{
+				++numDegenerate;
+				continue;
+			}
+
+			regionSettings.AddShape( JPH::Vec3::sZero(), JPH::Quat::sIdentity(), hullShape );
+			regionShape = hullShape;
+			++numInRegion;
+		}
+		start = end;
+
+		// A compound needs at least two children
+		if ( numInRegion > 1 )
+		{
+			JPH::ShapeSettings::ShapeResult result = regionSettings.Create();
+			if ( result.HasError() )
+			{
+				Com_Printf( S_COLOR_YELLOW "CPhysicsSystem::CreateStaticHullCompound: %s\n", result.GetError().c_str() );
+				continue;
+			}
+			regionShape = result.Get();
+		}
+
+		if ( regionShape )
+		{
+			worldSettings.AddShape( JPH::Vec3::sZero(), JPH::Quat::sIdentity(), regionShape );
+			lastShape = regionShape;
+			++numShapes;
+		}
+	}
+
+	if ( numDegenerate != 0 )
+	{
+		Com_DPrintf( "CPhysicsSystem::CreateStaticHullCompound: skipped %d degenerate hulls\n", numDegenerate );
+	}
+
+	JPH::ShapeRefC worldShape;
+
+	if ( numShapes > 1 )
+	{
+		JPH::ShapeSettings::ShapeResult result = worldSettings.Create();
+		if ( result.HasError() )
+		{
+			Com_Printf( S_COLOR_YELLOW "CPhysicsSystem::CreateStaticHullCompound: %s\n", result.GetError().c_str() );
+			return nullptr;
+		}
+		worldShape = result.Get();
+	}
+	else
+	{
+		worldShape = lastShape;
+	}
+
+	if ( !worldShape )
+	{
+		return nullptr;
+	}
+
+	JPH::Shape *pShape = const_cast<JPH::Shape *>( worldShape.GetPtr() );
+	pShape->AddRef();
+
+	return reinterpret_cast<IPhysicsShape *>( pShape );
+}
+
+//-------------------------------------------------------------------------------------------------
+// Serialization
+//-------------------------------------------------------------------------------------------------
+
+bool CPhysicsSystem::SaveShape( const IPhysicsShape *pShape, std::vector<byte> &data )
+{
+	const JPH::Shape *pJoltShape = reinterpret_cast<const JPH::Shape *>( pShape );
+
+	CVectorStreamOut stream( data );
+	JPH::Shape::ShapeToIDMap shapeMap;
+	JPH::Shape::MaterialToIDMap materialMap;
+
+	pJoltShape->SaveWithChildren( stream, shapeMap, materialMap );
+
+	return !stream.IsFailed();
+}
+
+IPhysicsShape *CPhysicsSystem::LoadShape( const byte *data, size_t size )
+{
+	CMemoryStreamIn stream( data, size );
+	JPH::Shape::IDToShapeMap shapeMap;
+	JPH::Shape::IDToMaterialMap materialMap;
+
+	JPH::Shape::ShapeResult result = JPH::Shape::sRestoreWithChildren( stream, shapeMap, materialMap );
+	if ( stream.IsFailed() || result.HasError() )
+	{
+		return nullptr;
+	}
+
+	JPH::Shape *pShape = const_cast<JPH::Shape *>( result.Get().GetPtr() );
+	pShape->AddRef();
+
+	return reinterpret_cast<IPhysicsShape *>( pShape );
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t CPhysicsSystem::GetShapeMemoryUsage( const IPhysicsShape *pShape )
+{
+	const JPH::Shape *pJoltShape = reinterpret_cast<const JPH::Shape *>( pShape );
+
+	JPH::Shape::VisitedShapes visitedShapes;
+
+	return pJoltShape->GetStatsRecursive( visitedShapes ).mSizeBytes;
+}
+
+} // namespace PhysicsPrivate
@@ -220,7 +220,7 @@ project "engine"
 	filter {}
 	filter "system:linux"
 		links {
-			"GL", "SDL2", "zlib", "png"
+			"GL", "SDL2", "zlib", "png", "pthread"
 		}
 	filter {}
 
@@ -279,7 +279,7 @@ project "engine"
 	removefiles {
 		"engine/client/cl_console.cpp",
 		"engine/client/cd_win.*",
-		"**/cd_vorbis.cpp",
+		"**/cd_null.cpp",
 		"**.def",
 		"**/*sv_null.*",
 		"**_pch.cpp"
@@ -478,6 +478,7 @@ if not _OPTIONS["exclude-utils"] then
 			removefiles {
 				"**/*_win.*"
 			}
+			links { "pthread" }
 		filter {}
 
 	project "qvis4"
@@ -515,6 +516,7 @@ if not _OPTIONS["exclude-utils"] then
 			removefiles {
 				"**/*_win.*"
 			}
+			links { "pthread" }
 		filter {}
 
 	project "qrad4"
@@ -553,6 +555,7 @@ if not _OPTIONS["exclude-utils"] then
 			removefiles {
 				"**/*_win.*"
 			}
+			links { "pthread" }
 		filter {}
 
 	--[[
@@ -15,6 +15,9 @@ dvis_t		*dvis = (dvis_t *)dvisdata;
 int			lightdatasize;
 byte		dlightdata[MAX_MAP_LIGHTING];
 
+int			lightgridsize;
+byte		dlightgrid[MAX_MAP_LIGHTGRID];
+
 int			entdatasize;
 char		dentdata[MAX_MAP_ENTSTRING];
 
@@ -383,6 +386,7 @@ void	LoadBSPFile (char *filename)
 
 	visdatasize = CopyLump (LUMP_VISIBILITY, dvisdata, 1);
 	lightdatasize = CopyLump (LUMP_LIGHTING, dlightdata, 1);
+	lightgridsize = CopyLump (LUMP_LIGHTGRID, dlightgrid, 1);
 	entdatasize = CopyLump (LUMP_ENTITIES, dentdata, 1);
 
 	free (header);		// everything has been copied out
@@ -490,6 +494,7 @@ void	WriteBSPFile (char *filename)
 	AddLump (LUMP_AREAPORTALS, dareaportals, numareaportals*sizeof(dareaportal_t));
 
 	AddLump (LUMP_LIGHTING, dlightdata, lightdatasize);
+	AddLump (LUMP_LIGHTGRID, dlightgrid, lightgridsize);
 	AddLump (LUMP_VISIBILITY, dvisdata, visdatasize);
 	AddLump (LUMP_ENTITIES, dentdata, entdatasize);
 	
@@ -543,6 +548,7 @@ void PrintBSPFileSizes (void)
 	Com_Printf ("%5i edges        %7i\n"
 		,numedges, (int)(numedges*sizeof(dedge_t)));
 	Com_Printf ("      lightdata    %7i\n", lightdatasize);
+	Com_Printf ("      lightgrid    %7i\n", lightgridsize);
 	Com_Printf ("      visdata      %7i\n", visdatasize);
 }
 
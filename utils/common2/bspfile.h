@@ -13,6 +13,9 @@ extern	dvis_t		*dvis;
 extern	int			lightdatasize;
 extern	byte		dlightdata[MAX_MAP_LIGHTING];
 
+extern	int			lightgridsize;
+extern	byte		dlightgrid[MAX_MAP_LIGHTGRID];
+
 extern	int			entdatasize;
 extern	char		dentdata[MAX_MAP_ENTSTRING];
 
@@ -3,125 +3,124 @@
 
 #include "threads.h"
 
-#include "../../core/sys_includes.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
 
-#define	MAX_THREADS	64
+#define	MAX_THREADS	256
 
-static int dispatch;
+// how many chunks each thread should get on average, more chunks means
+// better balancing when the cost of each work item varies wildly (vis)
+#define CHUNKS_PER_THREAD	64
+
+int numthreads = -1;
+
+static std::atomic<int> dispatch;
 static int workcount;
-static int oldf;
+static std::atomic<int> oldf;
 static bool pacifier;
 
+static std::atomic<int> completed;
+
 static bool threaded;
 
 /*
 =============
-GetThreadWork
+ThreadSetDefault
 
 =============
 */
-int	GetThreadWork()
+void ThreadSetDefault()
 {
-	int	r;
-	int	f;
-
-	ThreadLock();
-
-	if ( dispatch == workcount )
-	{
-		ThreadUnlock();
-		return -1;
-	}
-
-	f = 10 * dispatch / workcount;
-	if ( f != oldf )
+	if ( numthreads == -1 )	// not set manually
 	{
-		oldf = f;
-		if ( pacifier )
-			Com_Printf( "%i...", f );
+		numthreads = (int)std::thread::hardware_concurrency();
+		if ( numthreads < 1 || numthreads > MAX_THREADS )
+			numthreads = 1;
 	}
 
-	r = dispatch;
-	dispatch++;
-	ThreadUnlock();
-
-	return r;
+	Com_DPrintf( "%d threads\n", numthreads );
 }
 
+/*
+===============================================================================
 
-static threadworker_f workfunction;
+	Locking
 
-void ThreadWorkerFunction( int threadnum )
-{
-	int work;
+===============================================================================
+*/
 
-	while ( true )
-	{
-		work = GetThreadWork();
-		if ( work == -1 )
-			break;
+static std::mutex crit;
+static bool enter;
 
-		workfunction( work );
-	}
+void ThreadLock()
+{
+	if ( !threaded )
+		return;
+	crit.lock();
+	if ( enter )
+		Com_FatalErrorf( "Recursive ThreadLock\n" );
+	enter = true;
 }
 
-void RunThreadsOnIndividual( int workcnt, bool showpacifier, threadworker_f func )
+void ThreadUnlock()
 {
-	if ( numthreads == -1 )
-		ThreadSetDefault();
-
-	workfunction = func;
-	RunThreadsOn( workcnt, showpacifier, ThreadWorkerFunction );
+	if ( !threaded )
+		return;
+	if ( !enter )
+		Com_FatalErrorf( "ThreadUnlock without lock\n" );
+	enter = false;
+	crit.unlock();
 }
 
 /*
 ===============================================================================
 
-	WINDOWS
+	Pacifier
+
+	Workers bump an atomic completion count, whoever crosses a tenth
+	claims it with a CAS and prints it, no locks involved.
 
 ===============================================================================
 */
 
-#ifdef _WIN32
-
-int numthreads = -1;
+static void ThreadReportProgress( int count )
+{
+	int done = completed.fetch_add( count, std::memory_order_relaxed ) + count;
 
-static CRITICAL_SECTION crit;
-static int enter;
+	if ( !pacifier )
+		return;
 
-void ThreadSetDefault()
-{
-	SYSTEM_INFO info;
+	int f = (int)( 10LL * ( done - 1 ) / workcount );
+	int old = oldf.load( std::memory_order_relaxed );
 
-	if ( numthreads == -1 )	// not set manually
+	while ( old < f )
 	{
-		GetSystemInfo( &info );
-		numthreads = info.dwNumberOfProcessors;
-		if ( numthreads < 1 || numthreads > MAX_THREADS )
-			numthreads = 1;
+		if ( oldf.compare_exchange_weak( old, old + 1, std::memory_order_relaxed ) )
+		{
+			Com_Printf( "%i...", old + 1 );
+			++old;
+		}
 	}
-
-	Com_DPrintf( "%d threads\n", numthreads );
 }
 
-void ThreadLock()
-{
-	if ( !threaded )
-		return;
-	EnterCriticalSection( &crit );
-	if ( enter )
-		Com_FatalErrorf("Recursive ThreadLock\n" );
-	enter = 1;
-}
+/*
+=============
+GetThreadWork
 
-void ThreadUnlock()
+Hands out work items one at a time for RunThreadsOn workers
+=============
+*/
+int	GetThreadWork()
 {
-	if ( !threaded )
-		return;
-	if ( !enter )
-		Com_FatalErrorf("ThreadUnlock without lock\n" );
-	enter = 0;
-	LeaveCriticalSection( &crit );
+	int r = dispatch.fetch_add( 1, std::memory_order_relaxed );
+
+	if ( r >= workcount )
+		return -1;
+
+	ThreadReportProgress( 1 );
+
+	return r;
 }
 
 /*
@@ -131,12 +130,16 @@ RunThreadsOn
 */
 void RunThreadsOn( int workcnt, bool showpacifier, threadworker_f func )
 {
-	HANDLE	threadhandles[MAX_THREADS];
-	int		i;
-	double	start, end;
+	std::thread	threadhandles[MAX_THREADS];
+	int			i;
+	double		start, end;
+
+	if ( numthreads == -1 )
+		ThreadSetDefault();
 
 	start = Time_FloatSeconds();
 	dispatch = 0;
+	completed = 0;
 	workcount = workcnt;
 	oldf = -1;
 	pacifier = showpacifier;
@@ -145,43 +148,163 @@ void RunThreadsOn( int workcnt, bool showpacifier, threadworker_f func )
 	//
 	// run threads in parallel
 	//
-	InitializeCriticalSection( &crit );
-
 	if ( numthreads == 1 )
 	{	// use same thread
 		func( 0 );
 	}
 	else
 	{
-		// Create threads
-		for ( i = 0; i < numthreads; i++ )
+		// the calling thread is worker 0
+		for ( i = 1; i < numthreads; i++ )
 		{
-			threadhandles[i] = CreateThread(
-				NULL,
-				0,
-				(LPTHREAD_START_ROUTINE)func,
-				(LPVOID)(intptr_t)i,
-				0,
-				nullptr
-			);
+			threadhandles[i] = std::thread( func, i );
 		}
 
-		// Run them!
-		WaitForMultipleObjects( numthreads, threadhandles, TRUE, INFINITE );
+		func( 0 );
 
-		// Delete them
-		for ( i = 0; i < numthreads; i++ )
+		for ( i = 1; i < numthreads; i++ )
 		{
-			CloseHandle( threadhandles[i] );
+			threadhandles[i].join();
 		}
 	}
 
-	DeleteCriticalSection( &crit );
-
 	threaded = false;
 	end = Time_FloatSeconds();
 	if ( pacifier )
 		Com_Printf( " (%f)\n", end - start );
 }
 
-#endif
+/*
+===============================================================================
+
+	Work stealing
+
+	The work range is cut into chunks of consecutive items. Chunk c is dealt
+	to thread c % numthreads, so every thread owns an ascending sequence of
+	chunks and the items are still roughly processed in index order (vis
+	relies on this, cheap portals are sorted first and speed up the rest).
+
+	Each thread's sequence is a deque packed into a single 64-bit atomic,
+	the owner pops from the head and idle threads steal from the tail of a
+	victim, both with a single CAS.
+
+===============================================================================
+*/
+
+struct alignas( 64 ) workDeque_t
+{
+	std::atomic<uint64> range;		// head in the low 32 bits, tail in the high 32 bits
+};
+
+static workDeque_t	workdeques[MAX_THREADS];
+static int			chunksize;
+static int			numchunks;
+static int			numdeques;
+
+static threadworker_f workfunction;
+
+static inline uint64 PackRange( uint32 head, uint32 tail )
+{
+	return (uint64)head | ( (uint64)tail << 32 );
+}
+
+// Owner side, returns the next chunk or -1 if the deque is empty
+static int PopChunk( int threadnum )
+{
+	std::atomic<uint64> &range = workdeques[threadnum].range;
+	uint64 r = range.load( std::memory_order_relaxed );
+
+	while ( true )
+	{
+		uint32 head = (uint32)r;
+		uint32 tail = (uint32)( r >> 32 );
+		if ( head >= tail )
+			return -1;
+		if ( range.compare_exchange_weak( r, PackRange( head + 1, tail ), std::memory_order_relaxed ) )
+			return threadnum + head * numdeques;
+	}
+}
+
+// Thief side, takes the last chunk of a victim or -1 if the deque is empty
+static int StealChunk( int victim )
+{
+	std::atomic<uint64> &range = workdeques[victim].range;
+	uint64 r = range.load( std::memory_order_relaxed );
+
+	while ( true )
+	{
+		uint32 head = (uint32)r;
+		uint32 tail = (uint32)( r >> 32 );
+		if ( head >= tail )
+			return -1;
+		if ( range.compare_exchange_weak( r, PackRange( head, tail - 1 ), std::memory_order_relaxed ) )
+			return victim + ( tail - 1 ) * numdeques;
+	}
+}
+
+static void RunChunk( int chunk )
+{
+	int first = chunk * chunksize;
+	int last = Min( first + chunksize, workcount );
+
+	for ( int work = first; work < last; ++work )
+	{
+		workfunction( work );
+	}
+
+	ThreadReportProgress( last - first );
+}
+
+static void ThreadWorkerFunction( int threadnum )
+{
+	int chunk;
+
+	// drain our own deque first
+	while ( ( chunk = PopChunk( threadnum ) ) != -1 )
+	{
+		RunChunk( chunk );
+	}
+
+	// then go around stealing from everybody else until nothing is left
+	bool stole;
+	do
+	{
+		stole = false;
+		for ( int i = 1; i < numdeques; ++i )
+		{
+			int victim = ( threadnum + i ) % numdeques;
+			while ( ( chunk = StealChunk( victim ) ) != -1 )
+			{
+				RunChunk( chunk );
+				stole = true;
+			}
+		}
+	} while ( stole );
+}
+
+void RunThreadsOnIndividual( int workcnt, bool showpacifier, threadworker_f func )
+{
+	if ( numthreads == -1 )
+		ThreadSetDefault();
+
+	workfunction = func;
+
+	if ( workcnt <= 0 )
+	{
+		RunThreadsOn( workcnt, showpacifier, []( int ) {} );
+		return;
+	}
+
+	numdeques = numthreads;
+	chunksize = Max( workcnt / ( numdeques * CHUNKS_PER_THREAD ), 1 );
+	numchunks = ( workcnt + chunksize - 1 ) / chunksize;
+
+	for ( int i = 0; i < numdeques; ++i )
+	{
+		// chunks i, i + numdeques, i + numdeques * 2...
+		uint32 count = ( i < numchunks ) ? (uint32)( ( numchunks - i + numdeques - 1 ) / numdeques ) : 0;
+		workdeques[i].range.store( PackRange( 0, count ), std::memory_order_relaxed );
+	}
+
+	RunThreadsOn( workcnt, showpacifier, ThreadWorkerFunction );
+}
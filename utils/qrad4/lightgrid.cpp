@@ -0,0 +1,494 @@
+// lightgrid.c
+
+#include "qrad.h"
+
+#include <map>
+#include <string>
+
+/*
+
+NOTES
+-----
+
+The light grid is what models are lit from at runtime. Each sample takes the
+style 0 direct lights the same way a lightmap sample does, minus the cosine of
+the surface it would be on, and the bounced light leaving the patches it can
+see along a fixed set of rays. All of that is folded into an ambient colour
+and one directed colour coming from the brightest direction.
+
+Samples are computed a brick at a time. Bricks that are entirely in the solid
+aren't stored, and bricks that came out the same share their samples.
+
+*/
+
+#define	GATHER_RAYS		32
+#define	GATHER_DIST		4096
+
+vec3_t		gridsize = { 64, 64, 128 };
+qboolean	nogrid;
+
+static vec3_t	gridorigin;
+static int		gridbricks[3];
+
+static std::vector<dlightgridsample_t>	gridsamples;	// LIGHTGRID_BRICK_SAMPLES for every brick
+static std::vector<byte>				gridbrickused;
+
+static vec3_t	gatherdirs[GATHER_RAYS];
+
+typedef struct
+{
+	vec3_t		color;
+	vec3_t		dir;		// towards where the light comes from
+} gridlight_t;
+
+/*
+=============
+MakeGatherDirs
+
+Spreads the gather rays evenly over the sphere
+=============
+*/
+static void MakeGatherDirs (void)
+{
+	int		i;
+	float	z, r, phi;
+
+	for (i=0 ; i<GATHER_RAYS ; i++)
+	{
+		z = 1.0f - (2.0f*i + 1.0f) / GATHER_RAYS;
+		r = sqrt (1.0f - z*z);
+		phi = i * M_PI_F * (3.0f - sqrt (5.0f));
+
+		gatherdirs[i][0] = r * cos (phi);
+		gatherdirs[i][1] = r * sin (phi);
+		gatherdirs[i][2] = z;
+	}
+}
+
+/*
+=============
+GridDirectLight
+
+GatherSampleLight without a surface
+=============
+*/
+static void GridDirectLight (vec3_t pos, std::vector<gridlight_t> &lights)
+{
+	int				i;
+	directlight_t	*l;
+	byte			pvs[(MAX_MAP_LEAFS+7)/8];
+	vec3_t			delta;
+	float			dot2;
+	float			dist;
+	float			scale;
+	gridlight_t		light;
+
+	if (!PvsForOrigin (pos, pvs))
+		return;
+
+	for (i = 0 ; i<dvis->numclusters ; i++)
+	{
+		if ( ! (pvs[ i>>3] & (1<<(i&7))) )
+			continue;
+
+		for (l=directlights[i] ; l ; l=l->next)
+		{
+			// the grid only has the static lighting
+			if (l->style != 0)
+				continue;
+
+			VectorSubtract (l->origin, pos, delta);
+			dist = VectorNormalize (delta);
+
+			switch (l->type)
+			{
+			case emit_point:
+				scale = l->intensity - dist;
+				break;
+
+			case emit_surface:
+				dot2 = -DotProduct (delta, l->normal);
+				if (dot2 <= 0.001f)
+					continue;	// behind light surface
+				scale = (l->intensity / (dist*dist) ) * dot2;
+				break;
+
+			case emit_spotlight:
+				dot2 = -DotProduct (delta, l->normal);
+				if (dot2 <= l->stopdot)
+					continue;	// outside light cone
+				scale = l->intensity - dist;
+				break;
+
+			default:
+				Error ("Bad l->type");
+			}
+
+			if (scale <= 0)
+				continue;
+
+			if (TestLine_r (0, pos, l->origin))
+				continue;	// occluded
+
+			VectorScale (l->color, scale, light.color);
+			VectorCopy (delta, light.dir);
+			lights.push_back (light);
+		}
+	}
+}
+
+/*
+=============
+GatherTrace_r
+
+Finds the patch a ray hits first. Returns -1 if it didn't hit anything, 0 if
+it went into the solid somewhere without a patch, 1 if it hit one
+=============
+*/
+static int GatherTrace_r (int nodenum, vec3_t start, vec3_t stop, patch_t **hit)
+{
+	dnode_t		*node;
+	dplane_t	*plane;
+	patch_t		*patch;
+	float		front, back, frac;
+	vec3_t		mid, mins, maxs;
+	int			side;
+	int			i, j, r;
+
+	if (nodenum < 0)
+	{
+		if (dleafs[-nodenum - 1].contents & CONTENTS_SOLID)
+			return 0;
+		return -1;
+	}
+
+	node = &dnodes[nodenum];
+	plane = &dplanes[node->planenum];
+
+	front = DotProduct (start, plane->normal) - plane->dist;
+	back = DotProduct (stop, plane->normal) - plane->dist;
+	side = front < 0;
+
+	if ( (back < 0) == side )
+		return GatherTrace_r (node->children[side], start, stop, hit);
+
+	frac = front / (front-back);
+	mid[0] = start[0] + (stop[0] - start[0])*frac;
+	mid[1] = start[1] + (stop[1] - start[1])*frac;
+	mid[2] = start[2] + (stop[2] - start[2])*frac;
+
+	r = GatherTrace_r (node->children[side], start, mid, hit);
+	if (r >= 0)
+		return r;
+
+	// check the faces on this node that face the ray
+	for (i=0 ; i<node->numfaces ; i++)
+	{
+		if (dfaces[node->firstface + i].side != side)
+			continue;
+
+		for (patch = face_patches[node->firstface + i] ; patch ; patch=patch->next)
+		{
+			WindingBounds (patch->winding, mins, maxs);
+			for (j=0 ; j<3 ; j++)
+			{
+				if (mid[j] < mins[j] - 1 || mid[j] > maxs[j] + 1)
+					break;
+			}
+			if (j == 3)
+			{
+				*hit = patch;
+				return 1;
+			}
+		}
+	}
+
+	return GatherTrace_r (node->children[!side], mid, stop, hit);
+}
+
+/*
+=============
+GridBounceLight
+
+Picks up the light the patches around pos send out. The weights make a
+surface under uniform light come out the same as its lightmap would
+=============
+*/
+static void GridBounceLight (vec3_t pos, std::vector<gridlight_t> &lights)
+{
+	int			i, j;
+	vec3_t		stop;
+	patch_t		*patch;
+	gridlight_t	light;
+
+	for (i=0 ; i<GATHER_RAYS ; i++)
+	{
+		VectorMA (pos, GATHER_DIST, gatherdirs[i], stop);
+
+		if (GatherTrace_r (0, pos, stop, &patch) != 1)
+			continue;
+		if (patch->sky)
+			continue;
+
+		for (j=0 ; j<3 ; j++)
+			light.color[j] = (patch->samplelight[j] + patch->totallight[j]) * patch->reflectivity[j] * (4.0f / GATHER_RAYS);
+
+		if (light.color[0] + light.color[1] + light.color[2] <= 0)
+			continue;
+
+		VectorCopy (gatherdirs[i], light.dir);
+		lights.push_back (light);
+	}
+}
+
+/*
+=============
+GridSamplePosition
+
+Nudges samples that landed in the solid back out if they're close
+=============
+*/
+static qboolean GridSamplePosition (int x, int y, int z, vec3_t pos)
+{
+	static const float nudges[7][3] =
+	{ {0,0,0}, {8,0,0}, {-8,0,0}, {0,8,0}, {0,-8,0}, {0,0,8}, {0,0,-8} };
+	int		i;
+
+	for (i=0 ; i<7 ; i++)
+	{
+		pos[0] = gridorigin[0] + x*gridsize[0] + nudges[i][0];
+		pos[1] = gridorigin[1] + y*gridsize[1] + nudges[i][1];
+		pos[2] = gridorigin[2] + z*gridsize[2] + nudges[i][2];
+
+		if (!(PointInLeaf (pos)->contents & CONTENTS_SOLID))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+=============
+GridSample
+=============
+*/
+static void GridSample (vec3_t pos, dlightgridsample_t *sample, std::vector<gridlight_t> &lights)
+{
+	vec3_t		dir, sampleambient, sampledirected;
+	float		d, max, scale, yaw, pitch;
+	size_t		i;
+	int			j;
+
+	lights.clear ();
+	GridDirectLight (pos, lights);
+	if (numbounce > 0)
+		GridBounceLight (pos, lights);
+
+	// the directed light comes from wherever most of it does
+	VectorClear (dir);
+	for (i=0 ; i<lights.size() ; i++)
+		VectorMA (dir, lights[i].color[0] + lights[i].color[1] + lights[i].color[2], lights[i].dir, dir);
+	if (VectorNormalize (dir) == 0)
+		VectorSet (dir, 0, 0, 1);
+
+	// the directed part is the net flow of light along dir, and what cancels out
+	// is spread evenly, so light from every direction ends up all ambient
+	VectorClear (sampleambient);
+	VectorClear (sampledirected);
+	for (i=0 ; i<lights.size() ; i++)
+	{
+		d = DotProduct (lights[i].dir, dir);
+		VectorMA (sampledirected, d, lights[i].color, sampledirected);
+		VectorAdd (sampleambient, lights[i].color, sampleambient);
+	}
+
+	for (j=0 ; j<3 ; j++)
+	{
+		if (sampledirected[j] < 0)
+			sampledirected[j] = 0;
+		sampleambient[j] = (sampleambient[j] - sampledirected[j]) * 0.25f;
+
+		sampleambient[j] = (sampleambient[j] + ambient) * lightscale;
+		sampledirected[j] *= lightscale;
+
+		// a zero ambient means solid
+		if (sampleambient[j] < 1)
+			sampleambient[j] = 1;
+	}
+
+	// clamp the brightest facing without changing the hue, like the lightmaps
+	max = 0;
+	for (j=0 ; j<3 ; j++)
+	{
+		if (sampleambient[j] + sampledirected[j] > max)
+			max = sampleambient[j] + sampledirected[j];
+	}
+	scale = max > maxlight ? maxlight / max : 1.0f;
+
+	for (j=0 ; j<3 ; j++)
+	{
+		sample->ambient[j] = (byte)Max (1, Min (255, (int)(sampleambient[j]*scale + 0.5f)));
+		sample->directed[j] = (byte)Min (255, (int)(sampledirected[j]*scale + 0.5f));
+	}
+
+	// yaw around z over the whole byte, pitch down from straight up
+	yaw = atan2 (dir[1], dir[0]);
+	if (yaw < 0)
+		yaw += 2 * M_PI_F;
+	pitch = acos (Max (-1.0f, Min (1.0f, dir[2])));
+
+	sample->latlong[0] = (byte)((int)(yaw * (256 / (2 * M_PI)) + 0.5f) & 255);
+	sample->latlong[1] = (byte)(int)(pitch * (255 / M_PI) + 0.5f);
+}
+
+/*
+=============
+GridBrick
+=============
+*/
+static void GridBrick (int bricknum)
+{
+	int					bx, by, bz;
+	int					x, y, z;
+	vec3_t				pos;
+	dlightgridsample_t	*sample;
+	std::vector<gridlight_t>	lights;
+
+	bx = bricknum % gridbricks[0];
+	by = (bricknum / gridbricks[0]) % gridbricks[1];
+	bz = bricknum / (gridbricks[0] * gridbricks[1]);
+
+	sample = &gridsamples[(size_t)bricknum * LIGHTGRID_BRICK_SAMPLES];
+
+	for (z=0 ; z<LIGHTGRID_BRICK ; z++)
+	{
+		for (y=0 ; y<LIGHTGRID_BRICK ; y++)
+		{
+			for (x=0 ; x<LIGHTGRID_BRICK ; x++, sample++)
+			{
+				if (!GridSamplePosition (bx*LIGHTGRID_BRICK + x, by*LIGHTGRID_BRICK + y, bz*LIGHTGRID_BRICK + z, pos))
+				{
+					memset (sample, 0, sizeof(*sample));
+					continue;
+				}
+
+				GridSample (pos, sample, lights);
+				gridbrickused[bricknum] = true;
+			}
+		}
+	}
+}
+
+/*
+=============
+PackLightGrid
+
+Writes the bricks that have anything in them into dlightgrid
+=============
+*/
+static void PackLightGrid (int totalbricks)
+{
+	dlightgrid_t		*header;
+	int32				*index;
+	dlightgridsample_t	*out;
+	std::map<std::string, int>	stored;
+	int					i, numbricks, numused;
+	size_t				size;
+
+	size = sizeof(*header) + totalbricks*sizeof(*index);
+	if (size > MAX_MAP_LIGHTGRID)
+		Error ("MAX_MAP_LIGHTGRID");
+
+	header = (dlightgrid_t *)dlightgrid;
+	index = (int32 *)(header + 1);
+	out = (dlightgridsample_t *)(index + totalbricks);
+
+	numbricks = 0;
+	numused = 0;
+	for (i=0 ; i<totalbricks ; i++)
+	{
+		if (!gridbrickused[i])
+		{
+			index[i] = LittleLong (-1);
+			continue;
+		}
+		numused++;
+
+		std::string key ((const char *)&gridsamples[(size_t)i * LIGHTGRID_BRICK_SAMPLES],
+			LIGHTGRID_BRICK_SAMPLES * sizeof(dlightgridsample_t));
+
+		auto it = stored.find (key);
+		if (it != stored.end())
+		{
+			index[i] = LittleLong (it->second);
+			continue;
+		}
+
+		size += LIGHTGRID_BRICK_SAMPLES * sizeof(dlightgridsample_t);
+		if (size > MAX_MAP_LIGHTGRID)
+			Error ("MAX_MAP_LIGHTGRID");
+
+		memcpy (out + (size_t)numbricks * LIGHTGRID_BRICK_SAMPLES, key.data(), key.size());
+		stored.emplace (std::move (key), numbricks);
+		index[i] = LittleLong (numbricks);
+		numbricks++;
+	}
+
+	header->ident = LittleLong (LIGHTGRID_IDENT);
+	header->version = LittleLong (LIGHTGRID_VERSION);
+	for (i=0 ; i<3 ; i++)
+	{
+		header->origin[i] = LittleFloat (gridorigin[i]);
+		header->cellsize[i] = LittleFloat (gridsize[i]);
+		header->bricks[i] = LittleLong (gridbricks[i]);
+	}
+	header->numbricks = LittleLong (numbricks);
+
+	lightgridsize = (int)size;
+
+	printf ("light grid: %i of %i bricks used, %i stored, %i bytes\n", numused, totalbricks, numbricks, lightgridsize);
+}
+
+/*
+=============
+BuildLightGrid
+
+Needs the direct lights and the bounced patch light, so it goes after the lightmaps
+=============
+*/
+void BuildLightGrid (void)
+{
+	int		i, samples, totalbricks;
+	float	maxs;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		if (gridsize[i] < 1)
+			Error ("bad grid size");
+
+		gridorigin[i] = gridsize[i] * ceil (dmodels[0].mins[i] / gridsize[i]);
+		maxs = gridsize[i] * floor (dmodels[0].maxs[i] / gridsize[i]);
+		samples = (int)((maxs - gridorigin[i]) / gridsize[i]) + 1;
+		if (samples < 1)
+			samples = 1;
+		gridbricks[i] = (samples + LIGHTGRID_BRICK - 1) / LIGHTGRID_BRICK;
+	}
+
+	totalbricks = gridbricks[0] * gridbricks[1] * gridbricks[2];
+	qprintf ("light grid: %i x %i x %i bricks of %g x %g x %g\n",
+		gridbricks[0], gridbricks[1], gridbricks[2], gridsize[0], gridsize[1], gridsize[2]);
+
+	MakeGatherDirs ();
+
+	gridsamples.resize ((size_t)totalbricks * LIGHTGRID_BRICK_SAMPLES);
+	gridbrickused.assign (totalbricks, false);
+
+	RunThreadsOnIndividual (totalbricks, true, GridBrick);
+
+	PackLightGrid (totalbricks);
+
+	gridsamples.clear ();
+	gridsamples.shrink_to_fit ();
+	gridbrickused.clear ();
+	gridbrickused.shrink_to_fit ();
+}
@@ -483,6 +483,11 @@ void RadWorld (void)
 
 	lightdatasize = 0;
 	RunThreadsOnIndividual (numfaces, true, FinalLightFace);
+
+	// sample the lighting for models, a stale grid is worse than none
+	lightgridsize = 0;
+	if (!nogrid)
+		BuildLightGrid ();
 }
 
 
@@ -570,6 +575,18 @@ int main (int argc, char **argv)
 			++i;
 			g_smoothing_threshold = cos( DEG2RAD( (float)atof( argv[i] ) ) );
 		}
+		else if (!strcmp(argv[i],"-nogrid"))
+		{
+			nogrid = true;
+			printf ("nogrid = true\n");
+		}
+		else if (!strcmp(argv[i],"-gridsize"))
+		{
+			gridsize[0] = (float)atof (argv[i+1]);
+			gridsize[1] = (float)atof (argv[i+2]);
+			gridsize[2] = (float)atof (argv[i+3]);
+			i += 3;
+		}
 		else if (!strcmp (argv[i],"-tmpin"))
 			strcpy (inbase, "/tmp");
 		else if (!strcmp (argv[i],"-tmpout"))
@@ -584,7 +601,7 @@ int main (int argc, char **argv)
 		maxlight = 255;
 
 	if (i != argc - 1)
-		Error ("usage: qrad [-v] [-chop num] [-scale num] [-ambient num] [-maxlight num] [-threads num] bspfile");
+		Error ("usage: qrad [-v] [-chop num] [-scale num] [-ambient num] [-maxlight num] [-threads num] [-nogrid] [-gridsize x y z] bspfile");
 
 	start = Time_FloatSeconds ();
 
@@ -123,3 +123,10 @@ void MakePatches (void);
 void SubdividePatches (void);
 void PairEdges (void);
 void LoadMaterials (void);
+
+//==============================================
+
+extern	qboolean	nogrid;
+extern	vec3_t		gridsize;
+
+void BuildLightGrid (void);